@@ -128,11 +128,12 @@ int pagespace, framespace;
  * We'll take up to 16 invalidations before just flushing the whole TLB.
  */
 
+struct semaphore;
+
 struct tlbshootdown {
-	/*
-	 * Change this to what you need for your VM design.
-	 */
-	int ts_placeholder;
+	vaddr_t ts_vaddr;		/* First page to invalidate */
+	unsigned ts_npages;		/* Number of pages */
+	struct semaphore *ts_done;	/* V'd once they're gone */
 };
 
 #define TLBSHOOTDOWN_MAX 16
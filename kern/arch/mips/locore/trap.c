@@ -203,6 +203,17 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/*
+		 * If we're going back to user mode in a process that
+		 * is exiting, leave instead (see proc_exit). Get the
+		 * interrupt state back in sync first, as below.
+		 */
+		if (!iskern && curproc->p_exiting) {
+			spl = splhigh();
+			splx(spl);
+			proc_thread_exit(0);
+		}
 		goto done2;
 	}
 
@@ -323,6 +334,11 @@ mips_trap(struct trapframe *tf)
 	panic("I can't handle this... I think I'll just die now...\n");
 
  done:
+	/* Likewise on the way out of a syscall or fault. */
+	if (!iskern && curproc->p_exiting) {
+		proc_thread_exit(0);
+	}
+
 	/*
 	 * Turn interrupts off on the processor, without affecting the
 	 * stored interrupt state.
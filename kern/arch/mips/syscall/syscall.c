@@ -113,6 +113,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 
 	    /* process calls */
 
@@ -120,12 +125,23 @@ syscall(struct trapframe *tf)
 		err = sys_fork(tf, &retval);
 		break;
 
+	    case SYS_vfork:
+		err = sys_vfork(tf, &retval);
+		break;
+
 	    case SYS_execv:
 		err = sys_execv(
 			(userptr_t)tf->tf_a0,
 			(userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_spawnv:
+		err = sys_spawnv(
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			&retval);
+		break;
+
 	    case SYS__exit:
 		sys__exit(tf->tf_a0);
 		panic("Returning from exit\n");
@@ -142,6 +158,22 @@ syscall(struct trapframe *tf)
 		err = sys_getpid(&retval);
 		break;
 
+	    case SYS___thread_create:
+		err = sys___thread_create(tf,
+			(userptr_t)tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			(userptr_t)tf->tf_a2,
+			&retval);
+		break;
+
+	    case SYS_thread_join:
+		err = sys_thread_join(tf->tf_a0, (userptr_t)tf->tf_a1);
+		break;
+
+	    case SYS_thread_exit:
+		sys_thread_exit(tf->tf_a0);
+		panic("Returning from thread_exit\n");
+
 
 	    /* file calls */
 
@@ -164,6 +196,15 @@ syscall(struct trapframe *tf)
 		err = sys_close(tf->tf_a0);
 		break;
 
+	    case SYS_pipe:
+		err = sys_pipe((userptr_t)tf->tf_a0);
+		break;
+
+	    case SYS_poll:
+		err = sys_poll((userptr_t)tf->tf_a0, tf->tf_a1, tf->tf_a2,
+			       &retval);
+		break;
+
 	    case SYS_read:
 		err = sys_read(
 			tf->tf_a0,
@@ -178,6 +219,43 @@ syscall(struct trapframe *tf)
 			tf->tf_a2,
 			&retval);
 		break;
+	    case SYS_readv:
+		err = sys_readv(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_writev:
+		err = sys_writev(
+			tf->tf_a0,
+			(userptr_t)tf->tf_a1,
+			tf->tf_a2,
+			&retval);
+		break;
+	    case SYS_pread:
+	    case SYS_pwrite:
+		{
+			/*
+			 * The 64-bit position doesn't fit in a3 after
+			 * the size, so it goes on the stack, aligned,
+			 * past the space reserved for a0-a3.
+			 */
+			off_t pos;
+
+			err = copyin((userptr_t)tf->tf_sp + 16,
+				     &pos, sizeof(pos));
+			if (err) {
+				break;
+			}
+
+			err = (callno == SYS_pread) ?
+				sys_pread(tf->tf_a0, (userptr_t)tf->tf_a1,
+					  tf->tf_a2, pos, &retval) :
+				sys_pwrite(tf->tf_a0, (userptr_t)tf->tf_a1,
+					   tf->tf_a2, pos, &retval);
+		}
+		break;
 	    case SYS_lseek:
 		{
 			/*
@@ -245,6 +323,10 @@ syscall(struct trapframe *tf)
 		err = sys_getdirentry(tf->tf_a0, (userptr_t)tf->tf_a1,
 				      tf->tf_a2, &retval);
 		break;
+	    case SYS_getdirentries:
+		err = sys_getdirentries(tf->tf_a0, (userptr_t)tf->tf_a1,
+					tf->tf_a2, &retval);
+		break;
 	    case SYS_fstat:
 		err = sys_fstat(tf->tf_a0, (userptr_t)tf->tf_a1);
 		break;
@@ -261,6 +343,20 @@ syscall(struct trapframe *tf)
 		}
 		break;
 
+	    /* async I/O */
+	    case SYS_aio_submit:
+		err = sys_aio_submit((const_userptr_t)tf->tf_a0, tf->tf_a1,
+				     &retval);
+		break;
+	    case SYS_aio_reap:
+		err = sys_aio_reap((userptr_t)tf->tf_a0, tf->tf_a1,
+				   tf->tf_a2, tf->tf_a3, &retval);
+		break;
+
+	    case SYS_sendfile:
+		err = sys_sendfile(tf->tf_a0, tf->tf_a1, tf->tf_a2, &retval);
+		break;
+
 
 
 	    default:
@@ -316,3 +412,24 @@ enter_forked_process(struct trapframe *tf)
 
 	mips_usermode(tf);
 }
+
+/*
+ * Enter user mode for a new thread in an existing process.
+ *
+ * TF is a copy of the creating thread's trapframe, so registers like
+ * gp carry over. Start at ENTRY with ARG0 and ARG1 as the first two
+ * arguments, on the stack whose top is STACKPTR, leaving the 16 bytes
+ * of argument save area that a caller provides.
+ */
+void
+enter_new_thread(struct trapframe *tf, vaddr_t entry, vaddr_t stackptr,
+		 userptr_t arg0, userptr_t arg1)
+{
+	tf->tf_epc = entry;
+	tf->tf_sp = stackptr - 16;
+	tf->tf_a0 = (vaddr_t)arg0;
+	tf->tf_a1 = (vaddr_t)arg1;
+	tf->tf_ra = 0;
+
+	mips_usermode(tf);
+}
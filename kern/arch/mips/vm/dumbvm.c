@@ -112,6 +112,24 @@ vm_tlbshootdown(const struct tlbshootdown *ts)
 	panic("dumbvm tried to do tlb shootdown?!\n");
 }
 
+void
+vm_prefault(vaddr_t vaddr, size_t len, bool write)
+{
+	/* Not worth it here; the copy faults pages in as it goes. */
+	(void)vaddr;
+	(void)len;
+	(void)write;
+}
+
+int
+vm_loanpage(vaddr_t uaddr, vaddr_t *kvaddr)
+{
+	/* No copy-on-write here; the caller copies instead. */
+	(void)uaddr;
+	(void)kvaddr;
+	return ENOSYS;
+}
+
 int
 vm_fault(int faulttype, vaddr_t faultaddress)
 {
@@ -356,6 +374,23 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_threadstack(struct addrspace *as, unsigned slot, vaddr_t *stackptr)
+{
+	/* dumbvm has exactly one stack per address space. */
+	(void)as;
+	(void)slot;
+	(void)stackptr;
+	return ENOSYS;
+}
+
+void
+as_remove_threadstack(struct addrspace *as, unsigned slot)
+{
+	(void)as;
+	(void)slot;
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
@@ -52,6 +52,14 @@
  * real-time clock instead of compiling it in like this.
  */
 #define CPU_FREQUENCY 25000000 /* 25 MHz */
+#define CPU_NSECS_PER_CYCLE (1000000000 / CPU_FREQUENCY)
+
+/*
+ * Shortest timer interval we program. Setting c_compare to a count
+ * that has already gone by would mean waiting for the counter to wrap
+ * all the way around, so leave room for the instructions in between.
+ */
+#define TIMER_MIN_CYCLES 100
 
 /*
  * Access to the on-chip timer.
@@ -59,23 +67,43 @@
  * The c0_count register increments on every cycle; when the value
  * matches the c0_compare register, the timer interrupt line is
  * asserted. Writing to c0_compare again clears the interrupt.
+ *
+ * We restart c0_count from zero each time, so COUNT is the number of
+ * cycles until the interrupt.
  */
 static
 void
 mips_timer_set(uint32_t count)
 {
 	/*
-	 * $11 == c0_compare; we can't use the symbolic name inside
-	 * the asm string.
+	 * $9 == c0_count, $11 == c0_compare; we can't use the
+	 * symbolic names inside the asm string.
 	 */
 	__asm volatile(
 		".set push;"		/* save assembler mode */
 		".set mips32;"		/* allow MIPS32 registers */
+		"mtc0 $0, $9;"		/* restart the count */
 		"mtc0 %0, $11;"		/* do it */
 		".set pop"		/* restore assembler mode */
 		:: "r" (count));
 }
 
+/*
+ * One-shot timer for the MI clock code. Each cpu has its own on-chip
+ * timer, so this sets the current cpu's.
+ */
+void
+mainbus_settimer(uint32_t nsecs)
+{
+	uint32_t cycles;
+
+	cycles = nsecs / CPU_NSECS_PER_CYCLE;
+	if (cycles < TIMER_MIN_CYCLES) {
+		cycles = TIMER_MIN_CYCLES;
+	}
+	mips_timer_set(cycles);
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -114,9 +142,10 @@ mainbus_bootstrap(void)
 	autoconf_lamebus(lamebus, 0);
 
 	/*
-	 * Configure the MIPS on-chip timer to interrupt HZ times a second.
+	 * Start the MIPS on-chip timer, which the clock code runs
+	 * one-shot; it interrupts HZ times a second while we're busy.
 	 */
-	mips_timer_set(CPU_FREQUENCY / HZ);
+	hardclock_start();
 }
 
 /*
@@ -314,10 +343,13 @@ mainbus_interrupt(struct trapframe *tf)
 		seen = true;
 	}
 	if (cause & MIPS_TIMER_BIT) {
-		/* Reset the timer (this clears the interrupt) */
-		mips_timer_set(CPU_FREQUENCY / HZ);
-		/* and call hardclock */
-		hardclock();
+		/*
+		 * Push the timer as far off as it goes (this clears
+		 * the interrupt); the clock code sets it again for
+		 * whatever's due next.
+		 */
+		mips_timer_set(0xffffffff);
+		hardclock_interrupt();
 		seen = true;
 	}
 
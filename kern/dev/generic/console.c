@@ -39,6 +39,12 @@
  * supported, although such support could be added without undue
  * difficulty.
  *
+ * Output from threads goes through a ring buffer, which the device's
+ * write-done interrupt drains, so writers only wait when the ring is
+ * full. Input is collected in another ring by the read interrupt;
+ * reads from userlevel return whatever has arrived, up to the end of
+ * a line.
+ *
  * Note that nothing happens until we have a device to write to. A
  * buffer of size DELAYBUFSIZE is used to hold output that is
  * generated before this point. This means that (1) using kprintf for
@@ -49,12 +55,14 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/poll.h>
 #include <lib.h>
 #include <uio.h>
 #include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <wchan.h>
 #include <generic/console.h>
 #include <vfs.h>
 #include <device.h>
@@ -65,6 +73,14 @@
  */
 static struct con_softc *the_console = NULL;
 
+/*
+ * Size of the chunks moved to and from userlevel at a time.
+ */
+#define CON_CHUNK 128
+
+#define CON_INNEXT(n)  (((n) + 1) % CONSOLE_INPUT_BUFFER_SIZE)
+#define CON_OUTNEXT(n) (((n) + 1) % CONSOLE_OUTPUT_BUFFER_SIZE)
+
 /*
  * Lock so user I/Os are atomic.
  * We use two locks so readers waiting for input don't lock out writers.
@@ -122,41 +138,144 @@ putch_polled(struct con_softc *cs, int ch)
 
 //////////////////////////////////////////////////
 
+/*
+ * Output ring.
+ *
+ * If the device is idle, hand it the next character from the ring;
+ * con_start, on the write-done interrupt, sends the one after. Call
+ * with cs_lock held.
+ */
+static
+void
+con_startsend(struct con_softc *cs)
+{
+	int ch;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_lock));
+
+	if (cs->cs_sending || cs->cs_outchars_head == cs->cs_outchars_tail) {
+		return;
+	}
+	ch = cs->cs_outchars[cs->cs_outchars_tail];
+	cs->cs_outchars_tail = CON_OUTNEXT(cs->cs_outchars_tail);
+	cs->cs_sending = true;
+	cs->cs_send(cs->cs_devdata, ch);
+}
+
+/*
+ * Put a character in the output ring, waiting for room if it's full.
+ * Call with cs_lock held.
+ */
+static
+void
+con_queuech(struct con_softc *cs, int ch)
+{
+	unsigned nexthead;
+
+	KASSERT(spinlock_do_i_hold(&cs->cs_lock));
+
+	nexthead = CON_OUTNEXT(cs->cs_outchars_head);
+	while (nexthead == cs->cs_outchars_tail) {
+		con_startsend(cs);
+		wchan_sleep(cs->cs_wwchan, &cs->cs_lock);
+	}
+	cs->cs_outchars[cs->cs_outchars_head] = ch;
+	cs->cs_outchars_head = nexthead;
+}
+
+/*
+ * Queue LEN characters, turning newlines into CR-LF.
+ */
+static
+void
+con_queue(struct con_softc *cs, const char *buf, size_t len)
+{
+	size_t i;
+
+	spinlock_acquire(&cs->cs_lock);
+	for (i=0; i<len; i++) {
+		if (buf[i] == '\n') {
+			con_queuech(cs, '\r');
+		}
+		con_queuech(cs, buf[i]);
+	}
+	con_startsend(cs);
+	spinlock_release(&cs->cs_lock);
+}
+
 /*
  * Print a character, using interrupts to wait for I/O completion.
+ *
+ * This is kprintf from thread context, so wait until the character
+ * has actually gone out; otherwise whatever was printed just before
+ * a panic could be stuck in the ring when the system dies.
  */
 static
 void
 putch_intr(struct con_softc *cs, int ch)
 {
-	P(cs->cs_wsem);
-	cs->cs_send(cs->cs_devdata, ch);
+	spinlock_acquire(&cs->cs_lock);
+	con_queuech(cs, ch);
+	con_startsend(cs);
+	while (cs->cs_sending) {
+		wchan_sleep(cs->cs_wwchan, &cs->cs_lock);
+	}
+	spinlock_release(&cs->cs_lock);
 }
 
 /*
- * Read a character, using interrupts to wait for I/O completion.
+ * Input ring.
+ */
+
+/*
+ * Take a character from the input ring. Call with cs_lock held and
+ * the ring not empty.
  */
 static
 int
-getch_intr(struct con_softc *cs)
+con_takech(struct con_softc *cs)
 {
 	unsigned char ret;
 
-	P(cs->cs_rsem);
+	KASSERT(spinlock_do_i_hold(&cs->cs_lock));
+	KASSERT(cs->cs_gotchars_head != cs->cs_gotchars_tail);
+
 	ret = cs->cs_gotchars[cs->cs_gotchars_tail];
-	cs->cs_gotchars_tail =
-		(cs->cs_gotchars_tail + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+	cs->cs_gotchars_tail = CON_INNEXT(cs->cs_gotchars_tail);
+	return ret;
+}
+
+static
+unsigned
+con_numgot(struct con_softc *cs)
+{
+	return (cs->cs_gotchars_head + CONSOLE_INPUT_BUFFER_SIZE
+		- cs->cs_gotchars_tail) % CONSOLE_INPUT_BUFFER_SIZE;
+}
+
+/*
+ * Read a character, using interrupts to wait for I/O completion.
+ */
+static
+int
+getch_intr(struct con_softc *cs)
+{
+	int ret;
+
+	spinlock_acquire(&cs->cs_lock);
+	while (cs->cs_gotchars_head == cs->cs_gotchars_tail) {
+		wchan_sleep(cs->cs_rwchan, &cs->cs_lock);
+	}
+	ret = con_takech(cs);
+	spinlock_release(&cs->cs_lock);
 	return ret;
 }
 
 /*
  * Called from underlying device when a read-ready interrupt occurs.
  *
- * Note: if gotchars_head == gotchars_tail, the buffer is empty. Thus
- * if gotchars_head+1 == gotchars_tail, the buffer is full. A slightly
- * tidier way to implement this check (that avoids wasting a slot,
- * too) would be with a second semaphore used with a nonblocking P,
- * but we don't have that in OS/161.
+ * Readers and pollers alike only wait for the ring to be nonempty,
+ * so they're woken when it stops being empty.
  */
 void
 con_input(void *vcs, int ch)
@@ -164,27 +283,49 @@ con_input(void *vcs, int ch)
 	struct con_softc *cs = vcs;
 	unsigned nexthead;
 
-	nexthead = (cs->cs_gotchars_head + 1) % CONSOLE_INPUT_BUFFER_SIZE;
+	spinlock_acquire(&cs->cs_lock);
+	nexthead = CON_INNEXT(cs->cs_gotchars_head);
 	if (nexthead == cs->cs_gotchars_tail) {
 		/* overflow; drop character */
+		spinlock_release(&cs->cs_lock);
 		return;
 	}
 
 	cs->cs_gotchars[cs->cs_gotchars_head] = ch;
 	cs->cs_gotchars_head = nexthead;
 
-	V(cs->cs_rsem);
+	if (con_numgot(cs) == 1) {
+		pollqueue_wakeup(&cs->cs_pollq);
+		wchan_wakeall(cs->cs_rwchan, &cs->cs_lock);
+	}
+	spinlock_release(&cs->cs_lock);
 }
 
 /*
  * Called from underlying device when a write-done interrupt occurs.
+ *
+ * Send the next character, if any. Writers waiting for room are woken
+ * once the ring is down to half full, rather than for every character;
+ * kprintf callers waiting for their character to go out are woken
+ * when the device goes idle.
  */
 void
 con_start(void *vcs)
 {
 	struct con_softc *cs = vcs;
+	unsigned used;
 
-	V(cs->cs_wsem);
+	spinlock_acquire(&cs->cs_lock);
+	cs->cs_sending = false;
+	con_startsend(cs);
+
+	used = (cs->cs_outchars_head + CONSOLE_OUTPUT_BUFFER_SIZE
+		- cs->cs_outchars_tail) % CONSOLE_OUTPUT_BUFFER_SIZE;
+	if (used == CONSOLE_OUTPUT_BUFFER_SIZE / 2 || !cs->cs_sending) {
+		wchan_wakeall(cs->cs_wwchan, &cs->cs_lock);
+		pollqueue_wakeup(&cs->cs_pollq);
+	}
+	spinlock_release(&cs->cs_lock);
 }
 
 //////////////////////////////////////////////////
@@ -240,15 +381,92 @@ con_eachopen(struct device *dev, int openflags)
 	return 0;
 }
 
+/*
+ * Read from userlevel: wait until there's at least one character,
+ * then move out what's there, up to the end of a line or as much as
+ * was asked for. This is what makes poll's idea of readable (any
+ * input at all) true. Like getch, this doesn't echo; programs that
+ * want that (like the shell) read a character at a time and do it
+ * themselves.
+ */
 static
 int
-con_io(struct device *dev, struct uio *uio)
+con_read(struct con_softc *cs, struct uio *uio)
 {
+	char buf[CON_CHUNK];
+	size_t want, len;
+	bool gotline, gotsome;
 	int result;
-	char ch;
-	struct lock *lk;
 
-	(void)dev;  // unused
+	gotline = gotsome = false;
+	while (uio->uio_resid > 0 && !gotline) {
+		want = uio->uio_resid < sizeof(buf) ? uio->uio_resid
+			: sizeof(buf);
+
+		spinlock_acquire(&cs->cs_lock);
+		while (con_numgot(cs) == 0) {
+			if (gotsome) {
+				/* don't wait for more once we have some */
+				spinlock_release(&cs->cs_lock);
+				return 0;
+			}
+			result = wchan_sleep_intr(cs->cs_rwchan, &cs->cs_lock);
+			if (result) {
+				spinlock_release(&cs->cs_lock);
+				return result;
+			}
+		}
+		if (want > con_numgot(cs)) {
+			want = con_numgot(cs);
+		}
+		for (len = 0; len < want && !gotline; len++) {
+			buf[len] = con_takech(cs);
+			if (buf[len] == '\r') {
+				buf[len] = '\n';
+			}
+			gotline = (buf[len] == '\n');
+		}
+		spinlock_release(&cs->cs_lock);
+
+		result = uiomove(buf, len, uio);
+		if (result) {
+			return result;
+		}
+		gotsome = true;
+	}
+	return 0;
+}
+
+/*
+ * Write from userlevel: copy in a chunk at a time and queue it.
+ */
+static
+int
+con_write(struct con_softc *cs, struct uio *uio)
+{
+	char buf[CON_CHUNK];
+	size_t len;
+	int result;
+
+	while (uio->uio_resid > 0) {
+		len = uio->uio_resid < sizeof(buf) ? uio->uio_resid
+			: sizeof(buf);
+		result = uiomove(buf, len, uio);
+		if (result) {
+			return result;
+		}
+		con_queue(cs, buf, len);
+	}
+	return 0;
+}
+
+static
+int
+con_io(struct device *dev, struct uio *uio)
+{
+	struct con_softc *cs = dev->d_data;
+	struct lock *lk;
+	int result;
 
 	if (uio->uio_rw==UIO_READ) {
 		lk = con_userlock_read;
@@ -259,36 +477,14 @@ con_io(struct device *dev, struct uio *uio)
 
 	KASSERT(lk != NULL);
 	lock_acquire(lk);
-
-	while (uio->uio_resid > 0) {
-		if (uio->uio_rw==UIO_READ) {
-			ch = getch();
-			if (ch=='\r') {
-				ch = '\n';
-			}
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				break;
-			}
-		}
-		else {
-			result = uiomove(&ch, 1, uio);
-			if (result) {
-				lock_release(lk);
-				return result;
-			}
-			if (ch=='\n') {
-				putch('\r');
-			}
-			putch(ch);
-		}
+	if (uio->uio_rw==UIO_READ) {
+		result = con_read(cs, uio);
+	}
+	else {
+		result = con_write(cs, uio);
 	}
 	lock_release(lk);
-	return 0;
+	return result;
 }
 
 static
@@ -302,10 +498,40 @@ con_ioctl(struct device *dev, int op, userptr_t data)
 	return EINVAL;
 }
 
+/*
+ * poll: readable if there's any input, as con_read then returns
+ * without waiting; writable if there's room in the output ring.
+ */
+static
+int
+con_poll(struct device *dev, int events, struct poller *poller, int *revents)
+{
+	struct con_softc *cs = dev->d_data;
+	int ready;
+
+	if (poller != NULL) {
+		poller_register(poller, &cs->cs_pollq);
+	}
+
+	ready = 0;
+	spinlock_acquire(&cs->cs_lock);
+	if (con_numgot(cs) > 0) {
+		ready |= POLLIN;
+	}
+	if (CON_OUTNEXT(cs->cs_outchars_head) != cs->cs_outchars_tail) {
+		ready |= POLLOUT;
+	}
+	spinlock_release(&cs->cs_lock);
+
+	*revents = ready & events;
+	return 0;
+}
+
 static const struct device_ops console_devops = {
 	.devop_eachopen = con_eachopen,
 	.devop_io = con_io,
 	.devop_ioctl = con_ioctl,
+	.devop_poll = con_poll,
 };
 
 static
@@ -343,7 +569,7 @@ attach_console_to_vfs(struct con_softc *cs)
 int
 config_con(struct con_softc *cs, int unit)
 {
-	struct semaphore *rsem, *wsem;
+	struct wchan *rwc, *wwc;
 	struct lock *rlk, *wlk;
 
 	/*
@@ -359,33 +585,39 @@ config_con(struct con_softc *cs, int unit)
 	}
 	KASSERT(the_console==NULL);
 
-	rsem = sem_create("console read", 0);
-	if (rsem == NULL) {
+	rwc = wchan_create("console read");
+	if (rwc == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
-	if (wsem == NULL) {
-		sem_destroy(rsem);
+	wwc = wchan_create("console write");
+	if (wwc == NULL) {
+		wchan_destroy(rwc);
 		return ENOMEM;
 	}
 	rlk = lock_create("console-lock-read");
 	if (rlk == NULL) {
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(rwc);
+		wchan_destroy(wwc);
 		return ENOMEM;
 	}
 	wlk = lock_create("console-lock-write");
 	if (wlk == NULL) {
 		lock_destroy(rlk);
-		sem_destroy(rsem);
-		sem_destroy(wsem);
+		wchan_destroy(rwc);
+		wchan_destroy(wwc);
 		return ENOMEM;
 	}
 
-	cs->cs_rsem = rsem;
-	cs->cs_wsem = wsem;
+	spinlock_init(&cs->cs_lock);
+	spinlock_setname(&cs->cs_lock, "console");
+	cs->cs_rwchan = rwc;
+	cs->cs_wwchan = wwc;
 	cs->cs_gotchars_head = 0;
 	cs->cs_gotchars_tail = 0;
+	cs->cs_outchars_head = 0;
+	cs->cs_outchars_tail = 0;
+	cs->cs_sending = false;
+	pollqueue_init(&cs->cs_pollq);
 
 	the_console = cs;
 	con_userlock_read = rlk;
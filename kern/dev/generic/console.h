@@ -35,9 +35,20 @@
  *
  * devdata, send, and sendpolled are provided by the underlying
  * device, and are to be initialized by the attach routine.
+ *
+ * Output goes through a ring that the device's write-done interrupt
+ * drains one character at a time; input goes into another ring from
+ * the read interrupt. Both rings are empty when head == tail, so they
+ * hold one character less than their size.
  */
 
-#define CONSOLE_INPUT_BUFFER_SIZE 32
+#include <spinlock.h>
+#include <poll.h>
+
+struct wchan;
+
+#define CONSOLE_INPUT_BUFFER_SIZE 256
+#define CONSOLE_OUTPUT_BUFFER_SIZE 1024
 
 struct con_softc {
 	/* initialized by attach routine */
@@ -46,11 +57,17 @@ struct con_softc {
 	void (*cs_sendpolled)(void *devdata, int ch);
 
 	/* initialized by config routine */
-	struct semaphore *cs_rsem;
-	struct semaphore *cs_wsem;
+	struct spinlock cs_lock;	/* protects everything below */
+	struct wchan *cs_rwchan;	/* readers waiting for input */
+	struct wchan *cs_wwchan;	/* writers waiting for output space */
 	unsigned char cs_gotchars[CONSOLE_INPUT_BUFFER_SIZE];
 	unsigned cs_gotchars_head;	/* next slot to put a char in */
 	unsigned cs_gotchars_tail;	/* next slot to take a char out */
+	unsigned char cs_outchars[CONSOLE_OUTPUT_BUFFER_SIZE];
+	unsigned cs_outchars_head;	/* next slot to put a char in */
+	unsigned cs_outchars_tail;	/* next slot to send from */
+	bool cs_sending;		/* device busy with one of ours */
+	struct pollqueue cs_pollq;	/* poll()ers; has its own lock */
 };
 
 /*
@@ -1087,8 +1087,10 @@ static const struct vnode_ops emufs_fileops = {
 	.vop_read = emufs_read,
 	.vop_readlink = emufs_readlink_notlink,
 	.vop_getdirentry = emufs_uio_op_notdir,
+	.vop_getdirentries = emufs_uio_op_notdir,
 	.vop_write = emufs_write,
 	.vop_ioctl = emufs_ioctl,
+	.vop_poll = vnode_pollready,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_file_gettype,
 	.vop_isseekable = emufs_isseekable,
@@ -1121,8 +1123,10 @@ static const struct vnode_ops emufs_dirops = {
 	.vop_read = emufs_uio_op_isdir,
 	.vop_readlink = emufs_uio_op_isdir,
 	.vop_getdirentry = emufs_getdirentry,
+	.vop_getdirentries = vnode_getdirentries,
 	.vop_write = emufs_uio_op_isdir,
 	.vop_ioctl = emufs_ioctl,
+	.vop_poll = vnode_pollready,
 	.vop_stat = emufs_stat,
 	.vop_gettype = emufs_dir_gettype,
 	.vop_isseekable = emufs_isseekable,
@@ -1307,6 +1311,7 @@ emufs_addtovfs(struct emu_softc *sc, const char *devname)
 
 	ef->ef_fs.fs_data = ef;
 	ef->ef_fs.fs_ops = &emufs_fsops;
+	ef->ef_fs.fs_nonegcache = true;
 
 	ef->ef_emu = sc;
 	ef->ef_root = NULL;
@@ -268,6 +268,7 @@ static const struct device_ops lhd_devops = {
 	.devop_eachopen = lhd_eachopen,
 	.devop_io = lhd_io,
 	.devop_ioctl = lhd_ioctl,
+	.devop_poll = dev_pollready,
 };
 
 /*
@@ -49,8 +49,6 @@
 /* Granularity of countdown timer (usec) */
 #define LT_GRANULARITY   1000000
 
-static bool havetimerclock;
-
 /*
  * Setup routine called by autoconf stuff when an ltimer is found.
  */
@@ -84,18 +82,11 @@ config_ltimer(struct ltimer_softc *lt, int ltimerno)
 	lt->lt_hardclock = 0;
 
 	/*
-	 * We do, however, use ltimer for the timer clock, since the
-	 * on-chip timer can't do that.
+	 * We used to use ltimer for a once-a-second timer clock as
+	 * well, but timed sleeps are now done with timeouts on the
+	 * on-chip timer, and that interrupt would only wake up idle
+	 * CPUs. So there's nothing else for it to do.
 	 */
-	if (!havetimerclock) {
-		havetimerclock = true;
-		lt->lt_timerclock = 1;
-
-		/* Wire it to go off once every second. */
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_ROE, 1);
-		bus_write_register(lt->lt_bus, lt->lt_buspos, LT_REG_COUNT,
-				   LT_GRANULARITY);
-	}
 
 	return 0;
 }
@@ -118,12 +109,6 @@ ltimer_irq(void *vlt)
 		if (lt->lt_hardclock) {
 			hardclock();
 		}
-		/*
-		 * Likewise for timerclock.
-		 */
-		if (lt->lt_timerclock) {
-			timerclock();
-		}
 	}
 }
 
@@ -30,6 +30,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <uio.h>
 #include <synch.h>
@@ -151,6 +152,35 @@ semfs_wakeup(struct semfs_sem *sem, unsigned newcount)
 	else {
 		cv_broadcast(sem->sems_cv, sem->sems_lock);
 	}
+	pollqueue_wakeup(&sem->sems_pollq);
+}
+
+/*
+ * poll() for semaphore vnodes. Reading (P) waits for the count to be
+ * nonzero; writing (V) never waits.
+ */
+static
+int
+semfs_poll(struct vnode *vn, int events, struct poller *poller, int *revents)
+{
+	struct semfs_vnode *semv = vn->vn_data;
+	struct semfs_sem *sem;
+	int ready;
+
+	sem = semfs_getsem(semv);
+	if (poller != NULL) {
+		poller_register(poller, &sem->sems_pollq);
+	}
+
+	ready = POLLOUT;
+	lock_acquire(sem->sems_lock);
+	if (sem->sems_count > 0) {
+		ready |= POLLIN;
+	}
+	lock_release(sem->sems_lock);
+
+	*revents = ready & events;
+	return 0;
 }
 
 /*
@@ -657,8 +687,10 @@ static const struct vnode_ops semfs_dirops = {
 	.vop_read = vopfail_uio_isdir,
 	.vop_readlink = vopfail_uio_isdir,
 	.vop_getdirentry = semfs_getdirentry,
+	.vop_getdirentries = vnode_getdirentries,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = vnode_pollready,
 	.vop_stat = semfs_dirstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
@@ -690,8 +722,10 @@ static const struct vnode_ops semfs_semops = {
 	.vop_read = semfs_read,
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirentries = vopfail_uio_notdir,
 	.vop_write = semfs_write,
 	.vop_ioctl = semfs_ioctl,
+	.vop_poll = semfs_poll,
 	.vop_stat = semfs_semstat,
 	.vop_gettype = semfs_gettype,
 	.vop_isseekable = semfs_isseekable,
@@ -33,6 +33,7 @@
  * Block allocation.
  */
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <bitmap.h>
 #include <sfs.h>
@@ -41,7 +42,6 @@
 /*
  * Zero out a disk block.
  */
-static
 int
 sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 {
@@ -53,27 +53,50 @@ sfs_clearblock(struct sfs_fs *sfs, daddr_t block)
 
 /*
  * Allocate a block.
+ *
+ * GOAL is the block we would like to get, typically the one after
+ * the previous block of the same file; if it's taken we use the next
+ * free block after it. Pass 0 if there's no preference.
+ *
+ * If DOCLEAR is false the block is handed back with whatever junk
+ * was on disk in it; the caller must be about to overwrite the whole
+ * thing (or zero it itself) before anything can read it.
  */
 int
-sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock)
+sfs_balloc(struct sfs_fs *sfs, daddr_t goal, bool doclear, daddr_t *diskblock)
 {
 	int result;
 
-	result = bitmap_alloc(sfs->sfs_freemap, diskblock);
+	if (goal >= sfs->sfs_sb.sb_nblocks) {
+		goal = 0;
+	}
+
+	/* Don't take space promised to buffered writes. */
+	if (sfs->sfs_nfree <= sfs->sfs_reserved) {
+		return ENOSPC;
+	}
+
+	result = bitmap_alloc_near(sfs->sfs_freemap, goal, diskblock);
 	if (result) {
 		return result;
 	}
 	sfs->sfs_freemapdirty = true;
+	sfs->sfs_nfree--;
 
 	if (*diskblock >= sfs->sfs_sb.sb_nblocks) {
 		panic("sfs: %s: balloc: invalid block %u\n",
 		      sfs->sfs_sb.sb_volname, *diskblock);
 	}
 
+	if (!doclear) {
+		return 0;
+	}
+
 	/* Clear block before returning it */
 	result = sfs_clearblock(sfs, *diskblock);
 	if (result) {
 		bitmap_unmark(sfs->sfs_freemap, *diskblock);
+		sfs->sfs_nfree++;
 	}
 	return result;
 }
@@ -86,6 +109,7 @@ sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock)
 {
 	bitmap_unmark(sfs->sfs_freemap, diskblock);
 	sfs->sfs_freemapdirty = true;
+	sfs->sfs_nfree++;
 }
 
 /*
@@ -39,15 +39,56 @@
 #include <sfs.h>
 #include "sfsprivate.h"
 
+/*
+ * Choose where we'd like file block FILEBLOCK to go on disk: right
+ * after the disk block holding FILEBLOCK-1, so a file written
+ * sequentially comes out contiguous even while other files are
+ * growing at the same time. If there's no previous block to follow
+ * (start of file, or a hole), aim for just past the inode.
+ *
+ * IDBUF is the contents of the indirect block, or NULL if FILEBLOCK
+ * is a direct block.
+ */
+static
+daddr_t
+sfs_bmap_goal(struct sfs_vnode *sv, uint32_t fileblock,
+	      const uint32_t *idbuf)
+{
+	daddr_t prev;
+
+	if (fileblock == 0) {
+		prev = 0;
+	}
+	else if (fileblock <= SFS_NDIRECT) {
+		prev = sv->sv_i.sfi_direct[fileblock - 1];
+	}
+	else {
+		KASSERT(idbuf != NULL);
+		prev = idbuf[(fileblock - SFS_NDIRECT - 1) % SFS_DBPERIDB];
+	}
+
+	if (prev == 0) {
+		prev = sv->sv_ino;
+	}
+	return prev + 1;
+}
+
 /*
  * Look up the disk block number (from 0 up to the number of blocks on
  * the disk) given a file and the logical block number within that
  * file. If DOALLOC is set, and no such block exists, one will be
  * allocated.
+ *
+ * If ISNEW is NULL, a newly allocated block is zeroed on disk before
+ * being returned. Otherwise it is not, and *ISNEW is set to tell the
+ * caller whether the block was just allocated; in that case the
+ * caller must write the whole block (zero-filling whatever it isn't
+ * supplying) before returning. This saves a write per block when
+ * extending files.
  */
 int
 sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
-	 daddr_t *diskblock)
+	 daddr_t *diskblock, bool *isnew)
 {
 	/*
 	 * I/O buffer for handling indirect blocks.
@@ -62,6 +103,7 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	daddr_t block;
 	daddr_t idblock;
 	uint32_t idnum, idoff;
+	bool newidblock = false;
 	int result;
 
 	KASSERT(sizeof(idbuf)==SFS_BLOCKSIZE);
@@ -69,6 +111,10 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 	/* Since we're using a static buffer, we'd better be locked. */
 	KASSERT(vfs_biglock_do_i_hold());
 
+	if (isnew != NULL) {
+		*isnew = false;
+	}
+
 	/*
 	 * If the block we want is one of the direct blocks...
 	 */
@@ -82,7 +128,9 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 * Do we need to allocate?
 		 */
 		if (block==0 && doalloc) {
-			result = sfs_balloc(sfs, &block);
+			result = sfs_balloc(sfs,
+					    sfs_bmap_goal(sv, fileblock, NULL),
+					    isnew == NULL, &block);
 			if (result) {
 				return result;
 			}
@@ -90,6 +138,9 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 			/* Remember what we allocated; mark inode dirty */
 			sv->sv_i.sfi_direct[fileblock] = block;
 			sv->sv_dirty = true;
+			if (isnew != NULL) {
+				*isnew = true;
+			}
 		}
 
 		/*
@@ -141,12 +192,16 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 		 * There's no indirect block allocated, but we need to
 		 * allocate a block whose number needs to be stored in
 		 * the indirect block. Thus, we need to allocate an
-		 * indirect block.
+		 * indirect block. It doesn't need clearing on disk:
+		 * we zero the buffer here and write it out below once
+		 * the data block is in it.
 		 */
-		result = sfs_balloc(sfs, &idblock);
+		result = sfs_balloc(sfs, sfs_bmap_goal(sv, SFS_NDIRECT, NULL),
+				    false, &idblock);
 		if (result) {
 			return result;
 		}
+		newidblock = true;
 
 		/* Remember the block we just allocated */
 		sv->sv_i.sfi_indirect = idblock;
@@ -172,13 +227,24 @@ sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
 
 	/* If there's no block there, allocate one */
 	if (block==0 && doalloc) {
-		result = sfs_balloc(sfs, &block);
+		result = sfs_balloc(sfs,
+				    sfs_bmap_goal(sv, fileblock + SFS_NDIRECT,
+						  idbuf),
+				    isnew == NULL, &block);
 		if (result) {
+			if (newidblock) {
+				/* Don't leave a junk indirect block behind */
+				sfs_bfree(sfs, idblock);
+				sv->sv_i.sfi_indirect = 0;
+			}
 			return result;
 		}
 
 		/* Remember the block we allocated */
 		idbuf[idoff] = block;
+		if (isnew != NULL) {
+			*isnew = true;
+		}
 
 		/* The indirect block is now dirty; write it back */
 		result = sfs_writeblock(sfs, idblock, idbuf, sizeof(idbuf));
@@ -227,6 +293,9 @@ sfs_itrunc(struct sfs_vnode *sv, off_t len)
 
 	vfs_biglock_acquire();
 
+	/* Drop buffered data past the new end. */
+	sfs_buf_discard(sv, blocklen);
+
 	/*
 	 * Go through the direct blocks. Discard any that are
 	 * past the limit we're truncating to.
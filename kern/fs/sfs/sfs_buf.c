@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009, 2014
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * SFS filesystem
+ *
+ * Write-back buffers for file data.
+ *
+ * Writes to files land in these buffers rather than going straight
+ * to disk. A buffer is written out when its file is fsync'd or
+ * reclaimed, when the filesystem is synced, when the syncer finds it
+ * has been dirty for SFS_BUF_MAXAGE seconds, or when its space is
+ * needed and it's the oldest. A run of small writes to one block
+ * thus costs one disk write instead of a read and a write apiece.
+ *
+ * A block that isn't on disk yet doesn't get a disk block until it's
+ * written out; instead, space for it is reserved so the write can't
+ * fail later for lack of room. Since all of a file's buffers are
+ * written out together, in order, a file written a little at a time
+ * still comes out in one contiguous run.
+ *
+ * Only file data is buffered; directories are still written
+ * through.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <vfs.h>
+#include <sfs.h>
+#include "sfsprivate.h"
+
+/*
+ * Set up the buffers for a volume.
+ */
+int
+sfs_buf_init(struct sfs_fs *sfs)
+{
+	unsigned i;
+
+	sfs->sfs_bufs = kmalloc(SFS_NBUF * sizeof(struct sfs_buf));
+	if (sfs->sfs_bufs == NULL) {
+		return ENOMEM;
+	}
+	for (i=0; i<SFS_NBUF; i++) {
+		sfs->sfs_bufs[i].b_sv = NULL;
+		sfs->sfs_bufs[i].b_data = NULL;
+	}
+	for (i=0; i<SFS_NBUF; i++) {
+		sfs->sfs_bufs[i].b_data = kmalloc(SFS_BLOCKSIZE);
+		if (sfs->sfs_bufs[i].b_data == NULL) {
+			sfs_buf_cleanup(sfs);
+			return ENOMEM;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Release the buffers for a volume. They must all be unused.
+ */
+void
+sfs_buf_cleanup(struct sfs_fs *sfs)
+{
+	unsigned i;
+
+	if (sfs->sfs_bufs == NULL) {
+		return;
+	}
+	for (i=0; i<SFS_NBUF; i++) {
+		KASSERT(sfs->sfs_bufs[i].b_sv == NULL);
+		kfree(sfs->sfs_bufs[i].b_data);
+	}
+	kfree(sfs->sfs_bufs);
+	sfs->sfs_bufs = NULL;
+}
+
+/*
+ * Give up a buffer without writing it.
+ */
+static
+void
+sfs_buf_free(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	KASSERT(b->b_sv != NULL);
+	KASSERT(b->b_sv->sv_nbufs > 0);
+	KASSERT(sfs->sfs_reserved >= b->b_reserved);
+
+	sfs->sfs_reserved -= b->b_reserved;
+	b->b_reserved = 0;
+	b->b_sv->sv_nbufs--;
+	b->b_sv = NULL;
+}
+
+/*
+ * Find the buffer holding block FILEBLOCK of SV, if there is one.
+ */
+struct sfs_buf *
+sfs_buf_find(struct sfs_vnode *sv, uint32_t fileblock)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	if (sv->sv_nbufs == 0) {
+		return NULL;
+	}
+	for (i=0; i<SFS_NBUF; i++) {
+		if (sfs->sfs_bufs[i].b_sv == sv &&
+		    sfs->sfs_bufs[i].b_fileblock == fileblock) {
+			return &sfs->sfs_bufs[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Write a buffer to disk and free it, allocating its disk block if
+ * it doesn't have one yet.
+ */
+static
+int
+sfs_buf_write(struct sfs_fs *sfs, struct sfs_buf *b)
+{
+	daddr_t diskblock;
+	unsigned reserve;
+	bool isnew;
+	int result;
+
+	/*
+	 * Hand back the reserved space so sfs_balloc can use it. If
+	 * the write fails the buffer stays, so take it back again.
+	 */
+	reserve = b->b_reserved;
+	KASSERT(sfs->sfs_reserved >= reserve);
+	sfs->sfs_reserved -= reserve;
+	b->b_reserved = 0;
+
+	/* We write the whole block, so no need to clear it first. */
+	result = sfs_bmap(b->b_sv, b->b_fileblock, true, &diskblock, &isnew);
+	if (result == 0) {
+		result = sfs_writeblock(sfs, diskblock, b->b_data,
+					SFS_BLOCKSIZE);
+	}
+	if (result) {
+		sfs->sfs_reserved += reserve;
+		b->b_reserved = reserve;
+		return result;
+	}
+
+	sfs_buf_free(sfs, b);
+	return 0;
+}
+
+/*
+ * Write out all of a file's buffers, lowest block first so newly
+ * allocated blocks are laid out in order.
+ */
+int
+sfs_buf_flushvnode(struct sfs_vnode *sv)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *b;
+	unsigned i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	while (sv->sv_nbufs > 0) {
+		b = NULL;
+		for (i=0; i<SFS_NBUF; i++) {
+			if (sfs->sfs_bufs[i].b_sv == sv &&
+			    (b == NULL ||
+			     sfs->sfs_bufs[i].b_fileblock < b->b_fileblock)) {
+				b = &sfs->sfs_bufs[i];
+			}
+		}
+		KASSERT(b != NULL);
+
+		result = sfs_buf_write(sfs, b);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Write out every file that has a buffer more than SFS_BUF_MAXAGE
+ * seconds old, along with its inode. Called by the syncer.
+ */
+int
+sfs_buf_flushaged(struct sfs_fs *sfs)
+{
+	struct timespec now;
+	struct sfs_vnode *sv;
+	unsigned i;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	gettime(&now);
+	for (i=0; i<SFS_NBUF; i++) {
+		sv = sfs->sfs_bufs[i].b_sv;
+		if (sv == NULL ||
+		    now.tv_sec - sfs->sfs_bufs[i].b_dirtysince < SFS_BUF_MAXAGE) {
+			continue;
+		}
+		result = sfs_buf_flushvnode(sv);
+		if (result) {
+			return result;
+		}
+		result = sfs_sync_inode(sv);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Get the buffer for block FILEBLOCK of SV, to write into it. If it
+ * isn't buffered yet, get a free buffer, writing out the file with
+ * the oldest buffer if there aren't any. If FILL is true, the new
+ * buffer is loaded with the block's current contents; otherwise the
+ * caller must be going to overwrite all of it.
+ */
+int
+sfs_buf_get(struct sfs_vnode *sv, uint32_t fileblock, bool fill,
+	    struct sfs_buf **ret)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *b, *oldest;
+	struct timespec now;
+	daddr_t diskblock;
+	unsigned i, reserve;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	b = sfs_buf_find(sv, fileblock);
+	if (b != NULL) {
+		*ret = b;
+		return 0;
+	}
+
+	/* Is the block already on disk? */
+	result = sfs_bmap(sv, fileblock, false, &diskblock, NULL);
+	if (result) {
+		return result;
+	}
+
+	/*
+	 * If not, make sure there will be room for it when it's
+	 * written: one block, plus the indirect block if that has
+	 * to be allocated too.
+	 */
+	reserve = 0;
+	if (diskblock == 0) {
+		reserve = 1;
+		if (fileblock >= SFS_NDIRECT && sv->sv_i.sfi_indirect == 0) {
+			reserve++;
+		}
+		if (sfs->sfs_nfree < sfs->sfs_reserved + reserve) {
+			return ENOSPC;
+		}
+	}
+
+	/* Find a free buffer, or the oldest one to evict. */
+	b = oldest = NULL;
+	for (i=0; i<SFS_NBUF; i++) {
+		if (sfs->sfs_bufs[i].b_sv == NULL) {
+			b = &sfs->sfs_bufs[i];
+			break;
+		}
+		if (oldest == NULL ||
+		    sfs->sfs_bufs[i].b_dirtysince < oldest->b_dirtysince) {
+			oldest = &sfs->sfs_bufs[i];
+		}
+	}
+	if (b == NULL) {
+		/*
+		 * Write out the whole file rather than just the one
+		 * buffer, so its new blocks are allocated together.
+		 * This frees the buffer we want to use (and maybe
+		 * allocates the indirect block we reserved for).
+		 */
+		b = oldest;
+		result = sfs_buf_flushvnode(b->b_sv);
+		if (result) {
+			return result;
+		}
+		KASSERT(b->b_sv == NULL);
+		if (diskblock == 0 && sfs->sfs_nfree <
+		    sfs->sfs_reserved + reserve) {
+			return ENOSPC;
+		}
+	}
+
+	if (diskblock == 0) {
+		/* Not on disk: starts out as zeros */
+		bzero(b->b_data, SFS_BLOCKSIZE);
+	}
+	else if (fill) {
+		result = sfs_readblock(sfs, diskblock, b->b_data,
+				       SFS_BLOCKSIZE);
+		if (result) {
+			return result;
+		}
+	}
+
+	gettime(&now);
+	b->b_sv = sv;
+	b->b_fileblock = fileblock;
+	b->b_reserved = reserve;
+	b->b_dirtysince = now.tv_sec;
+	sfs->sfs_reserved += reserve;
+	sv->sv_nbufs++;
+
+	*ret = b;
+	return 0;
+}
+
+/*
+ * Give up the buffer B without writing it, after a write into a
+ * buffer fresh from sfs_buf_get failed partway.
+ */
+void
+sfs_buf_release(struct sfs_buf *b)
+{
+	sfs_buf_free(b->b_sv->sv_absvn.vn_fs->fs_data, b);
+}
+
+/*
+ * Throw away SV's buffers for blocks FROMBLOCK and up, because the
+ * file is being truncated.
+ */
+void
+sfs_buf_discard(struct sfs_vnode *sv, uint32_t fromblock)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<SFS_NBUF && sv->sv_nbufs > 0; i++) {
+		if (sfs->sfs_bufs[i].b_sv == sv &&
+		    sfs->sfs_bufs[i].b_fileblock >= fromblock) {
+			sfs_buf_free(sfs, &sfs->sfs_bufs[i]);
+		}
+	}
+}
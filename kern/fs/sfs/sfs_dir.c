@@ -34,6 +34,7 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/dirent.h>
 #include <lib.h>
 #include <vfs.h>
 #include <sfs.h>
@@ -96,12 +97,432 @@ sfs_dir_nentries(struct sfs_vnode *sv)
 }
 
 /*
- * Search a directory for a particular filename in a directory, and
- * return its inode number, its slot, and/or the slot number of an
- * empty directory slot if one is found.
+ * Directories smaller than this many blocks stay linear; scanning a
+ * couple of blocks is as cheap as hashing into them.
  */
+#define SFS_DIRHASH_MINBLOCKS 2
+
+/*
+ * Hash a name to pick its bucket in a hashed directory.
+ */
+static
+uint32_t
+sfs_dir_hash(const char *name)
+{
+	uint32_t h = SFS_DIRHASH_INIT;
+
+	while (*name) {
+		h = SFS_DIRHASH_STEP(h, *name);
+		name++;
+	}
+	return h;
+}
+
+/*
+ * Read or write a whole directory block (a bucket, if hashed).
+ */
+static
 int
-sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+sfs_dir_blockio(struct sfs_vnode *sv, uint32_t block,
+		struct sfs_direntry *sds, enum uio_rw rw)
+{
+	return sfs_metaio(sv, (off_t)block * SFS_BLOCKSIZE, sds,
+			  SFS_BLOCKSIZE, rw);
+}
+
+////////////////////////////////////////////////////////////
+// Name cache
+
+/*
+ * The name cache is a small direct-mapped table per volume mapping
+ * (directory, name) to (inode, slot). It only holds names that
+ * exist; it is kept up to date by sfs_dir_link and sfs_dir_unlink,
+ * and flushed for a directory when its slots get rearranged.
+ */
+
+static
+struct sfs_ncentry *
+sfs_nc_entry(struct sfs_vnode *dir, const char *name)
+{
+	struct sfs_fs *sfs = dir->sv_absvn.vn_fs->fs_data;
+	uint32_t h;
+
+	h = SFS_DIRHASH_STEP(sfs_dir_hash(name), dir->sv_ino);
+	return &sfs->sfs_ncache[h % SFS_NCACHE_SIZE];
+}
+
+static
+bool
+sfs_nc_lookup(struct sfs_vnode *dir, const char *name,
+	      uint32_t *ino, int *slot)
+{
+	struct sfs_ncentry *nc;
+
+	nc = sfs_nc_entry(dir, name);
+	if (nc->nc_dirino != dir->sv_ino || strcmp(nc->nc_name, name)) {
+		return false;
+	}
+	*ino = nc->nc_ino;
+	*slot = nc->nc_slot;
+	return true;
+}
+
+static
+void
+sfs_nc_enter(struct sfs_vnode *dir, const char *name, uint32_t ino, int slot)
+{
+	struct sfs_ncentry *nc;
+
+	if (strlen(name) + 1 > sizeof(nc->nc_name)) {
+		return;
+	}
+	nc = sfs_nc_entry(dir, name);
+	nc->nc_dirino = dir->sv_ino;
+	nc->nc_ino = ino;
+	nc->nc_slot = slot;
+	strcpy(nc->nc_name, name);
+}
+
+/*
+ * Drop the entry for SLOT of DIR, or (if SLOT is -1) all of DIR's.
+ */
+static
+void
+sfs_nc_forget(struct sfs_vnode *dir, int slot)
+{
+	struct sfs_fs *sfs = dir->sv_absvn.vn_fs->fs_data;
+	unsigned i;
+
+	for (i=0; i<SFS_NCACHE_SIZE; i++) {
+		struct sfs_ncentry *nc = &sfs->sfs_ncache[i];
+
+		if (nc->nc_dirino == dir->sv_ino &&
+		    (slot < 0 || nc->nc_slot == slot)) {
+			nc->nc_dirino = 0;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Hashed directories
+
+static int sfs_dirlinear_findname(struct sfs_vnode *sv, const char *name,
+		uint32_t *ino, int *slot, int *emptyslot);
+
+/*
+ * Look up NAME in a hashed directory. Only the blocks an entry for
+ * NAME could be in are read. If EMPTYSLOT is not NULL, *EMPTYSLOT
+ * should be -1 on entry and gets set to the first free slot seen,
+ * which is where NAME belongs if it's added.
+ */
+static
+int
+sfs_dirhash_findname(struct sfs_vnode *sv, const char *name,
+		     uint32_t *ino, int *slot, int *emptyslot)
+{
+	/* Since we're using a static buffer, we'd better be locked. */
+	static struct sfs_direntry sds[SFS_DIRPERBLOCK];
+
+	uint32_t nbuckets = sv->sv_i.sfi_dirbuckets;
+	uint32_t home, bucket, i, j;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	home = sfs_dir_hash(name) & (nbuckets - 1);
+	for (i=0; i <= sv->sv_i.sfi_dirprobe && i < nbuckets; i++) {
+		bucket = (home + i) & (nbuckets - 1);
+		result = sfs_dir_blockio(sv, bucket, sds, UIO_READ);
+		if (result) {
+			return result;
+		}
+		for (j=0; j<SFS_DIRPERBLOCK; j++) {
+			if (sds[j].sfd_ino == SFS_NOINO) {
+				if (emptyslot != NULL && *emptyslot < 0) {
+					*emptyslot = bucket*SFS_DIRPERBLOCK + j;
+				}
+				continue;
+			}
+			sds[j].sfd_name[sizeof(sds[j].sfd_name)-1] = 0;
+			if (!strcmp(sds[j].sfd_name, name)) {
+				*ino = sds[j].sfd_ino;
+				*slot = bucket*SFS_DIRPERBLOCK + j;
+				return 0;
+			}
+		}
+	}
+	return ENOENT;
+}
+
+/*
+ * Find a free slot for NAME in a hashed directory past the current
+ * probe limit, and raise the limit to cover it.
+ */
+static
+int
+sfs_dirhash_extend_probe(struct sfs_vnode *sv, const char *name, int *slot)
+{
+	static struct sfs_direntry sds[SFS_DIRPERBLOCK];
+
+	uint32_t nbuckets = sv->sv_i.sfi_dirbuckets;
+	uint32_t home, bucket, i, j;
+	int result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	home = sfs_dir_hash(name) & (nbuckets - 1);
+	for (i = sv->sv_i.sfi_dirprobe + 1; i < nbuckets; i++) {
+		bucket = (home + i) & (nbuckets - 1);
+		result = sfs_dir_blockio(sv, bucket, sds, UIO_READ);
+		if (result) {
+			return result;
+		}
+		for (j=0; j<SFS_DIRPERBLOCK; j++) {
+			if (sds[j].sfd_ino == SFS_NOINO) {
+				sv->sv_i.sfi_dirprobe = i;
+				sv->sv_dirty = true;
+				*slot = bucket*SFS_DIRPERBLOCK + j;
+				return 0;
+			}
+		}
+	}
+	return ENOSPC;
+}
+
+/*
+ * Put an entry into a hashed directory, assuming the name isn't
+ * already there. Doesn't touch sfi_dirused.
+ */
+static
+int
+sfs_dirhash_insert(struct sfs_vnode *sv, struct sfs_direntry *sd, int *slot)
+{
+	uint32_t dummyino;
+	int dummyslot, emptyslot = -1;
+	int result;
+
+	result = sfs_dirhash_findname(sv, sd->sfd_name, &dummyino,
+				      &dummyslot, &emptyslot);
+	if (result != ENOENT) {
+		KASSERT(result != 0);
+		return result;
+	}
+	if (emptyslot < 0) {
+		result = sfs_dirhash_extend_probe(sv, sd->sfd_name,
+						  &emptyslot);
+		if (result) {
+			return result;
+		}
+	}
+	*slot = emptyslot;
+	return sfs_writedir(sv, emptyslot, sd);
+}
+
+/*
+ * Turn a hashed directory back into a linear one. Every entry on disk
+ * is valid where it is, so this is just a matter of clearing the
+ * hash fields. Entries FIRST on of SDS (if SDS isn't NULL) are ones
+ * a failed rehash was holding only in memory; they go in free slots.
+ * If even that fails they're lost, and there's no safe way to go on.
+ */
+static
+void
+sfs_dir_unhash(struct sfs_vnode *sv, struct sfs_direntry *sds,
+	       uint32_t first)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	uint32_t dummyino, j;
+	int dummyslot, emptyslot;
+	int result;
+
+	sv->sv_i.sfi_dirbuckets = 0;
+	sv->sv_i.sfi_dirprobe = 0;
+	sv->sv_i.sfi_dirused = 0;
+	sv->sv_dirty = true;
+	sfs_nc_forget(sv, -1);
+
+	for (j=first; sds != NULL && j<SFS_DIRPERBLOCK; j++) {
+		if (sds[j].sfd_ino == SFS_NOINO) {
+			continue;
+		}
+		emptyslot = -1;
+		result = sfs_dirlinear_findname(sv, sds[j].sfd_name,
+						&dummyino, &dummyslot,
+						&emptyslot);
+		if (result == ENOENT) {
+			if (emptyslot < 0) {
+				emptyslot = sfs_dir_nentries(sv);
+			}
+			result = sfs_writedir(sv, emptyslot, &sds[j]);
+		}
+		else if (result == 0) {
+			/* Can't happen: it was only in memory */
+			result = EEXIST;
+		}
+		if (result) {
+			panic("sfs: %s: directory %u: lost entry %s "
+			      "(inode %u) after failed rehash: %s\n",
+			      sfs->sfs_sb.sb_volname, sv->sv_ino,
+			      sds[j].sfd_name, sds[j].sfd_ino,
+			      strerror(result));
+		}
+	}
+}
+
+/*
+ * Lay a directory out again as a hashed directory with NBUCKETS
+ * buckets. This is used both to convert a linear directory and to
+ * grow a hashed one.
+ *
+ * Each of the existing blocks is read, cleared on disk, and its
+ * entries put back where they now belong. An entry can land in a
+ * block we haven't got to yet and so get moved twice; that's
+ * harmless. It costs a pass over the directory, but only happens
+ * when the number of entries doubles.
+ *
+ * All the new blocks are allocated before anything is moved, so
+ * running out of space fails cleanly. Once entries start moving, the
+ * new layout always has room for them, so only an I/O error can stop
+ * us; then the directory goes back to being linear (see
+ * sfs_dir_unhash).
+ */
+static
+int
+sfs_dir_rehash(struct sfs_vnode *sv, uint32_t nbuckets)
+{
+	static struct sfs_direntry zeros[SFS_DIRPERBLOCK];
+
+	struct sfs_direntry *sds;
+	uint32_t oldblocks, used, b, j, pending;
+	daddr_t diskblock;
+	int slot, result;
+
+	KASSERT(vfs_biglock_do_i_hold());
+	KASSERT((nbuckets & (nbuckets - 1)) == 0);
+	KASSERT(nbuckets <= SFS_DIRHASH_MAXBUCKETS);
+
+	oldblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+	KASSERT(nbuckets >= oldblocks);
+
+	sds = kmalloc(SFS_BLOCKSIZE);
+	if (sds == NULL) {
+		return ENOMEM;
+	}
+
+	/* Count the entries first; some will get looked at twice below */
+	used = 0;
+	for (b=0; b<oldblocks; b++) {
+		result = sfs_dir_blockio(sv, b, sds, UIO_READ);
+		if (result) {
+			kfree(sds);
+			return result;
+		}
+		for (j=0; j<SFS_DIRPERBLOCK; j++) {
+			if (sds[j].sfd_ino != SFS_NOINO) {
+				used++;
+			}
+		}
+	}
+
+	/* Get the new blocks (zeroed) now; give them back if we can't */
+	for (b=oldblocks; b<nbuckets; b++) {
+		result = sfs_bmap(sv, b, true, &diskblock, NULL);
+		if (result) {
+			sfs_itrunc(sv, sv->sv_i.sfi_size);
+			kfree(sds);
+			return result;
+		}
+	}
+
+	/* Switch over. */
+	sv->sv_i.sfi_size = nbuckets * SFS_BLOCKSIZE;
+	sv->sv_i.sfi_dirbuckets = nbuckets;
+	sv->sv_i.sfi_dirprobe = 0;
+	sv->sv_i.sfi_dirused = used;
+	sv->sv_dirty = true;
+	sfs_nc_forget(sv, -1);
+
+	/* Entries of SDS from PENDING on are only in memory */
+	for (b=0; b<oldblocks; b++) {
+		pending = SFS_DIRPERBLOCK;
+		result = sfs_dir_blockio(sv, b, sds, UIO_READ);
+		if (result) {
+			goto fail;
+		}
+		result = sfs_dir_blockio(sv, b, zeros, UIO_WRITE);
+		if (result) {
+			goto fail;
+		}
+		for (pending=0; pending<SFS_DIRPERBLOCK; pending++) {
+			j = pending;
+			if (sds[j].sfd_ino == SFS_NOINO) {
+				continue;
+			}
+			sds[j].sfd_name[sizeof(sds[j].sfd_name)-1] = 0;
+			result = sfs_dirhash_insert(sv, &sds[j], &slot);
+			if (result) {
+				goto fail;
+			}
+		}
+	}
+
+	kfree(sds);
+	return 0;
+
+ fail:
+	sfs_dir_unhash(sv, sds, pending);
+	kfree(sds);
+	return result;
+}
+
+/*
+ * Decide whether a directory should be (re)hashed before adding
+ * another entry, and if so do it. NEEDSLOT says whether the linear
+ * search came up without a free slot, i.e. adding the entry would
+ * make a linear directory bigger.
+ */
+static
+int
+sfs_dir_maybe_rehash(struct sfs_vnode *sv, bool needslot)
+{
+	uint32_t nbuckets = sv->sv_i.sfi_dirbuckets;
+	uint32_t nblocks;
+
+	if (nbuckets == 0) {
+		/* Linear: convert once it's about to outgrow the minimum */
+		nblocks = DIVROUNDUP(sv->sv_i.sfi_size, SFS_BLOCKSIZE);
+		if (!needslot ||
+		    sv->sv_i.sfi_size < SFS_DIRHASH_MINBLOCKS*SFS_BLOCKSIZE ||
+		    nblocks >= SFS_DIRHASH_MAXBUCKETS) {
+			/* too big to hash (see sfs_dir_link) */
+			return 0;
+		}
+		nbuckets = 1;
+		while (nbuckets < 2*nblocks &&
+		       nbuckets < SFS_DIRHASH_MAXBUCKETS) {
+			nbuckets *= 2;
+		}
+		return sfs_dir_rehash(sv, nbuckets);
+	}
+
+	/* Hashed: double when more than 3/4 full */
+	if (nbuckets < SFS_DIRHASH_MAXBUCKETS &&
+	    (sv->sv_i.sfi_dirused + 1) * 4 > nbuckets*SFS_DIRPERBLOCK * 3) {
+		return sfs_dir_rehash(sv, nbuckets * 2);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// Directory operations
+
+/*
+ * Search a linear directory for a particular filename, as per
+ * sfs_dir_findname.
+ */
+static
+int
+sfs_dirlinear_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot)
 {
 	struct sfs_direntry tsd;
@@ -133,12 +554,8 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 				KASSERT(found==0);
 
 				found = 1;
-				if (slot != NULL) {
-					*slot = i;
-				}
-				if (ino != NULL) {
-					*ino = tsd.sfd_ino;
-				}
+				*slot = i;
+				*ino = tsd.sfd_ino;
 			}
 		}
 	}
@@ -146,6 +563,47 @@ sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 	return found ? 0 : ENOENT;
 }
 
+/*
+ * Search a directory for a particular filename in a directory, and
+ * return its inode number, its slot, and/or the slot number of an
+ * empty directory slot if one is found.
+ *
+ * The name cache is consulted first, unless an empty slot is wanted
+ * (the cache only knows about names that exist).
+ */
+int
+sfs_dir_findname(struct sfs_vnode *sv, const char *name,
+		uint32_t *ino, int *slot, int *emptyslot)
+{
+	uint32_t tino;
+	int tslot;
+	int result;
+
+	if (emptyslot == NULL && sfs_nc_lookup(sv, name, &tino, &tslot)) {
+		result = 0;
+	}
+	else if (sv->sv_i.sfi_dirbuckets != 0) {
+		result = sfs_dirhash_findname(sv, name, &tino, &tslot,
+					      emptyslot);
+	}
+	else {
+		result = sfs_dirlinear_findname(sv, name, &tino, &tslot,
+						emptyslot);
+	}
+	if (result) {
+		return result;
+	}
+
+	sfs_nc_enter(sv, name, tino, tslot);
+	if (slot != NULL) {
+		*slot = tslot;
+	}
+	if (ino != NULL) {
+		*ino = tino;
+	}
+	return 0;
+}
+
 /*
  * Create a link in a directory to the specified inode by number, with
  * the specified name, and optionally hand back the slot.
@@ -170,23 +628,58 @@ sfs_dir_link(struct sfs_vnode *sv, const char *name, uint32_t ino, int *slot)
 		return ENAMETOOLONG;
 	}
 
-	/* If we didn't get an empty slot, add the entry at the end. */
-	if (emptyslot < 0) {
-		emptyslot = sfs_dir_nentries(sv);
-	}
-
 	/* Set up the entry. */
 	bzero(&sd, sizeof(sd));
 	sd.sfd_ino = ino;
 	strcpy(sd.sfd_name, name);
 
+	/* Rehash if the directory is getting big or full. */
+	result = sfs_dir_maybe_rehash(sv, emptyslot < 0);
+	if (result) {
+		return result;
+	}
+
+	if (sv->sv_i.sfi_dirbuckets != 0) {
+		result = sfs_dirhash_insert(sv, &sd, &emptyslot);
+		if (result == ENOSPC) {
+			/*
+			 * Every bucket is full, which only happens at
+			 * SFS_DIRHASH_MAXBUCKETS. A linear directory
+			 * can grow further, so become one and add the
+			 * entry at the end.
+			 */
+			sfs_dir_unhash(sv, NULL, 0);
+			emptyslot = -1;
+		}
+		else if (result) {
+			return result;
+		}
+		else {
+			sv->sv_i.sfi_dirused++;
+			sv->sv_dirty = true;
+		}
+	}
+	if (sv->sv_i.sfi_dirbuckets == 0) {
+		/* If we didn't get an empty slot, add the entry at the end. */
+		if (emptyslot < 0) {
+			emptyslot = sfs_dir_nentries(sv);
+		}
+
+		/* Write the entry. */
+		result = sfs_writedir(sv, emptyslot, &sd);
+		if (result) {
+			return result;
+		}
+	}
+
+	sfs_nc_enter(sv, name, ino, emptyslot);
+
 	/* Hand back the slot, if so requested. */
 	if (slot) {
 		*slot = emptyslot;
 	}
 
-	/* Write the entry. */
-	return sfs_writedir(sv, emptyslot, &sd);
+	return 0;
 }
 
 /*
@@ -196,13 +689,25 @@ int
 sfs_dir_unlink(struct sfs_vnode *sv, int slot)
 {
 	struct sfs_direntry sd;
+	int result;
 
 	/* Initialize a suitable directory entry... */
 	bzero(&sd, sizeof(sd));
 	sd.sfd_ino = SFS_NOINO;
 
 	/* ... and write it */
-	return sfs_writedir(sv, slot, &sd);
+	result = sfs_writedir(sv, slot, &sd);
+	if (result) {
+		return result;
+	}
+
+	sfs_nc_forget(sv, slot);
+	if (sv->sv_i.sfi_dirbuckets != 0) {
+		KASSERT(sv->sv_i.sfi_dirused > 0);
+		sv->sv_i.sfi_dirused--;
+		sv->sv_dirty = true;
+	}
+	return 0;
 }
 
 /*
@@ -237,3 +742,86 @@ sfs_lookonce(struct sfs_vnode *sv, const char *name,
 	return 0;
 }
 
+
+/*
+ * Read names out of a directory, starting at the slot number in
+ * uio_offset and skipping free slots, and leave uio_offset at the
+ * slot after the last one used. This is the same for linear and
+ * hashed directories; only the order differs.
+ *
+ * If MANY is false this is getdirentry: copy out one bare name. If
+ * it's true this is getdirentries: copy out struct dirent records
+ * until the next one doesn't fit. It's an error if not even the
+ * first one fits. The type is only filled in for objects whose
+ * inodes are already in memory; it isn't worth a disk read each.
+ */
+int
+sfs_dir_getentries(struct sfs_vnode *sv, struct uio *uio, bool many)
+{
+	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_direntry sd;
+	struct dirent *d;
+	size_t namlen, reclen;
+	int nentries, slot, done, result;
+
+	KASSERT(uio->uio_offset >= 0);
+	nentries = sfs_dir_nentries(sv);
+
+	d = kmalloc(_DIRENT_RECLEN(SFS_NAMELEN));
+	if (d == NULL) {
+		return ENOMEM;
+	}
+
+	result = 0;
+	done = 0;
+	for (slot = uio->uio_offset; slot < nentries; slot++) {
+		result = sfs_readdir(sv, slot, &sd);
+		if (result) {
+			break;
+		}
+		if (sd.sfd_ino == SFS_NOINO) {
+			continue;
+		}
+		sd.sfd_name[sizeof(sd.sfd_name)-1] = 0;
+		namlen = strlen(sd.sfd_name);
+
+		if (!many) {
+			result = uiomove(sd.sfd_name, namlen, uio);
+			if (result == 0) {
+				slot++;
+			}
+			break;
+		}
+
+		reclen = _DIRENT_RECLEN(namlen);
+		if (reclen > uio->uio_resid) {
+			if (done == 0) {
+				result = EINVAL;
+			}
+			break;
+		}
+		bzero(d, reclen);
+		d->d_ino = sd.sfd_ino;
+		d->d_reclen = reclen;
+		switch (sfs_peektype(sfs, sd.sfd_ino)) {
+		    case SFS_TYPE_FILE: d->d_type = DT_REG; break;
+		    case SFS_TYPE_DIR: d->d_type = DT_DIR; break;
+		    default: d->d_type = DT_UNKNOWN; break;
+		}
+		d->d_namlen = namlen;
+		strcpy(d->d_name, sd.sfd_name);
+		result = uiomove(d, reclen, uio);
+		if (result) {
+			break;
+		}
+		done++;
+	}
+
+	kfree(d);
+
+	/* the offset is a slot number, not a byte count */
+	uio->uio_offset = slot;
+
+	/* if we got some entries, report any error next time */
+	return done > 0 ? 0 : result;
+}
@@ -112,13 +112,14 @@ static
 int
 sfs_sync_vnodes(struct sfs_fs *sfs)
 {
-	unsigned i, num;
+	struct sfs_vnode *sv;
+	unsigned i;
 
-	/* Go over the array of loaded vnodes, syncing as we go. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	for (i=0; i<num; i++) {
-		struct vnode *v = vnodearray_get(sfs->sfs_vnodes, i);
-		VOP_FSYNC(v);
+	/* Go over the table of loaded vnodes, syncing as we go. */
+	for (i=0; i<SFS_VNHASH_SIZE; i++) {
+		for (sv = sfs->sfs_vnhash[i]; sv != NULL; sv = sv->sv_hashnext) {
+			VOP_FSYNC(&sv->sv_absvn);
+		}
 	}
 	return 0;
 }
@@ -233,6 +234,32 @@ sfs_sync(struct fs *fs)
 	return 0;
 }
 
+/*
+ * Write-back routine, called every so often by the syncer. Writes
+ * out the data that has been sitting in buffers for a while, then
+ * the freemap and superblock if that changed them.
+ */
+static
+int
+sfs_writeback(struct fs *fs)
+{
+	struct sfs_fs *sfs = fs->fs_data;
+	int result;
+
+	vfs_biglock_acquire();
+
+	result = sfs_buf_flushaged(sfs);
+	if (result == 0) {
+		result = sfs_sync_freemap(sfs);
+	}
+	if (result == 0) {
+		result = sfs_sync_superblock(sfs);
+	}
+
+	vfs_biglock_release();
+	return result;
+}
+
 /*
  * Routine to retrieve the volume name. Filesystems can be referred
  * to by their volume name followed by a colon as well as the name
@@ -262,7 +289,10 @@ sfs_fs_destroy(struct sfs_fs *sfs)
 	if (sfs->sfs_freemap != NULL) {
 		bitmap_destroy(sfs->sfs_freemap);
 	}
-	vnodearray_destroy(sfs->sfs_vnodes);
+	sfs_buf_cleanup(sfs);
+	kfree(sfs->sfs_ncache);
+	KASSERT(sfs->sfs_nvnodes == 0);
+	kfree(sfs->sfs_vnhash);
 	KASSERT(sfs->sfs_device == NULL);
 	kfree(sfs);
 }
@@ -281,7 +311,7 @@ sfs_unmount(struct fs *fs)
 	vfs_biglock_acquire();
 
 	/* Do we have any files open? If so, can't unmount. */
-	if (vnodearray_num(sfs->sfs_vnodes) > 0) {
+	if (sfs->sfs_nvnodes > 0) {
 		vfs_biglock_release();
 		return EBUSY;
 	}
@@ -306,6 +336,7 @@ sfs_unmount(struct fs *fs)
  */
 static const struct fs_ops sfs_fsops = {
 	.fsop_sync = sfs_sync,
+	.fsop_writeback = sfs_writeback,
 	.fsop_getvolname = sfs_getvolname,
 	.fsop_getroot = sfs_getroot,
 	.fsop_unmount = sfs_unmount,
@@ -321,6 +352,7 @@ struct sfs_fs *
 sfs_fs_create(void)
 {
 	struct sfs_fs *sfs;
+	unsigned i;
 
 	/*
 	 * Make sure our on-disk structures aren't messed up
@@ -328,6 +360,8 @@ sfs_fs_create(void)
 	COMPILE_ASSERT(sizeof(struct sfs_superblock)==SFS_BLOCKSIZE);
 	COMPILE_ASSERT(sizeof(struct sfs_dinode)==SFS_BLOCKSIZE);
 	COMPILE_ASSERT(SFS_BLOCKSIZE % sizeof(struct sfs_direntry) == 0);
+	COMPILE_ASSERT(SFS_DIRHASH_MAXBUCKETS <=
+		       SFS_NDIRECT + SFS_NINDIRECT * SFS_DBPERIDB);
 
 	/* Allocate object */
 	sfs = kmalloc(sizeof(struct sfs_fs));
@@ -342,6 +376,7 @@ sfs_fs_create(void)
 	/* abstract vfs-level fs */
 	sfs->sfs_absfs.fs_data = sfs;
 	sfs->sfs_absfs.fs_ops = &sfs_fsops;
+	sfs->sfs_absfs.fs_nonegcache = false;
 
 	/* superblock */
 	/* (ignore sfs_super, we'll read in over it shortly) */
@@ -351,17 +386,40 @@ sfs_fs_create(void)
 	sfs->sfs_device = NULL;
 
 	/* vnode table */
-	sfs->sfs_vnodes = vnodearray_create();
-	if (sfs->sfs_vnodes == NULL) {
+	sfs->sfs_vnhash = kmalloc(SFS_VNHASH_SIZE * sizeof(struct sfs_vnode *));
+	if (sfs->sfs_vnhash == NULL) {
 		goto cleanup_object;
 	}
+	for (i=0; i<SFS_VNHASH_SIZE; i++) {
+		sfs->sfs_vnhash[i] = NULL;
+	}
+	sfs->sfs_nvnodes = 0;
 
 	/* freemap */
 	sfs->sfs_freemap = NULL;
 	sfs->sfs_freemapdirty = false;
 
+	/* name cache */
+	sfs->sfs_ncache = kmalloc(SFS_NCACHE_SIZE * sizeof(struct sfs_ncentry));
+	if (sfs->sfs_ncache == NULL) {
+		goto cleanup_vnodes;
+	}
+	bzero(sfs->sfs_ncache, SFS_NCACHE_SIZE * sizeof(struct sfs_ncentry));
+
+	/* write-back buffers */
+	sfs->sfs_nfree = 0;
+	sfs->sfs_reserved = 0;
+	sfs->sfs_bufs = NULL;
+	if (sfs_buf_init(sfs)) {
+		goto cleanup_ncache;
+	}
+
 	return sfs;
 
+cleanup_ncache:
+	kfree(sfs->sfs_ncache);
+cleanup_vnodes:
+	kfree(sfs->sfs_vnhash);
 cleanup_object:
 	kfree(sfs);
 fail:
@@ -387,6 +445,7 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 {
 	int result;
 	struct sfs_fs *sfs;
+	uint32_t i;
 
 	vfs_biglock_acquire();
 
@@ -464,6 +523,13 @@ sfs_domount(void *options, struct device *dev, struct fs **ret)
 		return result;
 	}
 
+	/* Count the free blocks */
+	for (i=0; i<SFS_FS_NBLOCKS(sfs); i++) {
+		if (!bitmap_isset(sfs->sfs_freemap, i)) {
+			sfs->sfs_nfree++;
+		}
+	}
+
 	/* Hand back the abstract fs */
 	*ret = &sfs->sfs_absfs;
 
@@ -40,6 +40,70 @@
 #include "sfsprivate.h"
 
 
+/*
+ * Table of loaded vnodes.
+ *
+ * This is a hash table on the inode number with doubly-linked
+ * chains, so vnodes can be found, added, and removed without looking
+ * at the others.
+ */
+
+static
+struct sfs_vnode **
+sfs_vnhash_chain(struct sfs_fs *sfs, uint32_t ino)
+{
+	return &sfs->sfs_vnhash[ino % SFS_VNHASH_SIZE];
+}
+
+static
+struct sfs_vnode *
+sfs_vnhash_find(struct sfs_fs *sfs, uint32_t ino)
+{
+	struct sfs_vnode *sv;
+
+	for (sv = *sfs_vnhash_chain(sfs, ino); sv != NULL;
+	     sv = sv->sv_hashnext) {
+		if (sv->sv_ino == ino) {
+			return sv;
+		}
+	}
+	return NULL;
+}
+
+static
+void
+sfs_vnhash_add(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	struct sfs_vnode **chain = sfs_vnhash_chain(sfs, sv->sv_ino);
+
+	sv->sv_hashprev = NULL;
+	sv->sv_hashnext = *chain;
+	if (*chain != NULL) {
+		(*chain)->sv_hashprev = sv;
+	}
+	*chain = sv;
+	sfs->sfs_nvnodes++;
+}
+
+static
+void
+sfs_vnhash_remove(struct sfs_fs *sfs, struct sfs_vnode *sv)
+{
+	if (sv->sv_hashprev != NULL) {
+		sv->sv_hashprev->sv_hashnext = sv->sv_hashnext;
+	}
+	else {
+		KASSERT(*sfs_vnhash_chain(sfs, sv->sv_ino) == sv);
+		*sfs_vnhash_chain(sfs, sv->sv_ino) = sv->sv_hashnext;
+	}
+	if (sv->sv_hashnext != NULL) {
+		sv->sv_hashnext->sv_hashprev = sv->sv_hashprev;
+	}
+	sv->sv_hashnext = sv->sv_hashprev = NULL;
+	KASSERT(sfs->sfs_nvnodes > 0);
+	sfs->sfs_nvnodes--;
+}
+
 /*
  * Write an on-disk inode structure back out to disk.
  */
@@ -70,7 +134,6 @@ sfs_reclaim(struct vnode *v)
 {
 	struct sfs_vnode *sv = v->vn_data;
 	struct sfs_fs *sfs = v->vn_fs->fs_data;
-	unsigned ix, i, num;
 	int result;
 
 	vfs_biglock_acquire();
@@ -93,14 +156,22 @@ sfs_reclaim(struct vnode *v)
 	}
 	spinlock_release(&v->vn_countlock);
 
-	/* If there are no on-disk references to the file either, erase it. */
+	/*
+	 * If there are no on-disk references to the file either, erase
+	 * it (which also throws away any buffered data). Otherwise,
+	 * write out any buffered data.
+	 */
 	if (sv->sv_i.sfi_linkcount == 0) {
 		result = sfs_itrunc(sv, 0);
-		if (result) {
-			vfs_biglock_release();
-			return result;
-		}
 	}
+	else {
+		result = sfs_buf_flushvnode(sv);
+	}
+	if (result) {
+		vfs_biglock_release();
+		return result;
+	}
+	KASSERT(sv->sv_nbufs == 0);
 
 	/* Sync the inode to disk */
 	result = sfs_sync_inode(sv);
@@ -115,21 +186,11 @@ sfs_reclaim(struct vnode *v)
 	}
 
 	/* Remove the vnode structure from the table in the struct sfs_fs. */
-	num = vnodearray_num(sfs->sfs_vnodes);
-	ix = num;
-	for (i=0; i<num; i++) {
-		struct vnode *v2 = vnodearray_get(sfs->sfs_vnodes, i);
-		struct sfs_vnode *sv2 = v2->vn_data;
-		if (sv2 == sv) {
-			ix = i;
-			break;
-		}
-	}
-	if (ix == num) {
+	if (sfs_vnhash_find(sfs, sv->sv_ino) != sv) {
 		panic("sfs: %s: reclaim vnode %u not in vnode pool\n",
 		      sfs->sfs_sb.sb_volname, sv->sv_ino);
 	}
-	vnodearray_remove(sfs->sfs_vnodes, ix);
+	sfs_vnhash_remove(sfs, sv);
 
 	vnode_cleanup(&sv->sv_absvn);
 
@@ -150,36 +211,25 @@ int
 sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		 struct sfs_vnode **ret)
 {
-	struct vnode *v;
 	struct sfs_vnode *sv;
 	const struct vnode_ops *ops;
-	unsigned i, num;
 	int result;
 
 	/* Look in the vnodes table */
-	num = vnodearray_num(sfs->sfs_vnodes);
-
-	/* Linear search. Is this too slow? You decide. */
-	for (i=0; i<num; i++) {
-		v = vnodearray_get(sfs->sfs_vnodes, i);
-		sv = v->vn_data;
-
+	sv = sfs_vnhash_find(sfs, ino);
+	if (sv != NULL) {
 		/* Every inode in memory must be in an allocated block */
 		if (!sfs_bused(sfs, sv->sv_ino)) {
 			panic("sfs: %s: Found inode %u in unallocated block\n",
 			      sfs->sfs_sb.sb_volname, sv->sv_ino);
 		}
 
-		if (sv->sv_ino==ino) {
-			/* Found */
-
-			/* forcetype is only allowed when creating objects */
-			KASSERT(forcetype==SFS_TYPE_INVAL);
+		/* forcetype is only allowed when creating objects */
+		KASSERT(forcetype==SFS_TYPE_INVAL);
 
-			VOP_INCREF(&sv->sv_absvn);
-			*ret = sv;
-			return 0;
-		}
+		VOP_INCREF(&sv->sv_absvn);
+		*ret = sv;
+		return 0;
 	}
 
 	/* Didn't have it loaded; load it */
@@ -241,20 +291,32 @@ sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 
 	/* Set the other fields in our vnode structure */
 	sv->sv_ino = ino;
+	sv->sv_nbufs = 0;
 
 	/* Add it to our table */
-	result = vnodearray_add(sfs->sfs_vnodes, &sv->sv_absvn, NULL);
-	if (result) {
-		vnode_cleanup(&sv->sv_absvn);
-		kfree(sv);
-		return result;
-	}
+	sfs_vnhash_add(sfs, sv);
 
 	/* Hand it back */
 	*ret = sv;
 	return 0;
 }
 
+/*
+ * Return the type of inode INO if it's loaded, or SFS_TYPE_INVAL if
+ * finding out would mean reading it from disk.
+ */
+int
+sfs_peektype(struct sfs_fs *sfs, uint32_t ino)
+{
+	struct sfs_vnode *sv;
+
+	sv = sfs_vnhash_find(sfs, ino);
+	if (sv == NULL) {
+		return SFS_TYPE_INVAL;
+	}
+	return sv->sv_i.sfi_type;
+}
+
 /*
  * Create a new filesystem object and hand back its vnode.
  */
@@ -266,10 +328,11 @@ sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret)
 
 	/*
 	 * First, get an inode. (Each inode is a block, and the inode
-	 * number is the block number, so just get a block.)
+	 * number is the block number, so just get a block.) It has
+	 * to be zeroed; sfs_loadvnode reads it back.
 	 */
 
-	result = sfs_balloc(sfs, &ino);
+	result = sfs_balloc(sfs, 0, true, &ino);
 	if (result) {
 		return result;
 	}
@@ -136,10 +136,12 @@ sfs_writeblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len)
 // File-level I/O
 
 /*
- * Do I/O to a block of a file that doesn't cover the whole block.  We
- * need to read in the original block first, even if we're writing, so
- * we don't clobber the portion of the block we're not intending to
- * write over.
+ * Do I/O to a block of a file that doesn't cover the whole block.
+ *
+ * Writes go into the block's write-back buffer, which is loaded from
+ * disk first if need be so we don't clobber the portion of the block
+ * we're not intending to write over. Reads come from the buffer if
+ * there is one; otherwise we read the block into a scratch area.
  *
  * SKIPSTART is the number of bytes to skip past at the beginning of
  * the sector; LEN is the number of bytes to actually read or write.
@@ -151,22 +153,17 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	      uint32_t skipstart, uint32_t len)
 {
 	/*
-	 * I/O buffer for handling partial sectors.
-	 *
-	 * Note: in real life (and when you've done the fs assignment)
-	 * you would get space from the disk buffer cache for this,
-	 * not use a static area.
+	 * I/O buffer for reading partial sectors.
 	 */
 	static char iobuf[SFS_BLOCKSIZE];
 
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
 	daddr_t diskblock;
 	uint32_t fileblock;
+	bool wasbuffered;
 	int result;
 
-	/* Allocate missing blocks if and only if we're writing */
-	bool doalloc = (uio->uio_rw==UIO_WRITE);
-
 	KASSERT(skipstart + len <= SFS_BLOCKSIZE);
 
 	/* We're using a global static buffer; it had better be locked */
@@ -175,8 +172,28 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	/* Compute the block offset of this block in the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
+	if (uio->uio_rw == UIO_WRITE) {
+		wasbuffered = sfs_buf_find(sv, fileblock) != NULL;
+		result = sfs_buf_get(sv, fileblock, true, &buf);
+		if (result) {
+			return result;
+		}
+		result = uiomove(buf->b_data + skipstart, len, uio);
+		if (result && !wasbuffered) {
+			/* Don't keep (and reserve space for) a failed write */
+			sfs_buf_release(buf);
+		}
+		return result;
+	}
+
+	/* Use the buffered copy if there is one */
+	buf = sfs_buf_find(sv, fileblock);
+	if (buf != NULL) {
+		return uiomove(buf->b_data + skipstart, len, uio);
+	}
+
 	/* Get the disk block number */
-	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
+	result = sfs_bmap(sv, fileblock, false, &diskblock, NULL);
 	if (result) {
 		return result;
 	}
@@ -184,9 +201,8 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	if (diskblock == 0) {
 		/*
 		 * There was no block mapped at this point in the file.
-		 * Zero the buffer.
+		 * Zero-fill.
 		 */
-		KASSERT(uio->uio_rw == UIO_READ);
 		bzero(iobuf, sizeof(iobuf));
 	}
 	else {
@@ -200,24 +216,9 @@ sfs_partialio(struct sfs_vnode *sv, struct uio *uio,
 	}
 
 	/*
-	 * Now perform the requested operation into/out of the buffer.
-	 */
-	result = uiomove(iobuf+skipstart, len, uio);
-	if (result) {
-		return result;
-	}
-
-	/*
-	 * If it was a write, write back the modified block.
+	 * Now copy out the requested part of the block.
 	 */
-	if (uio->uio_rw == UIO_WRITE) {
-		result = sfs_writeblock(sfs, diskblock, iobuf, sizeof(iobuf));
-		if (result) {
-			return result;
-		}
-	}
-
-	return 0;
+	return uiomove(iobuf+skipstart, len, uio);
 }
 
 /*
@@ -228,10 +229,11 @@ int
 sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 {
 	struct sfs_fs *sfs = sv->sv_absvn.vn_fs->fs_data;
+	struct sfs_buf *buf;
 	daddr_t diskblock;
 	uint32_t fileblock;
+	bool wasbuffered;
 	int result;
-	bool doalloc = (uio->uio_rw==UIO_WRITE);
 	off_t saveoff;
 	off_t diskoff;
 	off_t saveres;
@@ -240,8 +242,32 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	/* Get the block number within the file */
 	fileblock = uio->uio_offset / SFS_BLOCKSIZE;
 
-	/* Look up the disk block number */
-	result = sfs_bmap(sv, fileblock, doalloc, &diskblock);
+	if (uio->uio_rw == UIO_WRITE) {
+		/*
+		 * Write into the buffer. Since we're overwriting all
+		 * of it, there's no need to read the old contents.
+		 */
+		wasbuffered = sfs_buf_find(sv, fileblock) != NULL;
+		result = sfs_buf_get(sv, fileblock, false, &buf);
+		if (result) {
+			return result;
+		}
+		result = uiomove(buf->b_data, SFS_BLOCKSIZE, uio);
+		if (result && !wasbuffered) {
+			/* Don't write out a half-filled block */
+			sfs_buf_release(buf);
+		}
+		return result;
+	}
+
+	/* Use the buffered copy if there is one */
+	buf = sfs_buf_find(sv, fileblock);
+	if (buf != NULL) {
+		return uiomove(buf->b_data, SFS_BLOCKSIZE, uio);
+	}
+
+	/* Look up the disk block number. */
+	result = sfs_bmap(sv, fileblock, false, &diskblock, NULL);
 	if (result) {
 		return result;
 	}
@@ -249,11 +275,7 @@ sfs_blockio(struct sfs_vnode *sv, struct uio *uio)
 	if (diskblock == 0) {
 		/*
 		 * No block - fill with zeros.
-		 *
-		 * We must be reading, or sfs_bmap would have
-		 * allocated a block for us.
 		 */
-		KASSERT(uio->uio_rw == UIO_READ);
 		return uiomovezeros(SFS_BLOCKSIZE, uio);
 	}
 
@@ -295,8 +317,10 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	uint32_t nblocks, i;
 	int result = 0;
 	uint32_t origresid, extraresid = 0;
+	off_t okoffset;
 
 	origresid = uio->uio_resid;
+	okoffset = uio->uio_offset;
 
 	/*
 	 * If reading, check for EOF. If we can read a partial area,
@@ -336,6 +360,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 		}
 
 		/* Call sfs_partialio() to do it. */
+		okoffset = uio->uio_offset;
 		result = sfs_partialio(sv, uio, skip, len);
 		if (result) {
 			goto out;
@@ -353,6 +378,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	KASSERT(uio->uio_offset % SFS_BLOCKSIZE == 0);
 	nblocks = uio->uio_resid / SFS_BLOCKSIZE;
 	for (i=0; i<nblocks; i++) {
+		okoffset = uio->uio_offset;
 		result = sfs_blockio(sv, uio);
 		if (result) {
 			goto out;
@@ -365,6 +391,7 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 	KASSERT(uio->uio_resid < SFS_BLOCKSIZE);
 
 	if (uio->uio_resid > 0) {
+		okoffset = uio->uio_offset;
 		result = sfs_partialio(sv, uio, 0, uio->uio_resid);
 		if (result) {
 			goto out;
@@ -373,11 +400,18 @@ sfs_io(struct sfs_vnode *sv, struct uio *uio)
 
  out:
 
-	/* If writing and we did anything, adjust file length */
+	/*
+	 * If writing and we did anything, adjust file length. Not past
+	 * the start of a block that failed, though, as what went into
+	 * it may have been thrown away.
+	 */
+	if (result == 0) {
+		okoffset = uio->uio_offset;
+	}
 	if (uio->uio_resid != origresid &&
 	    uio->uio_rw == UIO_WRITE &&
-	    uio->uio_offset > (off_t)sv->sv_i.sfi_size) {
-		sv->sv_i.sfi_size = uio->uio_offset;
+	    okoffset > (off_t)sv->sv_i.sfi_size) {
+		sv->sv_i.sfi_size = okoffset;
 		sv->sv_dirty = true;
 	}
 
@@ -411,7 +445,7 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 	uint32_t vnblock;
 	uint32_t blockoffset;
 	daddr_t diskblock;
-	bool doalloc;
+	bool doalloc, isnew;
 	int result;
 
 	/*
@@ -432,7 +466,7 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 
 	/* Get the disk block number */
 	doalloc = (rw == UIO_WRITE);
-	result = sfs_bmap(sv, vnblock, doalloc, &diskblock);
+	result = sfs_bmap(sv, vnblock, doalloc, &diskblock, &isnew);
 	if (result) {
 		return result;
 	}
@@ -446,10 +480,17 @@ sfs_metaio(struct sfs_vnode *sv, off_t actualpos, void *data, size_t len,
 		return 0;
 	}
 
-	/* Read the block */
-	result = sfs_readblock(sfs, diskblock, metaiobuf, sizeof(metaiobuf));
-	if (result) {
-		return result;
+	if (isnew) {
+		/* Fresh block; its disk contents are junk, not zeros */
+		bzero(metaiobuf, sizeof(metaiobuf));
+	}
+	else {
+		/* Read the block */
+		result = sfs_readblock(sfs, diskblock, metaiobuf,
+				       sizeof(metaiobuf));
+		if (result) {
+			return result;
+		}
 	}
 
 	if (rw == UIO_READ) {
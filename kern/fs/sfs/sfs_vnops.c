@@ -128,6 +128,44 @@ sfs_write(struct vnode *v, struct uio *uio)
 	return result;
 }
 
+/*
+ * Called for getdirentry(). sfs_dir_getentries() does the work.
+ */
+static
+int
+sfs_getdirentry(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	KASSERT(uio->uio_rw==UIO_READ);
+
+	vfs_biglock_acquire();
+	result = sfs_dir_getentries(sv, uio, false);
+	vfs_biglock_release();
+
+	return result;
+}
+
+/*
+ * Called for getdirentries(). sfs_dir_getentries() does the work.
+ */
+static
+int
+sfs_getdirentries(struct vnode *v, struct uio *uio)
+{
+	struct sfs_vnode *sv = v->vn_data;
+	int result;
+
+	KASSERT(uio->uio_rw==UIO_READ);
+
+	vfs_biglock_acquire();
+	result = sfs_dir_getentries(sv, uio, true);
+	vfs_biglock_release();
+
+	return result;
+}
+
 /*
  * Called for ioctl()
  */
@@ -225,7 +263,10 @@ sfs_fsync(struct vnode *v)
 	int result;
 
 	vfs_biglock_acquire();
-	result = sfs_sync_inode(sv);
+	result = sfs_buf_flushvnode(sv);
+	if (result == 0) {
+		result = sfs_sync_inode(sv);
+	}
 	vfs_biglock_release();
 
 	return result;
@@ -470,6 +511,15 @@ sfs_rename(struct vnode *d1, const char *n1,
 	g1->sv_i.sfi_linkcount++;
 	g1->sv_dirty = true;
 
+	/*
+	 * Adding the new name may have rehashed the directory, which
+	 * moves entries around, so find the old name's slot again.
+	 */
+	result = sfs_dir_findname(sv, n1, NULL, &slot1, NULL);
+	if (result) {
+		goto puke_harder;
+	}
+
 	/* Unlink the old slot */
 	result = sfs_dir_unlink(sv, slot1);
 	if (result) {
@@ -593,8 +643,10 @@ const struct vnode_ops sfs_fileops = {
 	.vop_read = sfs_read,
 	.vop_readlink = vopfail_uio_notdir,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirentries = vopfail_uio_notdir,
 	.vop_write = sfs_write,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vnode_pollready,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
@@ -626,9 +678,11 @@ const struct vnode_ops sfs_dirops = {
 
 	.vop_read = vopfail_uio_isdir,
 	.vop_readlink = vopfail_uio_inval,
-	.vop_getdirentry = vopfail_uio_nosys,
+	.vop_getdirentry = sfs_getdirentry,
+	.vop_getdirentries = sfs_getdirentries,
 	.vop_write = vopfail_uio_isdir,
 	.vop_ioctl = sfs_ioctl,
+	.vop_poll = vnode_pollready,
 	.vop_stat = sfs_stat,
 	.vop_gettype = sfs_gettype,
 	.vop_isseekable = sfs_isseekable,
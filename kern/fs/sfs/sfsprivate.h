@@ -43,15 +43,28 @@ extern const struct vnode_ops sfs_dirops;
 
 
 /* Functions in sfs_balloc.c */
-int sfs_balloc(struct sfs_fs *sfs, daddr_t *diskblock);
+int sfs_clearblock(struct sfs_fs *sfs, daddr_t block);
+int sfs_balloc(struct sfs_fs *sfs, daddr_t goal, bool doclear,
+		daddr_t *diskblock);
 void sfs_bfree(struct sfs_fs *sfs, daddr_t diskblock);
 int sfs_bused(struct sfs_fs *sfs, daddr_t diskblock);
 
 /* Functions in sfs_bmap.c */
 int sfs_bmap(struct sfs_vnode *sv, uint32_t fileblock, bool doalloc,
-		daddr_t *diskblock);
+		daddr_t *diskblock, bool *isnew);
 int sfs_itrunc(struct sfs_vnode *sv, off_t len);
 
+/* Functions in sfs_buf.c */
+int sfs_buf_init(struct sfs_fs *sfs);
+void sfs_buf_cleanup(struct sfs_fs *sfs);
+struct sfs_buf *sfs_buf_find(struct sfs_vnode *sv, uint32_t fileblock);
+int sfs_buf_get(struct sfs_vnode *sv, uint32_t fileblock, bool fill,
+		struct sfs_buf **ret);
+int sfs_buf_flushvnode(struct sfs_vnode *sv);
+int sfs_buf_flushaged(struct sfs_fs *sfs);
+void sfs_buf_release(struct sfs_buf *b);
+void sfs_buf_discard(struct sfs_vnode *sv, uint32_t fromblock);
+
 /* Functions in sfs_dir.c */
 int sfs_dir_findname(struct sfs_vnode *sv, const char *name,
 		uint32_t *ino, int *slot, int *emptyslot);
@@ -61,6 +74,7 @@ int sfs_dir_unlink(struct sfs_vnode *sv, int slot);
 int sfs_lookonce(struct sfs_vnode *sv, const char *name,
 		struct sfs_vnode **ret,
 		int *slot);
+int sfs_dir_getentries(struct sfs_vnode *sv, struct uio *uio, bool many);
 
 /* Functions in sfs_inode.c */
 int sfs_sync_inode(struct sfs_vnode *sv);
@@ -69,6 +83,7 @@ int sfs_loadvnode(struct sfs_fs *sfs, uint32_t ino, int forcetype,
 		struct sfs_vnode **ret);
 int sfs_makeobj(struct sfs_fs *sfs, int type, struct sfs_vnode **ret);
 int sfs_getroot(struct fs *fs, struct vnode **ret);
+int sfs_peektype(struct sfs_fs *sfs, uint32_t ino);
 
 /* Functions in sfs_io.c */
 int sfs_readblock(struct sfs_fs *sfs, daddr_t block, void *data, size_t len);
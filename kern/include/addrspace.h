@@ -39,6 +39,7 @@
 #include "opt-dumbvm.h"
 
 struct vnode;
+struct rwlock;
 
 
 /*
@@ -71,6 +72,7 @@ struct addrspace {
         size_t as_npages2;
         paddr_t as_stackpbase;
 #else
+        struct rwlock *as_regionlock;   /* protects regions */
         struct region_spec *regions;
 #endif
 };
@@ -113,6 +115,15 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_threadstack - set up the stack for user thread SLOT (see
+ *                struct uthread in proc.h), below the main stack.
+ *                Hands back its initial stack pointer.
+ *
+ *    as_remove_threadstack - take a thread stack away again.
+ *
+ *    as_remove_region - unmap the region starting at VADDR and free
+ *                its pages, shooting them out of every CPU's TLB.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -131,8 +142,19 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_threadstack(struct addrspace *as, unsigned slot,
+                                        vaddr_t *initstackptr);
+void              as_remove_threadstack(struct addrspace *as, unsigned slot);
+int               as_remove_region(struct addrspace *as, vaddr_t vaddr);
 struct region_spec *as_check_valid_addr(struct addrspace *as, vaddr_t addr);
 
+/*
+ * The region list is read on every page fault but only changed while
+ * loading a program, so as_regionlock is a reader-writer lock; hold
+ * it (either way) around as_check_valid_addr and for as long as the
+ * region it returns is used.
+ */
+
 /*
  * Functions in loadelf.c
  *    load_elf - load an ELF user program executable into the current
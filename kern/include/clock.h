@@ -38,8 +38,16 @@
 
 
 /*
- * hardclock() is called on every CPU HZ times a second, possibly only
- * when the CPU is not idle, for scheduling.
+ * hardclock() is called on every CPU HZ times a second, but only when
+ * the CPU is not idle, for scheduling.
+ *
+ * The timer hardware is run one-shot: the MD code calls
+ * hardclock_interrupt() whenever this CPU's timer goes off, and that
+ * runs any expired timeouts, calls hardclock() if a tick is due, and
+ * reprograms the timer (with mainbus_settimer) for whichever comes
+ * next. hardclock_stop() and hardclock_start() are called by the idle
+ * loop; while stopped, the CPU only wakes for timeouts and every
+ * so often to look for threads to migrate.
  */
 
 /* hardclocks per second */
@@ -47,17 +55,45 @@
 
 void hardclock_bootstrap(void);
 void hardclock(void);
+void hardclock_interrupt(void);
+void hardclock_start(void);
+void hardclock_stop(void);
 
 /*
- * timerclock() is called on one CPU once a second to allow simple
- * timed operations. (This is a fairly simpleminded interface.)
+ * gettime() may be used to fetch the current time of day.
  */
-void timerclock(void);
+void gettime(struct timespec *ret);
 
 /*
- * gettime() may be used to fetch the current time of day.
+ * clock_nsecs() returns the current time in nanoseconds, for measuring
+ * intervals.
  */
-void gettime(struct timespec *ret);
+uint64_t clock_nsecs(void);
+
+/*
+ * Timeouts. timeout_add arranges for TO's function to be called from
+ * the timer interrupt on the current CPU, NSECS nanoseconds from now.
+ * The function runs in interrupt context and must not sleep.
+ *
+ * timeout_cancel takes TO back out if it hasn't gone off yet and
+ * returns true. Otherwise it returns false, after waiting for the
+ * function to finish if it is running on another CPU; so the caller
+ * must not hold anything the function needs. Either way, once
+ * timeout_cancel returns, the timeout is no longer in use and may be
+ * freed. A timeout may be added again from its own function.
+ */
+struct timeout {
+	struct timeout *to_next;	/* Next on the cpu's list */
+	struct cpu *to_cpu;		/* Cpu it's on, or NULL if idle */
+	uint64_t to_when;		/* When it goes off (ns) */
+	bool to_pending;		/* On the list, not yet run */
+	void (*to_func)(void *);
+	void *to_data;
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_add(struct timeout *to, uint64_t nsecs);
+bool timeout_cancel(struct timeout *to);
 
 /*
  * arithmetic on times
@@ -76,8 +112,10 @@ void timespec_sub(const struct timespec *t1,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ * clocknanosleep() does the same for a number of nanoseconds.
  */
 void clocksleep(int seconds);
+void clocknanosleep(uint64_t nsecs);
 
 
 #endif /* _CLOCK_H_ */
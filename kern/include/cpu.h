@@ -34,6 +34,7 @@
 #include <spinlock.h>
 #include <threadlist.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
+#include <workqueue.h>
 
 
 /*
@@ -61,6 +62,8 @@ struct cpu {
 	struct threadlist c_zombies;	/* List of exited threads */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	uint64_t c_nexttick;		/* When the next hardclock is due (ns) */
+	bool c_tickless;		/* Periodic tick stopped while idle */
 
 	/*
 	 * Accessed by other cpus.
@@ -70,6 +73,20 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Set up by workqueue_bootstrap. Zombies are handed off to
+	 * the workqueue once it's running (see exorcise()).
+	 */
+	struct workqueue *c_workqueue;	/* Deferred work for this cpu */
+	struct work c_reapwork;		/* Destroys c_zombies */
+
+	/*
+	 * Accessed by other cpus (to cancel timeouts).
+	 * Protected by the timeout lock.
+	 */
+	struct timeout *c_timeouts;	/* Pending timeouts, soonest first */
+	struct spinlock c_timeout_lock;
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -112,6 +129,13 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * cpu_count returns the number of CPUs, and cpu_get the one whose
+ * c_number is NUM. All CPUs are known once thread_start_cpus has run.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned num);
+
 /*
  * Produce a string describing the CPU type.
  */
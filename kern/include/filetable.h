@@ -48,14 +48,16 @@
  * or even to make it dynamic with the limit being user-settable. (See
  * setrlimit(2) on a Unix machine.)
  *
- * Because we only have single-threaded processes, the file table is
- * never shared and so it doesn't require synchronization. On fork,
- * the table is copied. Another exercise: what would you need to do to
- * make this code safe for multithreaded processes? What happens if
- * one thread calls close() while another one is in the middle of e.g.
- * read() using the same file handle?
+ * On fork, the table is copied. The table is looked up on every file
+ * syscall but changed only by open, close, and dup2, so it's
+ * protected by a reader-writer lock. filetable_get takes its own
+ * reference to the openfile, so if one thread calls close() while
+ * another is in the middle of e.g. read() on the same handle, the
+ * openfile stays alive until the read finishes and calls
+ * filetable_put.
  */
 struct filetable {
+	struct rwlock *ft_lock;
 	struct openfile *ft_openfiles[OPEN_MAX];
 };
 
@@ -68,7 +70,8 @@ struct filetable {
  * okfd -    Check if a file handle is in range.
  * get/put - Retrieve a fd for use and put it back when done. (Checks
  *           okfd and also fails on files not open; returned openfile
- *           is not NULL.) Call put with the file returned from get.
+ *           is not NULL, and is referenced until put.) Call put with
+ *           the file returned from get.
  * place -   Insert a file and return the fd.
  * placeat - Insert a file at a specific slot and return the file
  *           previously there.
@@ -37,17 +37,23 @@ struct vnode; /* in vnode.h */
  * Abstract file system. (Or device accessible as a file.)
  *
  * fs_data is a pointer to filesystem-specific data.
+ *
+ * fs_nonegcache is set by filesystems whose directories can gain
+ * entries without going through VFS (e.g. emufs, whose files live on
+ * the host); failed lookups on those must not be cached.
  */
 
 struct fs {
 	void *fs_data;
 	const struct fs_ops *fs_ops;
+	bool fs_nonegcache;
 };
 
 /*
  * Abstraction operations on a file system:
  *
  *      fsop_sync       - Flush all dirty buffers to disk.
+ *      fsop_writeback  - Flush buffers that have been dirty for a while.
  *      fsop_getvolname - Return volume name of filesystem.
  *      fsop_getroot    - Return root vnode of filesystem.
  *      fsop_unmount    - Attempt unmount of filesystem.
@@ -61,6 +67,9 @@ struct fs {
  * to make sure such changes don't cause name conflicts. So it probably
  * should be considered fixed.
  *
+ * fsop_writeback is called periodically by the syncer thread. It may
+ * be NULL on filesystems that don't hold on to dirty buffers.
+ *
  * fsop_getroot should increment the refcount of the vnode returned.
  * It should not ever return NULL.
  *
@@ -71,6 +80,7 @@ struct fs {
  */
 struct fs_ops {
 	int           (*fsop_sync)(struct fs *);
+	int           (*fsop_writeback)(struct fs *);
 	const char   *(*fsop_getvolname)(struct fs *);
 	int           (*fsop_getroot)(struct fs *, struct vnode **);
 	int           (*fsop_unmount)(struct fs *);
@@ -80,6 +90,7 @@ struct fs_ops {
  * Macros to shorten the calling sequences.
  */
 #define FSOP_SYNC(fs)        ((fs)->fs_ops->fsop_sync(fs))
+#define FSOP_WRITEBACK(fs)   ((fs)->fs_ops->fsop_writeback(fs))
 #define FSOP_GETVOLNAME(fs)  ((fs)->fs_ops->fsop_getvolname(fs))
 #define FSOP_GETROOT(fs, ret) ((fs)->fs_ops->fsop_getroot(fs, ret))
 #define FSOP_UNMOUNT(fs)     ((fs)->fs_ops->fsop_unmount(fs))
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_AIO_H_
+#define _KERN_AIO_H_
+
+/*
+ * Definitions for asynchronous I/O: aio_submit() and aio_reap().
+ *
+ * aio_submit queues a batch of reads and writes, each at an explicit
+ * offset like pread/pwrite, and returns without waiting for them.
+ * aio_reap collects finished ones, also in batches. Completions come
+ * back in the order they finish, not the order submitted; use
+ * ar_cookie to match them up.
+ */
+
+struct aioreq {
+	int ar_fd;			/* File handle */
+	int ar_op;			/* AIO_READ or AIO_WRITE */
+	off_t ar_offset;		/* Where in the file */
+	void *ar_buf;			/* Data */
+	size_t ar_len;			/* Amount of data */
+	void *ar_cookie;		/* Returned in ad_cookie */
+};
+
+struct aiodone {
+	void *ad_cookie;		/* From ar_cookie */
+	ssize_t ad_result;		/* Bytes transferred, or -1 */
+	int ad_errno;			/* Error, if ad_result is -1 */
+};
+
+/* Values for ar_op */
+#define AIO_READ	0
+#define AIO_WRITE	1
+
+/* Longest single request */
+#define AIO_MAXLEN	16384
+
+/* Most requests a process can have submitted and not yet reaped */
+#define AIO_MAXJOBS	16
+
+
+#endif /* _KERN_AIO_H_ */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_DIRENT_H_
+#define _KERN_DIRENT_H_
+
+/*
+ * Directory entry records, as returned by getdirentries().
+ *
+ * getdirentries packs as many of these into the caller's buffer as
+ * fit. Each is d_reclen bytes long, which is a multiple of 4, so the
+ * next one starts at (char *)d + d->d_reclen. The name is null
+ * terminated; d_namlen doesn't count the null.
+ *
+ * d_type is the S_IF* type of the object shifted down by 12 (as in
+ * BSD), or DT_UNKNOWN if the file system doesn't know it without
+ * going to disk, in which case use stat. d_ino may be 0 on file
+ * systems that don't have inode numbers.
+ */
+struct dirent {
+	ino_t d_ino;			/* Inode number */
+	__u16 d_reclen;			/* Length of this record */
+	__u8 d_type;			/* Type of object, or DT_UNKNOWN */
+	__u8 d_namlen;			/* Length of d_name */
+	char d_name[];			/* Null-terminated name */
+};
+
+/* Record length for a name of length NAMLEN */
+#define _DIRENT_RECLEN(namlen) \
+	((sizeof(struct dirent) + (namlen) + 1 + 3) & ~(unsigned)3)
+
+#define DT_UNKNOWN	0
+#define DT_FIFO		004	/* _S_IFIFO >> 12 */
+#define DT_CHR		006	/* _S_IFCHR >> 12 */
+#define DT_DIR		002	/* _S_IFDIR >> 12 */
+#define DT_BLK		007	/* _S_IFBLK >> 12 */
+#define DT_REG		001	/* _S_IFREG >> 12 */
+#define DT_LNK		003	/* _S_IFLNK >> 12 */
+#define DT_SOCK		005	/* _S_IFSOCK >> 12 */
+
+
+#endif /* _KERN_DIRENT_H_ */
@@ -86,9 +86,35 @@ struct sfs_dinode {
 	uint16_t sfi_linkcount;			/* # hard links to this file */
 	uint32_t sfi_direct[SFS_NDIRECT];	/* Direct blocks */
 	uint32_t sfi_indirect;			/* Indirect block */
-	uint32_t sfi_waste[128-3-SFS_NDIRECT];	/* unused space, set to 0 */
+	uint32_t sfi_dirbuckets;		/* Hashed dir: # of buckets */
+	uint32_t sfi_dirprobe;			/* Hashed dir: max probe */
+	uint32_t sfi_dirused;			/* Hashed dir: # of entries */
+	uint32_t sfi_waste[128-6-SFS_NDIRECT];	/* unused space, set to 0 */
 };
 
+/*
+ * Directories.
+ *
+ * A directory is an array of struct sfs_direntry; a free slot has
+ * sfd_ino == SFS_NOINO. Small directories (and all directories made
+ * by older code) are linear: entries can be in any slot and lookups
+ * scan the lot. Larger ones are hashed: sfi_dirbuckets is a power of
+ * two N, the directory is N blocks long, and an entry lives in block
+ * (hash(name) % N) or one of the sfi_dirprobe blocks after it,
+ * wrapping around; the hash is FNV-1a as defined below. sfi_dirused
+ * counts the entries in use. Setting sfi_dirbuckets (and the other
+ * two) to 0 always turns a hashed directory back into a valid linear
+ * one; that's what happens when a directory outgrows
+ * SFS_DIRHASH_MAXBUCKETS, since a linear directory can be longer.
+ */
+#define SFS_DIRPERBLOCK   (SFS_BLOCKSIZE / sizeof(struct sfs_direntry))
+#define SFS_DIRHASH_MAXBUCKETS 128	/* largest power of 2 that fits */
+
+/* 32-bit FNV-1a hash step, folded over a name to pick its bucket */
+#define SFS_DIRHASH_INIT  2166136261U
+#define SFS_DIRHASH_STEP(h, ch) \
+	(((h) ^ (uint32_t)(unsigned char)(ch)) * 16777619U)
+
 /*
  * On-disk directory entry
  */
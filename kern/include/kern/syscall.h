@@ -109,12 +109,12 @@
 #define SYS_close        49
 #define SYS_read         50
 #define SYS_pread        51
-//#define SYS_readv      52
+#define SYS_readv        52
 //#define SYS_preadv     53
 #define SYS_getdirentry  54
 #define SYS_write        55
 #define SYS_pwrite       56
-//#define SYS_writev     57
+#define SYS_writev       57
 //#define SYS_pwritev    58
 #define SYS_lseek        59
 #define SYS_flock        60
@@ -197,6 +197,24 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Threads --
+#define SYS___thread_create 121
+#define SYS_thread_join  122
+#define SYS_thread_exit  123
+
+//                              -- More file calls --
+#define SYS_getdirentries 124
+
+//                              -- More process calls --
+#define SYS_spawnv       125
+
+//                              -- Asynchronous I/O --
+#define SYS_aio_submit   126
+#define SYS_aio_reap     127
+
+//                              -- Data movement --
+#define SYS_sendfile     128
+
 /*CALLEND*/
 
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+/*
+ * Lock contention profiler. Enable with "options lockstat" in the
+ * kernel config; print the results with the "lockstat" menu command.
+ *
+ * Statistics are kept per name, not per lock: every lock, semaphore,
+ * CV, or wait channel created with the same name shares one record,
+ * so e.g. all the vnode locks show up together. Spinlocks are only
+ * named if someone calls spinlock_setname; the rest share a record
+ * called "(spinlock)".
+ *
+ * Time spent spinning and sleeping is measured with gettime(), so
+ * nothing is recorded until lockstat_bootstrap is called after the
+ * clock is attached.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+#include <kern/time.h>
+
+struct lockstat;
+
+struct lockstat *lockstat_get(const char *name);
+void lockstat_bootstrap(void);
+void lockstat_now(struct timespec *ts);
+void lockstat_acquire(struct lockstat *ls, bool contended);
+void lockstat_spun(struct lockstat *ls, const struct timespec *start);
+void lockstat_slept(struct lockstat *ls, const struct timespec *start);
+void lockstat_print(void);
+void lockstat_reset(void);
+
+#define LOCKSTAT_REF(sym)		struct lockstat *sym
+#define LOCKSTAT_TIMER(sym)		struct timespec sym
+#define LOCKSTAT_REF_INITIALIZER	NULL
+
+#define LOCKSTAT_INIT(p, name)		(*(p) = lockstat_get(name))
+#define LOCKSTAT_START(ts)		lockstat_now(ts)
+#define LOCKSTAT_ACQUIRE(ls, c)		lockstat_acquire(ls, c)
+#define LOCKSTAT_SPUN(ls, ts)		lockstat_spun(ls, ts)
+#define LOCKSTAT_SLEPT(ls, ts)		lockstat_slept(ls, ts)
+
+#else
+
+#define LOCKSTAT_REF(sym)
+#define LOCKSTAT_TIMER(sym)
+
+#define LOCKSTAT_INIT(p, name)
+#define LOCKSTAT_START(ts)
+#define LOCKSTAT_ACQUIRE(ls, c)
+#define LOCKSTAT_SPUN(ls, ts)
+#define LOCKSTAT_SLEPT(ls, ts)
+
+#define lockstat_bootstrap()
+
+#endif
+
+#endif /* LOCKSTAT_H */
@@ -52,6 +52,13 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Program this cpu's timer to interrupt once, NSECS nanoseconds from
+ * now, replacing any earlier setting. The interrupt calls
+ * hardclock_interrupt.
+ */
+void mainbus_settimer(uint32_t nsecs);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
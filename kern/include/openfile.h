@@ -63,6 +63,9 @@ struct openfile {
 int openfile_open(char *filename, int openflags, mode_t mode,
 		  struct openfile **ret);
 
+/* make a pipe; returns its read end and its write end */
+int openfile_pipe(struct openfile **readret, struct openfile **writeret);
+
 /* adjust the refcount on an openfile */
 void openfile_incref(struct openfile *);
 void openfile_decref(struct openfile *);
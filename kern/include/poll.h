@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _POLL_H_
+#define _POLL_H_
+
+/*
+ * Readiness notification, for poll().
+ *
+ * Anything that can block a reader or writer (a pipe, the console, a
+ * semaphore) embeds a pollqueue and calls pollqueue_wakeup whenever
+ * it might have become readable or writable. Its VOP_POLL checks the
+ * object's state, and first hooks the poller it's given (if any) onto
+ * the pollqueue with poller_register, so a change between the check
+ * and the poller going to sleep still wakes it.
+ *
+ * A poller is one thread waiting in poll. It has a fixed number of
+ * registration slots, set up by poller_init; it comes off all the
+ * queues at once in poller_cleanup.
+ *
+ * pollqueue_wakeup may be called from interrupt handlers and with
+ * spinlocks held.
+ */
+
+#include <spinlock.h>
+#include <kern/poll.h>
+
+struct wchan;
+struct poller;
+
+/* One poller hooked onto one pollqueue */
+struct pollentry {
+	struct pollentry *pe_next;	/* Next on the queue */
+	struct pollqueue *pe_queue;	/* The queue */
+	struct poller *pe_poller;	/* The poller */
+};
+
+struct pollqueue {
+	struct spinlock pq_lock;
+	struct pollentry *pq_entries;	/* Pollers to wake */
+};
+
+struct poller {
+	struct spinlock pl_lock;
+	struct wchan *pl_wchan;
+	bool pl_woken;			/* Something happened */
+	struct pollentry *pl_entries;	/* Registration slots */
+	unsigned pl_numentries;		/* Slots in use */
+	unsigned pl_maxentries;		/* Slots available */
+};
+
+void pollqueue_init(struct pollqueue *pq);
+void pollqueue_cleanup(struct pollqueue *pq);
+void pollqueue_wakeup(struct pollqueue *pq);
+
+int poller_init(struct poller *pl, unsigned maxentries);
+void poller_cleanup(struct poller *pl);
+void poller_register(struct poller *pl, struct pollqueue *pq);
+void poller_prepare(struct poller *pl);
+int poller_wait(struct poller *pl, uint64_t nsecs);
+
+
+#endif /* _POLL_H_ */
@@ -41,29 +41,56 @@
 
 struct addrspace;
 struct vnode;
+struct aioctx;
+struct cv;
+struct semaphore;
+
+/*
+ * User-level threads made with thread_create. Each gets a slot, which
+ * also picks its stack (see as_define_threadstack), until thread_join
+ * collects its exit status. The process's first thread has no slot
+ * and can't be joined.
+ */
+#define PROC_MAXUTHREADS 16
+
+struct uthread {
+	unsigned ut_tid;		/* Thread ID, or 0 if slot is free */
+	struct thread *ut_thread;	/* Its thread, once it has started */
+	bool ut_exited;			/* Has called thread_exit */
+	int ut_status;			/* ...with this value */
+};
 
 /*
  * Process structure.
  *
- * Note that unless you implement multithreaded processes, p_threads
- * will only contain one thread for all processes other than kproc.
+ * p_threads holds every thread in the process; for user processes
+ * that's the first thread plus any made with thread_create.
  *
  * Note: you can't protect p_threads with a spinlock because it needs
- * to be able to call kmalloc.
+ * to be able to call kmalloc. p_threadslock also covers the thread
+ * bookkeeping after it, and p_threadscv is signalled whenever a
+ * thread leaves or exits.
  */
 struct proc {
 	char *p_name;			/* Name of this process */
 	struct lock *p_threadslock;	/* Lock for p_threads */
 	struct threadarray p_threads;	/* Threads in this process */
+	struct cv *p_threadscv;		/* Signalled when a thread leaves */
+	unsigned p_nlive;		/* Threads not yet on their way out */
+	bool p_exiting;			/* Exiting; other threads must leave */
+	unsigned p_nexttid;		/* Next thread ID to hand out */
+	struct uthread p_uthreads[PROC_MAXUTHREADS];
 	struct spinlock p_lock;		/* Lock for rest of this structure */
 	pid_t p_pid;			/* Process ID */
 
 	/* VM */
 	struct addrspace *p_addrspace;	/* virtual address space */
+	struct semaphore *p_vforksem;	/* If borrowed: V when given back */
 
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 	struct filetable *p_filetable;	/* table of open files */
+	struct aioctx *p_aio;		/* async I/O, once it's used */
 
 	/* add more material here as needed */
 };
@@ -77,8 +104,18 @@ void proc_bootstrap(void);
 /* Create a fresh process for use by runprogram(). */
 int proc_create_runprogram(const char *name, struct proc **ret);
 
-/* Create a fresh process for use by fork() */
-int proc_fork(struct proc **ret);
+/*
+ * Create a fresh process for use by fork(). ASMODE says what it gets
+ * for an address space:
+ *    PROC_FORK_COPYAS   a copy of ours (fork)
+ *    PROC_FORK_SHAREAS  ours, borrowed until it execs or exits, when
+ *                       it Vs p_vforksem, which the caller sets (vfork)
+ *    PROC_FORK_NOAS     none; it will load a program (spawn)
+ */
+#define PROC_FORK_COPYAS	0
+#define PROC_FORK_SHAREAS	1
+#define PROC_FORK_NOAS		2
+int proc_fork(struct proc **ret, int asmode);
 
 /* Undo proc_fork if nothing's run in the new process yet. */
 void proc_unfork(struct proc *proc);
@@ -86,6 +123,9 @@ void proc_unfork(struct proc *proc);
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
+/* Get rid of the address space exec has replaced (or give it back). */
+void proc_dropas(struct addrspace *oldas);
+
 /*
  * Cause the current process to exit. The current thread switches
  * itself into the kernel process.
@@ -95,6 +135,20 @@ void proc_destroy(struct proc *proc);
  */
 void proc_exit(int status);
 
+/*
+ * Make the current thread leave its process with exit value STATUS,
+ * for thread_join. If it was the last thread, the whole process exits
+ * with STATUS. Also used to get rid of threads when another thread is
+ * taking the process down (p_exiting).
+ */
+__DEAD void proc_thread_exit(int status);
+
+/* Thread slots, for thread_create and thread_join. */
+int proc_uthread_alloc(unsigned *slot, unsigned *tid);
+void proc_uthread_free(unsigned slot);
+void proc_uthread_start(unsigned slot);
+int proc_uthread_join(unsigned tid, int *status);
+
 /* Attach a thread to a process. Must not already have a process. */
 int proc_addthread(struct proc *proc, struct thread *t);
 
@@ -56,8 +56,50 @@ struct sfs_vnode {
 	struct sfs_dinode sv_i;		/* copy of on-disk inode */
 	uint32_t sv_ino;                /* inode number */
 	bool sv_dirty;                  /* true if sv_i modified */
+	struct sfs_vnode *sv_hashnext;  /* next in sfs_vnhash chain */
+	struct sfs_vnode *sv_hashprev;  /* previous in sfs_vnhash chain */
+	unsigned sv_nbufs;              /* dirty buffers holding our data */
 };
 
+/*
+ * Write-back buffer: a block of file data that has been written but
+ * not yet put on disk. If the block wasn't on disk yet, no disk block
+ * is allocated for it until it's flushed; b_reserved blocks are
+ * held back from the free count to make sure there will be room.
+ * b_sv is NULL for an unused buffer.
+ */
+struct sfs_buf {
+	struct sfs_vnode *b_sv;         /* file the data belongs to */
+	uint32_t b_fileblock;           /* block number within the file */
+	unsigned b_reserved;            /* disk blocks reserved for it */
+	time_t b_dirtysince;            /* when it was first written */
+	char *b_data;                   /* the data (SFS_BLOCKSIZE) */
+};
+
+/*
+ * Name cache entry: remembers where a name was found in a directory
+ * so repeated lookups don't have to go to disk. nc_dirino is 0 for
+ * an unused entry.
+ */
+struct sfs_ncentry {
+	uint32_t nc_dirino;             /* directory inode number */
+	uint32_t nc_ino;                /* inode number the name maps to */
+	int nc_slot;                    /* directory slot of the entry */
+	char nc_name[SFS_NAMELEN];      /* the name */
+};
+
+/* Number of chains in the loaded-vnode hash table */
+#define SFS_VNHASH_SIZE  128
+
+/* Number of name cache entries; sized to fit in one page */
+#define SFS_NCACHE_SIZE  48
+
+/* Number of write-back buffers */
+#define SFS_NBUF         32
+
+/* Seconds a buffer may stay dirty before the syncer writes it */
+#define SFS_BUF_MAXAGE   3
+
 /*
  * In-memory info for a whole fs volume
  */
@@ -66,9 +108,14 @@ struct sfs_fs {
 	struct sfs_superblock sfs_sb;	/* copy of on-disk superblock */
 	bool sfs_superdirty;            /* true if superblock modified */
 	struct device *sfs_device;      /* device mounted on */
-	struct vnodearray *sfs_vnodes;  /* vnodes loaded into memory */
+	struct sfs_vnode **sfs_vnhash;  /* loaded vnodes, hashed by inode */
+	unsigned sfs_nvnodes;           /* number of vnodes loaded */
 	struct bitmap *sfs_freemap;     /* blocks in use are marked 1 */
 	bool sfs_freemapdirty;          /* true if freemap modified */
+	unsigned sfs_nfree;             /* number of free blocks */
+	unsigned sfs_reserved;          /* free blocks promised to buffers */
+	struct sfs_buf *sfs_bufs;       /* write-back buffers (SFS_NBUF) */
+	struct sfs_ncentry *sfs_ncache; /* name cache (SFS_NCACHE_SIZE) */
 };
 
 /*
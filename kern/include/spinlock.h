@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include <lockstat.h>
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -58,15 +59,23 @@
 struct spinlock {
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
+	LOCKSTAT_REF(splk_stat);	    /* Contention profiler hook. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
  */
-#ifdef OPT_HANGMAN
+#if OPT_HANGMAN && OPT_LOCKSTAT
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_REF_INITIALIZER, \
 				  HANGMAN_LOCKABLE_INITIALIZER }
+#elif OPT_HANGMAN
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  HANGMAN_LOCKABLE_INITIALIZER }
+#elif OPT_LOCKSTAT
+#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
+				  LOCKSTAT_REF_INITIALIZER }
 #else
 #define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
 #endif
@@ -81,6 +90,9 @@ struct spinlock {
  * release	Release the lock. May re-enable interrupts.
  *
  * do_i_hold	Check if the current CPU holds the lock.
+ *
+ * setname	Name the lock for the contention profiler (lockstat.h).
+ *		Does nothing if that isn't compiled in.
  */
 
 void spinlock_init(struct spinlock *lk);
@@ -91,5 +103,7 @@ void spinlock_release(struct spinlock *lk);
 
 bool spinlock_do_i_hold(struct spinlock *lk);
 
+void spinlock_setname(struct spinlock *lk, const char *name);
+
 
 #endif /* _SPINLOCK_H_ */
@@ -36,6 +36,7 @@
 
 
 #include <spinlock.h>
+#include <thread.h> /* for SCHED_NLEVELS */
 
 /*
  * Dijkstra-style semaphore.
@@ -48,6 +49,7 @@ struct semaphore {
         struct wchan *sem_wchan;
         struct spinlock sem_lock;
         volatile unsigned sem_count;
+        LOCKSTAT_REF(sem_stat);         /* Contention profiler hook. */
 };
 
 struct semaphore *sem_create(const char *name, unsigned initial_count);
@@ -71,13 +73,25 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * Locks do priority inheritance: the holder runs at the most urgent
+ * scheduling level of any thread waiting for it, and that passes
+ * along chains of threads waiting for locks held by threads waiting
+ * for other locks. lk_waitpri counts the waiters at each level, and
+ * lk_nextheld links the locks each thread holds.
+ *
+ * Locks are also adaptive: a thread that finds the lock held by a
+ * thread running on another cpu spins for a while before sleeping.
  */
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
+        LOCKSTAT_REF(lk_stat);          /* Contention profiler hook. */
         struct wchan *lk_wchan;
         struct spinlock lk_lock;
         struct thread *volatile lk_holder;
+        unsigned lk_waitpri[SCHED_NLEVELS]; /* Waiters at each level */
+        struct lock *lk_nextheld;       /* Next lock held by lk_holder */
 };
 
 struct lock *lock_create(const char *name);
@@ -126,18 +140,80 @@ void cv_destroy(struct cv *);
  * Operations:
  *    cv_wait      - Release the supplied lock, go to sleep, and, after
  *                   waking up again, re-acquire the lock.
+ *    cv_timedwait - As cv_wait, but give up after NSECS nanoseconds;
+ *                   returns ETIMEDOUT if it did, otherwise 0.
+ *    cv_wait_intr - As cv_wait, but returns EINTR if the thread was
+ *                   interrupted (see thread_interrupt), otherwise 0.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
  *
- * For all three operations, the current thread must hold the lock passed
+ * For all of these operations, the current thread must hold the lock passed
  * in. Note that under normal circumstances the same lock should be used
  * on all operations with any particular CV.
  *
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, uint64_t nsecs);
+int cv_wait_intr(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
 
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * Writers are preferred: once a writer is waiting, new readers wait
+ * behind it. To keep readers from starving in turn, when a writer
+ * releases the lock every reader that was waiting at that point is
+ * let in ahead of the remaining writers (rw_readpass of them, marked
+ * by having started waiting before rw_readgen last changed).
+ *
+ * The name field is for easier debugging. A copy of the name is made
+ * internally.
+ */
+struct rwlock {
+        char *rwlock_name;
+        struct wchan *rw_readwchan;     /* Readers wait here */
+        struct wchan *rw_writewchan;    /* Writers wait here */
+        struct wchan *rw_upgradewchan;  /* rw_upgrader waits here */
+        struct spinlock rw_lock;
+        unsigned rw_readers;            /* Readers holding the lock */
+        struct thread *rw_writer;       /* Writer holding the lock */
+        struct thread *rw_upgrader;     /* Reader waiting to upgrade */
+        unsigned rw_readwaiting;        /* Readers waiting */
+        unsigned rw_writewaiting;       /* Writers waiting */
+        unsigned rw_readgen;            /* Bumped on each handoff */
+        unsigned rw_readpass;           /* Readers let in past writers */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Give up a read hold.
+ *    rwlock_acquire_write - Get the lock for writing.
+ *    rwlock_release_write - Give up a write hold.
+ *    rwlock_upgrade       - Turn a read hold into a write hold, once
+ *                           the other readers leave. Fails (returning
+ *                           false, still holding the read lock) if
+ *                           another reader is already upgrading, as
+ *                           waiting would deadlock.
+ *    rwlock_downgrade     - Turn a write hold into a read hold without
+ *                           letting any writer in between.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                           the lock for writing.
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_upgrade(struct rwlock *);
+void rwlock_downgrade(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
+
+
 #endif /* _SYNCH_H_ */
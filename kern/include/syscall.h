@@ -47,6 +47,10 @@ void syscall(struct trapframe *tf);
 /* Helper for fork(). You write this. */
 void enter_forked_process(struct trapframe *tf);
 
+/* Helper for thread_create. Does not return. */
+__DEAD void enter_new_thread(struct trapframe *tf, vaddr_t entry,
+			     vaddr_t stackptr, userptr_t arg0, userptr_t arg1);
+
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
@@ -64,18 +68,33 @@ void exec_bootstrap(void);
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t req, userptr_t rem);
 
 int sys_fork(struct trapframe *tf, pid_t *retval);
+int sys_vfork(struct trapframe *tf, pid_t *retval);
 int sys_execv(userptr_t prog, userptr_t args);
+int sys_spawnv(userptr_t prog, userptr_t args, pid_t *retval);
 __DEAD void sys__exit(int code);
 int sys_waitpid(pid_t pid, userptr_t returncode, int flags, pid_t *retval);
 int sys_getpid(pid_t *retval);
 
+int sys___thread_create(struct trapframe *tf, userptr_t entry,
+			userptr_t func, userptr_t arg, int *retval);
+int sys_thread_join(int tid, userptr_t status);
+__DEAD void sys_thread_exit(int status);
+
 int sys_open(const_userptr_t filename, int flags, mode_t mode, int *retval);
 int sys_dup2(int oldfd, int newfd, int *retval);
+int sys_pipe(userptr_t fds);
+int sys_poll(userptr_t fds, unsigned nfds, int timeout, int *retval);
 int sys_close(int fd);
 int sys_read(int fd, userptr_t buf, size_t size, int *retval);
 int sys_write(int fd, userptr_t buf, size_t size, int *retval);
+int sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval);
+int sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval);
+int sys_sendfile(int outfd, int infd, size_t count, int *retval);
 int sys_lseek(int fd, off_t offset, int code, off_t *retval);
 
 int sys_chdir(const_userptr_t path);
@@ -88,8 +107,13 @@ int sys_remove(userptr_t path);
 int sys_link(userptr_t oldpath, userptr_t newpath);
 int sys_rename(userptr_t oldpath, userptr_t newpath);
 int sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval);
+int sys_getdirentries(int fd, userptr_t buf, size_t buflen, int *retval);
 int sys_fstat(int fd, userptr_t statptr);
 int sys_fsync(int fd);
 int sys_ftruncate(int fd, off_t len);
 
+int sys_aio_submit(const_userptr_t reqs, unsigned nreqs, int *retval);
+int sys_aio_reap(userptr_t done, unsigned max, unsigned min, int timeout,
+		 int *retval);
+
 #endif /* _SYSCALL_H_ */
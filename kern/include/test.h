@@ -55,8 +55,19 @@ int threadtest2(int, char **);
 int threadtest3(int, char **);
 int semtest(int, char **);
 int locktest(int, char **);
+int lockbench(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int rwtest(int, char **);
+int rwtest2(int, char **);
+int rwtest3(int, char **);
+int rwtest4(int, char **);
+int clocktest(int, char **);
+int clocktest2(int, char **);
+int clocktest3(int, char **);
+int wqtest(int, char **);
+int wqtest2(int, char **);
+int wqtest3(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
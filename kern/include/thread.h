@@ -41,6 +41,8 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
+struct wchan;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -56,6 +58,9 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/* Number of scheduler priority levels (see schedule() in thread.c) */
+#define SCHED_NLEVELS 4
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -85,6 +90,39 @@ struct thread {
 	struct proc *t_proc;		/* Process thread belongs to */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
 
+	/*
+	 * Scheduler fields. Protected by the runqueue lock of t_cpu
+	 * while the thread is on a run queue; otherwise touched only
+	 * by the thread itself.
+	 */
+	unsigned t_priority;		/* Queue level; 0 is most urgent */
+	unsigned t_quantum;		/* Hardclocks left in time slice */
+	unsigned t_lastran;		/* t_cpu's c_hardclocks when it
+					   last ran there (affinity hint) */
+	volatile bool t_oncpu;		/* Actually running on t_cpu now;
+					   read unlocked by lock spinners */
+	bool t_bound;			/* Never migrate off t_cpu */
+
+	/*
+	 * Priority inheritance fields. Protected by the lock
+	 * inheritance spinlock in synch.c; t_donated is also
+	 * protected by the runqueue lock of t_cpu.
+	 */
+	unsigned t_donated;		/* Level lent by lock waiters */
+	struct lock *t_waitlock;	/* Lock we're waiting for */
+	unsigned t_waitpri;		/* Level we're counted at there */
+	struct lock *t_heldlocks;	/* Locks we hold */
+
+	/*
+	 * Sleep interruption fields (see thread_interrupt). t_wchan
+	 * is protected by the spinlock of the channel it points to;
+	 * the rest by the interrupt spinlock in thread.c.
+	 */
+	struct wchan *t_wchan;		/* Channel we're sleeping on */
+	struct spinlock *t_intrlk;	/* Its lock, if interruptible */
+	unsigned t_intrbusy;		/* thread_interrupts using that */
+	bool t_interrupted;		/* Interruptible sleeps fail */
+
 	/*
 	 * Interrupt state fields.
 	 *
@@ -145,6 +183,15 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Like thread_fork, but the new thread belongs to the kernel process,
+ * runs on CPU, and is never migrated off it. For per-cpu service
+ * threads.
+ */
+int thread_fork_bound(const char *name, struct cpu *cpu,
+                      void (*func)(void *, unsigned long),
+                      void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -159,10 +206,32 @@ __DEAD void thread_exit(void);
 void thread_yield(void);
 
 /*
- * Reshuffle the run queue. Called from the timer interrupt.
+ * Interrupt thread T: if it is in an interruptible sleep
+ * (wchan_sleep_intr or cv_wait_intr) wake it up, and make that and
+ * any later interruptible sleep fail with EINTR. This is permanent;
+ * it's meant for getting the threads of an exiting process out of
+ * the kernel. The caller must keep T from being destroyed meanwhile.
+ */
+void thread_interrupt(struct thread *t);
+
+/*
+ * Charge the current thread for a clock tick, adjust priorities, and
+ * preempt if appropriate. Called from the timer interrupt.
  */
 void schedule(void);
 
+/*
+ * Priority for scheduling purposes: the thread's own level or the
+ * level lent to it by threads waiting for its locks, whichever is
+ * more urgent.
+ *
+ * thread_setdonated changes the lent level, moving the thread in its
+ * run queue if it's waiting to run. Used by lock priority
+ * inheritance.
+ */
+unsigned thread_effpriority(const struct thread *t);
+void thread_setdonated(struct thread *t, unsigned level);
+
 /*
  * Potentially migrate ready threads to other CPUs. Called from the
  * timer interrupt.
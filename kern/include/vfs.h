@@ -55,6 +55,7 @@ struct vnode;  /* abstract structure for an on-disk file (vnode.h) */
  *    vfs_clearcurdir - change current directory of current thread to "none"
  *    vfs_getcurdir - retrieve vnode of current directory of current thread
  *    vfs_sync      - force all dirty buffers to disk
+ *    vfs_writeback - write out buffers that have been dirty for a while
  *    vfs_getroot   - get root vnode for the filesystem named DEVNAME
  *    vfs_getdevname - get mounted device name for the filesystem passed in
  */
@@ -63,6 +64,7 @@ int vfs_setcurdir(struct vnode *dir);
 int vfs_clearcurdir(void);
 int vfs_getcurdir(struct vnode **retdir);
 int vfs_sync(void);
+void vfs_writeback(void);
 int vfs_getroot(const char *devname, struct vnode **result);
 const char *vfs_getdevname(struct fs *fs);
 
@@ -75,11 +77,18 @@ const char *vfs_getdevname(struct fs *fs);
  *    vfs_lookparent - Likewise, for VOP_LOOKPARENT.
  *
  * Both of these may destroy the path passed in.
+ *
+ *    vfs_dcache_purge   - Forget cached lookups that passed through a
+ *                         directory entry called NAME. Must be called
+ *                         after creating, removing, or renaming a name.
+ *    vfs_dcache_purgefs - Forget all cached lookups on filesystem FS.
  */
 
 int vfs_lookup(char *path, struct vnode **result);
 int vfs_lookparent(char *path, struct vnode **result,
 		   char *buf, size_t buflen);
+void vfs_dcache_purge(const char *name);
+void vfs_dcache_purgefs(struct fs *fs);
 
 /*
  * VFS layer high-level operations on pathnames
@@ -164,6 +173,9 @@ int vfs_getcwd(struct uio *buf);
  *                    decref'd first. Similar to vfs_unmount.
  *
  *    vfs_unmountall - Unmount all mounted filesystems.
+ *
+ *    vfs_syncer_start - Start the syncer thread, which calls
+ *                    vfs_writeback every second.
  */
 
 void vfs_bootstrap(void);
@@ -182,6 +194,7 @@ int vfs_unmount(const char *devname);
 int vfs_swapon(const char *devname, struct vnode **result);
 int vfs_swapoff(const char *devname);
 int vfs_unmountall(void);
+void vfs_syncer_start(void);
 
 /*
  * Array of vnodes.
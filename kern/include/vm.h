@@ -71,6 +71,15 @@ void frame_ref_mod(int index, int modifier);
 /* TLB shootdown handling called from interprocessor_interrupt */
 void vm_tlbshootdown(const struct tlbshootdown *);
 
+/* Drop a range of user pages from every CPU's TLB; waits until done */
+void vm_tlbshootdown_all(vaddr_t vaddr, unsigned npages);
+
+/* Fault in the user pages under a big copyin/copyout ahead of time */
+void vm_prefault(vaddr_t vaddr, size_t len, bool write);
+
+/* Lend a user page's frame copy-on-write (e.g. to a pipe) */
+int vm_loanpage(vaddr_t uaddr, vaddr_t *kvaddr);
+
 extern struct frametable_entry *frametable;
 extern struct pagetable_entry **pagetable;
 extern struct frametable_entry *firstfreeframe;
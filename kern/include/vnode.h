@@ -33,6 +33,7 @@
 #include <spinlock.h>
 struct uio;
 struct stat;
+struct poller;
 
 
 /*
@@ -98,6 +99,15 @@ struct vnode {
  *                      handled in the normal fashion.
  *                      On non-directory objects, return ENOTDIR.
  *
+ *    vop_getdirentries - Like vop_getdirentry, but fill the uio with
+ *                      as many struct dirent records (see
+ *                      <kern/dirent.h>) as fit, rather than one bare
+ *                      name. If not even one fits, return EINVAL.
+ *                      File systems without anything better can use
+ *                      vnode_getdirentries, which is built on
+ *                      vop_getdirentry.
+ *                      On non-directory objects, return ENOTDIR.
+ *
  *    vop_write       - Write data from uio to file at offset specified
  *                      in the uio, updating uio_resid to reflect the
  *                      amount written, and updating uio_offset to match.
@@ -107,6 +117,15 @@ struct vnode {
  *                      DATA. The interpretation of the data is specific
  *                      to each ioctl.
  *
+ *    vop_poll        - Check which of EVENTS (POLLIN, POLLOUT; see
+ *                      kern/poll.h) could be done now without
+ *                      blocking, plus POLLHUP/POLLERR if applicable,
+ *                      and put them in *REVENTS. If POLLER is not
+ *                      NULL, first register it (see poll.h) with
+ *                      whatever will be woken when that changes.
+ *                      Objects that never block can use
+ *                      vnode_pollready.
+ *
  *    vop_stat        - Return info about a file. The pointer is a
  *                      pointer to struct stat; see kern/stat.h.
  *
@@ -187,8 +206,11 @@ struct vnode_ops {
 	int (*vop_read)(struct vnode *file, struct uio *uio);
 	int (*vop_readlink)(struct vnode *link, struct uio *uio);
 	int (*vop_getdirentry)(struct vnode *dir, struct uio *uio);
+	int (*vop_getdirentries)(struct vnode *dir, struct uio *uio);
 	int (*vop_write)(struct vnode *file, struct uio *uio);
 	int (*vop_ioctl)(struct vnode *object, int op, userptr_t data);
+	int (*vop_poll)(struct vnode *object, int events,
+			struct poller *poller, int *revents);
 	int (*vop_stat)(struct vnode *object, struct stat *statbuf);
 	int (*vop_gettype)(struct vnode *object, mode_t *result);
 	bool (*vop_isseekable)(struct vnode *object);
@@ -231,8 +253,10 @@ struct vnode_ops {
 #define VOP_READ(vn, uio)               (__VOP(vn, read)(vn, uio))
 #define VOP_READLINK(vn, uio)           (__VOP(vn, readlink)(vn, uio))
 #define VOP_GETDIRENTRY(vn, uio)        (__VOP(vn,getdirentry)(vn, uio))
+#define VOP_GETDIRENTRIES(vn, uio)      (__VOP(vn,getdirentries)(vn, uio))
 #define VOP_WRITE(vn, uio)              (__VOP(vn, write)(vn, uio))
 #define VOP_IOCTL(vn, code, buf)        (__VOP(vn, ioctl)(vn,code,buf))
+#define VOP_POLL(vn, ev, pl, rev)       (__VOP(vn, poll)(vn, ev, pl, rev))
 #define VOP_STAT(vn, ptr) 	        (__VOP(vn, stat)(vn, ptr))
 #define VOP_GETTYPE(vn, result)         (__VOP(vn, gettype)(vn, result))
 #define VOP_ISSEEKABLE(vn)              (__VOP(vn, isseekable)(vn))
@@ -279,6 +303,17 @@ int vnode_init(struct vnode *, const struct vnode_ops *ops,
  */
 void vnode_cleanup(struct vnode *);
 
+/*
+ * vop_getdirentries for file systems that only do vop_getdirentry
+ */
+int vnode_getdirentries(struct vnode *dir, struct uio *uio);
+
+/*
+ * vop_poll for objects that are always ready
+ */
+int vnode_pollready(struct vnode *vn, int events, struct poller *poller,
+		    int *revents);
+
 /*
  * Common stubs for vnode functions that just fail, in various ways.
  */
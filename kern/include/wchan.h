@@ -66,6 +66,20 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * As wchan_sleep, but if nobody wakes the thread within NSECS
+ * nanoseconds, it wakes up anyway and ETIMEDOUT is returned.
+ * Otherwise returns 0.
+ */
+int wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk,
+			uint64_t nsecs);
+
+/*
+ * As wchan_sleep, but thread_interrupt can cut the sleep short, in
+ * which case EINTR is returned. Otherwise returns 0.
+ */
+int wchan_sleep_intr(struct wchan *wc, struct spinlock *lk);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
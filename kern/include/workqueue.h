@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Deferred work.
+ *
+ * Each CPU has a queue of work items and a few kernel threads bound
+ * to it that run them. Items are started in the order queued, but
+ * with more than one worker they can overlap, so don't count on one
+ * finishing before the next begins. work_queue puts an item on the
+ * current CPU's queue; it doesn't sleep, so it can be called from
+ * interrupt handlers and timeouts, or with spinlocks held, to push
+ * slow or non-urgent work out of the way. work_queue_delayed does the
+ * same after a delay.
+ *
+ * An item is "pending" from when it's queued until a worker picks it
+ * up; queueing an item that's already pending does nothing and
+ * returns false. Once its function has started, an item can be
+ * queued again (including by the function itself).
+ *
+ * work_cancel takes a pending item back off its queue and returns
+ * true; it returns false if the item wasn't pending. It doesn't wait
+ * for a function that's already running.
+ *
+ * Work functions run in a kernel thread and may sleep, but while one
+ * sleeps the items after it wait unless another of the CPU's workers
+ * is free. Up to WORKQUEUE_MAXWORKERS workers are started per CPU as
+ * needed, and the extras exit again when things quiet down. Workers
+ * take several items at a time, so an item whose function can block
+ * for long (e.g. on disk I/O) should be marked with work_mayblock
+ * after work_init; otherwise items taken along with it wait for it
+ * even when other workers are free.
+ */
+
+#include <spinlock.h>
+#include <clock.h>
+
+#define WORKQUEUE_MAXWORKERS	4
+
+struct workqueue;
+
+struct work {
+	struct work *w_next;		/* Next on the queue */
+	struct workqueue *w_queue;	/* Queue it's on, if any */
+	volatile spinlock_data_t w_pending; /* Queued or delayed */
+	struct timeout w_timeout;	/* For work_queue_delayed */
+	void (*w_func)(void *);
+	void *w_data;
+	bool w_mayblock;		/* Function can block for long */
+};
+
+void workqueue_bootstrap(void);
+
+void work_init(struct work *w, void (*func)(void *), void *data);
+void work_mayblock(struct work *w);
+bool work_queue(struct work *w);
+bool work_queue_delayed(struct work *w, uint64_t nsecs);
+bool work_cancel(struct work *w);
+
+
+#endif /* _WORKQUEUE_H_ */
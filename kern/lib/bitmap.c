@@ -120,6 +120,54 @@ bitmap_alloc(struct bitmap *b, unsigned *index)
         return ENOSPC;
 }
 
+int
+bitmap_alloc_near(struct bitmap *b, unsigned goal, unsigned *index)
+{
+        unsigned ix, n;
+        unsigned maxix = DIVROUNDUP(b->nbits, BITS_PER_WORD);
+        unsigned offset;
+
+        if (goal >= b->nbits) {
+                return bitmap_alloc(b, index);
+        }
+
+        /*
+         * Check the rest of the goal's own word bit by bit, then go
+         * word-wise through the remainder, wrapping around to the
+         * start. The goal's word comes up again last so the bits
+         * before the goal get a look too.
+         */
+        ix = goal / BITS_PER_WORD;
+        for (offset = goal % BITS_PER_WORD; offset < BITS_PER_WORD; offset++) {
+                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
+
+                if ((b->v[ix] & mask)==0) {
+                        b->v[ix] |= mask;
+                        *index = (ix*BITS_PER_WORD)+offset;
+                        KASSERT(*index < b->nbits);
+                        return 0;
+                }
+        }
+
+        for (n=1; n<=maxix; n++) {
+                ix = (goal / BITS_PER_WORD + n) % maxix;
+                if (b->v[ix]!=WORD_ALLBITS) {
+                        for (offset = 0; offset < BITS_PER_WORD; offset++) {
+                                WORD_TYPE mask = ((WORD_TYPE)1) << offset;
+
+                                if ((b->v[ix] & mask)==0) {
+                                        b->v[ix] |= mask;
+                                        *index = (ix*BITS_PER_WORD)+offset;
+                                        KASSERT(*index < b->nbits);
+                                        return 0;
+                                }
+                        }
+                        KASSERT(0);
+                }
+        }
+        return ENOSPC;
+}
+
 static
 inline
 void
@@ -42,6 +42,8 @@
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
+#include <workqueue.h>
 #include <vm.h>
 #include <mainbus.h>
 #include <vfs.h>
@@ -123,6 +125,8 @@ boot(void)
 	KASSERT(curthread->t_curspl == 0);
 	/* Now do pseudo-devices. */
 	pseudoconfig();
+	/* The clock is attached now, so lock waits can be timed. */
+	lockstat_bootstrap();
 	kprintf("\n");
 	kheap_nextgeneration();
 
@@ -130,6 +134,8 @@ boot(void)
 	kprintf_bootstrap();
 	exec_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
+	vfs_syncer_start();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -38,6 +38,7 @@
 #include <clock.h>
 #include <mainbus.h>
 #include <synch.h>
+#include <lockstat.h>
 #include <thread.h>
 #include <proc.h>
 #include <vfs.h>
@@ -47,6 +48,7 @@
 #include <test.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
+#include "opt-lockstat.h"
 
 /*
  * In-kernel menu and command dispatcher.
@@ -500,6 +502,30 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKSTAT
+/*
+ * Command for printing lock contention stats, or with "reset",
+ * clearing them.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+		return 0;
+	}
+	if (nargs != 1) {
+		kprintf("Usage: lockstat [reset]\n");
+		return EINVAL;
+	}
+
+	lockstat_print();
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -576,6 +602,17 @@ static const char *testmenu[] = {
 	"[sy2] Lock test                     ",
 	"[sy3] CV test                       ",
 	"[sy4] CV test #2                    ",
+	"[sy5] Lock contention benchmark     ",
+	"[rwt1] Reader-writer lock test      ",
+	"[rwt2] RW lock writer preference    ",
+	"[rwt3] RW lock reader fairness      ",
+	"[rwt4] RW lock upgrade/downgrade    ",
+	"[ct1] Timer nanosleep test          ",
+	"[ct2] Timed wait test               ",
+	"[ct3] Preemption test               ",
+	"[wq1] Workqueue test                ",
+	"[wq2] Delayed work test             ",
+	"[wq3] Workqueue worker test         ",
 	"[semu1-22] Semaphore unit tests     ",
 	"[wt]  waitpid test                  ",
 	"[fs1] Filesystem test               ",
@@ -606,6 +643,9 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock contention stats    ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -657,6 +697,9 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -679,6 +722,17 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	lockbench },
+	{ "rwt1",	rwtest },
+	{ "rwt2",	rwtest2 },
+	{ "rwt3",	rwtest3 },
+	{ "rwt4",	rwtest4 },
+	{ "ct1",	clocktest },
+	{ "ct2",	clocktest2 },
+	{ "ct3",	clocktest3 },
+	{ "wq1",	wqtest },
+	{ "wq2",	wqtest2 },
+	{ "wq3",	wqtest3 },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
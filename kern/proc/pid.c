@@ -36,12 +36,11 @@
 #include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
-#include <array.h>
-#include <clock.h>
+#include <spinlock.h>
+#include <wchan.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
-#include <synch.h>
 #include <pid.h>
 
 /*
@@ -50,13 +49,18 @@
  * If pi_ppid is INVALID_PID, the parent has gone away and will not be
  * waiting. If pi_ppid is INVALID_PID and pi_exited is true, the
  * structure can be freed.
+ *
+ * Each process's pidinfo is on its parent's list of children, so that
+ * exiting only has to look at its own children.
  */
 struct pidinfo {
 	pid_t pi_pid;			// process id of this thread
 	pid_t pi_ppid;			// process id of parent thread
-	volatile bool pi_exited;	// true if thread has exited
+	bool pi_exited;			// true if thread has exited
 	int pi_exitstatus;		// status (only valid if exited)
-	struct cv *pi_cv;		// use to wait for thread exit
+	struct wchan *pi_wchan;		// parent waits here for exit
+	struct pidinfo *pi_children;	// our children
+	struct pidinfo *pi_sibling;	// next on parent's list
 };
 
 
@@ -64,43 +68,52 @@ struct pidinfo {
  * Global pid and exit data.
  *
  * The process table is an el-cheapo hash table. It's indexed by
- * (pid % PROCS_MAX), and only allows one process per slot. If a
- * new pid allocation would cause a hash collision, we just don't
- * use that pid.
+ * (pid % PROCS_MAX), and only allows one process per slot. Rather
+ * than hunting for a pid whose slot is free, we keep a queue of free
+ * slots and hand out the next pid that falls in the slot at the
+ * front; so allocating and freeing are O(1), and a freed pid isn't
+ * reused until the whole table has gone around.
+ *
+ * Everything here is protected by pidlock, which is a spinlock and
+ * only ever held briefly; nothing sleeps or allocates holding it.
+ * Waiting for a process to exit is done on its own wait channel.
  */
-static struct lock *pidlock;		// lock for global exit data
+static struct spinlock pidlock = SPINLOCK_INITIALIZER;
 static struct pidinfo *pidinfo[PROCS_MAX]; // actual pid info
-static pid_t nextpid;			// next candidate pid
-static int nprocs;			// number of allocated pids
+static pid_t slotnextpid[PROCS_MAX];	// next pid to use in each slot
+static unsigned freeslots[PROCS_MAX];	// queue of free slots
+static unsigned freehead;		// first free slot in freeslots[]
+static unsigned nfree;			// number of free slots
 
 
 
 /*
- * Create a pidinfo structure for the specified pid.
+ * Create a pidinfo structure for a child of the specified pid. The
+ * pid itself is filled in later.
  */
 static
 struct pidinfo *
-pidinfo_create(pid_t pid, pid_t ppid)
+pidinfo_create(pid_t ppid)
 {
 	struct pidinfo *pi;
 
-	KASSERT(pid != INVALID_PID);
-
 	pi = kmalloc(sizeof(struct pidinfo));
 	if (pi==NULL) {
 		return NULL;
 	}
 
-	pi->pi_cv = cv_create("pidinfo cv");
-	if (pi->pi_cv == NULL) {
+	pi->pi_wchan = wchan_create("pidinfo");
+	if (pi->pi_wchan == NULL) {
 		kfree(pi);
 		return NULL;
 	}
 
-	pi->pi_pid = pid;
+	pi->pi_pid = INVALID_PID;
 	pi->pi_ppid = ppid;
 	pi->pi_exited = false;
 	pi->pi_exitstatus = 0xbeef;  /* Recognizably invalid value */
+	pi->pi_children = NULL;
+	pi->pi_sibling = NULL;
 
 	return pi;
 }
@@ -114,10 +127,28 @@ pidinfo_destroy(struct pidinfo *pi)
 {
 	KASSERT(pi->pi_exited == true);
 	KASSERT(pi->pi_ppid == INVALID_PID);
-	cv_destroy(pi->pi_cv);
+	KASSERT(pi->pi_children == NULL);
+	wchan_destroy(pi->pi_wchan);
 	kfree(pi);
 }
 
+/*
+ * Destroy a list of pidinfos (chained on pi_sibling) taken out of
+ * the table by pi_drop.
+ */
+static
+void
+pidinfo_destroylist(struct pidinfo *pi)
+{
+	struct pidinfo *next;
+
+	while (pi != NULL) {
+		next = pi->pi_sibling;
+		pidinfo_destroy(pi);
+		pi = next;
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -126,25 +157,38 @@ pidinfo_destroy(struct pidinfo *pi)
 void
 pid_bootstrap(void)
 {
-	int i;
+	struct pidinfo *pi;
+	unsigned i, slot;
 
-	pidlock = lock_create("pidlock");
-	if (pidlock == NULL) {
-		panic("Out of memory creating pid lock\n");
+	pi = pidinfo_create(INVALID_PID);
+	if (pi==NULL) {
+		panic("Out of memory creating kernel pid data\n");
 	}
+	pi->pi_pid = KERNEL_PID;
+
+	spinlock_setname(&pidlock, "pidlock");
+	spinlock_acquire(&pidlock);
 
-	/* not really necessary - should start zeroed */
+	/* Each slot's first pid is the lowest valid one that maps to it. */
 	for (i=0; i<PROCS_MAX; i++) {
 		pidinfo[i] = NULL;
+		slotnextpid[i] = (i < PID_MIN) ? i + PROCS_MAX : i;
 	}
 
-	pidinfo[KERNEL_PID] = pidinfo_create(KERNEL_PID, INVALID_PID);
-	if (pidinfo[KERNEL_PID]==NULL) {
-		panic("Out of memory creating kernel pid data\n");
+	pidinfo[KERNEL_PID % PROCS_MAX] = pi;
+	slotnextpid[KERNEL_PID % PROCS_MAX] = KERNEL_PID + PROCS_MAX;
+
+	/* Queue the rest, in order starting from PID_MIN. */
+	freehead = 0;
+	nfree = 0;
+	for (i=0; i<PROCS_MAX; i++) {
+		slot = (PID_MIN + i) % PROCS_MAX;
+		if (pidinfo[slot] == NULL) {
+			freeslots[nfree++] = slot;
+		}
 	}
 
-	nextpid = PID_MIN;
-	nprocs = 1;
+	spinlock_release(&pidlock);
 }
 
 /*
@@ -158,7 +202,7 @@ pi_get(pid_t pid)
 
 	KASSERT(pid>=0);
 	KASSERT(pid != INVALID_PID);
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(spinlock_do_i_hold(&pidlock));
 
 	pi = pidinfo[pid % PROCS_MAX];
 	if (pi==NULL) {
@@ -171,109 +215,98 @@ pi_get(pid_t pid)
 }
 
 /*
- * pi_put: insert a new pidinfo in the process table. The right slot
- * must be empty.
+ * pi_unlink: take a child off its parent's list of children.
  */
 static
 void
-pi_put(pid_t pid, struct pidinfo *pi)
+pi_unlink(struct pidinfo *parent, struct pidinfo *kid)
 {
-	KASSERT(lock_do_i_hold(pidlock));
+	struct pidinfo **pp;
 
-	KASSERT(pid != INVALID_PID);
+	KASSERT(spinlock_do_i_hold(&pidlock));
 
-	KASSERT(pidinfo[pid % PROCS_MAX] == NULL);
-	pidinfo[pid % PROCS_MAX] = pi;
-	nprocs++;
+	for (pp = &parent->pi_children; *pp != kid; pp = &(*pp)->pi_sibling) {
+		KASSERT(*pp != NULL);
+	}
+	*pp = kid->pi_sibling;
+	kid->pi_sibling = NULL;
 }
 
 /*
- * pi_drop: remove a pidinfo structure from the process table and free
- * it. It should reflect a process that has already exited and been
- * waited for.
+ * pi_drop: remove a pidinfo structure from the process table, and put
+ * its slot back on the free queue. It should reflect a process that
+ * has already exited and been waited for, and not be on anyone's list
+ * of children. The caller frees it after letting go of pidlock.
  */
 static
 void
-pi_drop(pid_t pid)
+pi_drop(struct pidinfo *pi)
 {
-	struct pidinfo *pi;
+	unsigned slot;
 
-	KASSERT(lock_do_i_hold(pidlock));
+	KASSERT(spinlock_do_i_hold(&pidlock));
 
-	pi = pidinfo[pid % PROCS_MAX];
-	KASSERT(pi != NULL);
-	KASSERT(pi->pi_pid == pid);
+	slot = pi->pi_pid % PROCS_MAX;
+	KASSERT(pidinfo[slot] == pi);
+	KASSERT(pi->pi_sibling == NULL);
 
-	pidinfo_destroy(pi);
-	pidinfo[pid % PROCS_MAX] = NULL;
-	nprocs--;
+	pidinfo[slot] = NULL;
+	KASSERT(nfree < PROCS_MAX);
+	freeslots[(freehead + nfree) % PROCS_MAX] = slot;
+	nfree++;
 }
 
 ////////////////////////////////////////////////////////////
 
-/*
- * Helper function for pid_alloc.
- */
-static
-void
-inc_nextpid(void)
-{
-	KASSERT(lock_do_i_hold(pidlock));
-
-	nextpid++;
-	if (nextpid > PID_MAX) {
-		nextpid = PID_MIN;
-	}
-}
-
 /*
  * pid_alloc: allocate a process id.
  */
 int
 pid_alloc(pid_t *retval)
 {
-	struct pidinfo *pi;
+	struct pidinfo *pi, *parent;
+	unsigned slot;
 	pid_t pid;
-	int count;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
-	/* lock the table */
-	lock_acquire(pidlock);
-
-	if (nprocs == PROCS_MAX) {
-		lock_release(pidlock);
-		return EAGAIN;
+	/* allocate first, so we don't do it holding the spinlock */
+	pi = pidinfo_create(curproc->p_pid);
+	if (pi==NULL) {
+		return ENOMEM;
 	}
 
-	/*
-	 * The above test guarantees that this loop terminates, unless
-	 * our nprocs count is off. Even so, assert we aren't looping
-	 * forever.
-	 */
-	count = 0;
-	while (pidinfo[nextpid % PROCS_MAX] != NULL) {
+	spinlock_acquire(&pidlock);
 
-		/* avoid various boundary cases by allowing extra loops */
-		KASSERT(count < PROCS_MAX*2+5);
-		count++;
-
-		inc_nextpid();
+	if (nfree == 0) {
+		spinlock_release(&pidlock);
+		pi->pi_exited = true;
+		pi->pi_ppid = INVALID_PID;
+		pidinfo_destroy(pi);
+		return EAGAIN;
 	}
 
-	pid = nextpid;
+	slot = freeslots[freehead];
+	freehead = (freehead + 1) % PROCS_MAX;
+	nfree--;
 
-	pi = pidinfo_create(pid, curproc->p_pid);
-	if (pi==NULL) {
-		lock_release(pidlock);
-		return ENOMEM;
+	pid = slotnextpid[slot];
+	KASSERT((unsigned)pid % PROCS_MAX == slot);
+	slotnextpid[slot] += PROCS_MAX;
+	if (slotnextpid[slot] > PID_MAX) {
+		slotnextpid[slot] = (slot < PID_MIN) ? slot + PROCS_MAX : slot;
 	}
 
-	pi_put(pid, pi);
+	KASSERT(pidinfo[slot] == NULL);
+	pi->pi_pid = pid;
+	pidinfo[slot] = pi;
 
-	inc_nextpid();
+	parent = pi_get(curproc->p_pid);
+	KASSERT(parent != NULL);
+	pi->pi_sibling = parent->pi_children;
+	parent->pi_children = pi;
 
-	lock_release(pidlock);
+	spinlock_release(&pidlock);
 
 	*retval = pid;
 	return 0;
@@ -286,25 +319,31 @@ pid_alloc(pid_t *retval)
 void
 pid_unalloc(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *them, *us;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	spinlock_acquire(&pidlock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_exited == false);
 	KASSERT(them->pi_ppid == curproc->p_pid);
 
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	pi_unlink(us, them);
+
 	/* keep pidinfo_destroy from complaining */
 	them->pi_exitstatus = 0xdead;
 	them->pi_exited = true;
 	them->pi_ppid = INVALID_PID;
 
-	pi_drop(theirpid);
+	pi_drop(them);
+
+	spinlock_release(&pidlock);
 
-	lock_release(pidlock);
+	pidinfo_destroy(them);
 }
 
 /*
@@ -314,22 +353,32 @@ pid_unalloc(pid_t theirpid)
 void
 pid_disown(pid_t theirpid)
 {
-	struct pidinfo *them;
+	struct pidinfo *them, *us;
+	bool drop;
 
 	KASSERT(theirpid >= PID_MIN && theirpid <= PID_MAX);
 
-	lock_acquire(pidlock);
+	spinlock_acquire(&pidlock);
 
 	them = pi_get(theirpid);
 	KASSERT(them != NULL);
 	KASSERT(them->pi_ppid==curproc->p_pid);
 
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	pi_unlink(us, them);
+
 	them->pi_ppid = INVALID_PID;
-	if (them->pi_exited) {
-		pi_drop(them->pi_pid);
+	drop = them->pi_exited;
+	if (drop) {
+		pi_drop(them);
 	}
 
-	lock_release(pidlock);
+	spinlock_release(&pidlock);
+
+	if (drop) {
+		pidinfo_destroy(them);
+	}
 }
 
 /*
@@ -343,42 +392,46 @@ pid_disown(pid_t theirpid)
 void
 pid_setexitstatus(int status)
 {
-	struct pidinfo *us;
-	int i;
+	struct pidinfo *us, *kid, *dead;
 
-	lock_acquire(pidlock);
+	dead = NULL;
+
+	spinlock_acquire(&pidlock);
 	KASSERT(curproc->p_pid != INVALID_PID);
 
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+
 	/* First, disown all children */
-	for (i=0; i<PROCS_MAX; i++) {
-		if (pidinfo[i]==NULL) {
-			continue;
-		}
-		if (pidinfo[i]->pi_ppid == curproc->p_pid) {
-			pidinfo[i]->pi_ppid = INVALID_PID;
-			if (pidinfo[i]->pi_exited) {
-				pi_drop(pidinfo[i]->pi_pid);
-			}
+	while ((kid = us->pi_children) != NULL) {
+		us->pi_children = kid->pi_sibling;
+		kid->pi_sibling = NULL;
+		kid->pi_ppid = INVALID_PID;
+		if (kid->pi_exited) {
+			pi_drop(kid);
+			kid->pi_sibling = dead;
+			dead = kid;
 		}
 	}
 
 	/* Now, wake up our parent */
-	us = pi_get(curproc->p_pid);
-	KASSERT(us != NULL);
-
 	us->pi_exitstatus = status;
 	us->pi_exited = true;
 
 	if (us->pi_ppid == INVALID_PID) {
 		/* no parent */
-		pi_drop(curproc->p_pid);
+		pi_drop(us);
+		us->pi_sibling = dead;
+		dead = us;
 	}
 	else {
-		cv_broadcast(us->pi_cv, pidlock);
+		wchan_wakeall(us->pi_wchan, &pidlock);
 	}
 
 	curproc->p_pid = INVALID_PID;
-	lock_release(pidlock);
+	spinlock_release(&pidlock);
+
+	pidinfo_destroylist(dead);
 }
 
 /*
@@ -392,7 +445,8 @@ pid_setexitstatus(int status)
 int
 pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 {
-	struct pidinfo *them;
+	struct pidinfo *them, *us;
+	int result;
 
 	KASSERT(curproc->p_pid != INVALID_PID);
 
@@ -415,11 +469,11 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		return EINVAL;
 	}
 
-	lock_acquire(pidlock);
+	spinlock_acquire(&pidlock);
 
 	them = pi_get(theirpid);
 	if (them==NULL) {
-		lock_release(pidlock);
+		spinlock_release(&pidlock);
 		return ESRCH;
 	}
 
@@ -427,20 +481,35 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 
 	/* Only allow waiting for own children. */
 	if (them->pi_ppid != curproc->p_pid) {
-		lock_release(pidlock);
+		spinlock_release(&pidlock);
 		return EPERM;
 	}
 
+	/*
+	 * Only our process can free it, and only once it's exited,
+	 * which wakes everyone on its wait channel; so the channel is
+	 * safe to sleep on. But another of our threads may get to it
+	 * first, so look it up again each time we wake up.
+	 */
 	if (them->pi_exited == false) {
 		if (flags == WNOHANG) {
-			lock_release(pidlock);
+			spinlock_release(&pidlock);
 			KASSERT(ret != NULL);
 			*ret = 0;
 			return 0;
 		}
-		/* don't need to loop on this */
-		cv_wait(them->pi_cv, pidlock);
-		KASSERT(them->pi_exited == true);
+		while (them->pi_exited == false) {
+			result = wchan_sleep_intr(them->pi_wchan, &pidlock);
+			them = pi_get(theirpid);
+			if (them == NULL || them->pi_ppid != curproc->p_pid) {
+				spinlock_release(&pidlock);
+				return ECHILD;
+			}
+			if (result) {
+				spinlock_release(&pidlock);
+				return result;
+			}
+		}
 	}
 
 	if (status != NULL) {
@@ -457,9 +526,15 @@ pid_wait(pid_t theirpid, int *status, int flags, pid_t *ret)
 		*ret = theirpid;
 	}
 
-	them->pi_ppid = 0;
-	pi_drop(them->pi_pid);
+	us = pi_get(curproc->p_pid);
+	KASSERT(us != NULL);
+	pi_unlink(us, them);
+
+	them->pi_ppid = INVALID_PID;
+	pi_drop(them);
+
+	spinlock_release(&pidlock);
 
-	lock_release(pidlock);
+	pidinfo_destroy(them);
 	return 0;
 }
@@ -44,6 +44,8 @@
 
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
+#include <lib.h>
 #include <spl.h>
 #include <synch.h>
 #include <proc.h>
@@ -52,6 +54,7 @@
 #include <vnode.h>
 #include <pid.h>
 #include <filetable.h>
+#include <aio.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -84,16 +87,30 @@ proc_create(const char *name)
 		return NULL;
 	}
 	threadarray_init(&proc->p_threads);
+	proc->p_threadscv = cv_create("p_threads");
+	if (proc->p_threadscv == NULL) {
+		threadarray_cleanup(&proc->p_threads);
+		lock_destroy(proc->p_threadslock);
+		kfree(proc->p_name);
+		kfree(proc);
+		return NULL;
+	}
+	proc->p_nlive = 0;
+	proc->p_exiting = false;
+	proc->p_nexttid = 1;
+	bzero(proc->p_uthreads, sizeof(proc->p_uthreads));
 
 	spinlock_init(&proc->p_lock);
 	proc->p_pid = INVALID_PID;
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
+	proc->p_vforksem = NULL;
 
 	/* VFS fields */
 	proc->p_cwd = NULL;
 	proc->p_filetable = NULL;
+	proc->p_aio = NULL;
 
 	return proc;
 }
@@ -125,6 +142,11 @@ proc_destroy(struct proc *proc)
 	 */
 
 	/* VFS fields */
+	if (proc->p_aio) {
+		/* before the files, as its jobs may still be using them */
+		aioctx_destroy(proc->p_aio);
+		proc->p_aio = NULL;
+	}
 	if (proc->p_cwd) {
 		VOP_DECREF(proc->p_cwd);
 		proc->p_cwd = NULL;
@@ -135,6 +157,22 @@ proc_destroy(struct proc *proc)
 	}
 
 	/* VM fields */
+	if (proc->p_vforksem != NULL) {
+		/*
+		 * The address space is our parent's, lent by vfork.
+		 * Take it off the process (as below) but give it
+		 * back instead of destroying it.
+		 */
+		if (proc == curproc) {
+			proc_setas(NULL);
+			as_deactivate();
+		}
+		else {
+			proc->p_addrspace = NULL;
+		}
+		V(proc->p_vforksem);
+		proc->p_vforksem = NULL;
+	}
 	if (proc->p_addrspace) {
 		/*
 		 * If p is the current process, remove it safely from
@@ -185,6 +223,7 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc->p_pid == INVALID_PID);
 	spinlock_cleanup(&proc->p_lock);
 	threadarray_cleanup(&proc->p_threads);
+	cv_destroy(proc->p_threadscv);
 	lock_destroy(proc->p_threadslock);
 
 	kfree(proc->p_name);
@@ -263,7 +302,7 @@ proc_create_runprogram(const char *name, struct proc **ret)
  * (the caller decides that).
  */
 int
-proc_fork(struct proc **ret)
+proc_fork(struct proc **ret, int asmode)
 {
 	struct proc *newproc;
 	struct addrspace *as;
@@ -293,7 +332,10 @@ proc_fork(struct proc **ret)
 
 	/* VM fields */
 	as = proc_getas();
-	if (as != NULL) {
+	if (as != NULL && asmode == PROC_FORK_SHAREAS) {
+		newproc->p_addrspace = as;
+	}
+	else if (as != NULL && asmode == PROC_FORK_COPYAS) {
 		result = as_copy(as, &newproc->p_addrspace);
 		if (result) {
 			pid_unalloc(newproc->p_pid);
@@ -308,7 +350,9 @@ proc_fork(struct proc **ret)
 	if (tbl != NULL) {
 		result = filetable_copy(tbl, &newproc->p_filetable);
 		if (result) {
-			as_destroy(newproc->p_addrspace);
+			if (asmode != PROC_FORK_SHAREAS) {
+				as_destroy(newproc->p_addrspace);
+			}
 			newproc->p_addrspace = NULL;
 			pid_unalloc(newproc->p_pid);
 			newproc->p_pid = INVALID_PID;
@@ -333,6 +377,31 @@ proc_fork(struct proc **ret)
 	return 0;
 }
 
+/*
+ * Called by exec once it has switched the current process to a new
+ * address space, to dispose of the old one. Normally that means
+ * destroying it, but if it was lent to us by vfork, it goes back to
+ * the parent, which can then run again.
+ */
+void
+proc_dropas(struct addrspace *oldas)
+{
+	struct proc *proc = curproc;
+	struct semaphore *sem;
+
+	spinlock_acquire(&proc->p_lock);
+	sem = proc->p_vforksem;
+	proc->p_vforksem = NULL;
+	spinlock_release(&proc->p_lock);
+
+	if (sem != NULL) {
+		V(sem);
+	}
+	else {
+		as_destroy(oldas);
+	}
+}
+
 /*
  * Undo proc_fork if nothing's run in the new process yet.
  */
@@ -344,17 +413,60 @@ proc_unfork(struct proc *newproc)
 	proc_destroy(newproc);
 }
 
+/*
+ * Detach the current thread from its process, which carries on
+ * without it, and get rid of the thread.
+ */
+static
+__DEAD
+void
+proc_thread_leave(void)
+{
+	proc_remthread(curthread);
+	proc_addthread(kproc, curthread);
+	thread_exit();
+}
+
 /*
  * Make the current process exit.
+ *
+ * Any other threads have to go first: they see p_exiting on their way
+ * back to user mode (or in thread_join) and leave, and we wait for the
+ * last of them. If another thread is already doing this, just leave.
+ *
+ * Threads blocked in waitpid, poll, aio_reap, console input, or a
+ * pipe might never get back to user mode, so those sleeps are
+ * interruptible and we interrupt everyone. Other sleeps (disk I/O,
+ * console output, locks, nanosleep) end by themselves soon enough.
  */
 void
 proc_exit(int status)
 {
 	struct proc *proc = curproc;
+	struct thread *t;
+	unsigned i;
 
 	/* The kernel isn't supposed to exit. */
 	KASSERT(proc != kproc);
 
+	lock_acquire(proc->p_threadslock);
+	if (proc->p_exiting) {
+		lock_release(proc->p_threadslock);
+		proc_thread_leave();
+	}
+	proc->p_exiting = true;
+	cv_broadcast(proc->p_threadscv, proc->p_threadslock);
+	for (i=0; i<threadarray_num(&proc->p_threads); i++) {
+		t = threadarray_get(&proc->p_threads, i);
+		if (t != curthread) {
+			thread_interrupt(t);
+		}
+	}
+	while (threadarray_num(&proc->p_threads) > 1) {
+		cv_wait(proc->p_threadscv, proc->p_threadslock);
+	}
+	lock_release(proc->p_threadslock);
+
 	/* Set exit status and wake up anyone waiting for us. */
 	pid_setexitstatus(status);
 
@@ -372,6 +484,179 @@ proc_exit(int status)
 	thread_exit();
 }
 
+/*
+ * Make the current thread exit with value STATUS.
+ *
+ * p_nlive counts the threads that haven't started leaving, so that of
+ * several threads exiting at once exactly one sees itself as the last
+ * and takes the process down.
+ *
+ * The stack goes back before the slot is marked exited, because once
+ * someone joins us the slot (and with it the stack address) can be
+ * handed out again. If the whole process is exiting, the address
+ * space is about to go anyway.
+ */
+__DEAD
+void
+proc_thread_exit(int status)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	unsigned i;
+	bool exiting;
+
+	KASSERT(proc != kproc);
+
+	lock_acquire(proc->p_threadslock);
+	exiting = proc->p_exiting;
+	if (!exiting && proc->p_nlive == 1) {
+		lock_release(proc->p_threadslock);
+		proc_exit(_MKWAIT_EXIT(status));
+		thread_exit();
+	}
+	KASSERT(proc->p_nlive > 0);
+	proc->p_nlive--;
+
+	ut = NULL;
+	for (i=0; i<PROC_MAXUTHREADS; i++) {
+		if (proc->p_uthreads[i].ut_tid != 0 &&
+		    proc->p_uthreads[i].ut_thread == curthread) {
+			ut = &proc->p_uthreads[i];
+			break;
+		}
+	}
+	lock_release(proc->p_threadslock);
+
+	if (ut != NULL) {
+		if (!exiting) {
+			as_remove_threadstack(proc_getas(), i);
+		}
+		lock_acquire(proc->p_threadslock);
+		ut->ut_status = status;
+		ut->ut_exited = true;
+		lock_release(proc->p_threadslock);
+	}
+
+	/* proc_remthread wakes up anyone joining us. */
+	proc_thread_leave();
+}
+
+/*
+ * Reserve a thread slot and ID for thread_create.
+ */
+int
+proc_uthread_alloc(unsigned *slot, unsigned *tid)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	unsigned i;
+
+	lock_acquire(proc->p_threadslock);
+	for (i=0; i<PROC_MAXUTHREADS; i++) {
+		ut = &proc->p_uthreads[i];
+		if (ut->ut_tid == 0) {
+			ut->ut_tid = proc->p_nexttid++;
+			if (proc->p_nexttid == 0) {
+				proc->p_nexttid = 1;
+			}
+			ut->ut_thread = NULL;
+			ut->ut_exited = false;
+			ut->ut_status = 0;
+
+			*slot = i;
+			*tid = ut->ut_tid;
+			lock_release(proc->p_threadslock);
+			return 0;
+		}
+	}
+	lock_release(proc->p_threadslock);
+	return EAGAIN;
+}
+
+/*
+ * Give back a slot whose thread never got started.
+ */
+void
+proc_uthread_free(unsigned slot)
+{
+	struct proc *proc = curproc;
+
+	KASSERT(slot < PROC_MAXUTHREADS);
+
+	lock_acquire(proc->p_threadslock);
+	KASSERT(proc->p_uthreads[slot].ut_thread == NULL);
+	proc->p_uthreads[slot].ut_tid = 0;
+	lock_release(proc->p_threadslock);
+}
+
+/*
+ * Called by a new user thread, before it first goes to user mode, to
+ * claim its slot.
+ */
+void
+proc_uthread_start(unsigned slot)
+{
+	struct proc *proc = curproc;
+
+	KASSERT(slot < PROC_MAXUTHREADS);
+
+	lock_acquire(proc->p_threadslock);
+	KASSERT(proc->p_uthreads[slot].ut_tid != 0);
+	proc->p_uthreads[slot].ut_thread = curthread;
+	lock_release(proc->p_threadslock);
+}
+
+/*
+ * Wait for thread TID to exit, collect its exit value, and free its
+ * slot. Fails with EINTR if the process starts exiting meanwhile.
+ */
+int
+proc_uthread_join(unsigned tid, int *status)
+{
+	struct proc *proc = curproc;
+	struct uthread *ut;
+	unsigned i;
+
+	if (tid == 0) {
+		return ESRCH;
+	}
+
+	lock_acquire(proc->p_threadslock);
+	ut = NULL;
+	for (i=0; i<PROC_MAXUTHREADS; i++) {
+		if (proc->p_uthreads[i].ut_tid == tid) {
+			ut = &proc->p_uthreads[i];
+			break;
+		}
+	}
+	if (ut == NULL) {
+		lock_release(proc->p_threadslock);
+		return ESRCH;
+	}
+	if (ut->ut_thread == curthread) {
+		lock_release(proc->p_threadslock);
+		return EINVAL;
+	}
+
+	/* Someone else might join it first and free the slot. */
+	while (ut->ut_tid == tid && !ut->ut_exited && !proc->p_exiting) {
+		cv_wait(proc->p_threadscv, proc->p_threadslock);
+	}
+	if (ut->ut_tid != tid) {
+		lock_release(proc->p_threadslock);
+		return ESRCH;
+	}
+	if (!ut->ut_exited) {
+		lock_release(proc->p_threadslock);
+		return EINTR;
+	}
+
+	*status = ut->ut_status;
+	ut->ut_tid = 0;
+	lock_release(proc->p_threadslock);
+	return 0;
+}
+
 /*
  * Add a thread to a process. Either the thread or the process might
  * or might not be current.
@@ -391,6 +676,9 @@ proc_addthread(struct proc *proc, struct thread *t)
 
 	lock_acquire(proc->p_threadslock);
 	result = threadarray_add(&proc->p_threads, t, NULL);
+	if (result == 0 && proc != kproc) {
+		proc->p_nlive++;
+	}
 	lock_release(proc->p_threadslock);
 	if (result) {
 		return result;
@@ -428,6 +716,7 @@ proc_remthread(struct thread *t)
 	for (i=0; i<num; i++) {
 		if (threadarray_get(&proc->p_threads, i) == t) {
 			threadarray_remove(&proc->p_threads, i);
+			cv_broadcast(proc->p_threadscv, proc->p_threadslock);
 			lock_release(proc->p_threadslock);
 			goto finish;
 		}
@@ -445,10 +734,9 @@ finish:
 /*
  * Fetch the address space of (the current) process.
  *
- * Caution: address spaces aren't refcounted. If you implement
- * multithreaded processes, make sure to set up a refcount scheme or
- * some other method to make this safe. Otherwise the returned address
- * space might disappear under you.
+ * Address spaces aren't refcounted; this is safe for a thread of the
+ * process because proc_exit waits for all the other threads to leave
+ * before destroying the address space.
  */
 struct addrspace *
 proc_getas(void)
@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous I/O.
+ *
+ * Each request becomes a job that runs on the workqueue: a worker
+ * thread does the VOP_READ or VOP_WRITE and puts the job on the
+ * process's done list, where aio_reap finds it. Workers don't run in
+ * the process's address space, so the data goes through kernel
+ * pages: a write's data is copied in when it's submitted, and a
+ * read's is copied out when it's reaped. Jobs keep their pages until
+ * they're reaped, so AIO_MAXJOBS also bounds the memory a process
+ * can tie up.
+ *
+ * Only seekable objects are allowed. A read from an empty pipe or the
+ * console could tie up a worker indefinitely, and the workqueue is
+ * shared with the rest of the kernel.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/aio.h>
+#include <kern/fcntl.h>
+#include <lib.h>
+#include <uio.h>
+#include <synch.h>
+#include <clock.h>
+#include <proc.h>
+#include <current.h>
+#include <copyinout.h>
+#include <vm.h>
+#include <vnode.h>
+#include <openfile.h>
+#include <filetable.h>
+#include <workqueue.h>
+#include <aio.h>
+#include <syscall.h>
+
+#define AIO_MAXPAGES	DIVROUNDUP(AIO_MAXLEN, PAGE_SIZE)
+
+struct aiojob {
+	struct aiojob *aj_next;		/* Next on the done list */
+	struct aioctx *aj_ctx;		/* Owning context */
+	struct work aj_work;		/* For the workqueue */
+	struct openfile *aj_file;	/* File (we hold a reference) */
+	enum uio_rw aj_rw;		/* Read or write */
+	off_t aj_offset;		/* Where in the file */
+	userptr_t aj_ubuf;		/* User's buffer */
+	size_t aj_len;			/* Amount of data */
+	userptr_t aj_cookie;		/* User's tag */
+	struct iovec aj_iov[AIO_MAXPAGES]; /* Kernel pages for the data */
+	unsigned aj_npages;
+	ssize_t aj_result;		/* Outcome */
+	int aj_errno;
+};
+
+struct aioctx {
+	struct lock *ac_lock;
+	struct cv *ac_cv;		/* Signalled when a job finishes */
+	unsigned ac_njobs;		/* Submitted and not yet reaped */
+	unsigned ac_ndone;		/* ...of which finished */
+	struct aiojob *ac_done;		/* Finished jobs, oldest first */
+	struct aiojob **ac_donetail;
+};
+
+////////////////////////////////////////////////////////////
+// contexts
+
+static
+struct aioctx *
+aioctx_create(void)
+{
+	struct aioctx *ctx;
+
+	ctx = kmalloc(sizeof(*ctx));
+	if (ctx == NULL) {
+		return NULL;
+	}
+	ctx->ac_lock = lock_create("aio");
+	if (ctx->ac_lock == NULL) {
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ac_cv = cv_create("aio");
+	if (ctx->ac_cv == NULL) {
+		lock_destroy(ctx->ac_lock);
+		kfree(ctx);
+		return NULL;
+	}
+	ctx->ac_njobs = 0;
+	ctx->ac_ndone = 0;
+	ctx->ac_done = NULL;
+	ctx->ac_donetail = &ctx->ac_done;
+	return ctx;
+}
+
+/*
+ * Get the current process's context, making it if need be. Another
+ * thread of the process might get there first, so check again after
+ * allocating.
+ */
+static
+int
+aioctx_get(struct aioctx **ret)
+{
+	struct proc *proc = curproc;
+	struct aioctx *ctx;
+
+	spinlock_acquire(&proc->p_lock);
+	ctx = proc->p_aio;
+	spinlock_release(&proc->p_lock);
+	if (ctx != NULL) {
+		*ret = ctx;
+		return 0;
+	}
+
+	ctx = aioctx_create();
+	if (ctx == NULL) {
+		return ENOMEM;
+	}
+	spinlock_acquire(&proc->p_lock);
+	if (proc->p_aio == NULL) {
+		proc->p_aio = ctx;
+		ctx = NULL;
+	}
+	*ret = proc->p_aio;
+	spinlock_release(&proc->p_lock);
+
+	if (ctx != NULL) {
+		aioctx_destroy(ctx);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// jobs
+
+static
+void
+aiojob_destroy(struct aiojob *aj)
+{
+	unsigned i;
+
+	for (i=0; i<aj->aj_npages; i++) {
+		kfree(aj->aj_iov[i].iov_kbase);
+	}
+	if (aj->aj_file != NULL) {
+		openfile_decref(aj->aj_file);
+	}
+	kfree(aj);
+}
+
+/*
+ * Workqueue function: do the I/O and hand the job back.
+ */
+static
+void
+aiojob_run(void *data)
+{
+	struct aiojob *aj = data;
+	struct aioctx *ctx = aj->aj_ctx;
+	struct uio ku;
+	int result;
+
+	ku.uio_iov = aj->aj_iov;
+	ku.uio_iovcnt = aj->aj_npages;
+	ku.uio_offset = aj->aj_offset;
+	ku.uio_resid = aj->aj_len;
+	ku.uio_segflg = UIO_SYSSPACE;
+	ku.uio_rw = aj->aj_rw;
+	ku.uio_space = NULL;
+
+	result = (aj->aj_rw == UIO_READ) ?
+		VOP_READ(aj->aj_file->of_vnode, &ku) :
+		VOP_WRITE(aj->aj_file->of_vnode, &ku);
+	if (result) {
+		aj->aj_result = -1;
+		aj->aj_errno = result;
+	}
+	else {
+		aj->aj_result = aj->aj_len - ku.uio_resid;
+		aj->aj_errno = 0;
+	}
+
+	lock_acquire(ctx->ac_lock);
+	aj->aj_next = NULL;
+	*ctx->ac_donetail = aj;
+	ctx->ac_donetail = &aj->aj_next;
+	ctx->ac_ndone++;
+	cv_broadcast(ctx->ac_cv, ctx->ac_lock);
+	lock_release(ctx->ac_lock);
+}
+
+/*
+ * Check one request and make a job for it. Writes get their data
+ * copied in here, while we're still in the process's address space.
+ */
+static
+int
+aiojob_create(const struct aioreq *req, struct aiojob **ret)
+{
+	struct filetable *ft = curproc->p_filetable;
+	struct openfile *file;
+	struct aiojob *aj;
+	size_t done, len;
+	unsigned i;
+	int badaccmode;
+	int result;
+
+	switch (req->ar_op) {
+	    case AIO_READ: badaccmode = O_WRONLY; break;
+	    case AIO_WRITE: badaccmode = O_RDONLY; break;
+	    default: return EINVAL;
+	}
+	if (req->ar_len > AIO_MAXLEN || req->ar_offset < 0) {
+		return EINVAL;
+	}
+
+	result = filetable_get(ft, req->ar_fd, &file);
+	if (result) {
+		return result;
+	}
+	if (file->of_accmode == badaccmode) {
+		filetable_put(ft, req->ar_fd, file);
+		return EBADF;
+	}
+	if (!VOP_ISSEEKABLE(file->of_vnode)) {
+		filetable_put(ft, req->ar_fd, file);
+		return ESPIPE;
+	}
+	openfile_incref(file);
+	filetable_put(ft, req->ar_fd, file);
+
+	aj = kmalloc(sizeof(*aj));
+	if (aj == NULL) {
+		openfile_decref(file);
+		return ENOMEM;
+	}
+	aj->aj_next = NULL;
+	aj->aj_ctx = NULL;
+	work_init(&aj->aj_work, aiojob_run, aj);
+	work_mayblock(&aj->aj_work);
+	aj->aj_file = file;
+	aj->aj_rw = (req->ar_op == AIO_READ) ? UIO_READ : UIO_WRITE;
+	aj->aj_offset = req->ar_offset;
+	aj->aj_ubuf = (userptr_t)req->ar_buf;
+	aj->aj_len = req->ar_len;
+	aj->aj_cookie = (userptr_t)req->ar_cookie;
+	aj->aj_npages = 0;
+
+	for (done = 0; done < aj->aj_len; done += len) {
+		len = aj->aj_len - done;
+		if (len > PAGE_SIZE) {
+			len = PAGE_SIZE;
+		}
+		i = aj->aj_npages;
+		aj->aj_iov[i].iov_kbase = kmalloc(PAGE_SIZE);
+		if (aj->aj_iov[i].iov_kbase == NULL) {
+			aiojob_destroy(aj);
+			return ENOMEM;
+		}
+		aj->aj_iov[i].iov_len = len;
+		aj->aj_npages++;
+
+		if (aj->aj_rw == UIO_WRITE) {
+			result = copyin(aj->aj_ubuf + done,
+					aj->aj_iov[i].iov_kbase, len);
+			if (result) {
+				aiojob_destroy(aj);
+				return result;
+			}
+		}
+	}
+
+	*ret = aj;
+	return 0;
+}
+
+/*
+ * Fill in a completion for a finished job. For a read, this is where
+ * the data finally reaches the user's buffer.
+ */
+static
+void
+aiojob_finish(struct aiojob *aj, struct aiodone *ad)
+{
+	size_t done, len, total;
+	unsigned i;
+	int result;
+
+	ad->ad_cookie = (void *)aj->aj_cookie;
+	ad->ad_result = aj->aj_result;
+	ad->ad_errno = aj->aj_errno;
+
+	if (aj->aj_rw != UIO_READ || aj->aj_result <= 0) {
+		return;
+	}
+	total = aj->aj_result;
+	done = 0;
+	for (i=0; i<aj->aj_npages && done < total; i++) {
+		len = aj->aj_iov[i].iov_len;
+		if (len > total - done) {
+			len = total - done;
+		}
+		result = copyout(aj->aj_iov[i].iov_kbase,
+				 aj->aj_ubuf + done, len);
+		if (result) {
+			ad->ad_result = -1;
+			ad->ad_errno = result;
+			return;
+		}
+		done += len;
+	}
+}
+
+////////////////////////////////////////////////////////////
+// teardown
+
+/*
+ * Called from proc_destroy. Jobs still running refer to the context,
+ * so wait for them; then drop whatever hasn't been reaped.
+ */
+void
+aioctx_destroy(struct aioctx *ctx)
+{
+	struct aiojob *aj;
+
+	lock_acquire(ctx->ac_lock);
+	while (ctx->ac_ndone < ctx->ac_njobs) {
+		cv_wait(ctx->ac_cv, ctx->ac_lock);
+	}
+	lock_release(ctx->ac_lock);
+
+	while (ctx->ac_done != NULL) {
+		aj = ctx->ac_done;
+		ctx->ac_done = aj->aj_next;
+		aiojob_destroy(aj);
+	}
+
+	cv_destroy(ctx->ac_cv);
+	lock_destroy(ctx->ac_lock);
+	kfree(ctx);
+}
+
+////////////////////////////////////////////////////////////
+// system calls
+
+/*
+ * aio_submit() - start NREQS requests. Returns how many were started;
+ * if one is bad we stop there, and only fail if it was the first.
+ */
+int
+sys_aio_submit(const_userptr_t ureqs, unsigned nreqs, int *retval)
+{
+	struct aioreq *reqs;
+	struct aioctx *ctx;
+	struct aiojob *aj;
+	unsigned i;
+	int result;
+
+	if (nreqs == 0) {
+		*retval = 0;
+		return 0;
+	}
+	if (nreqs > AIO_MAXJOBS) {
+		return EINVAL;
+	}
+
+	result = aioctx_get(&ctx);
+	if (result) {
+		return result;
+	}
+
+	reqs = kmalloc(nreqs * sizeof(reqs[0]));
+	if (reqs == NULL) {
+		return ENOMEM;
+	}
+	result = copyin(ureqs, reqs, nreqs * sizeof(reqs[0]));
+	if (result) {
+		kfree(reqs);
+		return result;
+	}
+
+	for (i=0; i<nreqs; i++) {
+		result = aiojob_create(&reqs[i], &aj);
+		if (result) {
+			break;
+		}
+
+		lock_acquire(ctx->ac_lock);
+		if (ctx->ac_njobs >= AIO_MAXJOBS) {
+			lock_release(ctx->ac_lock);
+			aiojob_destroy(aj);
+			result = EAGAIN;
+			break;
+		}
+		ctx->ac_njobs++;
+		lock_release(ctx->ac_lock);
+
+		aj->aj_ctx = ctx;
+		work_queue(&aj->aj_work);
+	}
+	kfree(reqs);
+
+	if (i == 0) {
+		return result;
+	}
+	*retval = i;
+	return 0;
+}
+
+/*
+ * aio_reap() - collect up to MAX finished requests, waiting until at
+ * least MIN have finished (or as many as are outstanding, if fewer).
+ * TIMEOUT is in milliseconds; negative means wait as long as it
+ * takes, and 0 means don't wait. Returns how many were collected.
+ */
+int
+sys_aio_reap(userptr_t udone, unsigned max, unsigned min, int timeout,
+	     int *retval)
+{
+	struct aioctx *ctx;
+	struct aiodone *done;
+	struct aiojob *jobs, *aj;
+	uint64_t deadline, now;
+	unsigned i, n;
+	int result;
+
+	if (max > AIO_MAXJOBS) {
+		max = AIO_MAXJOBS;
+	}
+	if (min > max) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&curproc->p_lock);
+	ctx = curproc->p_aio;
+	spinlock_release(&curproc->p_lock);
+	if (ctx == NULL || max == 0) {
+		*retval = 0;
+		return 0;
+	}
+
+	done = kmalloc(max * sizeof(done[0]));
+	if (done == NULL) {
+		return ENOMEM;
+	}
+
+	deadline = 0;
+	if (timeout > 0) {
+		deadline = clock_nsecs() + timeout * 1000000ULL;
+	}
+
+	lock_acquire(ctx->ac_lock);
+	while (ctx->ac_ndone < min && ctx->ac_ndone < ctx->ac_njobs &&
+	       timeout != 0) {
+		if (timeout < 0) {
+			/* Interrupted means we're exiting; take what there is */
+			if (cv_wait_intr(ctx->ac_cv, ctx->ac_lock)) {
+				break;
+			}
+			continue;
+		}
+		now = clock_nsecs();
+		if (now >= deadline ||
+		    cv_timedwait(ctx->ac_cv, ctx->ac_lock,
+				 deadline - now) == ETIMEDOUT) {
+			break;
+		}
+	}
+
+	/* Take the jobs off the list, and finish them without the lock */
+	jobs = ctx->ac_done;
+	for (n = 0, aj = NULL; n < max && ctx->ac_done != NULL; n++) {
+		aj = ctx->ac_done;
+		ctx->ac_done = aj->aj_next;
+	}
+	if (aj != NULL) {
+		aj->aj_next = NULL;
+	}
+	if (ctx->ac_done == NULL) {
+		ctx->ac_donetail = &ctx->ac_done;
+	}
+	ctx->ac_ndone -= n;
+	ctx->ac_njobs -= n;
+	lock_release(ctx->ac_lock);
+
+	for (i=0; i<n; i++) {
+		aj = jobs;
+		jobs = aj->aj_next;
+		aiojob_finish(aj, &done[i]);
+		aiojob_destroy(aj);
+	}
+
+	result = 0;
+	if (n > 0) {
+		result = copyout(done, udone, n * sizeof(done[0]));
+	}
+	kfree(done);
+	if (result) {
+		return result;
+	}
+	*retval = n;
+	return 0;
+}
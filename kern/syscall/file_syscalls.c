@@ -37,18 +37,35 @@
 #include <kern/limits.h>
 #include <kern/seek.h>
 #include <kern/stat.h>
+#include <kern/poll.h>
+#include <limits.h>
 #include <lib.h>
+#include <clock.h>
 #include <uio.h>
 #include <proc.h>
 #include <current.h>
 #include <synch.h>
 #include <copyinout.h>
+#include <vm.h>
 #include <vfs.h>
 #include <vnode.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <poll.h>
 #include <syscall.h>
 
+/* readv/writev calls with this few iovecs don't need to kmalloc */
+#define UIO_SMALLIOV	8
+
+/* readv/writev copy in at most a page of iovecs at a time */
+#define UIO_IOVCHUNK	(PAGE_SIZE / sizeof(struct iovec))
+
+/* Largest total a single read or write can report doing */
+#define RW_MAX		((size_t)-1 >> 1)
+
+/* Kernel pages sendfile copies through at a time */
+#define SENDFILE_NPAGES	4
+
 /*
  * open() - get the path with copyinstr, then use openfile_open and
  * filetable_place to do the real work.
@@ -105,46 +122,76 @@ sys_open(const_userptr_t upath, int flags, mode_t mode, int *retval)
 }
 
 /*
- * Common logic for read and write.
+ * Common logic for the read and write calls.
  *
- * Look up the fd, then use VOP_READ or VOP_WRITE.
+ * Look up the fd, then use VOP_READ or VOP_WRITE on a uio made from
+ * IOV, an array of IOVCNT iovecs that's already in the kernel but
+ * still holds user pointers. If POS is NULL, use and update the seek
+ * position; otherwise this is pread/pwrite and we go to *POS without
+ * touching the seek position, so we don't need its lock either.
  */
 static
 int
-sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
-	      int badaccmode, ssize_t *retval)
+sys_readwrite(int fd, struct iovec *iov, unsigned iovcnt, const off_t *pos,
+	      enum uio_rw rw, int badaccmode, ssize_t *retval)
 {
 	struct openfile *file;
 	bool locked;
-	off_t pos;
-	struct iovec iov;
 	struct uio useruio;
+	size_t size;
+	unsigned i;
 	int result;
 
+	/* add up the lengths; the total has to fit in the return value */
+	size = 0;
+	for (i=0; i<iovcnt; i++) {
+		if (iov[i].iov_len > RW_MAX - size) {
+			return EINVAL;
+		}
+		size += iov[i].iov_len;
+	}
+
 	/* better be a valid file descriptor */
 	result = filetable_get(curproc->p_filetable, fd, &file);
 	if (result) {
 		return result;
 	}
 
+	if (file->of_accmode == badaccmode) {
+		filetable_put(curproc->p_filetable, fd, file);
+		return EBADF;
+	}
+
+	if (pos != NULL) {
+		/* there's no such thing as a position in a pipe */
+		if (!VOP_ISSEEKABLE(file->of_vnode)) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return ESPIPE;
+		}
+		if (*pos < 0) {
+			filetable_put(curproc->p_filetable, fd, file);
+			return EINVAL;
+		}
+	}
+
 	/* Only lock the seek position if we're really using it. */
-	locked = VOP_ISSEEKABLE(file->of_vnode);
+	locked = pos == NULL && VOP_ISSEEKABLE(file->of_vnode);
+
+	/* set up a uio with the buffers, their size, and the offset */
+	useruio.uio_iov = iov;
+	useruio.uio_iovcnt = iovcnt;
+	useruio.uio_resid = size;
+	useruio.uio_segflg = UIO_USERSPACE;
+	useruio.uio_rw = rw;
+	useruio.uio_space = proc_getas();
 	if (locked) {
 		lock_acquire(file->of_offsetlock);
-		pos = file->of_offset;
+		useruio.uio_offset = file->of_offset;
 	}
 	else {
-		pos = 0;
+		useruio.uio_offset = pos != NULL ? *pos : 0;
 	}
 
-	if (file->of_accmode == badaccmode) {
-		result = EBADF;
-		goto fail;
-	}
-
-	/* set up a uio with the buffer, its size, and the current offset */
-	uio_uinit(&iov, &useruio, buf, size, pos, rw);
-
 	/* do the read or write */
 	result = (rw == UIO_READ) ?
 		VOP_READ(file->of_vnode, &useruio) :
@@ -162,8 +209,8 @@ sys_readwrite(int fd, userptr_t buf, size_t size, enum uio_rw rw,
 	filetable_put(curproc->p_filetable, fd, file);
 
 	/*
-	 * The amount read (or written) is the original buffer size,
-	 * minus how much is left in it.
+	 * The amount read (or written) is the original total size,
+	 * minus how much is left in the uio.
 	 */
 	*retval = size - useruio.uio_resid;
 
@@ -177,13 +224,136 @@ fail:
 	return result;
 }
 
+/*
+ * Copy in N iovecs starting at index FIRST of the user array IOVPTR.
+ */
+static
+int
+copyin_iovecs(const_userptr_t iovptr, unsigned first, unsigned n,
+	      struct iovec *iov)
+{
+	vaddr_t addr;
+
+	addr = (vaddr_t)iovptr + first * sizeof(struct iovec);
+	return copyin((const_userptr_t)addr, iov, n * sizeof(struct iovec));
+}
+
+/*
+ * Common logic for readv and writev: copy in the iovec array (a few
+ * fit on the stack) and use sys_readwrite.
+ *
+ * kmalloc can't give us more than a page, and IOV_MAX iovecs can be
+ * more than that, so long arrays go UIO_IOVCHUNK at a time. The
+ * whole array is checked before any I/O is done, so a bad entry
+ * anywhere still fails the call cleanly; after that, each chunk is a
+ * separate sys_readwrite, and a short count or an error part way
+ * through ends the call, reporting what got done.
+ */
+static
+int
+sys_readwritev(int fd, const_userptr_t iovptr, int iovcnt,
+	       enum uio_rw rw, int badaccmode, ssize_t *retval)
+{
+	struct iovec smalliov[UIO_SMALLIOV];
+	struct iovec *iov;
+	unsigned count, chunk, done, n, i;
+	size_t total, want;
+	ssize_t got;
+	int result;
+
+	if (iovcnt <= 0 || iovcnt > IOV_MAX) {
+		return EINVAL;
+	}
+	count = iovcnt;
+	chunk = count < UIO_IOVCHUNK ? count : UIO_IOVCHUNK;
+	if (chunk <= UIO_SMALLIOV) {
+		iov = smalliov;
+	}
+	else {
+		iov = kmalloc(chunk * sizeof(struct iovec));
+		if (iov == NULL) {
+			return ENOMEM;
+		}
+	}
+
+	/* check the lengths; the total has to fit in the return value */
+	total = 0;
+	for (done = 0; done < count; done += n) {
+		n = count - done < chunk ? count - done : chunk;
+		result = copyin_iovecs(iovptr, done, n, iov);
+		if (result) {
+			goto out;
+		}
+		for (i=0; i<n; i++) {
+			if (iov[i].iov_len > RW_MAX - total) {
+				result = EINVAL;
+				goto out;
+			}
+			total += iov[i].iov_len;
+		}
+	}
+
+	/* A single chunk is still there from the check. */
+	if (chunk == count) {
+		result = sys_readwrite(fd, iov, count, NULL, rw, badaccmode,
+				       retval);
+		goto out;
+	}
+
+	total = 0;
+	for (done = 0; done < count; done += n) {
+		n = count - done < chunk ? count - done : chunk;
+		result = copyin_iovecs(iovptr, done, n, iov);
+		if (result) {
+			break;
+		}
+		/* recheck, in case another thread changed them */
+		want = 0;
+		for (i=0; i<n; i++) {
+			if (iov[i].iov_len > RW_MAX - total - want) {
+				result = EINVAL;
+				break;
+			}
+			want += iov[i].iov_len;
+		}
+		if (result) {
+			break;
+		}
+		result = sys_readwrite(fd, iov, n, NULL, rw, badaccmode,
+				       &got);
+		if (result) {
+			break;
+		}
+		total += got;
+		if ((size_t)got < want) {
+			break;
+		}
+	}
+	if (total > 0) {
+		result = 0;
+	}
+	if (result == 0) {
+		*retval = total;
+	}
+
+ out:
+	if (iov != smalliov) {
+		kfree(iov);
+	}
+	return result;
+}
+
 /*
  * read() - use sys_readwrite
  */
 int
 sys_read(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_READ, O_WRONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, NULL, UIO_READ, O_WRONLY, retval);
 }
 
 /*
@@ -192,7 +362,224 @@ sys_read(int fd, userptr_t buf, size_t size, int *retval)
 int
 sys_write(int fd, userptr_t buf, size_t size, int *retval)
 {
-	return sys_readwrite(fd, buf, size, UIO_WRITE, O_RDONLY, retval);
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, NULL, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * readv() - use sys_readwritev
+ */
+int
+sys_readv(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * writev() - use sys_readwritev
+ */
+int
+sys_writev(int fd, const_userptr_t iov, int iovcnt, int *retval)
+{
+	return sys_readwritev(fd, iov, iovcnt, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * pread() - use sys_readwrite with an explicit position
+ */
+int
+sys_pread(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, &pos, UIO_READ, O_WRONLY, retval);
+}
+
+/*
+ * pwrite() - use sys_readwrite with an explicit position
+ */
+int
+sys_pwrite(int fd, userptr_t buf, size_t size, off_t pos, int *retval)
+{
+	struct iovec iov;
+
+	iov.iov_ubase = buf;
+	iov.iov_len = size;
+	return sys_readwrite(fd, &iov, 1, &pos, UIO_WRITE, O_RDONLY, retval);
+}
+
+/*
+ * Set up a uio for sendfile over the first LEN bytes of its pages.
+ */
+static
+void
+sendfile_uio(struct uio *ku, struct iovec *iov, size_t len, off_t pos,
+	     enum uio_rw rw)
+{
+	unsigned n;
+	size_t left;
+
+	n = 0;
+	for (left = len; left > 0; left -= iov[n++].iov_len) {
+		iov[n].iov_len = left < PAGE_SIZE ? left : PAGE_SIZE;
+	}
+	ku->uio_iov = iov;
+	ku->uio_iovcnt = n;
+	ku->uio_offset = pos;
+	ku->uio_resid = len;
+	ku->uio_segflg = UIO_SYSSPACE;
+	ku->uio_rw = rw;
+	ku->uio_space = NULL;
+}
+
+/*
+ * sendfile() - copy up to COUNT bytes from INFD to OUTFD, as if by
+ * read and write, but through a few kernel pages instead of a user
+ * buffer, so the data never crosses into user space. Both seek
+ * positions advance by the amount copied.
+ *
+ * If the input isn't seekable (a pipe or the console) we stop after
+ * the first chunk, as read would, instead of waiting for more.
+ *
+ * Like sys_readwrite, we hold the seek position locks of whichever
+ * files are seekable; we take them in address order so two copies
+ * going opposite ways between the same files can't deadlock.
+ */
+int
+sys_sendfile(int outfd, int infd, size_t count, int *retval)
+{
+	struct filetable *ft;
+	struct openfile *infile, *outfile;
+	struct lock *lk1, *lk2, *tmp;
+	struct iovec iov[SENDFILE_NPAGES];
+	struct uio ku;
+	unsigned npages, i;
+	bool inseek, outseek;
+	off_t inpos, outpos;
+	size_t done, len, got, put;
+	int result;
+
+	ft = curproc->p_filetable;
+	if (count > RW_MAX) {
+		count = RW_MAX;
+	}
+
+	result = filetable_get(ft, infd, &infile);
+	if (result) {
+		return result;
+	}
+	result = filetable_get(ft, outfd, &outfile);
+	if (result) {
+		filetable_put(ft, infd, infile);
+		return result;
+	}
+	if (infile == outfile) {
+		result = EINVAL;
+		goto out;
+	}
+	if (infile->of_accmode == O_WRONLY ||
+	    outfile->of_accmode == O_RDONLY) {
+		result = EBADF;
+		goto out;
+	}
+
+	npages = DIVROUNDUP(count, PAGE_SIZE);
+	if (npages > SENDFILE_NPAGES) {
+		npages = SENDFILE_NPAGES;
+	}
+	for (i=0; i<npages; i++) {
+		iov[i].iov_kbase = kmalloc(PAGE_SIZE);
+		if (iov[i].iov_kbase == NULL) {
+			npages = i;
+			result = ENOMEM;
+			goto freepages;
+		}
+	}
+
+	inseek = VOP_ISSEEKABLE(infile->of_vnode);
+	outseek = VOP_ISSEEKABLE(outfile->of_vnode);
+	lk1 = inseek ? infile->of_offsetlock : NULL;
+	lk2 = outseek ? outfile->of_offsetlock : NULL;
+	if (lk1 != NULL && lk2 != NULL && (vaddr_t)lk1 > (vaddr_t)lk2) {
+		tmp = lk1;
+		lk1 = lk2;
+		lk2 = tmp;
+	}
+	if (lk1 != NULL) {
+		lock_acquire(lk1);
+	}
+	if (lk2 != NULL) {
+		lock_acquire(lk2);
+	}
+	inpos = inseek ? infile->of_offset : 0;
+	outpos = outseek ? outfile->of_offset : 0;
+
+	done = 0;
+	while (done < count) {
+		len = count - done;
+		if (len > npages * PAGE_SIZE) {
+			len = npages * PAGE_SIZE;
+		}
+
+		sendfile_uio(&ku, iov, len, inpos, UIO_READ);
+		result = VOP_READ(infile->of_vnode, &ku);
+		if (result) {
+			break;
+		}
+		got = len - ku.uio_resid;
+		if (got == 0) {
+			/* EOF */
+			break;
+		}
+
+		sendfile_uio(&ku, iov, got, outpos, UIO_WRITE);
+		result = VOP_WRITE(outfile->of_vnode, &ku);
+		put = got - ku.uio_resid;
+
+		/* only count what made it out; reread the rest next time */
+		inpos += put;
+		outpos += put;
+		done += put;
+		if (result || put < got || !inseek) {
+			break;
+		}
+	}
+
+	if (inseek) {
+		infile->of_offset = inpos;
+	}
+	if (outseek) {
+		outfile->of_offset = outpos;
+	}
+	if (lk2 != NULL) {
+		lock_release(lk2);
+	}
+	if (lk1 != NULL) {
+		lock_release(lk1);
+	}
+
+	/* as with a short write, an error after some progress is dropped */
+	if (done > 0) {
+		result = 0;
+		*retval = done;
+	}
+	else if (result == 0) {
+		*retval = 0;
+	}
+
+ freepages:
+	for (i=0; i<npages; i++) {
+		kfree(iov[i].iov_kbase);
+	}
+ out:
+	filetable_put(ft, outfd, outfile);
+	filetable_put(ft, infd, infile);
+	return result;
 }
 
 /*
@@ -333,6 +720,186 @@ sys_dup2(int oldfd, int newfd, int *retval)
 	return 0;
 }
 
+/*
+ * pipe() - make a pipe and place its ends in the file table, read end
+ * first, then copy the two fds out.
+ */
+int
+sys_pipe(userptr_t fdsptr)
+{
+	struct filetable *ft;
+	struct openfile *readfile, *writefile;
+	struct openfile *junk;
+	int fds[2];
+	int result;
+
+	ft = curproc->p_filetable;
+
+	result = openfile_pipe(&readfile, &writefile);
+	if (result) {
+		return result;
+	}
+
+	result = filetable_place(ft, readfile, &fds[0]);
+	if (result) {
+		openfile_decref(readfile);
+		openfile_decref(writefile);
+		return result;
+	}
+	result = filetable_place(ft, writefile, &fds[1]);
+	if (result) {
+		openfile_decref(writefile);
+		goto fail;
+	}
+
+	result = copyout(fds, fdsptr, sizeof(fds));
+	if (result) {
+		filetable_placeat(ft, NULL, fds[1], &junk);
+		if (junk != NULL) {
+			openfile_decref(junk);
+		}
+		goto fail;
+	}
+	return 0;
+
+ fail:
+	filetable_placeat(ft, NULL, fds[0], &junk);
+	if (junk != NULL) {
+		openfile_decref(junk);
+	}
+	return result;
+}
+
+/*
+ * poll() - wait for any of a set of files to become ready.
+ *
+ * We hold a reference to each file for the whole call, so nothing
+ * can go away under the poller. The first pass over the files
+ * registers the poller with each one's pollqueue; after that we
+ * sleep until one of them wakes us (or time runs out) and look at
+ * them all again. TIMEOUT is in milliseconds; negative means wait
+ * forever.
+ */
+int
+sys_poll(userptr_t ufds, unsigned nfds, int timeout, int *retval)
+{
+	struct filetable *ft;
+	struct pollfd *fds;
+	struct openfile **files;
+	struct poller pl;
+	uint64_t deadline, now;
+	unsigned i, nready;
+	bool first;
+	int revents, result;
+
+	if (nfds > OPEN_MAX) {
+		return EINVAL;
+	}
+	ft = curproc->p_filetable;
+
+	fds = NULL;
+	files = NULL;
+	if (nfds > 0) {
+		fds = kmalloc(nfds * sizeof(fds[0]));
+		if (fds == NULL) {
+			return ENOMEM;
+		}
+		files = kmalloc(nfds * sizeof(files[0]));
+		if (files == NULL) {
+			kfree(fds);
+			return ENOMEM;
+		}
+		result = copyin(ufds, fds, nfds * sizeof(fds[0]));
+		if (result) {
+			kfree(files);
+			kfree(fds);
+			return result;
+		}
+	}
+
+	/* negative fds are ignored; other bad ones are reported */
+	for (i=0; i<nfds; i++) {
+		fds[i].revents = 0;
+		files[i] = NULL;
+		if (fds[i].fd < 0) {
+			continue;
+		}
+		if (filetable_get(ft, fds[i].fd, &files[i])) {
+			files[i] = NULL;
+			fds[i].revents = POLLNVAL;
+		}
+	}
+
+	result = poller_init(&pl, nfds);
+	if (result) {
+		goto out;
+	}
+
+	deadline = 0;
+	if (timeout > 0) {
+		deadline = clock_nsecs() + timeout * 1000000ULL;
+	}
+
+	first = true;
+	while (1) {
+		poller_prepare(&pl);
+		nready = 0;
+		for (i=0; i<nfds; i++) {
+			if (files[i] != NULL) {
+				result = VOP_POLL(files[i]->of_vnode,
+						  fds[i].events,
+						  first ? &pl : NULL,
+						  &revents);
+				if (result) {
+					goto done;
+				}
+				fds[i].revents = revents;
+			}
+			if (fds[i].revents != 0) {
+				nready++;
+			}
+		}
+		first = false;
+
+		if (nready > 0 || timeout == 0) {
+			break;
+		}
+		if (timeout < 0) {
+			result = poller_wait(&pl, 0);
+		}
+		else {
+			now = clock_nsecs();
+			if (now >= deadline) {
+				break;
+			}
+			result = poller_wait(&pl, deadline - now);
+		}
+		if (result == ETIMEDOUT) {
+			result = 0;
+			break;
+		}
+		if (result) {
+			goto done;
+		}
+	}
+	*retval = nready;
+
+ done:
+	poller_cleanup(&pl);
+ out:
+	for (i=0; i<nfds; i++) {
+		if (files[i] != NULL) {
+			filetable_put(ft, fds[i].fd, files[i]);
+		}
+	}
+	if (result == 0 && nfds > 0) {
+		result = copyout(fds, ufds, nfds * sizeof(fds[0]));
+	}
+	kfree(files);
+	kfree(fds);
+	return result;
+}
+
 /*
  * chdir() - change directory. Send the path off to the vfs layer.
  */
@@ -279,10 +279,13 @@ sys_rename(userptr_t oldpath, userptr_t newpath)
 }
 
 /*
- * getdirentry - call VOP_GETDIRENTRY
+ * Common code for getdirentry and getdirentries. MANY selects
+ * VOP_GETDIRENTRIES (packed struct dirent records) instead of
+ * VOP_GETDIRENTRY (one bare name).
  */
+static
 int
-sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval)
+sys_getdir(int fd, userptr_t buf, size_t buflen, bool many, int *retval)
 {
 	struct iovec iov;
 	struct uio useruio;
@@ -315,7 +318,12 @@ sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval)
 	uio_uinit(&iov, &useruio, buf, buflen, file->of_offset, UIO_READ);
 
 	/* do the read */
-	err = VOP_GETDIRENTRY(file->of_vnode, &useruio);
+	if (many) {
+		err = VOP_GETDIRENTRIES(file->of_vnode, &useruio);
+	}
+	else {
+		err = VOP_GETDIRENTRY(file->of_vnode, &useruio);
+	}
 	if (err) {
 		lock_release(file->of_offsetlock);
 		filetable_put(curproc->p_filetable, fd, file);
@@ -338,6 +346,24 @@ sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval)
 	return 0;
 }
 
+/*
+ * getdirentry - call VOP_GETDIRENTRY
+ */
+int
+sys_getdirentry(int fd, userptr_t buf, size_t buflen, int *retval)
+{
+	return sys_getdir(fd, buf, buflen, false, retval);
+}
+
+/*
+ * getdirentries - call VOP_GETDIRENTRIES
+ */
+int
+sys_getdirentries(int fd, userptr_t buf, size_t buflen, int *retval)
+{
+	return sys_getdir(fd, buf, buflen, true, retval);
+}
+
 /*
  * fstat - call VOP_FSTAT
  */
@@ -37,6 +37,7 @@
 #include <lib.h>
 #include <synch.h>
 #include <vfs.h>
+#include <pipe.h>
 #include <openfile.h>
 
 /*
@@ -116,6 +117,40 @@ openfile_open(char *filename, int openflags, mode_t mode,
 	return 0;
 }
 
+/*
+ * Make a pipe and wrap each end in an openfile object: one for
+ * reading and one for writing.
+ */
+int
+openfile_pipe(struct openfile **readret, struct openfile **writeret)
+{
+	struct vnode *readvn, *writevn;
+	struct openfile *readfile, *writefile;
+	int result;
+
+	result = pipe_create(&readvn, &writevn);
+	if (result) {
+		return result;
+	}
+
+	readfile = openfile_create(readvn, O_RDONLY);
+	if (readfile == NULL) {
+		vfs_close(readvn);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+	writefile = openfile_create(writevn, O_WRONLY);
+	if (writefile == NULL) {
+		openfile_decref(readfile);
+		vfs_close(writevn);
+		return ENOMEM;
+	}
+
+	*readret = readfile;
+	*writeret = writefile;
+	return 0;
+}
+
 /*
  * Increment the reference count on an openfile.
  */
@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Anonymous pipes.
+ *
+ * Data goes through a one-page ring buffer. Readers sleep until
+ * there's something to read and then take whatever is there; writers
+ * sleep until all of their data has gone in.
+ *
+ * A write from a page-aligned user buffer of at least a page doesn't
+ * go through the ring: the writer's page is lent to the pipe
+ * copy-on-write (see vm_loanpage) and the reader copies straight out
+ * of it, so the data is copied once instead of twice. If the writer
+ * scribbles on the page before the reader gets to it, the fault
+ * handler gives the writer its own copy. Loaned pages are only taken
+ * while the ring is empty, so everything on loan was written before
+ * anything in the ring.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/poll.h>
+#include <lib.h>
+#include <stat.h>
+#include <uio.h>
+#include <synch.h>
+#include <poll.h>
+#include <proc.h>
+#include <addrspace.h>
+#include <vm.h>
+#include <vnode.h>
+#include <pipe.h>
+
+#define PIPE_BUFSIZE	PAGE_SIZE	/* Size of the ring buffer */
+#define PIPE_MAXLOANS	4		/* Pages that can be on loan at once */
+
+struct pipeloan {
+	vaddr_t pl_kvaddr;		/* The lent frame */
+	size_t pl_pos;			/* How much has been read from it */
+};
+
+struct pipe {
+	struct lock *pp_lock;
+	struct cv *pp_readcv;		/* Readers wait here for data */
+	struct cv *pp_writecv;		/* Writers wait here for room */
+
+	char *pp_buf;			/* Ring buffer */
+	size_t pp_head;			/* Offset of first byte in ring */
+	size_t pp_count;		/* Bytes in ring */
+
+	struct pipeloan pp_loans[PIPE_MAXLOANS];
+	unsigned pp_loanhead;		/* Oldest loan */
+	unsigned pp_nloans;		/* Number of loans */
+
+	bool pp_reader;			/* Read end still exists */
+	bool pp_writer;			/* Write end still exists */
+
+	struct pollqueue pp_readpq;	/* Pollers on the read end */
+	struct pollqueue pp_writepq;	/* Pollers on the write end */
+
+	struct vnode pp_readvn;
+	struct vnode pp_writevn;
+};
+
+static const struct vnode_ops pipe_vnode_ops;
+
+/*
+ * Free a pipe, returning anything still on loan.
+ */
+static
+void
+pipe_destroy(struct pipe *pp)
+{
+	while (pp->pp_nloans > 0) {
+		free_kpages(pp->pp_loans[pp->pp_loanhead].pl_kvaddr);
+		pp->pp_loanhead = (pp->pp_loanhead + 1) % PIPE_MAXLOANS;
+		pp->pp_nloans--;
+	}
+	kfree(pp->pp_buf);
+	pollqueue_cleanup(&pp->pp_writepq);
+	pollqueue_cleanup(&pp->pp_readpq);
+	cv_destroy(pp->pp_writecv);
+	cv_destroy(pp->pp_readcv);
+	lock_destroy(pp->pp_lock);
+	kfree(pp);
+}
+
+/*
+ * Wake up whoever's waiting to read, or to write, including pollers.
+ * Call with pp_lock held.
+ */
+static
+void
+pipe_wakereaders(struct pipe *pp)
+{
+	cv_broadcast(pp->pp_readcv, pp->pp_lock);
+	pollqueue_wakeup(&pp->pp_readpq);
+}
+
+static
+void
+pipe_wakewriters(struct pipe *pp)
+{
+	cv_broadcast(pp->pp_writecv, pp->pp_lock);
+	pollqueue_wakeup(&pp->pp_writepq);
+}
+
+/*
+ * Make a pipe and return its two ends.
+ */
+int
+pipe_create(struct vnode **readret, struct vnode **writeret)
+{
+	struct pipe *pp;
+	int result;
+
+	pp = kmalloc(sizeof(*pp));
+	if (pp == NULL) {
+		return ENOMEM;
+	}
+	pp->pp_lock = lock_create("pipe");
+	pp->pp_readcv = cv_create("pipe read");
+	pp->pp_writecv = cv_create("pipe write");
+	pp->pp_buf = kmalloc(PIPE_BUFSIZE);
+	if (pp->pp_lock == NULL || pp->pp_readcv == NULL ||
+	    pp->pp_writecv == NULL || pp->pp_buf == NULL) {
+		if (pp->pp_buf != NULL) {
+			kfree(pp->pp_buf);
+		}
+		if (pp->pp_writecv != NULL) {
+			cv_destroy(pp->pp_writecv);
+		}
+		if (pp->pp_readcv != NULL) {
+			cv_destroy(pp->pp_readcv);
+		}
+		if (pp->pp_lock != NULL) {
+			lock_destroy(pp->pp_lock);
+		}
+		kfree(pp);
+		return ENOMEM;
+	}
+	pp->pp_head = 0;
+	pp->pp_count = 0;
+	pp->pp_loanhead = 0;
+	pp->pp_nloans = 0;
+	pp->pp_reader = true;
+	pp->pp_writer = true;
+	pollqueue_init(&pp->pp_readpq);
+	pollqueue_init(&pp->pp_writepq);
+
+	result = vnode_init(&pp->pp_readvn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		pipe_destroy(pp);
+		return result;
+	}
+	result = vnode_init(&pp->pp_writevn, &pipe_vnode_ops, NULL, pp);
+	if (result) {
+		vnode_cleanup(&pp->pp_readvn);
+		pipe_destroy(pp);
+		return result;
+	}
+
+	*readret = &pp->pp_readvn;
+	*writeret = &pp->pp_writevn;
+	return 0;
+}
+
+/*
+ * Called when one end's refcount reaches zero. Wake up anyone on the
+ * other end so they see EOF or EPIPE, and free the pipe once both
+ * ends are gone.
+ */
+static
+int
+pipe_reclaim(struct vnode *v)
+{
+	struct pipe *pp = v->vn_data;
+	bool isreader, last;
+
+	isreader = (v == &pp->pp_readvn);
+
+	/* do this first; the vnode goes with the pipe */
+	vnode_cleanup(v);
+
+	lock_acquire(pp->pp_lock);
+	if (isreader) {
+		pp->pp_reader = false;
+		pipe_wakewriters(pp);
+	}
+	else {
+		pp->pp_writer = false;
+		pipe_wakereaders(pp);
+	}
+	last = !pp->pp_reader && !pp->pp_writer;
+	lock_release(pp->pp_lock);
+
+	if (last) {
+		pipe_destroy(pp);
+	}
+	return 0;
+}
+
+/*
+ * Read. Wait until there's data (or no writer), then take as much as
+ * is there, loaned pages first.
+ */
+static
+int
+pipe_read(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	struct pipeloan *pl;
+	size_t len;
+	int result = 0;
+
+	if (v != &pp->pp_readvn) {
+		return EBADF;
+	}
+
+	lock_acquire(pp->pp_lock);
+	while (pp->pp_nloans == 0 && pp->pp_count == 0) {
+		if (!pp->pp_writer) {
+			/* EOF */
+			lock_release(pp->pp_lock);
+			return 0;
+		}
+		result = cv_wait_intr(pp->pp_readcv, pp->pp_lock);
+		if (result) {
+			lock_release(pp->pp_lock);
+			return result;
+		}
+	}
+
+	while (uio->uio_resid > 0 && pp->pp_nloans > 0) {
+		pl = &pp->pp_loans[pp->pp_loanhead];
+		len = PAGE_SIZE - pl->pl_pos;
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove((char *)pl->pl_kvaddr + pl->pl_pos, len, uio);
+		if (result) {
+			goto done;
+		}
+		pl->pl_pos += len;
+		if (pl->pl_pos == PAGE_SIZE) {
+			/* give it back */
+			free_kpages(pl->pl_kvaddr);
+			pp->pp_loanhead = (pp->pp_loanhead + 1) % PIPE_MAXLOANS;
+			pp->pp_nloans--;
+		}
+	}
+
+	while (uio->uio_resid > 0 && pp->pp_count > 0) {
+		len = PIPE_BUFSIZE - pp->pp_head;
+		if (len > pp->pp_count) {
+			len = pp->pp_count;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(pp->pp_buf + pp->pp_head, len, uio);
+		if (result) {
+			goto done;
+		}
+		pp->pp_head = (pp->pp_head + len) % PIPE_BUFSIZE;
+		pp->pp_count -= len;
+	}
+	if (pp->pp_count == 0) {
+		/* keep the free space in one piece */
+		pp->pp_head = 0;
+	}
+
+ done:
+	pipe_wakewriters(pp);
+	lock_release(pp->pp_lock);
+	return result;
+}
+
+/*
+ * Try to lend the next page of a write to the pipe instead of copying
+ * it into the ring. Returns nonzero if that's not possible, in which
+ * case nothing has happened and the caller should copy.
+ */
+static
+int
+pipe_loan(struct pipe *pp, struct uio *uio)
+{
+	struct iovec *iov;
+	struct pipeloan *pl;
+	vaddr_t ubase, kvaddr;
+	int result;
+
+	if (pp->pp_count > 0 || pp->pp_nloans == PIPE_MAXLOANS) {
+		return EAGAIN;
+	}
+	if (uio->uio_segflg != UIO_USERSPACE ||
+	    uio->uio_space != proc_getas() || uio->uio_iovcnt == 0) {
+		return EINVAL;
+	}
+	iov = uio->uio_iov;
+	ubase = (vaddr_t)iov->iov_ubase;
+	if (iov->iov_len < PAGE_SIZE || (ubase & ~PAGE_FRAME) != 0) {
+		return EINVAL;
+	}
+
+	result = vm_loanpage(ubase, &kvaddr);
+	if (result) {
+		return result;
+	}
+
+	pl = &pp->pp_loans[(pp->pp_loanhead + pp->pp_nloans) % PIPE_MAXLOANS];
+	pl->pl_kvaddr = kvaddr;
+	pl->pl_pos = 0;
+	pp->pp_nloans++;
+
+	/* what uiomove would have done */
+	iov->iov_ubase = (userptr_t)(ubase + PAGE_SIZE);
+	iov->iov_len -= PAGE_SIZE;
+	uio->uio_resid -= PAGE_SIZE;
+	uio->uio_offset += PAGE_SIZE;
+	return 0;
+}
+
+/*
+ * Write. Doesn't return until all the data is in the pipe, unless
+ * the read end goes away, which is EPIPE if nothing was written and
+ * a short count otherwise.
+ */
+static
+int
+pipe_write(struct vnode *v, struct uio *uio)
+{
+	struct pipe *pp = v->vn_data;
+	size_t start, tail, len;
+	int result = 0;
+
+	if (v != &pp->pp_writevn) {
+		return EBADF;
+	}
+
+	start = uio->uio_resid;
+	lock_acquire(pp->pp_lock);
+	while (uio->uio_resid > 0) {
+		if (!pp->pp_reader) {
+			result = EPIPE;
+			break;
+		}
+		if (uio->uio_resid >= PAGE_SIZE && pipe_loan(pp, uio) == 0) {
+			pipe_wakereaders(pp);
+			continue;
+		}
+		if (pp->pp_count == PIPE_BUFSIZE) {
+			result = cv_wait_intr(pp->pp_writecv, pp->pp_lock);
+			if (result) {
+				break;
+			}
+			continue;
+		}
+
+		tail = (pp->pp_head + pp->pp_count) % PIPE_BUFSIZE;
+		len = PIPE_BUFSIZE - pp->pp_count;
+		if (len > PIPE_BUFSIZE - tail) {
+			len = PIPE_BUFSIZE - tail;
+		}
+		if (len > uio->uio_resid) {
+			len = uio->uio_resid;
+		}
+		result = uiomove(pp->pp_buf + tail, len, uio);
+		if (result) {
+			break;
+		}
+		pp->pp_count += len;
+		pipe_wakereaders(pp);
+	}
+	lock_release(pp->pp_lock);
+
+	if (result == EPIPE && uio->uio_resid < start) {
+		result = 0;
+	}
+	return result;
+}
+
+/*
+ * Pipes aren't opened by name, so this shouldn't be reached.
+ */
+static
+int
+pipe_eachopen(struct vnode *v, int flags)
+{
+	(void)v;
+	(void)flags;
+	return EINVAL;
+}
+
+static
+int
+pipe_ioctl(struct vnode *v, int op, userptr_t data)
+{
+	(void)v;
+	(void)op;
+	(void)data;
+	return EIOCTL;
+}
+
+/*
+ * poll: the read end is readable if there's data, the write end
+ * writable if there's room in the ring. Once the other end is gone,
+ * report POLLHUP to the reader (read gives EOF) and POLLERR to the
+ * writer (write gives EPIPE).
+ */
+static
+int
+pipe_poll(struct vnode *v, int events, struct poller *poller, int *revents)
+{
+	struct pipe *pp = v->vn_data;
+	bool isreader;
+	int ready;
+
+	isreader = (v == &pp->pp_readvn);
+	if (poller != NULL) {
+		poller_register(poller,
+				isreader ? &pp->pp_readpq : &pp->pp_writepq);
+	}
+
+	ready = 0;
+	lock_acquire(pp->pp_lock);
+	if (isreader) {
+		if (pp->pp_nloans > 0 || pp->pp_count > 0) {
+			ready |= POLLIN & events;
+		}
+		if (!pp->pp_writer) {
+			ready |= POLLHUP;
+		}
+	}
+	else {
+		if (!pp->pp_reader) {
+			ready |= POLLERR;
+		}
+		else if (pp->pp_count < PIPE_BUFSIZE) {
+			ready |= POLLOUT & events;
+		}
+	}
+	lock_release(pp->pp_lock);
+
+	*revents = ready;
+	return 0;
+}
+
+/*
+ * The size reported is the amount of data waiting to be read.
+ */
+static
+int
+pipe_stat(struct vnode *v, struct stat *statbuf)
+{
+	struct pipe *pp = v->vn_data;
+
+	bzero(statbuf, sizeof(struct stat));
+
+	lock_acquire(pp->pp_lock);
+	statbuf->st_size = pp->pp_count;
+	if (pp->pp_nloans > 0) {
+		statbuf->st_size += pp->pp_nloans * PAGE_SIZE -
+			pp->pp_loans[pp->pp_loanhead].pl_pos;
+	}
+	lock_release(pp->pp_lock);
+
+	statbuf->st_mode = S_IFIFO | 0600;
+	statbuf->st_nlink = 1;
+	statbuf->st_blksize = PIPE_BUFSIZE;
+	return 0;
+}
+
+static
+int
+pipe_gettype(struct vnode *v, mode_t *ret)
+{
+	(void)v;
+	*ret = S_IFIFO;
+	return 0;
+}
+
+static
+bool
+pipe_isseekable(struct vnode *v)
+{
+	(void)v;
+	return false;
+}
+
+static
+int
+pipe_fsync(struct vnode *v)
+{
+	(void)v;
+	return 0;
+}
+
+static
+int
+pipe_truncate(struct vnode *v, off_t len)
+{
+	(void)v;
+	(void)len;
+	return EINVAL;
+}
+
+/*
+ * Function table for pipe vnodes.
+ */
+static const struct vnode_ops pipe_vnode_ops = {
+	.vop_magic = VOP_MAGIC,
+
+	.vop_eachopen = pipe_eachopen,
+	.vop_reclaim = pipe_reclaim,
+	.vop_read = pipe_read,
+	.vop_readlink = vopfail_uio_inval,
+	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirentries = vopfail_uio_notdir,
+	.vop_write = pipe_write,
+	.vop_ioctl = pipe_ioctl,
+	.vop_poll = pipe_poll,
+	.vop_stat = pipe_stat,
+	.vop_gettype = pipe_gettype,
+	.vop_isseekable = pipe_isseekable,
+	.vop_fsync = pipe_fsync,
+	.vop_mmap = vopfail_mmap_nosys,
+	.vop_truncate = pipe_truncate,
+	.vop_namefile = vopfail_uio_notdir,
+	.vop_creat = vopfail_creat_notdir,
+	.vop_symlink = vopfail_symlink_notdir,
+	.vop_mkdir = vopfail_mkdir_notdir,
+	.vop_link = vopfail_link_notdir,
+	.vop_remove = vopfail_string_notdir,
+	.vop_rmdir = vopfail_string_notdir,
+	.vop_rename = vopfail_rename_notdir,
+	.vop_lookup = vopfail_lookup_notdir,
+	.vop_lookparent = vopfail_lookparent_notdir,
+};
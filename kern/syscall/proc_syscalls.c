@@ -37,6 +37,7 @@
 #include <lib.h>
 #include <machine/trapframe.h>
 #include <clock.h>
+#include <synch.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -119,7 +120,7 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	}
 	*ntf = *tf;
 
-	result = proc_fork(&newproc);
+	result = proc_fork(&newproc, PROC_FORK_COPYAS);
 	if (result) {
 		kfree(ntf);
 		return result;
@@ -137,6 +138,73 @@ sys_fork(struct trapframe *tf, pid_t *retval)
 	return 0;
 }
 
+/*
+ * sys_vfork
+ *
+ * Like fork, except that the child borrows our address space instead
+ * of getting a copy, and we wait until it gives it back by exec'ing
+ * or exiting. This skips copying (and marking copy-on-write) the
+ * whole address space just to throw it away in exec.
+ *
+ * If there are other threads in the process they'd be running in the
+ * address space the child is scribbling on, so in that case just do a
+ * normal fork, which vfork is always allowed to be.
+ */
+int
+sys_vfork(struct trapframe *tf, pid_t *retval)
+{
+	struct trapframe *ntf;
+	struct semaphore *sem;
+	struct proc *newproc;
+	unsigned nlive;
+	int result;
+
+	lock_acquire(curproc->p_threadslock);
+	nlive = curproc->p_nlive;
+	lock_release(curproc->p_threadslock);
+	if (nlive > 1) {
+		return sys_fork(tf, retval);
+	}
+
+	sem = sem_create("vfork", 0);
+	if (sem == NULL) {
+		return ENOMEM;
+	}
+
+	/* As in fork; the child frees it. */
+	ntf = kmalloc(sizeof(struct trapframe));
+	if (ntf == NULL) {
+		sem_destroy(sem);
+		return ENOMEM;
+	}
+	*ntf = *tf;
+
+	result = proc_fork(&newproc, PROC_FORK_SHAREAS);
+	if (result) {
+		kfree(ntf);
+		sem_destroy(sem);
+		return result;
+	}
+	newproc->p_vforksem = sem;
+	*retval = newproc->p_pid;
+
+	result = thread_fork(curthread->t_name, newproc,
+			     fork_newthread, ntf, 0);
+	if (result) {
+		/* this Vs the semaphore, but nobody's waiting */
+		proc_unfork(newproc);
+		kfree(ntf);
+		sem_destroy(sem);
+		return result;
+	}
+
+	/* Wait until the child is done with our address space. */
+	P(sem);
+	sem_destroy(sem);
+
+	return 0;
+}
+
 /*
  * sys_waitpid
  * just pass off the work to the pid code.
@@ -36,10 +36,12 @@
 #include <kern/errno.h>
 #include <kern/fcntl.h>
 #include <kern/unistd.h>
+#include <kern/wait.h>
 #include <limits.h>
 #include <lib.h>
 #include <proc.h>
 #include <current.h>
+#include <cpu.h>
 #include <synch.h>
 #include <copyinout.h>
 #include <addrspace.h>
@@ -47,6 +49,7 @@
 #include <vfs.h>
 #include <openfile.h>
 #include <filetable.h>
+#include <pid.h>
 #include <syscall.h>
 #include <test.h>
 
@@ -61,16 +64,22 @@ struct argbuf {
 	size_t len;
 	size_t max;
 	int nargs;
-	bool tooksem;
+	bool pooled;
 };
 
 /*
- * Throttle to limit the number of processes in exec at once. Or,
- * rather, the number trying to use large exec buffers at once. See
- * design notes for the rationale.
+ * Pool of ARG_MAX buffers for execv, so execs don't each have to
+ * allocate (and can't fail to allocate) a large contiguous block.
+ * The buffers are allocated at boot while memory is still
+ * contiguous, enough for every CPU to be in exec at once with some
+ * to spare. If they're all in use we try kmalloc, and only if that
+ * fails do we wait for one to come back.
  */
-#define EXEC_BIGBUF_THROTTLE	1
-static struct semaphore *execthrottle;
+#define EXEC_ARGBUFS_PERCPU	2
+static char **execpool;
+static unsigned execpool_num, execpool_max;
+static struct lock *execpool_lock;
+static struct cv *execpool_cv;
 
 /*
  * Set things up.
@@ -78,10 +87,74 @@ static struct semaphore *execthrottle;
 void
 exec_bootstrap(void)
 {
-	execthrottle = sem_create("exec", EXEC_BIGBUF_THROTTLE);
-	if (execthrottle == NULL) {
-		panic("Cannot create exec throttle semaphore\n");
+	unsigned i;
+
+	execpool_lock = lock_create("execpool");
+	execpool_cv = cv_create("execpool");
+	if (execpool_lock == NULL || execpool_cv == NULL) {
+		panic("Cannot create exec argv pool lock\n");
+	}
+
+	execpool_max = EXEC_ARGBUFS_PERCPU * cpu_count();
+	execpool = kmalloc(execpool_max * sizeof(execpool[0]));
+	if (execpool == NULL) {
+		panic("Cannot allocate exec argv pool\n");
+	}
+	for (i=0; i<execpool_max; i++) {
+		execpool[i] = kmalloc(ARG_MAX);
+		if (execpool[i] == NULL) {
+			panic("Cannot allocate exec argv buffer\n");
+		}
+	}
+	execpool_num = execpool_max;
+}
+
+/*
+ * Get an ARG_MAX buffer, from the pool if possible. Sets *POOLED to
+ * say where it came from.
+ */
+static
+char *
+execpool_get(bool *pooled)
+{
+	char *ret;
+
+	lock_acquire(execpool_lock);
+	while (1) {
+		if (execpool_num > 0) {
+			ret = execpool[--execpool_num];
+			*pooled = true;
+			break;
+		}
+		ret = kmalloc(ARG_MAX);
+		if (ret != NULL) {
+			*pooled = false;
+			break;
+		}
+		cv_wait(execpool_cv, execpool_lock);
+	}
+	lock_release(execpool_lock);
+	return ret;
+}
+
+/*
+ * Give back a buffer from execpool_get.
+ */
+static
+void
+execpool_put(char *buf, bool pooled)
+{
+	if (!pooled) {
+		kfree(buf);
+		/* memory freed up; maybe a waiter can kmalloc now */
+	}
+	lock_acquire(execpool_lock);
+	if (pooled) {
+		KASSERT(execpool_num < execpool_max);
+		execpool[execpool_num++] = buf;
 	}
+	cv_signal(execpool_cv, execpool_lock);
+	lock_release(execpool_lock);
 }
 
 /*
@@ -95,7 +168,7 @@ argbuf_init(struct argbuf *buf)
 	buf->len = 0;
 	buf->max = 0;
 	buf->nargs = 0;
-	buf->tooksem = false;
+	buf->pooled = false;
 }
 
 /*
@@ -106,26 +179,34 @@ void
 argbuf_cleanup(struct argbuf *buf)
 {
 	if (buf->data != NULL) {
-		kfree(buf->data);
+		if (buf->max == ARG_MAX) {
+			execpool_put(buf->data, buf->pooled);
+		}
+		else {
+			kfree(buf->data);
+		}
 		buf->data = NULL;
 	}
 	buf->len = 0;
 	buf->max = 0;
 	buf->nargs = 0;
-	if (buf->tooksem) {
-		V(execthrottle);
-		buf->tooksem = false;
-	}
+	buf->pooled = false;
 }
 
 /*
- * Allocate the memory for an argv buffer.
+ * Allocate the memory for an argv buffer. Full-size buffers come
+ * from the exec pool.
  */
 static
 int
 argbuf_allocate(struct argbuf *buf, size_t size)
 {
-	buf->data = kmalloc(size);
+	if (size == ARG_MAX) {
+		buf->data = execpool_get(&buf->pooled);
+	}
+	else {
+		buf->data = kmalloc(size);
+	}
 	if (buf->data == NULL) {
 		return ENOMEM;
 	}
@@ -215,36 +296,14 @@ argbuf_fromuser(struct argbuf *buf, userptr_t uargv)
 {
 	int result;
 
-	/* try with a small buffer */
-	result = argbuf_allocate(buf, PAGE_SIZE);
+	/* take a full-size buffer from the pool */
+	result = argbuf_allocate(buf, ARG_MAX);
 	if (result) {
 		return result;
 	}
 
 	/* do the copyin */
-	result = argbuf_copyin(buf, uargv);
-	if (result == E2BIG) {
-		/*
-		 * Try again with the full-size buffer. Just start
-		 * over instead of trying to keep the page we already
-		 * did; this is a bit inefficient but it's not that
-		 * important.
-		 */
-		argbuf_cleanup(buf);
-		argbuf_init(buf);
-
-		/* Wait on the semaphore, to throttle this allocation */
-		P(execthrottle);
-		buf->tooksem = true;
-
-		result = argbuf_allocate(buf, ARG_MAX);
-		if (result) {
-			return result;
-		}
-
-		result = argbuf_copyin(buf, uargv);
-	}
-	return result;
+	return argbuf_copyin(buf, uargv);
 }
 
 /*
@@ -392,7 +451,7 @@ loadexec(char *path, vaddr_t *entrypoint, vaddr_t *stackptr)
 	 * nothing left for it to return an error to.
 	 */
 	if (oldvm) {
-		as_destroy(oldvm);
+		proc_dropas(oldvm);
 	}
 
 	/*
@@ -550,6 +609,10 @@ runprogram(char *progname)
  * 3. Load the executable.
  * 4. Copy the argv out again with copyout_args.
  * 5. Warp to usermode.
+ *
+ * Other threads in the process would be left running in the old image
+ * (or in none), and we don't go around killing them, so a process
+ * that has any can't exec.
  */
 int
 sys_execv(userptr_t prog, userptr_t uargv)
@@ -557,9 +620,17 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	char *path;
 	struct argbuf kargv;
 	vaddr_t entrypoint, stackptr;
+	unsigned nlive;
 	int argc;
 	int result;
 
+	lock_acquire(curproc->p_threadslock);
+	nlive = curproc->p_nlive;
+	lock_release(curproc->p_threadslock);
+	if (nlive > 1) {
+		return EBUSY;
+	}
+
 	path = kmalloc(PATH_MAX);
 	if (!path) {
 		return ENOMEM;
@@ -611,3 +682,133 @@ sys_execv(userptr_t prog, userptr_t uargv)
 	panic("enter_new_process returned\n");
 	return EINVAL;
 }
+
+/*
+ * spawnv.
+ *
+ * Make a new process running PROG with argv ARGS, like fork followed
+ * by execv in the child, but without copying our address space only
+ * to throw it away. The child gets a copy of our file table and
+ * current directory, as with fork.
+ *
+ * We copy in the path and argv here, and the child loads the program
+ * and copies the argv out. We wait for it to get that far so that a
+ * bad executable is reported to the caller, like execv would, and so
+ * the child can use our copies of the arguments.
+ */
+
+struct spawninfo {
+	char *path;			/* Program to run */
+	struct argbuf *args;		/* Its argv */
+	struct semaphore *done;		/* V'd when the child is loaded */
+	int result;			/* ...with this outcome */
+};
+
+static
+void
+spawn_newthread(void *vsi, unsigned long junk)
+{
+	struct spawninfo *si = vsi;
+	vaddr_t entrypoint, stackptr;
+	int argc;
+	userptr_t uargv;
+	int result;
+
+	(void)junk;
+
+	/* Load the executable. We don't have an address space yet. */
+	result = loadexec(si->path, &entrypoint, &stackptr);
+	if (result == 0) {
+		result = argbuf_copyout(si->args, &stackptr, &argc, &uargv);
+		if (result) {
+			/* If copyout fails, *we* messed up, so panic */
+			panic("spawnv: copyout_args failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	/* Tell the parent; SI belongs to it, so don't use it after this. */
+	si->result = result;
+	V(si->done);
+
+	if (result) {
+		/* The parent collects our exit status. */
+		proc_exit(_MKWAIT_EXIT(255));
+		thread_exit();
+	}
+
+	/* Warp to user mode. */
+	enter_new_process(argc, uargv, NULL /*uenv*/, stackptr, entrypoint);
+
+	/* enter_new_process does not return. */
+	panic("enter_new_process returned\n");
+}
+
+int
+sys_spawnv(userptr_t prog, userptr_t uargv, pid_t *retval)
+{
+	struct spawninfo si;
+	struct argbuf kargv;
+	struct proc *newproc;
+	pid_t pid;
+	int result;
+
+	si.path = kmalloc(PATH_MAX);
+	if (si.path == NULL) {
+		return ENOMEM;
+	}
+	si.args = &kargv;
+	si.result = 0;
+
+	/* Get the filename. */
+	result = copyinstr(prog, si.path, PATH_MAX, NULL);
+	if (result) {
+		kfree(si.path);
+		return result;
+	}
+
+	/* get the argv strings. */
+	argbuf_init(&kargv);
+	result = argbuf_fromuser(&kargv, uargv);
+	if (result) {
+		goto fail;
+	}
+
+	si.done = sem_create("spawn", 0);
+	if (si.done == NULL) {
+		result = ENOMEM;
+		goto fail;
+	}
+
+	result = proc_fork(&newproc, PROC_FORK_NOAS);
+	if (result) {
+		sem_destroy(si.done);
+		goto fail;
+	}
+	pid = newproc->p_pid;
+
+	result = thread_fork(curthread->t_name, newproc,
+			     spawn_newthread, &si, 0);
+	if (result) {
+		proc_unfork(newproc);
+		sem_destroy(si.done);
+		goto fail;
+	}
+
+	/* Wait for the child to load the program. */
+	P(si.done);
+	sem_destroy(si.done);
+
+	result = si.result;
+	if (result) {
+		/* it's exiting; reap it */
+		pid_wait(pid, NULL, 0, &pid);
+		goto fail;
+	}
+	*retval = pid;
+
+ fail:
+	argbuf_cleanup(&kargv);
+	kfree(si.path);
+	return result;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * User thread syscalls.
+ *
+ * A new thread shares everything with the rest of its process except
+ * its stack, which gets its own region (see as_define_threadstack).
+ * The thread bookkeeping, and what happens when threads exit, is in
+ * proc.c.
+ *
+ * The syscall is __thread_create(entry, func, arg): the thread starts
+ * at ENTRY with FUNC and ARG as its arguments. libc's thread_create
+ * passes a trampoline as ENTRY that calls thread_exit when FUNC
+ * returns; the kernel doesn't care.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <machine/trapframe.h>
+#include <thread.h>
+#include <proc.h>
+#include <current.h>
+#include <addrspace.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/*
+ * What the new thread needs to get going; freed by the new thread.
+ */
+struct newthread {
+	struct trapframe nt_tf;
+	vaddr_t nt_entry;
+	vaddr_t nt_stack;
+	userptr_t nt_func;
+	userptr_t nt_arg;
+};
+
+static
+void
+thread_newthread(void *vnt, unsigned long slot)
+{
+	struct newthread *nt = vnt;
+	struct trapframe mytf;
+	vaddr_t entry, stack;
+	userptr_t func, arg;
+
+	/* Copy everything to our stack so the heap copy can go. */
+	mytf = nt->nt_tf;
+	entry = nt->nt_entry;
+	stack = nt->nt_stack;
+	func = nt->nt_func;
+	arg = nt->nt_arg;
+	kfree(nt);
+
+	proc_uthread_start(slot);
+	enter_new_thread(&mytf, entry, stack, func, arg);
+}
+
+int
+sys___thread_create(struct trapframe *tf, userptr_t entry, userptr_t func,
+		    userptr_t arg, int *retval)
+{
+	struct newthread *nt;
+	unsigned slot, tid;
+	int result;
+
+	nt = kmalloc(sizeof(*nt));
+	if (nt == NULL) {
+		return ENOMEM;
+	}
+	nt->nt_tf = *tf;
+	nt->nt_entry = (vaddr_t)entry;
+	nt->nt_func = func;
+	nt->nt_arg = arg;
+
+	result = proc_uthread_alloc(&slot, &tid);
+	if (result) {
+		kfree(nt);
+		return result;
+	}
+
+	result = as_define_threadstack(proc_getas(), slot, &nt->nt_stack);
+	if (result) {
+		proc_uthread_free(slot);
+		kfree(nt);
+		return result;
+	}
+
+	result = thread_fork(curthread->t_name, NULL,
+			     thread_newthread, nt, slot);
+	if (result) {
+		as_remove_threadstack(proc_getas(), slot);
+		proc_uthread_free(slot);
+		kfree(nt);
+		return result;
+	}
+
+	*retval = tid;
+	return 0;
+}
+
+int
+sys_thread_join(int tid, userptr_t status)
+{
+	int kstatus;
+	int result;
+
+	if (tid <= 0) {
+		return ESRCH;
+	}
+
+	result = proc_uthread_join(tid, &kstatus);
+	if (result) {
+		return result;
+	}
+
+	if (status != NULL) {
+		result = copyout(&kstatus, status, sizeof(int));
+	}
+	return result;
+}
+
+__DEAD
+void
+sys_thread_exit(int status)
+{
+	proc_thread_exit(status);
+}
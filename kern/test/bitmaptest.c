@@ -40,7 +40,7 @@ bitmaptest(int nargs, char **args)
 	struct bitmap *b;
 	char data[TESTSIZE];
 	uint32_t x;
-	int i;
+	int i, result;
 
 	(void)nargs;
 	(void)args;
@@ -101,6 +101,23 @@ bitmaptest(int nargs, char **args)
 		KASSERT(data[i]==0);
 	}
 
+	/* alloc_near takes the goal if free, else searches up and wraps */
+	for (i=0; i<TESTSIZE; i++) {
+		bitmap_unmark(b, i);
+	}
+	bitmap_mark(b, 100);
+	result = bitmap_alloc_near(b, 99, &x);
+	KASSERT(result == 0 && x == 99);
+	result = bitmap_alloc_near(b, 99, &x);
+	KASSERT(result == 0 && x == 101);
+	result = bitmap_alloc_near(b, TESTSIZE-1, &x);
+	KASSERT(result == 0 && x == TESTSIZE-1);
+	result = bitmap_alloc_near(b, TESTSIZE-1, &x);
+	KASSERT(result == 0 && x == 0);
+	(void)result;
+
+	bitmap_destroy(b);
+
 	kprintf("Bitmap test complete\n");
 	return 0;
 }
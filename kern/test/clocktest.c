@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Timer tests.
+ *
+ *    ct1 - nanosleep: sleep for intervals shorter and longer than a
+ *          hardclock, and report how much we overslept by. Fails if
+ *          any sleep is short or more than CT1_MAXLATE long.
+ *    ct2 - timed waits: cv_timedwait times out when nobody signals,
+ *          and returns early when someone does.
+ *    ct3 - preemption: more spinning threads than cpus all get to
+ *          run, rather than waiting for each other to finish.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <cpu.h>
+#include <test.h>
+
+#define CT_ROUNDS	20
+#define CT1_MAXLATE	(2 * 1000000000ULL / HZ)	/* 2 hardclocks */
+
+static const uint64_t ct_intervals[] = {
+	50000,		/* 50 us */
+	500000,		/* 0.5 ms */
+	2000000,	/* 2 ms */
+	15000000,	/* 15 ms (1.5 hardclocks) */
+};
+
+int
+clocktest(int nargs, char **args)
+{
+	uint64_t interval, start, late, maxlate;
+	unsigned i, j;
+	bool failed = false;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting ct1...\n");
+	for (i=0; i<sizeof(ct_intervals)/sizeof(ct_intervals[0]); i++) {
+		interval = ct_intervals[i];
+		late = maxlate = 0;
+		for (j=0; j<CT_ROUNDS; j++) {
+			start = clock_nsecs();
+			clocknanosleep(interval);
+			start = clock_nsecs() - start;
+			if (start < interval) {
+				kprintf("Slept %llu ns, asked for %llu\n",
+					(unsigned long long)start,
+					(unsigned long long)interval);
+				failed = true;
+				continue;
+			}
+			late += start - interval;
+			if (start - interval > maxlate) {
+				maxlate = start - interval;
+			}
+			if (start - interval > CT1_MAXLATE) {
+				kprintf("Slept %llu ns, asked for %llu\n",
+					(unsigned long long)start,
+					(unsigned long long)interval);
+				failed = true;
+			}
+		}
+		kprintf("%8llu ns: late by %llu ns on average, "
+			"%llu ns at most\n",
+			(unsigned long long)interval,
+			(unsigned long long)(late / CT_ROUNDS),
+			(unsigned long long)maxlate);
+	}
+	kprintf(failed ? "Test failed\n" : "Test done.\n");
+	return 0;
+}
+
+static struct lock *ctlock;
+static struct cv *ctcv;
+static struct semaphore *ctdonesem;
+
+static
+void
+ctsignaller(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	clocknanosleep(1000000);
+	lock_acquire(ctlock);
+	cv_signal(ctcv, ctlock);
+	lock_release(ctlock);
+	V(ctdonesem);
+}
+
+int
+clocktest2(int nargs, char **args)
+{
+	uint64_t start;
+	int result;
+	bool failed = false;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting ct2...\n");
+	ctlock = lock_create("ctlock");
+	ctcv = cv_create("ctcv");
+	ctdonesem = sem_create("ctdonesem", 0);
+	if (ctlock == NULL || ctcv == NULL || ctdonesem == NULL) {
+		panic("ct2: out of memory\n");
+	}
+
+	/* Nobody signals: should time out after 3 ms. */
+	lock_acquire(ctlock);
+	start = clock_nsecs();
+	result = cv_timedwait(ctcv, ctlock, 3000000);
+	start = clock_nsecs() - start;
+	lock_release(ctlock);
+	if (result != ETIMEDOUT || start < 3000000) {
+		kprintf("Unsignalled wait: got %d after %llu ns\n", result,
+			(unsigned long long)start);
+		failed = true;
+	}
+
+	/* Signalled after 1 ms: should return well before 1 s. */
+	lock_acquire(ctlock);
+	result = thread_fork("ct2", NULL, ctsignaller, NULL, 0);
+	if (result) {
+		panic("ct2: thread_fork failed: %s\n", strerror(result));
+	}
+	start = clock_nsecs();
+	result = cv_timedwait(ctcv, ctlock, 1000000000);
+	start = clock_nsecs() - start;
+	lock_release(ctlock);
+	P(ctdonesem);
+	if (result != 0 || start >= 1000000000) {
+		kprintf("Signalled wait: got %d after %llu ns\n", result,
+			(unsigned long long)start);
+		failed = true;
+	}
+
+	sem_destroy(ctdonesem);
+	cv_destroy(ctcv);
+	lock_destroy(ctlock);
+	kprintf(failed ? "Test failed\n" : "Test passed.\n");
+	return 0;
+}
+
+#define CT3_SPINNSECS	1000000000ULL	/* Each thread spins this long */
+#define CT3_MAXDELAY	(CT3_SPINNSECS / 2)
+
+static volatile uint64_t *ct3started;
+static volatile unsigned long *ct3loops;
+
+static
+void
+ctspinner(void *junk, unsigned long num)
+{
+	uint64_t start;
+
+	(void)junk;
+
+	start = clock_nsecs();
+	ct3started[num] = start;
+	while (clock_nsecs() - start < CT3_SPINNSECS) {
+		ct3loops[num]++;
+	}
+	V(ctdonesem);
+}
+
+/*
+ * Start one more spinner than there are cpus, so at least two have
+ * to share a cpu. If the timer preempts them, every one starts well
+ * before any other could have finished; if not, someone waits.
+ */
+int
+clocktest3(int nargs, char **args)
+{
+	uint64_t launch, delay;
+	unsigned i, n;
+	int result;
+	bool failed = false;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting ct3...\n");
+	n = cpu_count() + 1;
+	ct3started = kmalloc(n * sizeof(ct3started[0]));
+	ct3loops = kmalloc(n * sizeof(ct3loops[0]));
+	ctdonesem = sem_create("ctdonesem", 0);
+	if (ct3started == NULL || ct3loops == NULL || ctdonesem == NULL) {
+		panic("ct3: out of memory\n");
+	}
+	for (i=0; i<n; i++) {
+		ct3started[i] = 0;
+		ct3loops[i] = 0;
+	}
+
+	launch = clock_nsecs();
+	for (i=0; i<n; i++) {
+		result = thread_fork("ct3", NULL, ctspinner, NULL, i);
+		if (result) {
+			panic("ct3: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<n; i++) {
+		P(ctdonesem);
+	}
+
+	for (i=0; i<n; i++) {
+		delay = ct3started[i] - launch;
+		kprintf("Spinner %u: started after %llu us, %lu loops\n", i,
+			(unsigned long long)(delay / 1000), ct3loops[i]);
+		if (delay >= CT3_MAXDELAY || ct3loops[i] == 0) {
+			failed = true;
+		}
+	}
+
+	sem_destroy(ctdonesem);
+	kfree((void *)ct3loops);
+	kfree((void *)ct3started);
+	kprintf(failed ? "Test failed\n" : "Test passed.\n");
+	return 0;
+}
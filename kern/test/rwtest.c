@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Reader-writer lock tests.
+ *
+ *    rwt1 - stress: readers check that nobody writes under them, and
+ *           writers that they're alone.
+ *    rwt2 - writer preference: a reader arriving after a waiting
+ *           writer waits for it.
+ *    rwt3 - no reader starvation: readers waiting when a writer lets
+ *           go get in ahead of writers queued behind it.
+ *    rwt4 - upgrade and downgrade.
+ *
+ * rwt2-4 use clocksleep to let threads get to where they're supposed
+ * to block, like the semaphore unit tests.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <test.h>
+
+#define NRWTHREADS	16
+#define NRWLOOPS	200
+
+static struct rwlock *testrw;
+static struct semaphore *rwdonesem;
+static struct spinlock rwtest_lock = SPINLOCK_INITIALIZER;
+
+/* Protected by testrw (and rwtest_lock for the reader count) */
+static volatile unsigned long rwval1, rwval2;
+static volatile unsigned rwreaders, rwwriters, rwmaxreaders;
+static volatile bool rwfailed;
+
+/* Order in which threads got the lock, for rwt2-4. */
+static char rworder[16];
+static volatile unsigned rwordernext;
+
+static
+void
+rwinit(void)
+{
+	testrw = rwlock_create("testrw");
+	if (testrw == NULL) {
+		panic("rwtest: rwlock_create failed\n");
+	}
+	rwdonesem = sem_create("rwdonesem", 0);
+	if (rwdonesem == NULL) {
+		panic("rwtest: sem_create failed\n");
+	}
+	rwval1 = rwval2 = 0;
+	rwreaders = rwwriters = rwmaxreaders = 0;
+	rwfailed = false;
+	rwordernext = 0;
+}
+
+static
+void
+rwcleanup(void)
+{
+	rwlock_destroy(testrw);
+	testrw = NULL;
+	sem_destroy(rwdonesem);
+	rwdonesem = NULL;
+}
+
+static
+void
+rwfork(const char *name, void (*func)(void *, unsigned long),
+       unsigned long num)
+{
+	int result;
+
+	result = thread_fork(name, NULL, func, NULL, num);
+	if (result) {
+		panic("rwtest: thread_fork failed: %s\n", strerror(result));
+	}
+}
+
+static
+void
+rwnote(char c)
+{
+	spinlock_acquire(&rwtest_lock);
+	KASSERT(rwordernext < sizeof(rworder) - 1);
+	rworder[rwordernext++] = c;
+	rworder[rwordernext] = 0;
+	spinlock_release(&rwtest_lock);
+}
+
+static
+void
+rwcheck(const char *want)
+{
+	if (strcmp(rworder, want)) {
+		kprintf("Got lock in order %s, expected %s\n", rworder, want);
+		kprintf("Test failed\n");
+	}
+	else {
+		kprintf("Test passed.\n");
+	}
+}
+
+////////////////////////////////////////////////////////////
+// rwt1
+
+static
+void
+rwt1thread(void *junk, unsigned long num)
+{
+	unsigned i, n;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if ((num + i) % 4 == 0) {
+			rwlock_acquire_write(testrw);
+			if (rwreaders != 0 || rwwriters != 0) {
+				rwfailed = true;
+			}
+			rwwriters++;
+			rwval1 = num;
+			thread_yield();
+			rwval2 = num * 2;
+			rwwriters--;
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			spinlock_acquire(&rwtest_lock);
+			n = ++rwreaders;
+			if (n > rwmaxreaders) {
+				rwmaxreaders = n;
+			}
+			spinlock_release(&rwtest_lock);
+
+			if (rwwriters != 0 || rwval2 != rwval1 * 2) {
+				rwfailed = true;
+			}
+			thread_yield();
+			if (rwwriters != 0 || rwval2 != rwval1 * 2) {
+				rwfailed = true;
+			}
+
+			spinlock_acquire(&rwtest_lock);
+			rwreaders--;
+			spinlock_release(&rwtest_lock);
+			rwlock_release_read(testrw);
+		}
+	}
+	V(rwdonesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting rwt1...\n");
+	rwinit();
+	for (i=0; i<NRWTHREADS; i++) {
+		rwfork("rwt1", rwt1thread, i);
+	}
+	for (i=0; i<NRWTHREADS; i++) {
+		P(rwdonesem);
+	}
+
+	if (rwfailed) {
+		kprintf("Test failed\n");
+	}
+	else {
+		kprintf("Test passed; up to %u readers at once.\n",
+			rwmaxreaders);
+	}
+	rwcleanup();
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// rwt2, rwt3
+
+static
+void
+rwreader(void *junk, unsigned long c)
+{
+	(void)junk;
+
+	rwlock_acquire_read(testrw);
+	rwnote(c);
+	rwlock_release_read(testrw);
+	V(rwdonesem);
+}
+
+static
+void
+rwwriter(void *junk, unsigned long c)
+{
+	(void)junk;
+
+	rwlock_acquire_write(testrw);
+	rwnote(c);
+	rwlock_release_write(testrw);
+	V(rwdonesem);
+}
+
+/*
+ * Hold a read lock; queue writer W and then reader r behind it. r
+ * must not slip in past W even though the lock is only read-held.
+ */
+int
+rwtest2(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting rwt2...\n");
+	rwinit();
+
+	rwlock_acquire_read(testrw);
+	rwfork("rwt2 writer", rwwriter, 'W');
+	clocksleep(1);
+	rwfork("rwt2 reader", rwreader, 'r');
+	clocksleep(1);
+	rwnote('R');
+	rwlock_release_read(testrw);
+
+	P(rwdonesem);
+	P(rwdonesem);
+	rwcheck("RWr");
+	rwcleanup();
+	return 0;
+}
+
+/*
+ * Hold a write lock; queue two readers (a), then writer W. When we
+ * let go, both readers must get in before W.
+ */
+int
+rwtest3(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting rwt3...\n");
+	rwinit();
+
+	rwlock_acquire_write(testrw);
+	rwfork("rwt3 reader", rwreader, 'a');
+	rwfork("rwt3 reader", rwreader, 'a');
+	clocksleep(1);
+	rwfork("rwt3 writer", rwwriter, 'W');
+	clocksleep(1);
+	rwnote('X');
+	rwlock_release_write(testrw);
+
+	P(rwdonesem);
+	P(rwdonesem);
+	P(rwdonesem);
+	rwcheck("XaaW");
+	rwcleanup();
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// rwt4
+
+/*
+ * A second reader that tries to upgrade while the main thread is
+ * already waiting to: that must fail rather than deadlock. Meanwhile
+ * new readers must wait for the pending upgrade.
+ */
+static
+void
+rwt4holder(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	rwlock_acquire_read(testrw);
+	V(rwdonesem);
+
+	/* Let the main thread start upgrading, and a reader queue up. */
+	clocksleep(1);
+	rwfork("rwt4 reader", rwreader, 'b');
+	clocksleep(1);
+
+	if (rwlock_upgrade(testrw)) {
+		kprintf("Second upgrade succeeded\n");
+		rwfailed = true;
+		rwlock_release_write(testrw);
+	}
+	else {
+		rwnote('h');
+		rwlock_release_read(testrw);
+	}
+	V(rwdonesem);
+}
+
+/*
+ * Upgrade while another reader holds the lock, which must wait for
+ * it; then downgrade, after which the waiting reader shares the lock
+ * with us.
+ */
+int
+rwtest4(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting rwt4...\n");
+	rwinit();
+
+	rwlock_acquire_read(testrw);
+	rwfork("rwt4 holder", rwt4holder, 0);
+	P(rwdonesem);
+
+	if (!rwlock_upgrade(testrw)) {
+		panic("rwt4: upgrade failed with no competition\n");
+	}
+	KASSERT(rwlock_do_i_hold_write(testrw));
+	rwnote('U');
+
+	/* The reader is still waiting... */
+	clocksleep(1);
+	rwnote('D');
+
+	/* ...until we downgrade, when it can share with us. */
+	rwlock_downgrade(testrw);
+	KASSERT(!rwlock_do_i_hold_write(testrw));
+	P(rwdonesem);
+	P(rwdonesem);
+	rwlock_release_read(testrw);
+
+	if (rwfailed) {
+		kprintf("Test failed\n");
+	}
+	else {
+		rwcheck("hUDb");
+	}
+	rwcleanup();
+	return 0;
+}
@@ -32,6 +32,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <kern/wait.h>
 #include <lib.h>
 #include <clock.h>
@@ -221,6 +222,106 @@ locktest(int nargs, char **args)
 	return 0;
 }
 
+/*
+ * Lock contention benchmark. A handful of threads hammer one lock,
+ * each holding it just long enough to do a little work, which is the
+ * case adaptive spinning in lock_acquire is meant to help. Reports
+ * the wall-clock time and the average cost of a lock/unlock pair.
+ *
+ * Usage: sy5 [threads [loops]]
+ */
+
+#define LOCKBENCH_THREADS	8
+#define LOCKBENCH_LOOPS		2000
+#define LOCKBENCH_WORK		20
+
+static struct lock *benchlock;
+static volatile unsigned long benchcount;
+
+static
+void
+lockbenchthread(void *junk, unsigned long loops)
+{
+	unsigned long i;
+	volatile unsigned j;
+
+	(void)junk;
+
+	for (i=0; i<loops; i++) {
+		lock_acquire(benchlock);
+		for (j=0; j<LOCKBENCH_WORK; j++) {
+			benchcount++;
+		}
+		lock_release(benchlock);
+	}
+	V(donesem);
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	unsigned long nthreads, loops, total;
+	uint64_t nsecs;
+	struct timespec ts1, ts2;
+	unsigned long i;
+	int result;
+
+	nthreads = LOCKBENCH_THREADS;
+	loops = LOCKBENCH_LOOPS;
+	if (nargs > 1) {
+		nthreads = atoi(args[1]);
+	}
+	if (nargs > 2) {
+		loops = atoi(args[2]);
+	}
+	if (nthreads == 0 || loops == 0) {
+		kprintf("Usage: sy5 [threads [loops]]\n");
+		return EINVAL;
+	}
+
+	inititems();
+	benchlock = lock_create("benchlock");
+	if (benchlock == NULL) {
+		panic("lockbench: lock_create failed\n");
+	}
+	benchcount = 0;
+
+	kprintf("Starting lock contention benchmark: %lu threads, "
+		"%lu loops...\n", nthreads, loops);
+
+	gettime(&ts1);
+	for (i=0; i<nthreads; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, loops);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<nthreads; i++) {
+		P(donesem);
+	}
+	gettime(&ts2);
+
+	/* ts2 -= ts1 */
+	timespec_sub(&ts2, &ts1, &ts2);
+
+	total = nthreads * loops;
+	KASSERT(benchcount == total * LOCKBENCH_WORK);
+	nsecs = ts2.tv_sec * 1000000000ULL + ts2.tv_nsec;
+
+	kprintf("%lu lock/unlock pairs in %llu.%09lu seconds "
+		"(%lu ns each)\n", total, (unsigned long long)ts2.tv_sec,
+		(unsigned long)ts2.tv_nsec, (unsigned long)(nsecs / total));
+
+	lock_destroy(benchlock);
+	benchlock = NULL;
+
+	kprintf("Lock contention benchmark done.\n");
+
+	return 0;
+}
+
 static
 void
 cvtestthread(void *junk, unsigned long num)
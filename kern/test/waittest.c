@@ -108,7 +108,7 @@ dofork(const char *name, void (*func)(void *, unsigned long),
 	struct proc *proc;
 	int result;
 
-	result = proc_fork(&proc);
+	result = proc_fork(&proc, PROC_FORK_COPYAS);
 	if (result) {
 		return result;
 	}
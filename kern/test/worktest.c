@@ -0,0 +1,289 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Workqueue tests.
+ *
+ *    wq1 - queue a batch of items, some from thread context and some
+ *          from a timeout (interrupt context); check they each run
+ *          once, and that requeueing a pending item fails.
+ *    wq2 - delayed work runs after its delay, and cancelled work
+ *          doesn't run at all.
+ *    wq3 - items that sleep get spread over more workers, but no more
+ *          than WORKQUEUE_MAXWORKERS.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <synch.h>
+#include <clock.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NWQITEMS	32
+
+static struct work wqitems[NWQITEMS];
+static struct semaphore *wqdonesem;
+static struct spinlock wqtest_lock = SPINLOCK_INITIALIZER;
+static volatile unsigned wqran[NWQITEMS];
+static volatile unsigned wqrunning, wqmaxrunning;
+static volatile bool wqfailed;
+static uint64_t wqstamp[NWQITEMS];
+
+static
+void
+wqinit(void)
+{
+	wqdonesem = sem_create("wqdonesem", 0);
+	if (wqdonesem == NULL) {
+		panic("wqtest: sem_create failed\n");
+	}
+	wqrunning = wqmaxrunning = 0;
+	wqfailed = false;
+}
+
+static
+void
+wqcleanup(void)
+{
+	sem_destroy(wqdonesem);
+	wqdonesem = NULL;
+}
+
+////////////////////////////////////////////////////////////
+// wq1
+
+static
+void
+wq1func(void *data)
+{
+	unsigned num = (unsigned)(uintptr_t)data;
+
+	spinlock_acquire(&wqtest_lock);
+	wqran[num]++;
+	spinlock_release(&wqtest_lock);
+	V(wqdonesem);
+}
+
+/* Queue the second half of the items from interrupt context. */
+static
+void
+wq1timeout(void *data)
+{
+	unsigned i;
+
+	(void)data;
+	for (i=NWQITEMS/2; i<NWQITEMS; i++) {
+		work_queue(&wqitems[i]);
+	}
+}
+
+int
+wqtest(int nargs, char **args)
+{
+	struct timeout to;
+	unsigned i;
+	int spl;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting wq1...\n");
+	wqinit();
+	for (i=0; i<NWQITEMS; i++) {
+		work_init(&wqitems[i], wq1func, (void *)(uintptr_t)i);
+		wqran[i] = 0;
+	}
+
+	/* Queue the first half, and set the timeout for the rest. */
+	timeout_init(&to, wq1timeout, NULL);
+	spl = splhigh();
+	for (i=0; i<NWQITEMS/2; i++) {
+		if (!work_queue(&wqitems[i])) {
+			wqfailed = true;
+		}
+	}
+	if (work_queue(&wqitems[0])) {
+		kprintf("Queued a pending item twice\n");
+		wqfailed = true;
+	}
+	timeout_add(&to, 1000000);
+	splx(spl);
+
+	for (i=0; i<NWQITEMS; i++) {
+		P(wqdonesem);
+	}
+	timeout_cancel(&to);
+
+	/* Let any extra (wrong) runs happen before we look. */
+	clocknanosleep(10000000);
+	for (i=0; i<NWQITEMS; i++) {
+		if (wqran[i] != 1) {
+			kprintf("Item %u ran %u times\n", i, wqran[i]);
+			wqfailed = true;
+		}
+	}
+
+	if (wqfailed) {
+		kprintf("Test failed\n");
+	}
+	else {
+		kprintf("Test passed.\n");
+	}
+	wqcleanup();
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// wq2
+
+static
+void
+wq2func(void *data)
+{
+	unsigned num = (unsigned)(uintptr_t)data;
+
+	wqstamp[num] = clock_nsecs();
+	V(wqdonesem);
+}
+
+int
+wqtest2(int nargs, char **args)
+{
+	uint64_t start;
+	unsigned i;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting wq2...\n");
+	wqinit();
+	for (i=0; i<3; i++) {
+		work_init(&wqitems[i], wq2func, (void *)(uintptr_t)i);
+		wqstamp[i] = 0;
+	}
+
+	start = clock_nsecs();
+	work_queue_delayed(&wqitems[0], 5000000);
+	work_queue_delayed(&wqitems[1], 2000000);
+	work_queue_delayed(&wqitems[2], 3000000);
+	if (!work_cancel(&wqitems[2])) {
+		kprintf("Couldn't cancel delayed item\n");
+		wqfailed = true;
+	}
+
+	P(wqdonesem);
+	P(wqdonesem);
+	/* Give the cancelled one time to (wrongly) go off. */
+	clocknanosleep(10000000);
+
+	if (wqstamp[1] - start < 2000000 || wqstamp[0] - start < 5000000 ||
+	    wqstamp[0] < wqstamp[1]) {
+		kprintf("Items ran at +%llu and +%llu ns\n",
+			(unsigned long long)(wqstamp[0] - start),
+			(unsigned long long)(wqstamp[1] - start));
+		wqfailed = true;
+	}
+	if (wqstamp[2] != 0) {
+		kprintf("Cancelled item ran\n");
+		wqfailed = true;
+	}
+	if (work_cancel(&wqitems[0])) {
+		kprintf("Cancelled an item that already ran\n");
+		wqfailed = true;
+	}
+
+	kprintf(wqfailed ? "Test failed\n" : "Test passed.\n");
+	wqcleanup();
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+// wq3
+
+static
+void
+wq3func(void *data)
+{
+	(void)data;
+
+	spinlock_acquire(&wqtest_lock);
+	wqrunning++;
+	if (wqrunning > wqmaxrunning) {
+		wqmaxrunning = wqrunning;
+	}
+	spinlock_release(&wqtest_lock);
+
+	clocknanosleep(5000000);
+
+	spinlock_acquire(&wqtest_lock);
+	wqrunning--;
+	spinlock_release(&wqtest_lock);
+	V(wqdonesem);
+}
+
+int
+wqtest3(int nargs, char **args)
+{
+	unsigned i;
+	int spl;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting wq3...\n");
+	wqinit();
+	for (i=0; i<NWQITEMS; i++) {
+		work_init(&wqitems[i], wq3func, NULL);
+	}
+
+	/* All on one cpu, so they share its workers. */
+	spl = splhigh();
+	for (i=0; i<NWQITEMS; i++) {
+		work_queue(&wqitems[i]);
+	}
+	splx(spl);
+
+	for (i=0; i<NWQITEMS; i++) {
+		P(wqdonesem);
+	}
+
+	kprintf("Up to %u items ran at once\n", wqmaxrunning);
+	if (wqmaxrunning < 2 || wqmaxrunning > WORKQUEUE_MAXWORKERS) {
+		kprintf("Test failed\n");
+	}
+	else {
+		kprintf("Test passed.\n");
+	}
+	wqcleanup();
+	return 0;
+}
@@ -29,18 +29,27 @@
 
 #include <types.h>
 #include <lib.h>
+#include <spl.h>
 #include <cpu.h>
 #include <wchan.h>
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Each CPU has a sorted list of pending timeouts. The timer hardware
+ * is programmed one-shot for the earlier of the first timeout and the
+ * next hardclock, so timeouts go off when they're due rather than at
+ * the next tick. A CPU sitting in the idle loop turns its tick off
+ * and wakes only for timeouts, interrupts, and an occasional check
+ * for threads to migrate.
+ *
+ * The lists are expected to be short (one entry per sleeping thread,
+ * at most) so a sorted list is good enough; a busier kernel would
+ * want a heap or a timer wheel.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -48,16 +57,19 @@
 
 /*
  * Timing constants. These should be tuned along with any work done on
- * the scheduler.
+ * the scheduler. (The scheduler's time slices are in thread.c.)
  */
-#define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
 
+#define NSECS_PER_SEC		1000000000ULL
+#define TICK_NSECS		(NSECS_PER_SEC / HZ)
+#define TIMER_MAX_NSECS		NSECS_PER_SEC	/* Furthest we program */
+
 /*
- * Once a second, everything waiting on lbolt is awakened by CPU 0.
+ * Timed sleeps wait here; timeouts wake them up individually.
  */
-static struct wchan *lbolt;
-static struct spinlock lbolt_lock;
+static struct wchan *sleep_wchan;
+static struct spinlock sleep_lock;
 
 /*
  * Setup.
@@ -65,29 +77,280 @@ static struct spinlock lbolt_lock;
 void
 hardclock_bootstrap(void)
 {
-	spinlock_init(&lbolt_lock);
-	lbolt = wchan_create("lbolt");
-	if (lbolt == NULL) {
-		panic("Couldn't create lbolt\n");
+	spinlock_init(&sleep_lock);
+	sleep_wchan = wchan_create("clocksleep");
+	if (sleep_wchan == NULL) {
+		panic("Couldn't create clocksleep wchan\n");
 	}
 }
 
+uint64_t
+clock_nsecs(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return ts.tv_sec * NSECS_PER_SEC + ts.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////
+// timeouts
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = NULL;
+	to->to_cpu = NULL;
+	to->to_when = 0;
+	to->to_pending = false;
+	to->to_func = func;
+	to->to_data = data;
+}
+
 /*
- * This is called once per second, on one processor, by the timer
- * code.
+ * Program this CPU's timer for whatever is due next: the first
+ * timeout, or the next hardclock; or when the tick is stopped, the
+ * next hardclock on which we'd look for threads to migrate.
  */
+static
 void
-timerclock(void)
+clock_rearm(struct cpu *c, uint64_t now)
 {
-	/* Just broadcast on lbolt */
-	spinlock_acquire(&lbolt_lock);
-	wchan_wakeall(lbolt, &lbolt_lock);
-	spinlock_release(&lbolt_lock);
+	uint64_t when, delta;
+	unsigned next, skip;
+
+	KASSERT(c == curcpu->c_self);
+	KASSERT(spinlock_do_i_hold(&c->c_timeout_lock));
+
+	when = c->c_nexttick;
+	if (c->c_tickless) {
+		next = c->c_hardclocks + 1;
+		skip = (MIGRATE_HARDCLOCKS - next % MIGRATE_HARDCLOCKS)
+			% MIGRATE_HARDCLOCKS;
+		when += (uint64_t)skip * TICK_NSECS;
+	}
+	if (c->c_timeouts != NULL && c->c_timeouts->to_when < when) {
+		when = c->c_timeouts->to_when;
+	}
+
+	delta = (when > now) ? when - now : 0;
+	if (delta > TIMER_MAX_NSECS) {
+		delta = TIMER_MAX_NSECS;
+	}
+	mainbus_settimer(delta);
+}
+
+void
+timeout_add(struct timeout *to, uint64_t nsecs)
+{
+	struct timeout **pp;
+	struct cpu *c;
+	uint64_t now;
+	int spl;
+
+	KASSERT(!to->to_pending);
+
+	/* Stay on this cpu until it's on the list. */
+	spl = splhigh();
+	c = curcpu->c_self;
+	now = clock_nsecs();
+	to->to_when = now + nsecs;
+
+	spinlock_acquire(&c->c_timeout_lock);
+	pp = &c->c_timeouts;
+	while (*pp != NULL && (*pp)->to_when <= to->to_when) {
+		pp = &(*pp)->to_next;
+	}
+	to->to_next = *pp;
+	*pp = to;
+	to->to_cpu = c;
+	to->to_pending = true;
+	if (c->c_timeouts == to) {
+		/* New first deadline */
+		clock_rearm(c, now);
+	}
+	spinlock_release(&c->c_timeout_lock);
+	splx(spl);
+}
+
+bool
+timeout_cancel(struct timeout *to)
+{
+	struct timeout **pp;
+	struct cpu *c;
+
+	while ((c = to->to_cpu) != NULL) {
+		spinlock_acquire(&c->c_timeout_lock);
+		if (to->to_cpu != c) {
+			/* Finished while we were getting the lock */
+			spinlock_release(&c->c_timeout_lock);
+			continue;
+		}
+		if (to->to_pending) {
+			for (pp = &c->c_timeouts; *pp != to;
+			     pp = &(*pp)->to_next) {
+				KASSERT(*pp != NULL);
+			}
+			*pp = to->to_next;
+			to->to_next = NULL;
+			to->to_cpu = NULL;
+			to->to_pending = false;
+			spinlock_release(&c->c_timeout_lock);
+			return true;
+		}
+		/* Its function is running; wait for it. */
+		spinlock_release(&c->c_timeout_lock);
+	}
+	return false;
 }
 
 /*
- * This is called HZ times a second (on each processor) by the timer
- * code.
+ * Run the timeouts on C that are due. The function is called without
+ * the list locked, so it can add timeouts (including its own).
+ */
+static
+void
+timeout_runexpired(struct cpu *c, uint64_t now)
+{
+	struct timeout *to;
+
+	spinlock_acquire(&c->c_timeout_lock);
+	while (c->c_timeouts != NULL && c->c_timeouts->to_when <= now) {
+		to = c->c_timeouts;
+		c->c_timeouts = to->to_next;
+		to->to_next = NULL;
+		to->to_pending = false;
+		spinlock_release(&c->c_timeout_lock);
+
+		to->to_func(to->to_data);
+
+		spinlock_acquire(&c->c_timeout_lock);
+		if (!to->to_pending) {
+			/* Done with it; lets timeout_cancel return. */
+			to->to_cpu = NULL;
+		}
+	}
+	spinlock_release(&c->c_timeout_lock);
+}
+
+////////////////////////////////////////////////////////////
+// hardclock
+
+/*
+ * Move C's next tick past NOW and return how many ticks that was.
+ */
+static
+unsigned
+clock_advance(struct cpu *c, uint64_t now)
+{
+	unsigned ticks;
+
+	if (c->c_nexttick == 0) {
+		/* First time on this cpu */
+		c->c_nexttick = now + TICK_NSECS;
+		return 0;
+	}
+	if (now < c->c_nexttick) {
+		return 0;
+	}
+	ticks = (now - c->c_nexttick) / TICK_NSECS + 1;
+	c->c_nexttick += (uint64_t)ticks * TICK_NSECS;
+	return ticks;
+}
+
+/*
+ * This is called from the MD code whenever this CPU's timer goes off.
+ */
+void
+hardclock_interrupt(void)
+{
+	struct cpu *c = curcpu->c_self;
+	uint64_t now;
+	unsigned ticks, before;
+
+	now = clock_nsecs();
+	timeout_runexpired(c, now);
+
+	ticks = clock_advance(c, now);
+	if (ticks > 0 && c->c_tickless) {
+		/* Just count them, and check for migration. */
+		before = c->c_hardclocks;
+		c->c_hardclocks += ticks;
+		if (before / MIGRATE_HARDCLOCKS !=
+		    c->c_hardclocks / MIGRATE_HARDCLOCKS) {
+			thread_consider_migration();
+		}
+	}
+
+	/*
+	 * Rearm before calling hardclock: it may switch to another
+	 * thread, which must not run with the timer still parked by
+	 * the interrupt code. (We might not even be on this cpu by
+	 * the time it returns.)
+	 */
+	spinlock_acquire(&c->c_timeout_lock);
+	clock_rearm(c, now);
+	spinlock_release(&c->c_timeout_lock);
+
+	if (ticks > 0 && !c->c_tickless) {
+		/* Any we missed beyond one don't get called. */
+		c->c_hardclocks += ticks - 1;
+		hardclock();
+	}
+}
+
+/*
+ * Start the periodic tick on this CPU, at boot or on leaving the
+ * idle loop. Ticks that went by while it was stopped are counted but
+ * not run.
+ */
+void
+hardclock_start(void)
+{
+	struct cpu *c;
+	uint64_t now;
+	int spl;
+
+	spl = splhigh();
+	c = curcpu->c_self;
+	now = clock_nsecs();
+	c->c_tickless = false;
+	c->c_hardclocks += clock_advance(c, now);
+
+	spinlock_acquire(&c->c_timeout_lock);
+	clock_rearm(c, now);
+	spinlock_release(&c->c_timeout_lock);
+	splx(spl);
+}
+
+/*
+ * Stop the periodic tick on this CPU, on entering the idle loop. The
+ * idle loop only restarts it if this actually stopped it.
+ */
+void
+hardclock_stop(void)
+{
+	struct cpu *c;
+	int spl;
+
+	spl = splhigh();
+	c = curcpu->c_self;
+	if (c->c_nexttick == 0) {
+		/* Not started yet (early boot) */
+		splx(spl);
+		return;
+	}
+	c->c_tickless = true;
+
+	spinlock_acquire(&c->c_timeout_lock);
+	clock_rearm(c, clock_nsecs());
+	spinlock_release(&c->c_timeout_lock);
+	splx(spl);
+}
+
+/*
+ * This is called HZ times a second (on each processor) by
+ * hardclock_interrupt, while the processor isn't idle.
  */
 void
 hardclock(void)
@@ -100,10 +363,27 @@ hardclock(void)
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
-	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
-		schedule();
+	schedule();
+}
+
+////////////////////////////////////////////////////////////
+// sleeping
+
+/*
+ * Suspend execution for NSECS nanoseconds.
+ */
+void
+clocknanosleep(uint64_t nsecs)
+{
+	uint64_t start, now;
+
+	start = clock_nsecs();
+	spinlock_acquire(&sleep_lock);
+	while ((now = clock_nsecs()) - start < nsecs) {
+		wchan_sleep_timeout(sleep_wchan, &sleep_lock,
+				    nsecs - (now - start));
 	}
-	thread_yield();
+	spinlock_release(&sleep_lock);
 }
 
 /*
@@ -112,10 +392,7 @@ hardclock(void)
 void
 clocksleep(int num_secs)
 {
-	spinlock_acquire(&lbolt_lock);
-	while (num_secs > 0) {
-		wchan_sleep(lbolt, &lbolt_lock);
-		num_secs--;
+	if (num_secs > 0) {
+		clocknanosleep(num_secs * NSECS_PER_SEC);
 	}
-	spinlock_release(&lbolt_lock);
 }
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention profiler.
+ *
+ * This is called from inside spinlock_acquire, so it can't use
+ * spinlocks itself (or kmalloc, which does). The records live in a
+ * fixed table and each is protected by a bare test-and-set word,
+ * taken with interrupts off like a spinlock but not instrumented.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <clock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_MAX		128	/* Number of distinct names */
+#define LOCKSTAT_NAMELEN	24	/* Longest name kept, plus one */
+
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];
+	volatile spinlock_data_t ls_lock;
+	uint64_t ls_acquires;		/* Times acquired */
+	uint64_t ls_contended;		/* ...that had to wait */
+	uint64_t ls_spinns;		/* Time spent spinning, in ns */
+	uint64_t ls_sleepns;		/* Time spent asleep, in ns */
+};
+
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static unsigned lockstats_num;
+static volatile spinlock_data_t lockstats_lock = SPINLOCK_DATA_INITIALIZER;
+static bool lockstat_running;
+
+/*
+ * Unnamed spinlocks, and names that don't fit in the table.
+ */
+static struct lockstat lockstat_anon = { .ls_name = "(spinlock)" };
+static struct lockstat lockstat_other = { .ls_name = "(other)" };
+
+static
+int
+lockstat_rawlock(volatile spinlock_data_t *sd)
+{
+	int spl;
+
+	spl = splhigh();
+	while (spinlock_data_get(sd) != 0 ||
+	       spinlock_data_testandset(sd) != 0) {
+		/* spin */
+	}
+	return spl;
+}
+
+static
+void
+lockstat_rawunlock(volatile spinlock_data_t *sd, int spl)
+{
+	spinlock_data_set(sd, 0);
+	splx(spl);
+}
+
+/*
+ * Find the record for NAME, creating it if need be. Names longer
+ * than the table keeps are cut short, and share a record with
+ * anything else that starts the same way.
+ */
+struct lockstat *
+lockstat_get(const char *name)
+{
+	char buf[LOCKSTAT_NAMELEN];
+	struct lockstat *ls;
+	unsigned i;
+	int spl;
+
+	if (name == NULL) {
+		return NULL;
+	}
+	for (i=0; i<LOCKSTAT_NAMELEN-1 && name[i] != 0; i++) {
+		buf[i] = name[i];
+	}
+	buf[i] = 0;
+
+	spl = lockstat_rawlock(&lockstats_lock);
+	for (i=0; i<lockstats_num; i++) {
+		if (!strcmp(lockstats[i].ls_name, buf)) {
+			ls = &lockstats[i];
+			goto done;
+		}
+	}
+	if (lockstats_num < LOCKSTAT_MAX) {
+		ls = &lockstats[lockstats_num++];
+		strcpy(ls->ls_name, buf);
+	}
+	else {
+		ls = &lockstat_other;
+	}
+ done:
+	lockstat_rawunlock(&lockstats_lock, spl);
+	return ls;
+}
+
+/*
+ * Start timing. Called once the clock is attached; until then the
+ * profiler counts acquisitions but not time.
+ */
+void
+lockstat_bootstrap(void)
+{
+	lockstat_running = true;
+}
+
+void
+lockstat_now(struct timespec *ts)
+{
+	if (lockstat_running) {
+		gettime(ts);
+	}
+	else {
+		ts->tv_sec = 0;
+		ts->tv_nsec = 0;
+	}
+}
+
+static
+uint64_t
+lockstat_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	if (!lockstat_running) {
+		return 0;
+	}
+	if (start->tv_sec == 0 && start->tv_nsec == 0) {
+		/* started before lockstat_bootstrap */
+		return 0;
+	}
+	gettime(&now);
+	timespec_sub(&now, start, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void
+lockstat_acquire(struct lockstat *ls, bool contended)
+{
+	int spl;
+
+	if (ls == NULL) {
+		ls = &lockstat_anon;
+	}
+	spl = lockstat_rawlock(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (contended) {
+		ls->ls_contended++;
+	}
+	lockstat_rawunlock(&ls->ls_lock, spl);
+}
+
+void
+lockstat_spun(struct lockstat *ls, const struct timespec *start)
+{
+	uint64_t ns;
+	int spl;
+
+	if (ls == NULL) {
+		ls = &lockstat_anon;
+	}
+	ns = lockstat_since(start);
+	spl = lockstat_rawlock(&ls->ls_lock);
+	ls->ls_spinns += ns;
+	lockstat_rawunlock(&ls->ls_lock, spl);
+}
+
+void
+lockstat_slept(struct lockstat *ls, const struct timespec *start)
+{
+	uint64_t ns;
+	int spl;
+
+	if (ls == NULL) {
+		ls = &lockstat_anon;
+	}
+	ns = lockstat_since(start);
+	spl = lockstat_rawlock(&ls->ls_lock);
+	ls->ls_sleepns += ns;
+	lockstat_rawunlock(&ls->ls_lock, spl);
+}
+
+static
+uint64_t
+lockstat_totalwait(const struct lockstat *ls)
+{
+	return ls->ls_spinns + ls->ls_sleepns;
+}
+
+/*
+ * Print one line. Times are shown in microseconds.
+ */
+static
+void
+lockstat_printone(struct lockstat *ls)
+{
+	struct lockstat copy;
+	int spl;
+
+	spl = lockstat_rawlock(&ls->ls_lock);
+	copy = *ls;
+	lockstat_rawunlock(&ls->ls_lock, spl);
+
+	if (copy.ls_acquires == 0 && copy.ls_sleepns == 0) {
+		return;
+	}
+	kprintf("%-23s %10llu %10llu %12llu %12llu\n", copy.ls_name,
+		(unsigned long long)copy.ls_acquires,
+		(unsigned long long)copy.ls_contended,
+		(unsigned long long)(copy.ls_spinns / 1000),
+		(unsigned long long)(copy.ls_sleepns / 1000));
+}
+
+/*
+ * Print everything, sorted by total time spent waiting (most first).
+ * The table is small, so a selection sort over it is fine.
+ */
+void
+lockstat_print(void)
+{
+	struct lockstat *all[LOCKSTAT_MAX + 2];
+	struct lockstat *tmp;
+	unsigned num, i, j, best;
+
+	num = lockstats_num;
+	for (i=0; i<num; i++) {
+		all[i] = &lockstats[i];
+	}
+	all[num++] = &lockstat_anon;
+	all[num++] = &lockstat_other;
+
+	for (i=0; i<num; i++) {
+		best = i;
+		for (j=i+1; j<num; j++) {
+			if (lockstat_totalwait(all[j]) >
+			    lockstat_totalwait(all[best])) {
+				best = j;
+			}
+		}
+		tmp = all[i];
+		all[i] = all[best];
+		all[best] = tmp;
+	}
+
+	if (!lockstat_running) {
+		kprintf("lockstat: clock not attached yet; no times\n");
+	}
+	kprintf("%-23s %10s %10s %12s %12s\n", "name", "acquires",
+		"contended", "spin (us)", "sleep (us)");
+	for (i=0; i<num; i++) {
+		lockstat_printone(all[i]);
+	}
+}
+
+/*
+ * Zero all the counts (but keep the names).
+ */
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i, num;
+	int spl;
+
+	num = lockstats_num;
+	for (i=0; i<num + 2; i++) {
+		ls = (i < num) ? &lockstats[i] :
+			(i == num) ? &lockstat_anon : &lockstat_other;
+		spl = lockstat_rawlock(&ls->ls_lock);
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_spinns = 0;
+		ls->ls_sleepns = 0;
+		lockstat_rawunlock(&ls->ls_lock, spl);
+	}
+}
@@ -52,6 +52,7 @@ spinlock_init(struct spinlock *splk)
 {
 	spinlock_data_set(&splk->splk_lock, 0);
 	splk->splk_holder = NULL;
+	LOCKSTAT_INIT(&splk->splk_stat, NULL);
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
 }
 
@@ -76,6 +77,7 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	LOCKSTAT_TIMER(start);
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -93,6 +95,15 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+	if (spinlock_data_get(&splk->splk_lock) == 0 &&
+	    spinlock_data_testandset(&splk->splk_lock) == 0) {
+		/* Got it first try. */
+		LOCKSTAT_ACQUIRE(splk->splk_stat, false);
+		goto gotit;
+	}
+	LOCKSTAT_ACQUIRE(splk->splk_stat, true);
+	LOCKSTAT_START(&start);
+
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -112,7 +123,9 @@ spinlock_acquire(struct spinlock *splk)
 		}
 		break;
 	}
+	LOCKSTAT_SPUN(splk->splk_stat, &start);
 
+ gotit:
 	membar_store_any();
 	splk->splk_holder = mycpu;
 
@@ -154,3 +167,14 @@ spinlock_do_i_hold(struct spinlock *splk)
 	/* Assume we can read splk_holder atomically enough for this to work */
 	return (splk->splk_holder == curcpu->c_self);
 }
+
+/*
+ * Give the lock a name for the contention profiler.
+ */
+void
+spinlock_setname(struct spinlock *splk, const char *name)
+{
+	LOCKSTAT_INIT(&splk->splk_stat, name);
+	(void)splk;
+	(void)name;
+}
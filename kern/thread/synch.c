@@ -69,6 +69,7 @@ sem_create(const char *name, unsigned initial_count)
 
 	spinlock_init(&sem->sem_lock);
 	sem->sem_count = initial_count;
+	LOCKSTAT_INIT(&sem->sem_stat, sem->sem_name);
 
 	return sem;
 }
@@ -100,6 +101,7 @@ P(struct semaphore *sem)
 
 	/* Use the semaphore spinlock to protect the wchan as well. */
 	spinlock_acquire(&sem->sem_lock);
+	LOCKSTAT_ACQUIRE(sem->sem_stat, sem->sem_count == 0);
 	while (sem->sem_count == 0) {
 		/*
 		 *
@@ -142,6 +144,7 @@ struct lock *
 lock_create(const char *name)
 {
 	struct lock *lock;
+	unsigned i;
 
 	lock = kmalloc(sizeof(*lock));
 	if (lock == NULL) {
@@ -155,6 +158,7 @@ lock_create(const char *name)
 	}
 
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
+	LOCKSTAT_INIT(&lock->lk_stat, lock->lk_name);
 
 	lock->lk_wchan = wchan_create(lock->lk_name);
 	if (lock->lk_wchan == NULL) {
@@ -164,6 +168,10 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		lock->lk_waitpri[i] = 0;
+	}
+	lock->lk_nextheld = NULL;
 
 	return lock;
 }
@@ -171,9 +179,14 @@ lock_create(const char *name)
 void
 lock_destroy(struct lock *lock)
 {
+	unsigned i;
+
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	for (i=0; i<SCHED_NLEVELS; i++) {
+		KASSERT(lock->lk_waitpri[i] == 0);
+	}
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -181,9 +194,159 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+/*
+ * Adaptive spinning: how long lock_acquire spins waiting for a holder
+ * that's running on another cpu before giving up and sleeping. Each
+ * round polls lk_holder LOCK_SPIN_LOOPS times and then rechecks that
+ * the holder is still on a cpu.
+ */
+#define LOCK_SPIN_ROUNDS	50
+#define LOCK_SPIN_LOOPS		100
+
+/*
+ * Priority inheritance.
+ *
+ * This follows the same waits-for graph the hangman deadlock detector
+ * does (thread -> lock it's waiting for -> thread holding that lock
+ * -> ...), and is updated at the same points, but has to be kept
+ * whether or not hangman is compiled in. It's all protected by
+ * lock_pi_lock, which is taken inside lock->lk_lock and outside the
+ * run queue locks.
+ */
+static struct spinlock lock_pi_lock = SPINLOCK_INITIALIZER;
+
+/*
+ * Work out what level T should be lent by the waiters on the locks it
+ * holds, and set it. If that changes T's effective level and T is
+ * itself waiting for a lock, update its count there and carry on to
+ * that lock's holder, and so on down the chain.
+ */
+static
+void
+lock_pi_propagate(struct thread *t)
+{
+	struct lock *l;
+	unsigned donated, oldpri, newpri, i;
+
+	KASSERT(spinlock_do_i_hold(&lock_pi_lock));
+
+	while (t != NULL) {
+		donated = SCHED_NLEVELS;
+		for (l = t->t_heldlocks; l != NULL; l = l->lk_nextheld) {
+			for (i=0; i<donated; i++) {
+				if (l->lk_waitpri[i] > 0) {
+					donated = i;
+					break;
+				}
+			}
+		}
+
+		oldpri = thread_effpriority(t);
+		if (donated != t->t_donated) {
+			thread_setdonated(t, donated);
+		}
+		newpri = thread_effpriority(t);
+
+		if (newpri == oldpri || t->t_waitlock == NULL) {
+			break;
+		}
+
+		l = t->t_waitlock;
+		KASSERT(l->lk_waitpri[t->t_waitpri] > 0);
+		l->lk_waitpri[t->t_waitpri]--;
+		t->t_waitpri = newpri;
+		l->lk_waitpri[newpri]++;
+		t = l->lk_holder;
+	}
+}
+
+/*
+ * Note that the current thread is waiting for LOCK, or (if it already
+ * was) that its level may have changed, e.g. by being woken up, and
+ * lend its level to the holder.
+ */
+static
+void
+lock_pi_wait(struct lock *lock)
+{
+	struct thread *cur = curthread;
+	unsigned pri;
+
+	spinlock_acquire(&lock_pi_lock);
+
+	pri = thread_effpriority(cur);
+	if (cur->t_waitlock == NULL) {
+		cur->t_waitlock = lock;
+		cur->t_waitpri = pri;
+		lock->lk_waitpri[pri]++;
+	}
+	else {
+		KASSERT(cur->t_waitlock == lock);
+		KASSERT(lock->lk_waitpri[cur->t_waitpri] > 0);
+		lock->lk_waitpri[cur->t_waitpri]--;
+		cur->t_waitpri = pri;
+		lock->lk_waitpri[pri]++;
+	}
+	lock_pi_propagate(lock->lk_holder);
+
+	spinlock_release(&lock_pi_lock);
+}
+
+/*
+ * Note that the current thread now holds LOCK; it stops lending its
+ * level (if it was waiting) and inherits from the remaining waiters.
+ */
+static
+void
+lock_pi_acquire(struct lock *lock)
+{
+	struct thread *cur = curthread;
+
+	spinlock_acquire(&lock_pi_lock);
+
+	if (cur->t_waitlock != NULL) {
+		KASSERT(cur->t_waitlock == lock);
+		KASSERT(lock->lk_waitpri[cur->t_waitpri] > 0);
+		lock->lk_waitpri[cur->t_waitpri]--;
+		cur->t_waitlock = NULL;
+	}
+	lock->lk_nextheld = cur->t_heldlocks;
+	cur->t_heldlocks = lock;
+	lock_pi_propagate(cur);
+
+	spinlock_release(&lock_pi_lock);
+}
+
+/*
+ * Note that the current thread is letting go of LOCK, and give back
+ * whatever its waiters lent.
+ */
+static
+void
+lock_pi_release(struct lock *lock)
+{
+	struct thread *cur = curthread;
+	struct lock **lp;
+
+	spinlock_acquire(&lock_pi_lock);
+
+	for (lp = &cur->t_heldlocks; *lp != lock; lp = &(*lp)->lk_nextheld) {
+		KASSERT(*lp != NULL);
+	}
+	*lp = lock->lk_nextheld;
+	lock->lk_nextheld = NULL;
+	lock_pi_propagate(cur);
+
+	spinlock_release(&lock_pi_lock);
+}
+
 void
 lock_acquire(struct lock *lock)
 {
+	struct thread *holder;
+	unsigned spins, i;
+	LOCKSTAT_TIMER(start);
+
 	DEBUGASSERT(lock != NULL);
 	KASSERT(curthread->t_in_interrupt == false);
 
@@ -193,11 +356,40 @@ lock_acquire(struct lock *lock)
 	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
 
 	KASSERT(lock->lk_holder != curthread);
+	LOCKSTAT_ACQUIRE(lock->lk_stat, lock->lk_holder != NULL);
+	spins = 0;
 	while (lock->lk_holder != NULL) {
+		/*
+		 * If the holder is running on another cpu it will
+		 * probably let go soon, so spin (without lk_lock)
+		 * for a bit rather than paying for a sleep and a
+		 * wakeup. The holder can't go away while we hold
+		 * lk_lock, so it's safe to look at it here, but not
+		 * while spinning; then we only compare the pointer.
+		 */
+		holder = lock->lk_holder;
+		if (spins < LOCK_SPIN_ROUNDS && holder->t_oncpu) {
+			spinlock_release(&lock->lk_lock);
+			LOCKSTAT_START(&start);
+			for (i=0; i<LOCK_SPIN_LOOPS; i++) {
+				if (lock->lk_holder != holder) {
+					break;
+				}
+			}
+			LOCKSTAT_SPUN(lock->lk_stat, &start);
+			spins++;
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
+
+		/* Lend our priority to the holder while we wait */
+		lock_pi_wait(lock);
+
 		/* As in the semaphore. */
 		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
 	}
 	lock->lk_holder = curthread;
+	lock_pi_acquire(lock);
 
 	/* Call this (atomically) once the lock is acquired */
 	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
@@ -213,6 +405,7 @@ lock_release(struct lock *lock)
 	spinlock_acquire(&lock->lk_lock);
 
 	KASSERT(lock->lk_holder == curthread);
+	lock_pi_release(lock);
 	lock->lk_holder = NULL;
 	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
 
@@ -298,6 +491,32 @@ cv_wait(struct cv *cv, struct lock *lock)
 	lock_acquire(lock);
 }
 
+int
+cv_timedwait(struct cv *cv, struct lock *lock, uint64_t nsecs)
+{
+	int result;
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	result = wchan_sleep_timeout(cv->cv_wchan, &cv->cv_wchanlock, nsecs);
+	spinlock_release(&cv->cv_wchanlock);
+	lock_acquire(lock);
+	return result;
+}
+
+int
+cv_wait_intr(struct cv *cv, struct lock *lock)
+{
+	int result;
+
+	spinlock_acquire(&cv->cv_wchanlock);
+	lock_release(lock);
+	result = wchan_sleep_intr(cv->cv_wchan, &cv->cv_wchanlock);
+	spinlock_release(&cv->cv_wchanlock);
+	lock_acquire(lock);
+	return result;
+}
+
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
@@ -315,3 +534,247 @@ cv_broadcast(struct cv *cv, struct lock *lock)
 	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
 	spinlock_release(&cv->cv_wchanlock);
 }
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(*rw));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rwlock_name = kstrdup(name);
+	if (rw->rwlock_name == NULL) {
+		goto fail_rw;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_readwchan == NULL) {
+		goto fail_name;
+	}
+	rw->rw_writewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_writewchan == NULL) {
+		goto fail_readwchan;
+	}
+	rw->rw_upgradewchan = wchan_create(rw->rwlock_name);
+	if (rw->rw_upgradewchan == NULL) {
+		goto fail_writewchan;
+	}
+
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_writer = NULL;
+	rw->rw_upgrader = NULL;
+	rw->rw_readwaiting = 0;
+	rw->rw_writewaiting = 0;
+	rw->rw_readgen = 0;
+	rw->rw_readpass = 0;
+
+	return rw;
+
+ fail_writewchan:
+	wchan_destroy(rw->rw_writewchan);
+ fail_readwchan:
+	wchan_destroy(rw->rw_readwchan);
+ fail_name:
+	kfree(rw->rwlock_name);
+ fail_rw:
+	kfree(rw);
+	return NULL;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_upgrader == NULL);
+	KASSERT(rw->rw_readwaiting == 0);
+	KASSERT(rw->rw_writewaiting == 0);
+
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_upgradewchan);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+	kfree(rw->rwlock_name);
+	kfree(rw);
+}
+
+/*
+ * Hand the lock over when a writer lets go of it (or downgrades).
+ * Readers that are waiting now go first, even past waiting writers,
+ * so a stream of writers can't starve them; if there are none, wake
+ * the next writer.
+ */
+static
+void
+rwlock_handoff(struct rwlock *rw)
+{
+	KASSERT(spinlock_do_i_hold(&rw->rw_lock));
+	KASSERT(rw->rw_writer == NULL);
+
+	if (rw->rw_readwaiting > 0) {
+		rw->rw_readgen++;
+		rw->rw_readpass = rw->rw_readwaiting;
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	else if (rw->rw_readers == 0 && rw->rw_writewaiting > 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	unsigned gen;
+
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+
+	/*
+	 * Wait while there's a writer, or one waiting, unless we were
+	 * already waiting the last time a writer let go; then we get
+	 * a pass.
+	 */
+	gen = rw->rw_readgen;
+	while (rw->rw_writer != NULL || rw->rw_upgrader != NULL ||
+	       (rw->rw_writewaiting > 0 && gen == rw->rw_readgen)) {
+		rw->rw_readwaiting++;
+		wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+		rw->rw_readwaiting--;
+	}
+	if (gen != rw->rw_readgen) {
+		KASSERT(rw->rw_readpass > 0);
+		rw->rw_readpass--;
+	}
+	rw->rw_readers++;
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	rw->rw_readers--;
+	if (rw->rw_upgrader != NULL) {
+		if (rw->rw_readers == 1) {
+			wchan_wakeone(rw->rw_upgradewchan, &rw->rw_lock);
+		}
+	}
+	else if (rw->rw_readers == 0 && rw->rw_writewaiting > 0) {
+		wchan_wakeone(rw->rw_writewchan, &rw->rw_lock);
+	}
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+
+	while (rw->rw_writer != NULL || rw->rw_readers > 0 ||
+	       rw->rw_readpass > 0) {
+		rw->rw_writewaiting++;
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+		rw->rw_writewaiting--;
+	}
+	KASSERT(rw->rw_upgrader == NULL);
+	rw->rw_writer = curthread;
+
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	rwlock_handoff(rw);
+
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_upgrade(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_readers > 0);
+	KASSERT(rw->rw_writer == NULL);
+	if (rw->rw_upgrader != NULL) {
+		/* Both of us waiting for the other to leave: no. */
+		spinlock_release(&rw->rw_lock);
+		return false;
+	}
+
+	/* New readers now wait; wait for the existing ones to leave. */
+	rw->rw_upgrader = curthread;
+	while (rw->rw_readers > 1) {
+		wchan_sleep(rw->rw_upgradewchan, &rw->rw_lock);
+	}
+	rw->rw_upgrader = NULL;
+	rw->rw_readers = 0;
+	rw->rw_writer = curthread;
+
+	spinlock_release(&rw->rw_lock);
+	return true;
+}
+
+void
+rwlock_downgrade(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	rw->rw_readers = 1;
+	rwlock_handoff(rw);
+
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	ret = (rw->rw_writer == curthread);
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
+}
@@ -53,15 +53,39 @@
 #include <mainbus.h>
 #include <vnode.h>
 #include <pid.h>
+#include <clock.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Scheduler parameters; see schedule() below.
+ *
+ * SCHED_NLEVELS (in thread.h) is the number of priority levels. A
+ * thread at level L gets SCHED_QUANTUM(L) hardclocks at a time. Every
+ * SCHED_BOOST_HARDCLOCKS, everything is moved back to the top level
+ * so nothing starves.
+ */
+#define SCHED_QUANTUM(level)	(2U << (level))
+#define SCHED_BOOST_HARDCLOCKS	100
+
+/*
+ * Migration parameters; see thread_consider_migration() below.
+ *
+ * A cpu only steals if the busiest cpu has at least MIGRATE_MINGAP
+ * more ready threads than it does. A thread that ran within the last
+ * MIGRATE_HOT_HARDCLOCKS on its cpu probably still has its cache
+ * footprint there, and is only taken by a cpu with nothing to do.
+ */
+#define MIGRATE_MINGAP		2
+#define MIGRATE_HOT_HARDCLOCKS	8
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
 	struct threadlist wc_threads;	/* list of waiting threads */
+	LOCKSTAT_REF(wc_stat);		/* contention profiler hook */
 };
 
 /* Master array of CPUs. */
@@ -72,6 +96,11 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Protects the sleep interruption fields of all threads. */
+static struct spinlock thread_intr_lock = SPINLOCK_INITIALIZER;
+
+static void thread_reap(void *);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -145,6 +174,25 @@ thread_create(const char *name)
 	thread->t_proc = NULL;
 	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
 
+	/* Scheduler fields: new threads start out at the top */
+	thread->t_priority = 0;
+	thread->t_quantum = SCHED_QUANTUM(0);
+	thread->t_lastran = 0;
+	thread->t_oncpu = false;
+	thread->t_bound = false;
+
+	/* Priority inheritance fields */
+	thread->t_donated = SCHED_NLEVELS;
+	thread->t_waitlock = NULL;
+	thread->t_waitpri = 0;
+	thread->t_heldlocks = NULL;
+
+	/* Sleep interruption fields */
+	thread->t_wchan = NULL;
+	thread->t_intrlk = NULL;
+	thread->t_intrbusy = 0;
+	thread->t_interrupted = false;
+
 	/* Interrupt state fields */
 	thread->t_in_interrupt = false;
 	thread->t_curspl = IPL_HIGH;
@@ -182,11 +230,19 @@ cpu_create(unsigned hardware_number)
 	threadlist_init(&c->c_zombies);
 	c->c_hardclocks = 0;
 	c->c_spinlocks = 0;
+	c->c_nexttick = 0;
+	c->c_tickless = false;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
 
+	c->c_workqueue = NULL;
+	work_init(&c->c_reapwork, thread_reap, NULL);
+
+	c->c_timeouts = NULL;
+	spinlock_init(&c->c_timeout_lock);
+
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
@@ -241,6 +297,7 @@ cpu_create(unsigned hardware_number)
 		 */
 		curthread->t_cpu = curcpu;
 		curcpu->c_curthread = curthread;
+		curthread->t_oncpu = true;
 	}
 
 	HANGMAN_ACTORINIT(&c->c_hangman, "cpu");
@@ -255,6 +312,18 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned num)
+{
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Destroy a thread.
  *
@@ -277,6 +346,7 @@ thread_destroy(struct thread *thread)
 
 	/* Thread subsystem fields */
 	KASSERT(thread->t_proc == NULL);
+	KASSERT(thread->t_heldlocks == NULL);
 	if (thread->t_stack != NULL) {
 		kfree(thread->t_stack);
 	}
@@ -291,22 +361,56 @@ thread_destroy(struct thread *thread)
 }
 
 /*
- * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
- *
- * The list of zombies is per-cpu.
+ * Destroy the current cpu's zombies. This runs in one of the cpu's
+ * (bound) workqueue threads, or inline from exorcise before there are
+ * any, so the list is always this cpu's own.
  */
 static
 void
-exorcise(void)
+thread_reap(void *junk)
 {
+	struct threadlist zombies;
 	struct thread *z;
+	int spl;
 
+	(void)junk;
+
+	threadlist_init(&zombies);
+	spl = splhigh();
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
+		threadlist_addtail(&zombies, z);
+	}
+	splx(spl);
+
+	while ((z = threadlist_remhead(&zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
 		thread_destroy(z);
 	}
+	threadlist_cleanup(&zombies);
+}
+
+/*
+ * Clean up zombies. (Zombies are threads that have exited but still
+ * need to have thread_destroy called on them.)
+ *
+ * The list of zombies is per-cpu. This is called on every context
+ * switch, so rather than freeing them here we have the workqueue do
+ * it, once there is one.
+ */
+static
+void
+exorcise(void)
+{
+	if (threadlist_isempty(&curcpu->c_zombies)) {
+		return;
+	}
+	if (curcpu->c_workqueue != NULL) {
+		work_queue(&curcpu->c_reapwork);
+	}
+	else {
+		thread_reap(NULL);
+	}
 }
 
 /*
@@ -414,6 +518,8 @@ cpu_hatch(unsigned software_number)
 	KASSERT(curthread != NULL);
 	KASSERT(curcpu->c_number == software_number);
 
+	curthread->t_oncpu = true;
+	hardclock_start();
 	spl0();
 	cpu_identify(buf, sizeof(buf));
 
@@ -445,6 +551,40 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Scheduling priority, taking priority inheritance into account.
+ */
+unsigned
+thread_effpriority(const struct thread *t)
+{
+	return t->t_donated < t->t_priority ? t->t_donated : t->t_priority;
+}
+
+/*
+ * Put a thread on a cpu's run queue, which is kept sorted by
+ * priority: after every thread at its own level or above, so threads
+ * at the same level take turns. The cpu's run queue must be locked.
+ *
+ * Most of the time the thread goes at or near the tail, so search
+ * from that end.
+ */
+static
+void
+thread_enqueue(struct cpu *c, struct thread *t)
+{
+	struct thread *prev;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	THREADLIST_FORALL_REV(prev, c->c_runqueue) {
+		if (thread_effpriority(prev) <= thread_effpriority(t)) {
+			threadlist_insertafter(&c->c_runqueue, prev, t);
+			return;
+		}
+	}
+	threadlist_addhead(&c->c_runqueue, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -467,9 +607,23 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
 
+	KASSERT(targetcpu != NULL);
+
+	/*
+	 * A thread waking up from sleep gave up the cpu before its
+	 * time slice ran out, so it's probably interactive or I/O
+	 * bound; move it up a level and give it a fresh slice.
+	 */
+	if (target->t_state == S_SLEEP) {
+		if (target->t_priority > 0) {
+			target->t_priority--;
+		}
+		target->t_quantum = SCHED_QUANTUM(target->t_priority);
+	}
+
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_enqueue(targetcpu, target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -485,20 +639,15 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common code for thread_fork and thread_fork_bound: make a new
+ * thread in process PROC that starts on cpu CPU.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_on(const char *name,
+	       struct proc *proc, struct cpu *cpu, bool bound,
+	       void (*entrypoint)(void *data1, unsigned long data2),
+	       void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
@@ -521,12 +670,10 @@ thread_fork(const char *name,
 	 */
 
 	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_cpu = cpu;
+	newthread->t_bound = bound;
 
 	/* Attach the new thread to its process */
-	if (proc == NULL) {
-		proc = curthread->t_proc;
-	}
 	result = proc_addthread(proc, newthread);
 	if (result) {
 		/* thread_destroy will clean up the stack */
@@ -544,12 +691,47 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the cpu's run queue and make the new thread runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	if (proc == NULL) {
+		proc = curthread->t_proc;
+	}
+	return thread_fork_on(name, proc, curthread->t_cpu, false,
+			      entrypoint, data1, data2);
+}
+
+/*
+ * Create a kernel thread that stays on CPU.
+ */
+int
+thread_fork_bound(const char *name, struct cpu *cpu,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  void *data1, unsigned long data2)
+{
+	return thread_fork_on(name, kproc, cpu, true,
+			      entrypoint, data1, data2);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -565,6 +747,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	bool idled;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -587,6 +770,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
+	/* Remember when it last ran here, for thread migration. */
+	cur->t_lastran = curcpu->c_hardclocks;
+
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
@@ -615,6 +801,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		 * on the list.
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		spinlock_release(lk);
 		break;
 	    case S_ZOMBIE:
@@ -623,6 +810,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	}
 	cur->t_state = newstate;
+	cur->t_oncpu = false;
 
 	/*
 	 * Get the next thread. While there isn't one, call cpu_idle().
@@ -641,17 +829,28 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * lock to look at it, this should not be visible or matter.
 	 */
 
-	/* The current cpu is now idle. */
+	/*
+	 * The current cpu is now idle. If it actually has to wait,
+	 * stop the periodic tick until it has something to run.
+	 */
 	curcpu->c_isidle = true;
+	idled = false;
 	do {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
+			if (!idled) {
+				hardclock_stop();
+				idled = true;
+			}
 			cpu_idle();
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
+	if (idled && curcpu->c_tickless) {
+		hardclock_start();
+	}
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -716,6 +915,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	/* Clear the wait channel and set the thread state. */
 	cur->t_wchan_name = NULL;
 	cur->t_state = S_RUN;
+	cur->t_oncpu = true;
 
 	/* Unlock the run queue. */
 	spinlock_release(&curcpu->c_runqueue_lock);
@@ -749,6 +949,7 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	/* Clear the wait channel and set the thread state. */
 	cur->t_wchan_name = NULL;
 	cur->t_state = S_RUN;
+	cur->t_oncpu = true;
 
 	/* Release the runqueue lock acquired in thread_switch. */
 	spinlock_release(&curcpu->c_runqueue_lock);
@@ -821,139 +1022,226 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multilevel feedback queue scheduler. Each thread is at
+ * one of SCHED_NLEVELS priority levels; the run queue is kept in
+ * priority order (see thread_enqueue) so thread_switch always picks
+ * the most urgent ready thread. The rules:
+ *
+ *   - A thread at level L runs for up to SCHED_QUANTUM(L) hardclocks
+ *     before being preempted. Lower levels get longer slices, since
+ *     the threads there are CPU-bound and context switches just
+ *     cost them cache.
+ *   - A thread that uses up its whole slice moves down a level.
+ *   - A thread that sleeps and is woken moves up a level (see
+ *     thread_make_runnable), so interactive and I/O-bound threads
+ *     stay near the top.
+ *   - If a more urgent thread becomes ready, the running thread is
+ *     preempted at the next hardclock without waiting for its slice
+ *     to finish.
+ *   - Every SCHED_BOOST_HARDCLOCKS everything goes back to the top
+ *     level, so CPU-bound threads can't be starved forever and
+ *     threads that change behavior get reclassified.
+ *
+ * This is called from hardclock() on every tick.
  */
-
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct thread *cur = curthread;
+	struct thread *t;
+	bool preempt;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+
+	if (curcpu->c_isidle) {
+		/* Nothing running to charge. */
+		spinlock_release(&curcpu->c_runqueue_lock);
+		return;
+	}
+
+	if ((curcpu->c_hardclocks % SCHED_BOOST_HARDCLOCKS) == 0) {
+		THREADLIST_FORALL(t, curcpu->c_runqueue) {
+			t->t_priority = 0;
+			t->t_quantum = SCHED_QUANTUM(0);
+		}
+		cur->t_priority = 0;
+		cur->t_quantum = SCHED_QUANTUM(0);
+	}
+
+	/* Charge the current thread for this tick. */
+	KASSERT(cur->t_quantum > 0);
+	cur->t_quantum--;
+	if (cur->t_quantum == 0) {
+		/* Used its whole slice; demote it. */
+		if (cur->t_priority < SCHED_NLEVELS - 1) {
+			cur->t_priority++;
+		}
+		cur->t_quantum = SCHED_QUANTUM(cur->t_priority);
+		preempt = true;
+	}
+	else {
+		/* Preempt if something more urgent is waiting. */
+		t = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+		preempt = t != NULL &&
+			thread_effpriority(t) < thread_effpriority(cur);
+	}
+
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (preempt) {
+		thread_yield();
+	}
+}
+
+/*
+ * Change the priority level lent to T by threads waiting on its
+ * locks. If T is on a run queue, it has to be moved to its new place
+ * in line; T might be in the middle of being migrated (t_cpu is NULL
+ * while that happens), in which case wait until it lands.
+ */
+void
+thread_setdonated(struct thread *t, unsigned level)
+{
+	struct cpu *c;
+	unsigned oldpri;
+
+	while (1) {
+		c = *(struct cpu *volatile *)&t->t_cpu;
+		if (c == NULL) {
+			continue;
+		}
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (t->t_cpu == c) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	oldpri = thread_effpriority(t);
+	t->t_donated = level;
+	if (t->t_state == S_READY && thread_effpriority(t) != oldpri) {
+		threadlist_remove(&c->c_runqueue, t);
+		thread_enqueue(c, t);
+	}
+
+	spinlock_release(&c->c_runqueue_lock);
 }
 
 /*
  * Thread migration.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * This is also called periodically from hardclock(), on every CPU
+ * including idle ones. If the current CPU has noticeably less to do
+ * than the busiest one, it steals some of that CPU's ready threads.
  *
  * Migrating threads isn't free because of cache affinity; a thread's
- * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
+ * working cache set (and TLB contents) will end up having to be moved
+ * to the other CPU, which is fairly slow. So:
  *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ *   - We only steal when the imbalance is at least MIGRATE_MINGAP,
+ *     and then take half the difference in one batch, rather than
+ *     shuffling single threads back and forth.
+ *   - Threads that ran on their CPU within MIGRATE_HOT_HARDCLOCKS
+ *     (per t_lastran) are left alone unless we're sitting in the idle
+ *     loop (c_isidle).
+ *   - Threads are taken from the tail of the run queue, which holds
+ *     the least urgent and least recently run ones.
+ *
+ * Only one run queue lock is held at a time: the other CPU's while
+ * taking threads off it, then our own while putting them on.
  */
 void
 thread_consider_migration(void)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	unsigned my_count, busiest_count, count, to_take, i, numcpus;
+	struct cpu *c, *busiest;
+	struct threadlist stolen;
+	struct thread *t, *prev;
+	bool hot, idle;
+
+	/* Find how busy we are, and the busiest other cpu. */
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	my_count = curcpu->c_runqueue.tl_count;
+	idle = curcpu->c_isidle;
+	spinlock_release(&curcpu->c_runqueue_lock);
 
-	my_count = total_count = 0;
+	busiest = NULL;
+	busiest_count = 0;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
 		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+			continue;
 		}
+		spinlock_acquire(&c->c_runqueue_lock);
+		count = c->c_runqueue.tl_count;
 		spinlock_release(&c->c_runqueue_lock);
+		if (count > busiest_count) {
+			busiest = c;
+			busiest_count = count;
+		}
 	}
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	if (busiest == NULL || busiest_count < my_count + MIGRATE_MINGAP) {
 		return;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
-	}
-	spinlock_release(&curcpu->c_runqueue_lock);
+	/* Take half the difference, starting from the tail. */
+	threadlist_init(&stolen);
+	spinlock_acquire(&busiest->c_runqueue_lock);
+	to_take = (busiest->c_runqueue.tl_count - my_count) / 2;
+	t = busiest->c_runqueue.tl_tail.tln_prev->tln_self;
+	while (t != NULL && to_take > 0) {
+		prev = t->t_listnode.tln_prev->tln_self;
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
-		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
-			continue;
-		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
+		hot = busiest->c_hardclocks - t->t_lastran <
+			MIGRATE_HOT_HARDCLOCKS;
 
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+		/*
+		 * Ordinarily, a cpu's curthread will not appear on its
+		 * run queue. However, it can under the following
+		 * circumstances:
+		 *   - it went to sleep;
+		 *   - the processor became idle, so it
+		 *     remained curthread;
+		 *   - it was reawakened, so it was put on the
+		 *     run queue;
+		 *   - and the processor hasn't fully unidled
+		 *     yet, so all these things are still true.
+		 *
+		 * *Migrating* that thread can cause bad things to
+		 * happen (Exercise: Why? And what?) so skip it.
+		 */
+		if (t != busiest->c_curthread && !t->t_bound &&
+		    (!hot || idle)) {
+			threadlist_remove(&busiest->c_runqueue, t);
+			threadlist_addhead(&stolen, t);
+			/* In transit; see thread_setdonated */
+			t->t_cpu = NULL;
+			to_take--;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+		t = prev;
 	}
+	spinlock_release(&busiest->c_runqueue_lock);
 
-	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
-	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
-		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+	if (threadlist_isempty(&stolen)) {
+		threadlist_cleanup(&stolen);
+		return;
 	}
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	/* Now put them on our own run queue. */
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	while ((t = threadlist_remhead(&stolen)) != NULL) {
+		DEBUG(DB_THREADS, "Migrated thread %s: cpu %u -> %u",
+		      t->t_name, busiest->c_number, curcpu->c_number);
+		t->t_cpu = curcpu->c_self;
+		/* Count it as hot here so it isn't bounced right back. */
+		t->t_lastran = curcpu->c_hardclocks;
+		thread_enqueue(curcpu->c_self, t);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	threadlist_cleanup(&stolen);
 }
 
 ////////////////////////////////////////////////////////////
@@ -981,6 +1269,7 @@ wchan_create(const char *name)
 	}
 	threadlist_init(&wc->wc_threads);
 	wc->wc_name = name;
+	LOCKSTAT_INIT(&wc->wc_stat, name);
 
 	return wc;
 }
@@ -1006,6 +1295,8 @@ wchan_destroy(struct wchan *wc)
 void
 wchan_sleep(struct wchan *wc, struct spinlock *lk)
 {
+	LOCKSTAT_TIMER(start);
+
 	/* may not sleep in an interrupt handler */
 	KASSERT(!curthread->t_in_interrupt);
 
@@ -1015,10 +1306,167 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	/* must not hold other spinlocks */
 	KASSERT(curcpu->c_spinlocks == 1);
 
+	LOCKSTAT_START(&start);
 	thread_switch(S_SLEEP, wc, lk);
+	LOCKSTAT_SLEPT(wc->wc_stat, &start);
 	spinlock_acquire(lk);
 }
 
+/*
+ * Timed sleep. A timeout on the sleeping thread's cpu takes it back
+ * off the channel if nobody has woken it by then.
+ */
+struct wchan_timeout {
+	struct wchan *wt_wc;
+	struct spinlock *wt_lk;
+	struct thread *wt_thread;
+	bool wt_expired;
+};
+
+static
+void
+wchan_timeout_expire(void *data)
+{
+	struct wchan_timeout *wt = data;
+	struct thread *t;
+
+	spinlock_acquire(wt->wt_lk);
+	THREADLIST_FORALL(t, wt->wt_wc->wc_threads) {
+		if (t == wt->wt_thread) {
+			threadlist_remove(&wt->wt_wc->wc_threads, t);
+			t->t_wchan = NULL;
+			wt->wt_expired = true;
+			thread_make_runnable(t, false);
+			break;
+		}
+	}
+	spinlock_release(wt->wt_lk);
+}
+
+/*
+ * Like wchan_sleep, but give up after NSECS nanoseconds and return
+ * ETIMEDOUT.
+ *
+ * The timeout can't go off before we're on the channel: it's queued
+ * on this cpu, and we hold LK (so interrupts are off) until
+ * thread_switch has put us on the list.
+ */
+int
+wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk, uint64_t nsecs)
+{
+	struct wchan_timeout wt;
+	struct timeout to;
+	LOCKSTAT_TIMER(start);
+
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(lk));
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	wt.wt_wc = wc;
+	wt.wt_lk = lk;
+	wt.wt_thread = curthread;
+	wt.wt_expired = false;
+	timeout_init(&to, wchan_timeout_expire, &wt);
+	timeout_add(&to, nsecs);
+
+	LOCKSTAT_START(&start);
+	thread_switch(S_SLEEP, wc, lk);
+	LOCKSTAT_SLEPT(wc->wc_stat, &start);
+
+	/* Without LK, in case the timeout is running and waiting for it */
+	timeout_cancel(&to);
+	spinlock_acquire(lk);
+
+	return wt.wt_expired ? ETIMEDOUT : 0;
+}
+
+/*
+ * Like wchan_sleep, but return EINTR if thread_interrupt is (or has
+ * been) called on us.
+ *
+ * LK is recorded for thread_interrupt before we go on the channel,
+ * and we don't return until any thread_interrupt that picked it up
+ * is done with it, so it stays valid for as long as that needs it.
+ */
+int
+wchan_sleep_intr(struct wchan *wc, struct spinlock *lk)
+{
+	struct thread *cur = curthread;
+	bool interrupted;
+	LOCKSTAT_TIMER(start);
+
+	KASSERT(!cur->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(lk));
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	spinlock_acquire(&thread_intr_lock);
+	if (cur->t_interrupted) {
+		spinlock_release(&thread_intr_lock);
+		return EINTR;
+	}
+	cur->t_intrlk = lk;
+	spinlock_release(&thread_intr_lock);
+
+	LOCKSTAT_START(&start);
+	thread_switch(S_SLEEP, wc, lk);
+	LOCKSTAT_SLEPT(wc->wc_stat, &start);
+
+	/* Without LK, as thread_interrupt may be holding it */
+	spinlock_acquire(&thread_intr_lock);
+	cur->t_intrlk = NULL;
+	while (cur->t_intrbusy > 0) {
+		spinlock_release(&thread_intr_lock);
+		thread_yield();
+		spinlock_acquire(&thread_intr_lock);
+	}
+	interrupted = cur->t_interrupted;
+	spinlock_release(&thread_intr_lock);
+
+	spinlock_acquire(lk);
+	return interrupted ? EINTR : 0;
+}
+
+/*
+ * Interrupt thread T; see thread.h.
+ *
+ * Whoever takes a thread off a channel clears t_wchan while holding
+ * the channel's lock, so if it's still set once we have that lock
+ * the thread is still asleep and the channel can't have been
+ * destroyed out from under us.
+ */
+void
+thread_interrupt(struct thread *t)
+{
+	struct spinlock *lk;
+	struct wchan *wc;
+
+	spinlock_acquire(&thread_intr_lock);
+	t->t_interrupted = true;
+	lk = t->t_intrlk;
+	if (lk != NULL) {
+		t->t_intrbusy++;
+	}
+	spinlock_release(&thread_intr_lock);
+
+	if (lk == NULL) {
+		/* Not in an interruptible sleep; it'll see the flag. */
+		return;
+	}
+
+	spinlock_acquire(lk);
+	wc = t->t_wchan;
+	if (wc != NULL) {
+		threadlist_remove(&wc->wc_threads, t);
+		t->t_wchan = NULL;
+		thread_make_runnable(t, false);
+	}
+	spinlock_release(lk);
+
+	spinlock_acquire(&thread_intr_lock);
+	t->t_intrbusy--;
+	spinlock_release(&thread_intr_lock);
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1036,6 +1484,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 		/* Nobody was sleeping. */
 		return;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1066,6 +1515,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
@@ -1173,8 +1623,11 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 void
 interprocessor_interrupt(void)
 {
+	struct tlbshootdown shootdown[TLBSHOOTDOWN_MAX];
 	uint32_t bits;
-	unsigned i;
+	unsigned i, numshootdown;
+
+	numshootdown = 0;
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
@@ -1204,16 +1657,23 @@ interprocessor_interrupt(void)
 	}
 	if (bits & (1U << IPI_TLBSHOOTDOWN)) {
 		/*
-		 * Note: depending on your VM system locking you might
-		 * need to release the ipi lock while calling
-		 * vm_tlbshootdown.
+		 * vm_tlbshootdown wakes up the thread that asked for
+		 * the shootdown, which takes a run queue lock; and
+		 * run queue locks are held while sending IPIs. So
+		 * copy the requests out and handle them after
+		 * releasing the ipi lock.
 		 */
-		for (i=0; i<curcpu->c_numshootdown; i++) {
-			vm_tlbshootdown(&curcpu->c_shootdown[i]);
+		numshootdown = curcpu->c_numshootdown;
+		for (i=0; i<numshootdown; i++) {
+			shootdown[i] = curcpu->c_shootdown[i];
 		}
 		curcpu->c_numshootdown = 0;
 	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	for (i=0; i<numshootdown; i++) {
+		vm_tlbshootdown(&shootdown[i]);
+	}
 }
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per-cpu deferred work queues.
+ *
+ * Each queue is a FIFO list protected by a spinlock, with a pool of
+ * worker threads bound to the cpu. Workers take items off in batches
+ * of up to WQ_BATCH per lock acquisition. Only queueing onto an empty
+ * queue wakes a worker; items queued behind that get picked up by
+ * whoever is already on the way. A worker that takes a batch and
+ * sees more left behind gets another worker going on the rest, waking
+ * an idle one or starting a new one if there's room, so one slow
+ * item doesn't hold up everything else queued.
+ *
+ * That doesn't help the rest of the slow item's own batch, which
+ * would wait for it behind the worker's back. So before running an
+ * item marked with work_mayblock, the worker puts whatever is left of
+ * its batch back on the front of the queue and gets another worker
+ * onto it the same way.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spl.h>
+#include <membar.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <wchan.h>
+#include <workqueue.h>
+
+#define WQ_BATCH	8			/* Items per lock trip */
+#define WQ_IDLE_NSECS	1000000000ULL		/* Idle time before an
+						   extra worker exits */
+
+struct workqueue {
+	struct cpu *wq_cpu;
+	struct spinlock wq_lock;
+	struct wchan *wq_wchan;		/* Idle workers sleep here */
+	struct work *wq_head;
+	struct work *wq_tail;
+	unsigned wq_workers;		/* Workers running or starting */
+	unsigned wq_idle;		/* ...of those, asleep and not
+					   yet woken */
+};
+
+static void workqueue_worker(void *, unsigned long);
+
+/*
+ * Start another worker on WQ, which has already been counted in
+ * wq_workers. If we can't, we make do with the ones we have.
+ */
+static
+void
+workqueue_spawn(struct workqueue *wq)
+{
+	int result;
+
+	result = thread_fork_bound("workqueue", wq->wq_cpu,
+				   workqueue_worker, wq, 0);
+	if (result) {
+		spinlock_acquire(&wq->wq_lock);
+		wq->wq_workers--;
+		spinlock_release(&wq->wq_lock);
+	}
+}
+
+/*
+ * Wake one idle worker. The waker takes it off the idle count, so
+ * nobody else tries to wake the same one.
+ */
+static
+void
+workqueue_wakeone(struct workqueue *wq)
+{
+	KASSERT(spinlock_do_i_hold(&wq->wq_lock));
+	KASSERT(wq->wq_idle > 0);
+
+	wq->wq_idle--;
+	wchan_wakeone(wq->wq_wchan, &wq->wq_lock);
+}
+
+/*
+ * Get another worker onto what's left on the queue, if anything:
+ * wake an idle one, or if there are none, return true if the caller
+ * should start one (with workqueue_spawn, after dropping the lock).
+ */
+static
+bool
+workqueue_helper(struct workqueue *wq)
+{
+	KASSERT(spinlock_do_i_hold(&wq->wq_lock));
+
+	if (wq->wq_head == NULL) {
+		return false;
+	}
+	if (wq->wq_idle > 0) {
+		workqueue_wakeone(wq);
+		return false;
+	}
+	if (wq->wq_workers < WORKQUEUE_MAXWORKERS) {
+		wq->wq_workers++;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Put BATCH, the untouched rest of a worker's batch, back on the
+ * front of the queue.
+ */
+static
+void
+workqueue_unbatch(struct workqueue *wq, struct work *batch)
+{
+	struct work *w;
+	bool spawn;
+
+	spinlock_acquire(&wq->wq_lock);
+	for (w = batch; ; w = w->w_next) {
+		w->w_queue = wq;
+		if (w->w_next == NULL) {
+			break;
+		}
+	}
+	w->w_next = wq->wq_head;
+	if (wq->wq_head == NULL) {
+		wq->wq_tail = w;
+	}
+	wq->wq_head = batch;
+	spawn = workqueue_helper(wq);
+	spinlock_release(&wq->wq_lock);
+
+	if (spawn) {
+		workqueue_spawn(wq);
+	}
+}
+
+static
+void
+workqueue_worker(void *data1, unsigned long data2)
+{
+	struct workqueue *wq = data1;
+	struct work *batch, *w;
+	unsigned n;
+	bool spawn;
+	int result;
+
+	(void)data2;
+	KASSERT(curthread->t_bound);
+	KASSERT(curcpu->c_self == wq->wq_cpu);
+
+	spinlock_acquire(&wq->wq_lock);
+	while (1) {
+		if (wq->wq_head == NULL) {
+			wq->wq_idle++;
+			result = wchan_sleep_timeout(wq->wq_wchan,
+						     &wq->wq_lock,
+						     WQ_IDLE_NSECS);
+			if (result == ETIMEDOUT) {
+				/* Nobody woke us, so we're still counted */
+				wq->wq_idle--;
+				if (wq->wq_head == NULL &&
+				    wq->wq_workers > 1) {
+					wq->wq_workers--;
+					spinlock_release(&wq->wq_lock);
+					thread_exit();
+				}
+			}
+			continue;
+		}
+
+		/* Take a batch off the front. */
+		batch = w = wq->wq_head;
+		for (n = 1; n < WQ_BATCH && w->w_next != NULL; n++) {
+			w->w_queue = NULL;
+			w = w->w_next;
+		}
+		w->w_queue = NULL;
+		wq->wq_head = w->w_next;
+		if (wq->wq_head == NULL) {
+			wq->wq_tail = NULL;
+		}
+		w->w_next = NULL;
+
+		/* If there's more, get someone else onto it. */
+		spawn = workqueue_helper(wq);
+		spinlock_release(&wq->wq_lock);
+
+		if (spawn) {
+			workqueue_spawn(wq);
+		}
+
+		while (batch != NULL) {
+			w = batch;
+			batch = w->w_next;
+			w->w_next = NULL;
+			if (w->w_mayblock && batch != NULL) {
+				/* Don't make the rest wait for it. */
+				workqueue_unbatch(wq, batch);
+				batch = NULL;
+			}
+			/* From here on it can be queued again. */
+			membar_store_store();
+			spinlock_data_set(&w->w_pending, 0);
+			w->w_func(w->w_data);
+		}
+
+		spinlock_acquire(&wq->wq_lock);
+	}
+}
+
+/*
+ * Set up a queue and its first worker for each cpu.
+ */
+void
+workqueue_bootstrap(void)
+{
+	struct workqueue *wq;
+	struct cpu *c;
+	unsigned i, num;
+	int result;
+
+	num = cpu_count();
+	for (i=0; i<num; i++) {
+		c = cpu_get(i);
+
+		wq = kmalloc(sizeof(*wq));
+		if (wq == NULL) {
+			panic("workqueue_bootstrap: Out of memory\n");
+		}
+		wq->wq_cpu = c;
+		spinlock_init(&wq->wq_lock);
+		wq->wq_wchan = wchan_create("workqueue");
+		if (wq->wq_wchan == NULL) {
+			panic("workqueue_bootstrap: Out of memory\n");
+		}
+		wq->wq_head = wq->wq_tail = NULL;
+		wq->wq_workers = 1;
+		wq->wq_idle = 0;
+
+		result = thread_fork_bound("workqueue", c,
+					   workqueue_worker, wq, 0);
+		if (result) {
+			panic("workqueue_bootstrap: thread_fork_bound: %s\n",
+			      strerror(result));
+		}
+		c->c_workqueue = wq;
+	}
+}
+
+////////////////////////////////////////////////////////////
+// work items
+
+/*
+ * Put W, which has just been marked pending, on this cpu's queue.
+ */
+static
+void
+workqueue_add(struct work *w)
+{
+	struct workqueue *wq;
+	int spl;
+
+	/* Stay on this cpu until it's queued. */
+	spl = splhigh();
+	wq = curcpu->c_workqueue;
+	KASSERT(wq != NULL);
+
+	spinlock_acquire(&wq->wq_lock);
+	w->w_next = NULL;
+	w->w_queue = wq;
+	if (wq->wq_tail == NULL) {
+		wq->wq_head = wq->wq_tail = w;
+		if (wq->wq_idle > 0) {
+			workqueue_wakeone(wq);
+		}
+	}
+	else {
+		wq->wq_tail->w_next = w;
+		wq->wq_tail = w;
+	}
+	spinlock_release(&wq->wq_lock);
+	splx(spl);
+}
+
+/*
+ * Timeout function for work_queue_delayed. Runs on the cpu the work
+ * was delayed on, so it's queued there too.
+ */
+static
+void
+work_timeout(void *data)
+{
+	workqueue_add(data);
+}
+
+void
+work_init(struct work *w, void (*func)(void *), void *data)
+{
+	w->w_next = NULL;
+	w->w_queue = NULL;
+	spinlock_data_set(&w->w_pending, 0);
+	timeout_init(&w->w_timeout, work_timeout, w);
+	w->w_func = func;
+	w->w_data = data;
+	w->w_mayblock = false;
+}
+
+/*
+ * Mark W as an item whose function can block for long; see above.
+ */
+void
+work_mayblock(struct work *w)
+{
+	w->w_mayblock = true;
+}
+
+bool
+work_queue(struct work *w)
+{
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		return false;
+	}
+	workqueue_add(w);
+	return true;
+}
+
+bool
+work_queue_delayed(struct work *w, uint64_t nsecs)
+{
+	if (spinlock_data_testandset(&w->w_pending) != 0) {
+		return false;
+	}
+	timeout_add(&w->w_timeout, nsecs);
+	return true;
+}
+
+bool
+work_cancel(struct work *w)
+{
+	struct workqueue *wq;
+	struct work **pp, *prev;
+
+	/* Still waiting for its delay? */
+	if (timeout_cancel(&w->w_timeout)) {
+		spinlock_data_set(&w->w_pending, 0);
+		return true;
+	}
+
+	/* On a queue? */
+	wq = w->w_queue;
+	if (wq == NULL) {
+		return false;
+	}
+	spinlock_acquire(&wq->wq_lock);
+	if (w->w_queue != wq) {
+		/* A worker just took it */
+		spinlock_release(&wq->wq_lock);
+		return false;
+	}
+	prev = NULL;
+	for (pp = &wq->wq_head; *pp != w; pp = &(*pp)->w_next) {
+		KASSERT(*pp != NULL);
+		prev = *pp;
+	}
+	*pp = w->w_next;
+	if (wq->wq_tail == w) {
+		wq->wq_tail = prev;
+	}
+	w->w_next = NULL;
+	w->w_queue = NULL;
+	spinlock_data_set(&w->w_pending, 0);
+	spinlock_release(&wq->wq_lock);
+	return true;
+}
@@ -36,6 +36,7 @@
 #include <types.h>
 #include <kern/errno.h>
 #include <kern/fcntl.h>
+#include <kern/poll.h>
 #include <stat.h>
 #include <lib.h>
 #include <uio.h>
@@ -150,6 +151,31 @@ dev_ioctl(struct vnode *v, int op, userptr_t data)
 	return DEVOP_IOCTL(d, op, data);
 }
 
+/*
+ * Called for poll().
+ */
+static
+int
+dev_poll(struct vnode *v, int events, struct poller *poller, int *revents)
+{
+	struct device *d = v->vn_data;
+	return DEVOP_POLL(d, events, poller, revents);
+}
+
+/*
+ * devop_poll for devices that are always ready (disks, null, etc.)
+ */
+int
+dev_pollready(struct device *dev, int events, struct poller *poller,
+	      int *revents)
+{
+	(void)dev;
+	(void)poller;
+
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
+
 /*
  * Called for stat().
  * Set the type and the size (block devices only).
@@ -330,8 +356,10 @@ static const struct vnode_ops dev_vnode_ops = {
 	.vop_read = dev_read,
 	.vop_readlink = vopfail_uio_inval,
 	.vop_getdirentry = vopfail_uio_notdir,
+	.vop_getdirentries = vopfail_uio_notdir,
 	.vop_write = dev_write,
 	.vop_ioctl = dev_ioctl,
+	.vop_poll = dev_poll,
 	.vop_stat = dev_stat,
 	.vop_gettype = dev_gettype,
 	.vop_isseekable = dev_isseekable,
@@ -39,6 +39,8 @@
 #include <lib.h>
 #include <array.h>
 #include <synch.h>
+#include <clock.h>
+#include <thread.h>
 #include <vfs.h>
 #include <fs.h>
 #include <vnode.h>
@@ -190,6 +192,65 @@ vfs_sync(void)
 	return 0;
 }
 
+/*
+ * Global write-back function - call FSOP_WRITEBACK on all devices
+ * that have one.
+ */
+void
+vfs_writeback(void)
+{
+	struct knowndev *dev;
+	unsigned i, num;
+	int result;
+
+	vfs_biglock_acquire();
+
+	num = knowndevarray_num(knowndevs);
+	for (i=0; i<num; i++) {
+		dev = knowndevarray_get(knowndevs, i);
+		if (dev->kd_fs != NULL && dev->kd_fs != SWAP_FS &&
+		    dev->kd_fs->fs_ops->fsop_writeback != NULL) {
+			result = FSOP_WRITEBACK(dev->kd_fs);
+			if (result) {
+				kprintf("vfs: Warning: writeback failed for "
+					"%s: %s\n", dev->kd_name,
+					strerror(result));
+			}
+		}
+	}
+
+	vfs_biglock_release();
+}
+
+/*
+ * The syncer: a kernel thread that wakes up once a second (with
+ * clocksleep) and has the filesystems write back
+ * whatever has been dirty too long.
+ */
+static
+void
+vfs_syncer(void *data1, unsigned long data2)
+{
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		clocksleep(1);
+		vfs_writeback();
+	}
+}
+
+void
+vfs_syncer_start(void)
+{
+	int result;
+
+	result = thread_fork("syncer", NULL, vfs_syncer, NULL, 0);
+	if (result) {
+		panic("vfs: Cannot start syncer: %s\n", strerror(result));
+	}
+}
+
 /*
  * Given a device name (lhd0, emu0, somevolname, null, etc.), hand
  * back an appropriate vnode.
@@ -654,6 +715,9 @@ vfs_unmount(const char *devname)
 	KASSERT(kd->kd_rawname != NULL);
 	KASSERT(kd->kd_device != NULL);
 
+	/* drop cached lookups, which hold vnodes */
+	vfs_dcache_purgefs(kd->kd_fs);
+
 	/* sync the fs */
 	result = FSOP_SYNC(kd->kd_fs);
 	if (result) {
@@ -745,6 +809,8 @@ vfs_unmountall(void)
 
 		kprintf("vfs: Unmounting %s:\n", dev->kd_name);
 
+		vfs_dcache_purgefs(dev->kd_fs);
+
 		result = FSOP_SYNC(dev->kd_fs);
 		if (result) {
 			kprintf("vfs: Warning: sync failed for %s: %s, trying "
@@ -234,6 +234,219 @@ getdevice(char *path, char **subpath, struct vnode **startvn)
 	return 0;
 }
 
+/*
+ * Lookup cache.
+ *
+ * This remembers the results of recent vfs_lookup calls, keyed on the
+ * directory the lookup started from and the path handed to
+ * VOP_LOOKUP, so repeated lookups of the same path (e.g. the programs
+ * the shell runs over and over) don't go to the filesystem. A lookup
+ * that failed with ENOENT is remembered too, as an entry with no
+ * vnode. Each entry holds a reference to both of its vnodes.
+ *
+ * Because the path can have several components, an entry depends on
+ * every directory entry it passed through. So anything that changes
+ * the directory entry NAME drops every cached path with NAME as one
+ * of its components; see vfs_dcache_purge. Paths containing ".."
+ * depend on where the starting directory is, which rename can
+ * change, so those are never cached.
+ *
+ * The cache is protected by vfs_biglock, which is also held across
+ * the VOP_LOOKUP whose result gets entered, and by the callers in
+ * vfspath.c across each directory-changing VOP and its purge. So no
+ * lookup can see or enter a stale result between the two.
+ *
+ * ENOENT results are not cached on filesystems that set
+ * fs_nonegcache, since nothing would purge them when the file
+ * appears.
+ */
+
+#define DCACHE_SIZE     64	/* number of entries */
+#define DCACHE_PATHLEN  48	/* longest path cached, plus 1 */
+
+struct dcentry {
+	struct vnode *dc_dir;		/* starting dir, or NULL if unused */
+	struct vnode *dc_vn;		/* result, or NULL for ENOENT */
+	uint32_t dc_hash;		/* hash of dc_path */
+	unsigned dc_lastuse;		/* dcache_clock at last use */
+	char dc_path[DCACHE_PATHLEN];	/* path looked up */
+};
+
+static struct dcentry dcache[DCACHE_SIZE];
+static unsigned dcache_clock;
+
+/*
+ * Hash a path (FNV-1a).
+ */
+static
+uint32_t
+dcache_hash(const char *path)
+{
+	uint32_t hash = 2166136261U;
+
+	for (; *path; path++) {
+		hash = (hash ^ (unsigned char)*path) * 16777619U;
+	}
+	return hash;
+}
+
+/*
+ * Check if NAME is one of the components of PATH.
+ */
+static
+bool
+dcache_hascomponent(const char *path, const char *name)
+{
+	size_t i;
+
+	while (*path) {
+		for (i=0; name[i] != 0 && path[i] == name[i]; i++) {
+			/* nothing */
+		}
+		if (name[i] == 0 && (path[i] == '/' || path[i] == 0)) {
+			return true;
+		}
+		path = strchr(path, '/');
+		if (path == NULL) {
+			break;
+		}
+		path++;
+	}
+	return false;
+}
+
+/*
+ * Check if PATH is one we are willing to cache.
+ */
+static
+bool
+dcache_cacheable(struct vnode *dir, const char *path)
+{
+	/* Devices don't do lookups. */
+	if (dir->vn_fs == NULL) {
+		return false;
+	}
+	if (strlen(path) >= DCACHE_PATHLEN) {
+		return false;
+	}
+	return !dcache_hascomponent(path, "..");
+}
+
+/*
+ * Drop a cache entry.
+ */
+static
+void
+dcache_drop(struct dcentry *dc)
+{
+	KASSERT(dc->dc_dir != NULL);
+
+	VOP_DECREF(dc->dc_dir);
+	if (dc->dc_vn != NULL) {
+		VOP_DECREF(dc->dc_vn);
+	}
+	dc->dc_dir = NULL;
+	dc->dc_vn = NULL;
+}
+
+/*
+ * Look for a cached lookup of PATH starting from DIR.
+ */
+static
+struct dcentry *
+dcache_find(struct vnode *dir, const char *path, uint32_t hash)
+{
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	for (i=0; i<DCACHE_SIZE; i++) {
+		if (dcache[i].dc_dir == dir && dcache[i].dc_hash == hash &&
+		    !strcmp(dcache[i].dc_path, path)) {
+			dcache[i].dc_lastuse = ++dcache_clock;
+			return &dcache[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Remember that looking up PATH from DIR produced VN (NULL for
+ * ENOENT), replacing the least recently used entry if need be.
+ */
+static
+void
+dcache_enter(struct vnode *dir, const char *path, uint32_t hash,
+	     struct vnode *vn)
+{
+	struct dcentry *dc;
+	unsigned i;
+
+	KASSERT(vfs_biglock_do_i_hold());
+
+	dc = &dcache[0];
+	for (i=0; i<DCACHE_SIZE; i++) {
+		if (dcache[i].dc_dir == NULL) {
+			dc = &dcache[i];
+			break;
+		}
+		if (dcache[i].dc_lastuse < dc->dc_lastuse) {
+			dc = &dcache[i];
+		}
+	}
+	if (dc->dc_dir != NULL) {
+		dcache_drop(dc);
+	}
+
+	VOP_INCREF(dir);
+	if (vn != NULL) {
+		VOP_INCREF(vn);
+	}
+	dc->dc_dir = dir;
+	dc->dc_vn = vn;
+	dc->dc_hash = hash;
+	dc->dc_lastuse = ++dcache_clock;
+	strcpy(dc->dc_path, path);
+}
+
+/*
+ * Drop every cached lookup that went through the directory entry
+ * NAME, in any directory. Called after anything that might have
+ * created, removed, or replaced such an entry.
+ */
+void
+vfs_dcache_purge(const char *name)
+{
+	unsigned i;
+
+	vfs_biglock_acquire();
+	for (i=0; i<DCACHE_SIZE; i++) {
+		if (dcache[i].dc_dir != NULL &&
+		    dcache_hascomponent(dcache[i].dc_path, name)) {
+			dcache_drop(&dcache[i]);
+		}
+	}
+	vfs_biglock_release();
+}
+
+/*
+ * Drop every cached lookup on filesystem FS, so the references they
+ * hold don't keep it from being unmounted.
+ */
+void
+vfs_dcache_purgefs(struct fs *fs)
+{
+	unsigned i;
+
+	vfs_biglock_acquire();
+	for (i=0; i<DCACHE_SIZE; i++) {
+		if (dcache[i].dc_dir != NULL && dcache[i].dc_dir->vn_fs == fs) {
+			dcache_drop(&dcache[i]);
+		}
+	}
+	vfs_biglock_release();
+}
+
 /*
  * Name-to-vnode translation.
  * (In BSD, both of these are subsumed by namei().)
@@ -276,6 +489,9 @@ int
 vfs_lookup(char *path, struct vnode **retval)
 {
 	struct vnode *startvn;
+	struct dcentry *dc;
+	char key[DCACHE_PATHLEN];
+	uint32_t hash;
 	int result;
 
 	vfs_biglock_acquire();
@@ -292,7 +508,39 @@ vfs_lookup(char *path, struct vnode **retval)
 		return 0;
 	}
 
+	if (!dcache_cacheable(startvn, path)) {
+		result = VOP_LOOKUP(startvn, path, retval);
+		VOP_DECREF(startvn);
+		vfs_biglock_release();
+		return result;
+	}
+
+	hash = dcache_hash(path);
+	dc = dcache_find(startvn, path, hash);
+	if (dc != NULL) {
+		if (dc->dc_vn == NULL) {
+			result = ENOENT;
+		}
+		else {
+			VOP_INCREF(dc->dc_vn);
+			*retval = dc->dc_vn;
+			result = 0;
+		}
+		VOP_DECREF(startvn);
+		vfs_biglock_release();
+		return result;
+	}
+
+	/* VOP_LOOKUP may destroy the path, so keep a copy. */
+	strcpy(key, path);
+
 	result = VOP_LOOKUP(startvn, path, retval);
+	if (result == 0) {
+		dcache_enter(startvn, key, hash, *retval);
+	}
+	else if (result == ENOENT && !startvn->vn_fs->fs_nonegcache) {
+		dcache_enter(startvn, key, hash, NULL);
+	}
 
 	VOP_DECREF(startvn);
 	vfs_biglock_release();
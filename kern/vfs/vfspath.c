@@ -73,7 +73,10 @@ vfs_open(char *path, int openflags, mode_t mode, struct vnode **ret)
 			return result;
 		}
 
+		vfs_biglock_acquire();
 		result = VOP_CREAT(dir, name, excl, mode, &vn);
+		vfs_dcache_purge(name);
+		vfs_biglock_release();
 
 		VOP_DECREF(dir);
 	}
@@ -145,7 +148,10 @@ vfs_remove(char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_REMOVE(dir, name);
+	vfs_dcache_purge(name);
+	vfs_biglock_release();
 	VOP_DECREF(dir);
 
 	return result;
@@ -178,7 +184,11 @@ vfs_rename(char *oldpath, char *newpath)
 		return EXDEV;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_RENAME(olddir, oldname, newdir, newname);
+	vfs_dcache_purge(oldname);
+	vfs_dcache_purge(newname);
+	vfs_biglock_release();
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(olddir);
@@ -212,7 +222,10 @@ vfs_link(char *oldpath, char *newpath)
 		return EXDEV;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_LINK(newdir, newname, oldfile);
+	vfs_dcache_purge(newname);
+	vfs_biglock_release();
 
 	VOP_DECREF(newdir);
 	VOP_DECREF(oldfile);
@@ -239,7 +252,10 @@ vfs_symlink(const char *contents, char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_SYMLINK(newdir, newname, contents);
+	vfs_dcache_purge(newname);
+	vfs_biglock_release();
 	VOP_DECREF(newdir);
 
 	return result;
@@ -285,7 +301,10 @@ vfs_mkdir(char *path, mode_t mode)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_MKDIR(parent, name, mode);
+	vfs_dcache_purge(name);
+	vfs_biglock_release();
 
 	VOP_DECREF(parent);
 
@@ -307,7 +326,10 @@ vfs_rmdir(char *path)
 		return result;
 	}
 
+	vfs_biglock_acquire();
 	result = VOP_RMDIR(parent, name);
+	vfs_dcache_purge(name);
+	vfs_biglock_release();
 
 	VOP_DECREF(parent);
 
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Readiness notification for poll(). See poll.h.
+ *
+ * Lock order: the object's own lock (if the wakeup comes from under
+ * it), then pq_lock, then pl_lock.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <wchan.h>
+#include <poll.h>
+
+void
+pollqueue_init(struct pollqueue *pq)
+{
+	spinlock_init(&pq->pq_lock);
+	pq->pq_entries = NULL;
+}
+
+void
+pollqueue_cleanup(struct pollqueue *pq)
+{
+	/* Pollers hold references to the object, so none can be left */
+	KASSERT(pq->pq_entries == NULL);
+	spinlock_cleanup(&pq->pq_lock);
+}
+
+/*
+ * Wake everyone polling on PQ. They stay registered; each will look
+ * at the object again and decide for itself whether it's ready.
+ */
+void
+pollqueue_wakeup(struct pollqueue *pq)
+{
+	struct pollentry *pe;
+	struct poller *pl;
+
+	spinlock_acquire(&pq->pq_lock);
+	for (pe = pq->pq_entries; pe != NULL; pe = pe->pe_next) {
+		pl = pe->pe_poller;
+		spinlock_acquire(&pl->pl_lock);
+		pl->pl_woken = true;
+		wchan_wakeall(pl->pl_wchan, &pl->pl_lock);
+		spinlock_release(&pl->pl_lock);
+	}
+	spinlock_release(&pq->pq_lock);
+}
+
+/*
+ * Set up a poller with room for MAXENTRIES registrations.
+ */
+int
+poller_init(struct poller *pl, unsigned maxentries)
+{
+	pl->pl_wchan = wchan_create("poll");
+	if (pl->pl_wchan == NULL) {
+		return ENOMEM;
+	}
+	pl->pl_entries = NULL;
+	if (maxentries > 0) {
+		pl->pl_entries = kmalloc(maxentries * sizeof(pl->pl_entries[0]));
+		if (pl->pl_entries == NULL) {
+			wchan_destroy(pl->pl_wchan);
+			return ENOMEM;
+		}
+	}
+	spinlock_init(&pl->pl_lock);
+	pl->pl_woken = false;
+	pl->pl_numentries = 0;
+	pl->pl_maxentries = maxentries;
+	return 0;
+}
+
+/*
+ * Take PL off every queue it's on, and destroy it.
+ */
+void
+poller_cleanup(struct poller *pl)
+{
+	struct pollentry *pe, **pp;
+	struct pollqueue *pq;
+	unsigned i;
+
+	for (i=0; i<pl->pl_numentries; i++) {
+		pe = &pl->pl_entries[i];
+		pq = pe->pe_queue;
+		spinlock_acquire(&pq->pq_lock);
+		for (pp = &pq->pq_entries; *pp != pe; pp = &(*pp)->pe_next) {
+			KASSERT(*pp != NULL);
+		}
+		*pp = pe->pe_next;
+		spinlock_release(&pq->pq_lock);
+	}
+
+	kfree(pl->pl_entries);
+	spinlock_cleanup(&pl->pl_lock);
+	wchan_destroy(pl->pl_wchan);
+}
+
+/*
+ * Hook PL onto PQ. Called from VOP_POLL before looking at the
+ * object's state. If we're out of slots, just never sleep; the
+ * caller then polls instead of waiting, which is slow but correct.
+ */
+void
+poller_register(struct poller *pl, struct pollqueue *pq)
+{
+	struct pollentry *pe;
+
+	if (pl->pl_numentries == pl->pl_maxentries) {
+		spinlock_acquire(&pl->pl_lock);
+		pl->pl_woken = true;
+		spinlock_release(&pl->pl_lock);
+		return;
+	}
+
+	pe = &pl->pl_entries[pl->pl_numentries++];
+	pe->pe_queue = pq;
+	pe->pe_poller = pl;
+
+	spinlock_acquire(&pq->pq_lock);
+	pe->pe_next = pq->pq_entries;
+	pq->pq_entries = pe;
+	spinlock_release(&pq->pq_lock);
+}
+
+/*
+ * Call before each pass over the objects; any wakeup after this
+ * means the pass may have missed something.
+ */
+void
+poller_prepare(struct poller *pl)
+{
+	spinlock_acquire(&pl->pl_lock);
+	pl->pl_woken = false;
+	spinlock_release(&pl->pl_lock);
+}
+
+/*
+ * Wait for a wakeup since the last poller_prepare, for at most NSECS
+ * nanoseconds (0 for no limit). Returns ETIMEDOUT if time ran out.
+ * An unlimited wait can be interrupted, and then returns EINTR.
+ */
+int
+poller_wait(struct poller *pl, uint64_t nsecs)
+{
+	int result;
+
+	result = 0;
+	spinlock_acquire(&pl->pl_lock);
+	while (!pl->pl_woken && result == 0) {
+		if (nsecs == 0) {
+			result = wchan_sleep_intr(pl->pl_wchan, &pl->pl_lock);
+		}
+		else {
+			result = wchan_sleep_timeout(pl->pl_wchan,
+						     &pl->pl_lock, nsecs);
+		}
+	}
+	spinlock_release(&pl->pl_lock);
+	return result;
+}
@@ -32,7 +32,11 @@
  */
 #include <types.h>
 #include <kern/errno.h>
+#include <kern/dirent.h>
+#include <kern/poll.h>
+#include <limits.h>
 #include <lib.h>
+#include <uio.h>
 #include <synch.h>
 #include <vfs.h>
 #include <vnode.h>
@@ -71,6 +75,82 @@ vnode_cleanup(struct vnode *vn)
 	vn->vn_data = NULL;
 }
 
+/*
+ * Default vop_getdirentries: call vop_getdirentry once per name and
+ * pack them up as struct dirent records. We don't know inode numbers
+ * or types this way, so those are left 0 and DT_UNKNOWN. A name that
+ * doesn't fit is left for next time by not advancing the offset past
+ * it.
+ */
+int
+vnode_getdirentries(struct vnode *dir, struct uio *uio)
+{
+	struct dirent *d;
+	struct iovec iov;
+	struct uio nameuio;
+	size_t namlen, reclen;
+	unsigned done;
+	int result;
+
+	KASSERT(uio->uio_rw == UIO_READ);
+
+	d = kmalloc(_DIRENT_RECLEN(NAME_MAX));
+	if (d == NULL) {
+		return ENOMEM;
+	}
+
+	done = 0;
+	while (1) {
+		bzero(d, _DIRENT_RECLEN(NAME_MAX));
+		uio_kinit(&iov, &nameuio, d->d_name, NAME_MAX,
+			  uio->uio_offset, UIO_READ);
+		result = VOP_GETDIRENTRY(dir, &nameuio);
+		if (result) {
+			break;
+		}
+		namlen = NAME_MAX - nameuio.uio_resid;
+		if (namlen == 0) {
+			/* EOF */
+			break;
+		}
+
+		reclen = _DIRENT_RECLEN(namlen);
+		if (reclen > uio->uio_resid) {
+			result = EINVAL;
+			break;
+		}
+		d->d_ino = 0;
+		d->d_reclen = reclen;
+		d->d_type = DT_UNKNOWN;
+		d->d_namlen = namlen;
+		result = uiomove(d, reclen, uio);
+		if (result) {
+			break;
+		}
+		uio->uio_offset = nameuio.uio_offset;
+		done++;
+	}
+
+	kfree(d);
+
+	/* stopping early is only an error if we got nothing */
+	return done > 0 ? 0 : result;
+}
+
+/*
+ * Default vop_poll, for objects that never block: whatever is asked
+ * for is ready.
+ */
+int
+vnode_pollready(struct vnode *vn, int events, struct poller *poller,
+		int *revents)
+{
+	(void)vn;
+	(void)poller;
+
+	*revents = events & (POLLIN | POLLOUT);
+	return 0;
+}
 
 /*
  * Increment refcount.
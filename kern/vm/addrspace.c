@@ -32,6 +32,7 @@
 #include <lib.h>
 #include <spl.h>
 #include <spinlock.h>
+#include <synch.h>
 #include <current.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
@@ -45,6 +46,7 @@
     as_check_valid_addr
     Checks a given address against an address space regions.
     If valid region found, returns the region.
+    The caller must hold as->as_regionlock.
 */
 struct region_spec *
 as_check_valid_addr(struct addrspace *as, vaddr_t addr){
@@ -78,6 +80,11 @@ as_create(void)
         if (as == NULL) {
                 return NULL;
         }
+        as->as_regionlock = rwlock_create("as_regions");
+        if (as->as_regionlock == NULL) {
+                kfree(as);
+                return NULL;
+        }
         as->regions = NULL;
         return as;
 }
@@ -123,17 +130,20 @@ as_copy(struct addrspace *old, struct addrspace **ret)
             return ENOMEM;
     }
 
-    /* No lock required on addrspace as regions are never changed */
+    /* Copy the region list, keeping it stable while we walk it */
+    rwlock_acquire_read(old->as_regionlock);
     struct region_spec *curr_region = old->regions;
     while(curr_region!=NULL){
         /* copy old regions into the new address space*/
         result = as_copy_region(new_as,curr_region);
         if(result){
+            rwlock_release_read(old->as_regionlock);
             as_destroy(new_as);
             return result;
         }
         curr_region = curr_region->as_next;
     }
+    rwlock_release_read(old->as_regionlock);
 
     /* allocate new page table entries*/
     result = copy_page_table(old, new_as);
@@ -196,7 +206,7 @@ as_destroy(struct addrspace *as)
 
     spinlock_release(&pagetable_lock);
 
-    /* free all regions - no lock required*/
+    /* free all regions - no lock required, nobody else can see us */
     struct region_spec *curr_region = as->regions;
     struct region_spec *next_region = NULL;
 
@@ -206,6 +216,7 @@ as_destroy(struct addrspace *as)
         curr_region = next_region;
     }
 
+    rwlock_destroy(as->as_regionlock);
     kfree(as);
 
     /* Flush TLB */
@@ -279,14 +290,17 @@ as_define_region(struct addrspace *as, vaddr_t vaddr, size_t memsize,
             return ENOMEM;
         }
 
+        region->as_perms = 0;
         if(readable) region->as_perms |= PF_R;
         if(writeable) region->as_perms |= PF_W;
         if(executable) region->as_perms |= PF_X;
 
         region->as_vbase = vaddr;
         region->as_npages = memsize / PAGE_SIZE;
+        rwlock_acquire_write(as->as_regionlock);
         region->as_next = as->regions;
         as->regions = region;
+        rwlock_release_write(as->as_regionlock);
 
         return 0;
 }
@@ -303,6 +317,7 @@ as_prepare_load(struct addrspace *as)
             return EFAULT;
         }
 
+        rwlock_acquire_write(as->as_regionlock);
         struct region_spec *curr_region = as->regions;
         while(curr_region!=NULL){
             if(!(curr_region->as_perms & PF_W)){
@@ -311,6 +326,7 @@ as_prepare_load(struct addrspace *as)
             }
             curr_region = curr_region->as_next;
         }
+        rwlock_release_write(as->as_regionlock);
         return 0;
 }
 
@@ -330,6 +346,7 @@ as_complete_load(struct addrspace *as)
         return EFAULT;
     }
 
+    rwlock_acquire_write(as->as_regionlock);
     spinlock_acquire(&pagetable_lock);
 
     /* walk the length of the pagetable */
@@ -345,6 +362,7 @@ as_complete_load(struct addrspace *as)
                 struct region_spec * region =as_check_valid_addr(as, page_vbase);
                 if(region==NULL){
                     spinlock_release(&pagetable_lock);
+                    rwlock_release_write(as->as_regionlock);
                     return EFAULT;
                 }
                 /* turn off dirty bit */
@@ -355,7 +373,7 @@ as_complete_load(struct addrspace *as)
             curr = curr->next;
         }
 
-        /* set all modified regions to correct perms - no lock required*/
+        /* set all modified regions to correct perms */
         struct region_spec * curr_region = as->regions;
         while(curr_region!=NULL){
             if(curr_region->as_perms & OS_M){
@@ -366,6 +384,7 @@ as_complete_load(struct addrspace *as)
     }
 
     spinlock_release(&pagetable_lock);
+    rwlock_release_write(as->as_regionlock);
 
     /* Flush TLB */
     as_activate();
@@ -401,3 +420,116 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 
     return 0;
 }
+
+
+/*
+    as_threadstack_base
+    thread stacks go below the main one, one per slot, with an unmapped
+    guard page under each so running off the end faults
+*/
+static vaddr_t
+as_threadstack_base(unsigned slot){
+    return USERSTACK - STACKSIZE - (slot + 1) * (STACKSIZE + PAGE_SIZE);
+}
+
+
+/*
+    as_define_threadstack
+    setup the stack region for a user thread and return its stack pointer.
+*/
+int
+as_define_threadstack(struct addrspace *as, unsigned slot, vaddr_t *stackptr)
+{
+    if(as==NULL){
+        return EFAULT;
+    }
+
+    vaddr_t stackbase = as_threadstack_base(slot);
+
+    int result = as_define_region(as, stackbase, STACKSIZE, VALID_BIT, VALID_BIT, INVALID_BIT);
+    if(result){
+        return result;
+    }
+
+    *stackptr = stackbase + STACKSIZE;
+    return 0;
+}
+
+
+/*
+    as_remove_threadstack
+    free a user thread's stack once it has exited
+*/
+void
+as_remove_threadstack(struct addrspace *as, unsigned slot)
+{
+    int result = as_remove_region(as, as_threadstack_base(slot));
+    KASSERT(result == 0);
+}
+
+
+/*
+    as_remove_region
+    unmap the region starting at vaddr and free its pages and frames.
+    The pages come out of the pagetable first, so no fault can load them
+    again, then out of every TLB; only then can the frames be reused.
+*/
+int
+as_remove_region(struct addrspace *as, vaddr_t vaddr)
+{
+    struct region_spec *region, **prevp;
+    struct pagetable_entry *curr, **currp, *dead;
+
+    if(as==NULL){
+        return EFAULT;
+    }
+
+    /* unlink the region so faults on it fail from now on */
+    rwlock_acquire_write(as->as_regionlock);
+    prevp = &as->regions;
+    while(*prevp != NULL && (*prevp)->as_vbase != vaddr){
+        prevp = &(*prevp)->as_next;
+    }
+    region = *prevp;
+    if(region==NULL){
+        rwlock_release_write(as->as_regionlock);
+        return EINVAL;
+    }
+    *prevp = region->as_next;
+    rwlock_release_write(as->as_regionlock);
+
+    /* take its pages out of the pagetable */
+    dead = NULL;
+    spinlock_acquire(&pagetable_lock);
+    for(size_t i = 0; i<region->as_npages; i++){
+        vaddr_t page_vbase = region->as_vbase + i*PAGE_SIZE;
+        uint32_t index = hpt_hash(as, page_vbase);
+
+        currp = &pagetable[index];
+        while((curr = *currp) != NULL){
+            if(curr->pid == as && curr->pagenumber == page_vbase >> PAGE_BITS){
+                *currp = curr->next;
+                curr->next = dead;
+                dead = curr;
+            }else{
+                currp = &curr->next;
+            }
+        }
+    }
+    spinlock_release(&pagetable_lock);
+
+    /* other threads of this process may have them cached anywhere */
+    vm_tlbshootdown_all(region->as_vbase, region->as_npages);
+
+    /* now nobody can see the frames */
+    while(dead!=NULL){
+        curr = dead;
+        dead = curr->next;
+        paddr_t framebase = (curr->entrylo.lo.framenum)<<FRAME_TO_PADDR;
+        free_kpages(PADDR_TO_KVADDR(framebase));
+        kfree(curr);
+    }
+    kfree(region);
+
+    return 0;
+}
@@ -26,6 +26,8 @@ struct spinlock frametable_lock = SPINLOCK_INITIALIZER;
 void frametable_bootstrap(void){
     unsigned int i;
 
+    spinlock_setname(&frametable_lock, "frametable_lock");
+
     /* calculate the ram size to get size of frametable */
     paddr_t ramtop = ram_getsize();
 
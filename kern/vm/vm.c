@@ -9,6 +9,8 @@
 #include <proc.h>
 #include <elf.h>
 #include <spl.h>
+#include <synch.h>
+#include <cpu.h>
 
 
 
@@ -16,14 +18,19 @@ struct frametable_entry *firstfreeframe = 0;
 struct pagetable_entry **pagetable = NULL;
 struct spinlock pagetable_lock = SPINLOCK_INITIALIZER;
 
+/* one cross-CPU shootdown at a time, so the IPI queues can't fill up */
+static struct lock *shootdown_lock;
+static struct semaphore *shootdown_sem;
+
 
 /* Page table functions */
-static struct pagetable_entry *find_page(struct addrspace *as, uint32_t index);
+static struct pagetable_entry *find_page(struct addrspace *as, uint32_t index, uint32_t pagenumber);
 static void set_entrylo (struct EntryLo *entrylo, int valid, int dirty, uint32_t framenum);
 static void copyframe(int from_frame, int to_frame);
 static void insert_page(uint32_t index,struct pagetable_entry *page_entry);
 static struct pagetable_entry * create_page(struct addrspace *as, uint32_t pagenumber, int dirtybit);
-static int readonwrite(struct pagetable_entry *page);
+static int readonwrite(struct pagetable_entry *page, int *oldframe);
+static void tlb_invalidate(vaddr_t vaddr, unsigned npages);
 static struct pagetable_entry *create_shared_page(struct addrspace *as, uint32_t pagenumber, uint32_t sharedframe, int valid);
 
 
@@ -43,6 +50,11 @@ void vm_bootstrap(void)
         pagetable = kmalloc(pagespace);
         KASSERT(pagetable != NULL);
         for(int i = 0; i<npages; i++) pagetable[i] = NULL;
+        spinlock_setname(&pagetable_lock, "pagetable_lock");
+
+        shootdown_lock = lock_create("shootdown_lock");
+        shootdown_sem = sem_create("shootdown", 0);
+        KASSERT(shootdown_lock != NULL && shootdown_sem != NULL);
 
         /* initialise frametable */
         frametable_bootstrap();
@@ -52,13 +64,16 @@ void vm_bootstrap(void)
 /*
     find_page
     looks inside chained page table entry for a VALID translation.
+    pages of one address space can collide in the hash, so the page
+    number has to match as well.
 */
 static struct pagetable_entry *
-find_page(struct addrspace *as, uint32_t index){
+find_page(struct addrspace *as, uint32_t index, uint32_t pagenumber){
     struct pagetable_entry *curr_entry = pagetable[index];
     while(curr_entry!=NULL){
-        /* check address space matches and valid bit */
-        if(curr_entry->pid == as && curr_entry->entrylo.lo.valid){
+        /* check address space, page number and valid bit */
+        if(curr_entry->pid == as && curr_entry->pagenumber == pagenumber &&
+           curr_entry->entrylo.lo.valid){
             break;
         }
         curr_entry = curr_entry->next;
@@ -146,12 +161,22 @@ create_page(struct addrspace *as, uint32_t pagenumber, int dirtybit){
 
 
 
+/*
+    readonwrite
+    make a copy-on-write page writable, giving it its own copy of the
+    frame unless nobody else is using it. If it moves, the old frame
+    is handed back in oldframe, still referenced: other CPUs may have
+    it in their TLBs, so the caller drops it after the shootdown.
+    Otherwise oldframe is -1. Must hold pagetable lock.
+*/
 static int
-readonwrite(struct pagetable_entry *page){
+readonwrite(struct pagetable_entry *page, int *oldframe){
 
     /* check current frame reference count */
     int from_frame = page->entrylo.lo.framenum;
 
+    *oldframe = -1;
+
     /* if last reference to frame  */
     if(frame_ref_cnt(from_frame)==1){
         /* set page as writeable */
@@ -165,8 +190,8 @@ readonwrite(struct pagetable_entry *page){
         return ENOMEM;
     }
 
-    /* decrement old frame ref count */
-    frame_ref_mod(from_frame, -1);
+    /* the old frame's reference goes once no TLB can point at it */
+    *oldframe = from_frame;
 
     /* set the entrylo */
     paddr_t paddr = KVADDR_TO_PADDR(kvaddr);
@@ -187,6 +212,8 @@ readonwrite(struct pagetable_entry *page){
     copy_page_table
     given an existing address space, copies all valid page table entries to the new address space,
     sets both pages to share the existing frame, and sets both pages to read only.
+    old must be the current address space: its writable TLB entries are
+    dropped here, on every CPU if other threads might be using them.
 */
 int
 copy_page_table(struct addrspace *old, struct addrspace *new){
@@ -224,6 +251,14 @@ copy_page_table(struct addrspace *old, struct addrspace *new){
         }
     }
     spinlock_release(&pagetable_lock);
+
+    /* the old pages are read only now; so must their TLB entries be */
+    KASSERT(old == proc_getas());
+    if(curproc->p_nlive > 1){
+        vm_tlbshootdown_all(0, USERSPACETOP / PAGE_SIZE);
+    }else{
+        tlb_invalidate(0, USERSPACETOP / PAGE_SIZE);
+    }
     return 0;
 }
 
@@ -258,11 +293,14 @@ vm_fault(int faulttype, vaddr_t faultaddress)
     uint32_t pagenumber = faultaddress/PAGE_SIZE;
     vaddr_t page_vbase = faultaddress & PAGE_FRAME;
     uint32_t entryhi, entrylo;
+    int tlbindex;
     entryhi = entrylo = 0;
 
     switch (faulttype) {
     	    case VM_FAULT_READONLY:
-                return EFAULT;
+                /* a store to a copy-on-write page; same as a write miss */
+                faulttype = VM_FAULT_WRITE;
+                break;
     	    case VM_FAULT_READ:
     	    case VM_FAULT_WRITE:
     		    break;
@@ -283,19 +321,23 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 
         /* Search for existing page entry*/
         uint32_t index = hpt_hash(as, page_vbase);
-        struct pagetable_entry *page_entry = find_page(as, index);
+        struct pagetable_entry *page_entry = find_page(as, index, pagenumber);
+        struct pagetable_entry *existing;
 
         /* No PageTable Entry Found*/
         if(page_entry==NULL){
 
             /* Check valid region address. */
+            rwlock_acquire_read(as->as_regionlock);
             struct region_spec *region = as_check_valid_addr(as,faultaddress);
             if(region==NULL){
+                rwlock_release_read(as->as_regionlock);
                 return EFAULT;
             }
 
             int dirtybit = 0;
             if(region->as_perms & PF_W) dirtybit = 1;
+            rwlock_release_read(as->as_regionlock);
 
             /* create a new page table entry  */
             page_entry = create_page(as,pagenumber,dirtybit);
@@ -303,10 +345,23 @@ vm_fault(int faulttype, vaddr_t faultaddress)
                 return ENOMEM;
             }
 
-            /* insert new page table entry */
+            /*
+             * insert new page table entry, unless another thread of
+             * the process faulted the page in meanwhile; then use
+             * that one and throw ours away. (If this was a write to
+             * a read only page, it'll fault again and be dealt with.)
+             */
             spinlock_acquire(&pagetable_lock);
-            insert_page(index,page_entry);
+            existing = find_page(as, index, pagenumber);
+            if(existing==NULL){
+                insert_page(index,page_entry);
+            }
             spinlock_release(&pagetable_lock);
+            if(existing!=NULL){
+                free_kpages(PADDR_TO_KVADDR((paddr_t)page_entry->entrylo.lo.framenum << FRAME_TO_PADDR));
+                kfree(page_entry);
+                page_entry = existing;
+            }
 
         }else{
 
@@ -317,22 +372,38 @@ vm_fault(int faulttype, vaddr_t faultaddress)
                 if(page_entry->entrylo.lo.dirty == 0){
 
                     /* check valid region address. */
+                    rwlock_acquire_read(as->as_regionlock);
                     struct region_spec *region = as_check_valid_addr(as,faultaddress);
                     if(region==NULL){
+                        rwlock_release_read(as->as_regionlock);
                         return EFAULT;
                     }
 
                     /* check region has write permisions */
                     if (!(region->as_perms & PF_W)){
+                        rwlock_release_read(as->as_regionlock);
                         return EFAULT;
                     }
+                    rwlock_release_read(as->as_regionlock);
 
+                    int oldframe;
                     spinlock_acquire(&pagetable_lock);
-                    int result = readonwrite(page_entry);
+                    int result = readonwrite(page_entry, &oldframe);
                     spinlock_release(&pagetable_lock);
                     if(result){
                         return result;
                     }
+
+                    /*
+                     * If the page moved, sibling threads on other CPUs
+                     * may still have the shared frame in their TLBs.
+                     */
+                    if(oldframe >= 0){
+                        if(curproc->p_nlive > 1){
+                            vm_tlbshootdown_all(page_vbase, 1);
+                        }
+                        free_kpages(PADDR_TO_KVADDR((paddr_t)oldframe << FRAME_TO_PADDR));
+                    }
                 }
             }
         }
@@ -340,23 +411,183 @@ vm_fault(int faulttype, vaddr_t faultaddress)
         entryhi = page_vbase;
         entrylo = page_entry->entrylo.uint;
 
-        /* Write to the TLB */
+        /* Write to the TLB, replacing a read-only entry if there is one */
         int spl = splhigh();
-        tlb_random(entryhi,entrylo);
+        tlbindex = tlb_probe(entryhi, 0);
+        if(tlbindex >= 0){
+            tlb_write(entryhi, entrylo, tlbindex);
+        }else{
+            tlb_random(entryhi,entrylo);
+        }
         splx(spl);
 
         return 0;
 }
 
 /*
- *
- * SMP-specific functions.  Unused in our configuration.
- */
+    tlb_invalidate
+    drop any entries for npages pages from vaddr from this CPU's TLB;
+    for a big range it's quicker to flush the lot
+*/
+static void
+tlb_invalidate(vaddr_t vaddr, unsigned npages){
+    int i, spl;
+    unsigned p;
+
+    spl = splhigh();
+    if(npages > TLBSHOOTDOWN_MAX){
+        for (i=0; i<NUM_TLB; i++) {
+            tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+        }
+    }else{
+        for(p = 0; p<npages; p++){
+            i = tlb_probe(vaddr + p*PAGE_SIZE, 0);
+            if(i >= 0){
+                tlb_write(TLBHI_INVALID(i), TLBLO_INVALID(), i);
+            }
+        }
+    }
+    splx(spl);
+}
+
+
+/*
+    vm_tlbshootdown
+    another CPU is unmapping pages; drop them and tell it we're done
+*/
 void
 vm_tlbshootdown(const struct tlbshootdown *ts)
 {
-        (void)ts;
-        panic("vm tried to do tlb shootdown?!\n");
+        tlb_invalidate(ts->ts_vaddr, ts->ts_npages);
+        V(ts->ts_done);
+}
+
+
+/*
+    vm_tlbshootdown_all
+    drop a range of pages from every CPU's TLB, and wait until the
+    other CPUs have done it, so the frames behind them can be reused.
+    Only pages of the current address space can be cached in a TLB
+    (as_activate flushes on every switch), but with several threads
+    in a process any CPU might be running one of them.
+*/
+void
+vm_tlbshootdown_all(vaddr_t vaddr, unsigned npages)
+{
+        struct tlbshootdown ts;
+        struct cpu *c;
+        unsigned i, num, sent;
+        int spl;
+
+        ts.ts_vaddr = vaddr & PAGE_FRAME;
+        ts.ts_npages = npages;
+        ts.ts_done = shootdown_sem;
+        sent = 0;
+
+        lock_acquire(shootdown_lock);
+
+        /* stay on this CPU while we pick out the others */
+        spl = splhigh();
+        tlb_invalidate(ts.ts_vaddr, npages);
+        num = cpu_count();
+        for(i = 0; i<num; i++){
+            c = cpu_get(i);
+            if(c != curcpu){
+                ipi_tlbshootdown(c, &ts);
+                sent++;
+            }
+        }
+        splx(spl);
+
+        for(i = 0; i<sent; i++){
+            P(shootdown_sem);
+        }
+
+        lock_release(shootdown_lock);
+}
+
+/*
+    vm_prefault
+    load the user pages under [vaddr, vaddr+len) into the TLB ahead of
+    a big copyin/copyout, straight through vm_fault, instead of taking
+    a TLB exception for each one partway through the copy. Only as many
+    pages as the TLB comfortably holds; there's no need to pin the
+    frames, as nothing is ever paged out. Errors are left for the copy
+    itself to run into.
+*/
+void
+vm_prefault(vaddr_t vaddr, size_t len, bool write)
+{
+        vaddr_t page, end;
+        uint32_t entryhi, entrylo;
+        unsigned n;
+        int i, spl;
+
+        end = vaddr + len;
+        page = vaddr & PAGE_FRAME;
+        for(n = 0; page < end && n < NUM_TLB/2; page += PAGE_SIZE, n++){
+            spl = splhigh();
+            i = tlb_probe(page, 0);
+            if(i >= 0){
+                tlb_read(&entryhi, &entrylo, i);
+            }
+            splx(spl);
+
+            /* already there (and writable, if need be) */
+            if(i >= 0 && (!write || (entrylo & TLBLO_DIRTY))){
+                continue;
+            }
+            if(vm_fault(write ? VM_FAULT_WRITE : VM_FAULT_READ, page)){
+                return;
+            }
+        }
+}
+
+/*
+    vm_loanpage
+    lend the frame behind a resident, page-aligned user page of the
+    current address space, e.g. to a pipe. The page becomes
+    copy-on-write for its owner and the frame gets an extra reference,
+    which the borrower drops with free_kpages on the returned kernel
+    address. Fails if the page isn't resident; the caller copies instead.
+*/
+int
+vm_loanpage(vaddr_t uaddr, vaddr_t *kvaddr)
+{
+        struct addrspace *as;
+        struct pagetable_entry *page_entry;
+        uint32_t framenum;
+
+        KASSERT((uaddr & ~PAGE_FRAME) == 0);
+
+        as = proc_getas();
+        if(as == NULL || uaddr >= USERSPACETOP){
+            return EFAULT;
+        }
+
+        spinlock_acquire(&pagetable_lock);
+        page_entry = find_page(as, hpt_hash(as, uaddr), uaddr / PAGE_SIZE);
+        if(page_entry == NULL){
+            spinlock_release(&pagetable_lock);
+            return EFAULT;
+        }
+        page_entry->entrylo.lo.dirty = 0;
+        framenum = page_entry->entrylo.lo.framenum;
+        frame_ref_mod(framenum, 1);
+        spinlock_release(&pagetable_lock);
+
+        /*
+         * With only this thread in the process, no other CPU can be
+         * running with our TLB entries loaded, so a local flush does.
+         */
+        if(curproc->p_nlive > 1){
+            vm_tlbshootdown_all(uaddr, 1);
+        }else{
+            tlb_invalidate(uaddr, 1);
+        }
+
+        *kvaddr = PADDR_TO_KVADDR((paddr_t)framenum << FRAME_TO_PADDR);
+        return 0;
 }
 
 /*
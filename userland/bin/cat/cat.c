@@ -29,6 +29,7 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -36,6 +37,32 @@
  * Usage: cat [files]
  */
 
+/* How much to ask sendfile for at once */
+#define SENDCHUNK	65536
+
+/*
+ * Print a file with sendfile, which copies it inside the kernel.
+ * Returns -1, having printed nothing, if sendfile doesn't work for
+ * this file (or at all), so the caller can do it the slow way.
+ */
+static
+int
+sendcat(const char *name, int fd)
+{
+	ssize_t r;
+	int sent = 0;
+
+	while ((r = sendfile(STDOUT_FILENO, fd, SENDCHUNK)) > 0) {
+		sent = 1;
+	}
+	if (r < 0) {
+		if (!sent && (errno == ENOSYS || errno == EINVAL)) {
+			return -1;
+		}
+		err(1, "%s", name);
+	}
+	return 0;
+}
 
 
 /* Print a file that's already been opened. */
@@ -46,6 +73,10 @@ docat(const char *name, int fd)
 	char buf[1024];
 	int len, wr, wrtot;
 
+	if (sendcat(name, fd) == 0) {
+		return;
+	}
+
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -28,6 +28,7 @@
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
 
 /*
@@ -35,6 +36,32 @@
  * Usage: cp oldfile newfile
  */
 
+/* How much to ask sendfile for at once */
+#define SENDCHUNK	65536
+
+/*
+ * Copy with sendfile, which moves the data inside the kernel.
+ * Returns -1, having copied nothing, if sendfile doesn't work for
+ * these files (or at all), so the caller can do it the slow way.
+ */
+static
+int
+sendcopy(const char *from, int fromfd, int tofd)
+{
+	ssize_t r;
+	int sent = 0;
+
+	while ((r = sendfile(tofd, fromfd, SENDCHUNK)) > 0) {
+		sent = 1;
+	}
+	if (r < 0) {
+		if (!sent && (errno == ENOSYS || errno == EINVAL)) {
+			return -1;
+		}
+		err(1, "%s", from);
+	}
+	return 0;
+}
 
 /* Copy one file to another. */
 static
@@ -58,6 +85,10 @@ copy(const char *from, const char *to)
 		err(1, "%s", to);
 	}
 
+	if (sendcopy(from, fromfd, tofd) == 0) {
+		goto done;
+	}
+
 	/*
 	 * As long as we get more than zero bytes, we haven't hit EOF.
 	 * Zero means EOF. Less than zero means an error occurred.
@@ -85,6 +116,7 @@ copy(const char *from, const char *to)
 		err(1, "%s", from);
 	}
 
+ done:
 	if (close(fromfd) < 0) {
 		err(1, "%s: close", from);
 	}
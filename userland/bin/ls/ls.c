@@ -31,6 +31,7 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <dirent.h>
 #include <string.h>
 #include <errno.h>
 #include <err.h>
@@ -186,20 +187,18 @@ print(const char *path)
 }
 
 /*
- * List a directory.
+ * Read a directory's entries a bufferful at a time with getdirentries
+ * and call FUNC on each one. This is a lot fewer system calls than
+ * getdirentry, which returns only one name per call.
  */
 static
 void
-listdir(const char *path, int showheader)
+foreachentry(const char *path, void (*func)(const char *, struct dirent *))
 {
 	int fd;
-	char buf[1024];
-	char newpath[1024];
-	ssize_t len;
-
-	if (showheader) {
-		printheader(path);
-	}
+	char buf[4096];
+	struct dirent *d;
+	ssize_t len, pos;
 
 	/*
 	 * Open it.
@@ -210,21 +209,16 @@ listdir(const char *path, int showheader)
 	}
 
 	/*
-	 * List the directory.
+	 * Go through the directory.
 	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
-
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
-
-		if (aopt || buf[0]!='.') {
-			/* Print it */
-			print(newpath);
+	while ((len = getdirentries(fd, buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < len; pos += d->d_reclen) {
+			d = (struct dirent *)(buf + pos);
+			func(path, d);
 		}
 	}
 	if (len<0) {
-		err(1, "%s: getdirentry", path);
+		err(1, "%s: getdirentries", path);
 	}
 
 	/* Done */
@@ -233,54 +227,69 @@ listdir(const char *path, int showheader)
 
 static
 void
-recursedir(const char *path)
+listentry(const char *path, struct dirent *d)
 {
-	int fd;
-	char buf[1024];
 	char newpath[1024];
-	int len;
 
-	/*
-	 * Open it.
-	 */
-	fd = open(path, O_RDONLY);
-	if (fd<0) {
-		err(1, "%s", path);
+	if (aopt || d->d_name[0]!='.') {
+		/* Assemble the full name of the new item */
+		snprintf(newpath, sizeof(newpath), "%s/%s", path, d->d_name);
+
+		/* Print it */
+		print(newpath);
 	}
+}
 
-	/*
-	 * List the directory.
-	 */
-	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
-		buf[len] = 0;
+/*
+ * List a directory.
+ */
+static
+void
+listdir(const char *path, int showheader)
+{
+	if (showheader) {
+		printheader(path);
+	}
+	foreachentry(path, listentry);
+}
 
-		/* Assemble the full name of the new item */
-		snprintf(newpath, sizeof(newpath), "%s/%s", path, buf);
+static void recursedir(const char *path);
 
-		if (!aopt && buf[0]=='.') {
-			/* skip this one */
-			continue;
-		}
+static
+void
+recurseentry(const char *path, struct dirent *d)
+{
+	char newpath[1024];
 
-		if (!strcmp(buf, ".") || !strcmp(buf, "..")) {
-			/* always skip these */
-			continue;
-		}
+	if (!aopt && d->d_name[0]=='.') {
+		/* skip this one */
+		return;
+	}
 
-		if (!isdir(newpath)) {
-			continue;
-		}
+	if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, "..")) {
+		/* always skip these */
+		return;
+	}
 
-		listdir(newpath, 1 /*showheader*/);
-		if (Ropt) {
-			recursedir(newpath);
-		}
+	/* Assemble the full name of the new item */
+	snprintf(newpath, sizeof(newpath), "%s/%s", path, d->d_name);
+
+	/* Use d_type if we have it, so we don't have to open everything */
+	if (d->d_type == DT_UNKNOWN ? !isdir(newpath) : d->d_type != DT_DIR) {
+		return;
 	}
-	if (len<0) {
-		err(1, "%s", path);
+
+	listdir(newpath, 1 /*showheader*/);
+	if (Ropt) {
+		recursedir(newpath);
 	}
+}
 
-	close(fd);
+static
+void
+recursedir(const char *path)
+{
+	foreachentry(path, recurseentry);
 }
 
 static
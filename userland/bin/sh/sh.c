@@ -421,30 +421,17 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
-	}
-
-	/* parent */
+	/*
+	 * Start it in a new process. This is fork and execvp in one
+	 * go, without copying our address space just to discard it.
+	 */
+	pid = spawnvp(args[0], args);
+	if (pid < 0) {
+		warn("%s", args[0]);
+		exitinfo_exit(ei, 1);
+		return;
+	}
+
 	if (bg) {
 		/* background this command */
 		remember_bg(pid);
@@ -40,6 +40,7 @@
  */
 #include <kern/fcntl.h>
 #include <kern/ioctl.h>
+#include <kern/iovec.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
 #include <kern/time.h>
@@ -68,6 +69,8 @@
  *     remove:   stdio.h
  *     rename:   stdio.h
  *     time:     time.h
+ *     readv:    sys/uio.h
+ *     writev:   sys/uio.h
  *
  * Also note that the prototypes for open() and mkdir() contain, for
  * compatibility with Unix, an extra argument that is not meaningful
@@ -141,13 +144,26 @@ int chdir(const char *path);
 
 /* Optional. */
 void *sbrk(__intptr_t change);
+pid_t vfork(void);
+pid_t spawnv(const char *prog, char *const *args);
 ssize_t getdirentry(int filehandle, char *buf, size_t buflen);
+ssize_t getdirentries(int filehandle, char *buf, size_t buflen);
 int symlink(const char *target, const char *linkname);
 ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
+ssize_t readv(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t writev(int filehandle, const struct iovec *iov, int iovcnt);
+ssize_t pread(int filehandle, void *buf, size_t size, off_t pos);
+ssize_t pwrite(int filehandle, const void *buf, size_t size, off_t pos);
+ssize_t sendfile(int outhandle, int inhandle, size_t count);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
+int __thread_create(void (*entry)(int (*)(void *), void *),
+		    int (*func)(void *), void *arg);
+int thread_join(int tid, int *status);
+__DEAD void thread_exit(int status);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -156,8 +172,10 @@ ssize_t __getcwd(char *buf, size_t buflen);
  */
 
 int execvp(const char *prog, char *const *args); /* calls execv */
+pid_t spawnvp(const char *prog, char *const *args); /* calls spawnv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int thread_create(int (*func)(void *), void *arg); /* calls __thread_create */
 
 /* UNSW versions of mmap() and munmap()
  * This are simplified compared to the standard version on UNIX
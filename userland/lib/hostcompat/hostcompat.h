@@ -34,6 +34,7 @@
 void hostcompat_init(int argc, char **argv);
 
 time_t __time(time_t *secs, unsigned long *nsecs);
+pid_t spawnvp(const char *prog, char *const *args);
 
 #ifdef DECLARE_NTOHLL
 #include <stdint.h>
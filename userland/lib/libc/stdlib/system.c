@@ -74,18 +74,10 @@ system(const char *cmd)
 
 	argv[nargs] = NULL;
 
-	pid = fork();
-	switch (pid) {
-	    case -1:
+	pid = spawnv(argv[0], argv);
+	if (pid < 0) {
 		return -1;
-	    case 0:
-		/* child */
-		execv(argv[0], argv);
-		/* exec only returns if it fails */
-		_exit(255);
-	    default:
-		/* parent */
-		waitpid(pid, &status, 0);
-		return status;
 	}
+	waitpid(pid, &status, 0);
+	return status;
 }
@@ -72,6 +72,7 @@ extern const char *hostcompat_progname;
 static bool dofiles, dodirs;
 static bool doindirect;
 static bool recurse;
+static bool dofrag;
 
 ////////////////////////////////////////////////////////////
 // printouts
@@ -476,6 +477,11 @@ dumpinode(uint32_t ino, const char *name)
 	}
 	printf("    Indirect block: %u (0x%x)\n",
 	       SWAP32(sfi.sfi_indirect), SWAP32(sfi.sfi_indirect));
+	if (SWAP32(sfi.sfi_dirbuckets) != 0) {
+		printf("    Hashed directory: %u buckets, max probe %u, "
+		       "%u entries\n", SWAP32(sfi.sfi_dirbuckets),
+		       SWAP32(sfi.sfi_dirprobe), SWAP32(sfi.sfi_dirused));
+	}
 	for (i=0; i<ARRAYCOUNT(sfi.sfi_waste); i++) {
 		if (sfi.sfi_waste[i] != 0) {
 			printf("    Word %u in waste area: 0x%x\n",
@@ -498,6 +504,152 @@ dumpinode(uint32_t ino, const char *name)
 	}
 }
 
+////////////////////////////////////////////////////////////
+// fragmentation report
+
+/*
+ * An extent is a run of consecutive disk blocks. A file laid out
+ * perfectly has one extent; the indirect block is counted as part of
+ * the run since the allocator places it between the direct blocks
+ * and the blocks it maps. Holes don't break a run.
+ */
+
+static uint32_t frag_lastblock;
+static uint32_t frag_blocks, frag_extents;
+
+static unsigned frag_nfiles, frag_nfragmented;
+static unsigned long frag_totblocks, frag_totextents;
+static uint32_t frag_worstino;
+static uint32_t frag_worstextents;
+
+static
+void
+fragblock(uint32_t diskblock)
+{
+	if (diskblock == 0) {
+		return;
+	}
+	if (frag_blocks == 0 || diskblock != frag_lastblock + 1) {
+		frag_extents++;
+	}
+	frag_blocks++;
+	frag_lastblock = diskblock;
+}
+
+static
+void
+fragcount(const struct sfs_dinode *sfi)
+{
+	uint32_t ib[SFS_BLOCKSIZE/sizeof(uint32_t)];
+	uint32_t fileblock, numblocks, idblock;
+	unsigned i;
+
+	frag_blocks = frag_extents = 0;
+	numblocks = DIVROUNDUP(SWAP32(sfi->sfi_size), SFS_BLOCKSIZE);
+
+	fileblock = 0;
+	for (i=0; i<SFS_NDIRECT && fileblock < numblocks; i++) {
+		fragblock(SWAP32(sfi->sfi_direct[i]));
+		fileblock++;
+	}
+	idblock = SWAP32(sfi->sfi_indirect);
+	if (fileblock < numblocks && idblock != 0) {
+		fragblock(idblock);
+		diskread(ib, idblock);
+		for (i=0; i<ARRAYCOUNT(ib) && fileblock < numblocks; i++) {
+			fragblock(SWAP32(ib[i]));
+			fileblock++;
+		}
+	}
+}
+
+static void fraginode(uint32_t ino, const char *name);
+
+static
+void
+fragdirblock(uint32_t fileblock, uint32_t diskblock)
+{
+	struct sfs_direntry sds[SFS_BLOCKSIZE/sizeof(struct sfs_direntry)];
+	int nsds = SFS_BLOCKSIZE/sizeof(struct sfs_direntry);
+	int i;
+
+	(void)fileblock;
+	if (diskblock == 0) {
+		return;
+	}
+	diskread(&sds, diskblock);
+
+	for (i=0; i<nsds; i++) {
+		uint32_t ino = SWAP32(sds[i].sfd_ino);
+		if (ino==SFS_NOINO) {
+			continue;
+		}
+		sds[i].sfd_name[SFS_NAMELEN-1] = 0; /* just in case */
+		if (!strcmp(sds[i].sfd_name, ".") ||
+		    !strcmp(sds[i].sfd_name, "..")) {
+			continue;
+		}
+		fraginode(ino, sds[i].sfd_name);
+	}
+}
+
+static
+void
+fraginode(uint32_t ino, const char *name)
+{
+	struct sfs_dinode sfi;
+
+	diskread(&sfi, ino);
+	fragcount(&sfi);
+
+	printf("    %-6u %-30s %6u blocks %4u extent%s\n", ino, name,
+	       frag_blocks, frag_extents, frag_extents == 1 ? "" : "s");
+
+	frag_nfiles++;
+	frag_totblocks += frag_blocks;
+	frag_totextents += frag_extents;
+	if (frag_extents > 1) {
+		frag_nfragmented++;
+	}
+	if (frag_extents > frag_worstextents) {
+		frag_worstextents = frag_extents;
+		frag_worstino = ino;
+	}
+
+	if (SWAP16(sfi.sfi_type) == SFS_TYPE_DIR) {
+		traverse(&sfi, fragdirblock);
+	}
+}
+
+static
+void
+dumpfrag(void)
+{
+	printf("Fragmentation\n");
+	printf("-------------\n");
+	fraginode(SFS_ROOTDIR_INO, "/");
+	printf("\n");
+
+	dumpvalf("Files", "%u", frag_nfiles);
+	dumpvalf("Fragmented files", "%u", frag_nfragmented);
+	dumpvalf("Data blocks", "%lu", frag_totblocks);
+	dumpvalf("Extents", "%lu", frag_totextents);
+	if (frag_totextents > 0) {
+		dumpvalf("Blocks per extent", "%lu.%02lu",
+			 frag_totblocks / frag_totextents,
+			 (frag_totblocks * 100 / frag_totextents) % 100);
+	}
+	if (frag_worstextents > 1) {
+		dumpvalf("Worst file", "inode %u, %u extents",
+			 frag_worstino, frag_worstextents);
+	}
+	if (dumppos % 2 == 1) {
+		printf("\n");
+		dumppos++;
+	}
+	printf("\n");
+}
+
 ////////////////////////////////////////////////////////////
 // main
 
@@ -513,6 +665,7 @@ usage(void)
 	warnx("   -f: dump file contents");
 	warnx("   -d: dump directory contents");
 	warnx("   -r: recurse into directory contents");
+	warnx("   -F: report per-file extents and overall fragmentation");
 	warnx("   -a: equivalent to -sbdfr -i 1");
 	errx(1, "   Default is -i 1");
 }
@@ -554,6 +707,7 @@ main(int argc, char **argv)
 				    case 'f': dofiles = true; break;
 				    case 'd': dodirs = true; break;
 				    case 'r': recurse = true; break;
+				    case 'F': dofrag = true; break;
 				    case 'a':
 					dosb = true;
 					dofreemap = true;
@@ -584,7 +738,7 @@ main(int argc, char **argv)
 		usage();
 	}
 
-	if (!dosb && !dofreemap && dumpino == 0) {
+	if (!dosb && !dofreemap && !dofrag && dumpino == 0) {
 		dumpino = SFS_ROOTDIR_INO;
 	}
 
@@ -600,6 +754,9 @@ main(int argc, char **argv)
 	if (dumpino != 0) {
 		dumpinode(dumpino, NULL);
 	}
+	if (dofrag) {
+		dumpfrag();
+	}
 
 	closedisk();
 
@@ -277,6 +277,17 @@ pass1_inode(uint32_t ino, struct sfs_dinode *sfi, int alreadychanged)
 		changed = 1;
 	}
 
+	if (!isdir && (sfi->sfi_dirbuckets != 0 || sfi->sfi_dirprobe != 0 ||
+		       sfi->sfi_dirused != 0)) {
+		warnx("Inode %lu: directory hash fields set on a regular "
+		      "file (cleared)", (unsigned long) ino);
+		setbadness(EXIT_RECOV);
+		sfi->sfi_dirbuckets = 0;
+		sfi->sfi_dirprobe = 0;
+		sfi->sfi_dirused = 0;
+		changed = 1;
+	}
+
 	if (check_inode_blocks(ino, sfi, isdir)) {
 		changed = 1;
 	}
@@ -350,6 +361,88 @@ pass1_direntry(const char *path, uint32_t index, struct sfs_direntry *sfd)
 	return dchanged;
 }
 
+/*
+ * Check the hash index of a hashed directory, whose inode is SFI and
+ * whose NDIRENTRIES entries are in DIRENTRIES. If the layout is
+ * invalid, drop the index (a hashed directory is always a valid
+ * linear one); otherwise make sure every entry is within the probe
+ * limit of its bucket and the entry count is right.
+ *
+ * Returns nonzero if SFI has been modified and needs to be written
+ * back.
+ */
+static
+int
+pass1_dirhash(const char *path, struct sfs_dinode *sfi,
+	      const struct sfs_direntry *direntries, uint32_t ndirentries)
+{
+	const uint32_t perblock = SFS_DIRPERBLOCK;
+	uint32_t nbuckets = sfi->sfi_dirbuckets;
+	uint32_t i, used, maxprobe, home, dist;
+	const char *s;
+	int changed = 0;
+
+	if (nbuckets == 0) {
+		if (sfi->sfi_dirprobe != 0 || sfi->sfi_dirused != 0) {
+			setbadness(EXIT_RECOV);
+			warnx("Directory %s: stray hash fields in linear "
+			      "directory (cleared)", path);
+			sfi->sfi_dirprobe = 0;
+			sfi->sfi_dirused = 0;
+			changed = 1;
+		}
+		return changed;
+	}
+
+	if ((nbuckets & (nbuckets - 1)) != 0 ||
+	    nbuckets > SFS_DIRHASH_MAXBUCKETS ||
+	    sfi->sfi_size != nbuckets * SFS_BLOCKSIZE) {
+		setbadness(EXIT_RECOV);
+		warnx("Directory %s: invalid hash index with %lu buckets "
+		      "(dropped)", path, (unsigned long) nbuckets);
+		sfi->sfi_dirbuckets = 0;
+		sfi->sfi_dirprobe = 0;
+		sfi->sfi_dirused = 0;
+		return 1;
+	}
+
+	used = maxprobe = 0;
+	for (i=0; i<ndirentries; i++) {
+		if (direntries[i].sfd_ino == SFS_NOINO) {
+			continue;
+		}
+		/* must match sfs_dir_hash() in the kernel */
+		home = SFS_DIRHASH_INIT;
+		for (s = direntries[i].sfd_name; *s; s++) {
+			home = SFS_DIRHASH_STEP(home, *s);
+		}
+		home &= nbuckets - 1;
+		dist = (i / perblock - home) & (nbuckets - 1);
+		if (dist > maxprobe) {
+			maxprobe = dist;
+		}
+		used++;
+	}
+
+	if (sfi->sfi_dirprobe < maxprobe) {
+		setbadness(EXIT_RECOV);
+		warnx("Directory %s: hash probe limit %lu should be %lu "
+		      "(fixed)", path, (unsigned long) sfi->sfi_dirprobe,
+		      (unsigned long) maxprobe);
+		sfi->sfi_dirprobe = maxprobe;
+		changed = 1;
+	}
+	if (sfi->sfi_dirused != used) {
+		setbadness(EXIT_RECOV);
+		warnx("Directory %s: hash entry count %lu should be %lu "
+		      "(fixed)", path, (unsigned long) sfi->sfi_dirused,
+		      (unsigned long) used);
+		sfi->sfi_dirused = used;
+		changed = 1;
+	}
+	return changed;
+}
+
 /*
  * Check a directory. INO is the inode number; PATHSOFAR is the path
  * to this directory. This traverses the volume directory tree
@@ -392,6 +485,10 @@ pass1_dir(uint32_t ino, const char *pathsofar)
 		}
 	}
 
+	if (pass1_dirhash(pathsofar, &sfi, direntries, ndirentries)) {
+		sfs_writeinode(ino, &sfi);
+	}
+
 	for (i=0; i<ndirentries; i++) {
 		if (direntries[i].sfd_ino == SFS_NOINO) {
 			/* nothing */
@@ -297,6 +297,19 @@ pass2_dir(uint32_t ino, uint32_t parentino, const char *pathsofar)
 		ichanged = 1;
 	}
 
+	/*
+	 * If we moved entries around in a hashed directory they may
+	 * not be where the hashing says; make it linear again.
+	 */
+
+	if (dchanged && sfi.sfi_dirbuckets != 0) {
+		warnx("Directory %s: Dropped hash index", pathsofar);
+		sfi.sfi_dirbuckets = 0;
+		sfi.sfi_dirprobe = 0;
+		sfi.sfi_dirused = 0;
+		ichanged = 1;
+	}
+
 	/*
 	 * Write back anything that changed, clean up, and return.
 	 */
@@ -81,6 +81,9 @@ swapinode(struct sfs_dinode *sfi)
 	sfi->sfi_size = SWAP32(sfi->sfi_size);
 	sfi->sfi_type = SWAP16(sfi->sfi_type);
 	sfi->sfi_linkcount = SWAP16(sfi->sfi_linkcount);
+	sfi->sfi_dirbuckets = SWAP32(sfi->sfi_dirbuckets);
+	sfi->sfi_dirprobe = SWAP32(sfi->sfi_dirprobe);
+	sfi->sfi_dirused = SWAP32(sfi->sfi_dirused);
 
 	for (i=0; i<NUM_D; i++) {
 		SET_D(sfi, i) = SWAP32(GET_D(sfi, i));
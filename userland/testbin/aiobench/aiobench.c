@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * aiobench.c
+ *
+ * 	Compare synchronous and asynchronous file I/O.
+ *
+ * Writes a file of BLOCKS blocks with pwrite and reads it back with
+ * pread, one block at a time; then does the same with aio_submit and
+ * aio_reap, keeping up to DEPTH blocks in flight. Every block read is
+ * checked.
+ *
+ * Usage: aiobench [blocks [depth]]
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <aio.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define FILENAME   "aiobench.dat"
+#define BLKSIZE    4096
+#define DEFBLOCKS  256
+#define DEFDEPTH   8
+
+static char bufs[AIO_MAXJOBS][BLKSIZE];
+
+static
+void
+fill(char *buf, unsigned blk)
+{
+	unsigned i;
+
+	for (i=0; i<BLKSIZE; i++) {
+		buf[i] = (blk * 7 + i) % 251;
+	}
+}
+
+static
+void
+check(const char *buf, unsigned blk)
+{
+	unsigned i;
+
+	for (i=0; i<BLKSIZE; i++) {
+		if (buf[i] != (char)((blk * 7 + i) % 251)) {
+			errx(1, "block %u: wrong data at byte %u", blk, i);
+		}
+	}
+}
+
+static
+void
+sync_pass(int fd, int write, unsigned nblocks)
+{
+	unsigned blk;
+	ssize_t r;
+
+	for (blk=0; blk<nblocks; blk++) {
+		if (write) {
+			fill(bufs[0], blk);
+			r = pwrite(fd, bufs[0], BLKSIZE, (off_t)blk * BLKSIZE);
+		}
+		else {
+			r = pread(fd, bufs[0], BLKSIZE, (off_t)blk * BLKSIZE);
+		}
+		if (r < 0) {
+			err(1, "%s: block %u", write ? "pwrite" : "pread", blk);
+		}
+		if (r != BLKSIZE) {
+			errx(1, "block %u: short transfer (%zd)", blk, r);
+		}
+		if (!write) {
+			check(bufs[0], blk);
+		}
+	}
+}
+
+/*
+ * Keep DEPTH requests going: each time around, submit a request for
+ * every free buffer, then reap whatever has finished (at least one).
+ */
+static
+void
+aio_pass(int fd, int write, unsigned nblocks, unsigned depth)
+{
+	struct aioreq reqs[AIO_MAXJOBS];
+	struct aiodone done[AIO_MAXJOBS];
+	unsigned freeslots[AIO_MAXJOBS], blkof[AIO_MAXJOBS];
+	unsigned nfree, next, inflight, nsub, slot, i;
+	int r;
+
+	for (i=0; i<depth; i++) {
+		freeslots[i] = i;
+	}
+	nfree = depth;
+	next = 0;
+	inflight = 0;
+
+	while (next < nblocks || inflight > 0) {
+		nsub = 0;
+		while (nfree > 0 && next < nblocks) {
+			slot = freeslots[--nfree];
+			blkof[slot] = next;
+			if (write) {
+				fill(bufs[slot], next);
+			}
+			reqs[nsub].ar_fd = fd;
+			reqs[nsub].ar_op = write ? AIO_WRITE : AIO_READ;
+			reqs[nsub].ar_offset = (off_t)next * BLKSIZE;
+			reqs[nsub].ar_buf = bufs[slot];
+			reqs[nsub].ar_len = BLKSIZE;
+			reqs[nsub].ar_cookie = (void *)(uintptr_t)slot;
+			nsub++;
+			next++;
+		}
+		if (nsub > 0) {
+			r = aio_submit(reqs, nsub);
+			if (r < 0) {
+				err(1, "aio_submit");
+			}
+			if ((unsigned)r != nsub) {
+				errx(1, "aio_submit: started %d of %u",
+				     r, nsub);
+			}
+			inflight += nsub;
+		}
+
+		r = aio_reap(done, depth, 1, -1);
+		if (r < 0) {
+			err(1, "aio_reap");
+		}
+		for (i=0; i<(unsigned)r; i++) {
+			slot = (uintptr_t)done[i].ad_cookie;
+			if (done[i].ad_result < 0) {
+				errx(1, "block %u: %s", blkof[slot],
+				     strerror(done[i].ad_errno));
+			}
+			if (done[i].ad_result != BLKSIZE) {
+				errx(1, "block %u: short transfer (%zd)",
+				     blkof[slot], done[i].ad_result);
+			}
+			if (!write) {
+				check(bufs[slot], blkof[slot]);
+			}
+			freeslots[nfree++] = slot;
+			inflight--;
+		}
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct benchtime start;
+	unsigned nblocks, depth;
+	int fd;
+
+	nblocks = DEFBLOCKS;
+	depth = DEFDEPTH;
+	if (argc > 1) {
+		nblocks = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		depth = atoi(argv[2]);
+	}
+	if (argc > 3 || nblocks == 0 || depth == 0 || depth > AIO_MAXJOBS) {
+		errx(1, "Usage: aiobench [blocks [depth (1-%d)]]",
+		     AIO_MAXJOBS);
+	}
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	printf("aiobench: %u blocks of %d bytes, depth %u\n",
+	       nblocks, BLKSIZE, depth);
+
+	bench_start(&start);
+	sync_pass(fd, 1, nblocks);
+	bench_report("pwrite", &start, nblocks);
+
+	bench_start(&start);
+	sync_pass(fd, 0, nblocks);
+	bench_report("pread", &start, nblocks);
+
+	bench_start(&start);
+	aio_pass(fd, 1, nblocks, depth);
+	bench_report("aio write", &start, nblocks);
+
+	bench_start(&start);
+	aio_pass(fd, 0, nblocks, depth);
+	bench_report("aio read", &start, nblocks);
+
+	close(fd);
+	remove(FILENAME);
+	printf("aiobench: passed\n");
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * conbench.c
+ *
+ * 	Benchmark for console output throughput.
+ *
+ * Writes KBYTES kilobytes of text to standard output in writes of
+ * CHUNK bytes, then reports the time taken. Lines
+ * are 64 characters long, so the newline translation is exercised
+ * too. Try it with a chunk size of 1 to see the per-call cost.
+ *
+ * Usage: conbench [kbytes [chunk]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define DEFKBYTES 1024
+#define DEFCHUNK  4096
+#define MAXCHUNK  8192
+#define LINELEN   64
+
+/* Starting each write at a different offset keeps the lines even. */
+static char buf[MAXCHUNK + LINELEN];
+
+int
+main(int argc, char *argv[])
+{
+	struct benchtime start;
+	unsigned long kbytes, chunk, total, done, len;
+	unsigned i;
+	ssize_t r;
+
+	kbytes = DEFKBYTES;
+	chunk = DEFCHUNK;
+	if (argc > 1) {
+		kbytes = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		chunk = atoi(argv[2]);
+	}
+	if (chunk < 1 || chunk > MAXCHUNK) {
+		errx(1, "Chunk size must be between 1 and %d", MAXCHUNK);
+	}
+
+	for (i=0; i<sizeof(buf); i++) {
+		buf[i] = (i % LINELEN == LINELEN - 1) ? '\n' :
+			'a' + (i / LINELEN) % 26;
+	}
+
+	total = kbytes * 1024;
+	bench_start(&start);
+	for (done = 0; done < total; done += r) {
+		len = total - done < chunk ? total - done : chunk;
+		r = write(STDOUT_FILENO, buf + done % LINELEN, len);
+		if (r <= 0) {
+			err(1, "write");
+		}
+	}
+
+	printf("\n");
+	bench_report("console write", &start, total / chunk);
+	return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * copybench.c
+ *
+ * 	Compare ways of copying a file.
+ *
+ * Makes a file of KBYTES kilobytes, then copies it with read and
+ * write through a 1K buffer (as cp used to), through a 16K buffer,
+ * and with sendfile, checking each copy. Then sends it down a pipe
+ * with sendfile to a child that checks what it gets.
+ *
+ * Usage: copybench [kbytes]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define SRCFILE    "copybench.src"
+#define DSTFILE    "copybench.dst"
+#define DEFKBYTES  512
+#define BIGBUF     16384
+
+static char buf[BIGBUF];
+
+static
+char
+pattern(unsigned long pos)
+{
+	return (pos * 3 + pos / 1024) % 253;
+}
+
+static
+void
+makesrc(unsigned long total)
+{
+	unsigned long done, i;
+	size_t len;
+	int fd;
+
+	fd = open(SRCFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", SRCFILE);
+	}
+	for (done = 0; done < total; done += len) {
+		len = total - done < BIGBUF ? total - done : BIGBUF;
+		for (i=0; i<len; i++) {
+			buf[i] = pattern(done + i);
+		}
+		if (write(fd, buf, len) != (ssize_t)len) {
+			err(1, "%s: write", SRCFILE);
+		}
+	}
+	close(fd);
+}
+
+/*
+ * Read everything from FD and check it against the pattern.
+ */
+static
+void
+checkfd(const char *name, int fd, unsigned long total)
+{
+	unsigned long got;
+	ssize_t r, i;
+
+	got = 0;
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		for (i=0; i<r; i++) {
+			if (buf[i] != pattern(got + i)) {
+				errx(1, "%s: wrong data at offset %lu",
+				     name, got + i);
+			}
+		}
+		got += r;
+	}
+	if (r < 0) {
+		err(1, "%s: read", name);
+	}
+	if (got != total) {
+		errx(1, "%s: got %lu bytes, expected %lu", name, got, total);
+	}
+}
+
+static
+void
+checkdst(unsigned long total)
+{
+	int fd;
+
+	fd = open(DSTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", DSTFILE);
+	}
+	checkfd(DSTFILE, fd, total);
+	close(fd);
+}
+
+static
+void
+openboth(int *infd, int *outfd)
+{
+	*infd = open(SRCFILE, O_RDONLY);
+	if (*infd < 0) {
+		err(1, "%s", SRCFILE);
+	}
+	*outfd = open(DSTFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (*outfd < 0) {
+		err(1, "%s", DSTFILE);
+	}
+}
+
+static
+void
+copy_rw(unsigned long total, size_t bufsize)
+{
+	struct benchtime start;
+	char what[32];
+	int infd, outfd;
+	ssize_t r;
+
+	openboth(&infd, &outfd);
+	bench_start(&start);
+	while ((r = read(infd, buf, bufsize)) > 0) {
+		if (write(outfd, buf, r) != r) {
+			err(1, "%s: write", DSTFILE);
+		}
+	}
+	if (r < 0) {
+		err(1, "%s: read", SRCFILE);
+	}
+	snprintf(what, sizeof(what), "read/write %zu", bufsize);
+	bench_report(what, &start, total / 1024);
+	close(infd);
+	close(outfd);
+	checkdst(total);
+}
+
+static
+void
+copy_sendfile(unsigned long total)
+{
+	struct benchtime start;
+	int infd, outfd;
+	ssize_t r;
+
+	openboth(&infd, &outfd);
+	bench_start(&start);
+	while ((r = sendfile(outfd, infd, total)) > 0) {
+		/* nothing */
+	}
+	if (r < 0) {
+		err(1, "sendfile");
+	}
+	bench_report("sendfile", &start, total / 1024);
+	close(infd);
+	close(outfd);
+	checkdst(total);
+}
+
+static
+void
+pipe_sendfile(unsigned long total)
+{
+	struct benchtime start;
+	int fds[2], infd, status;
+	ssize_t r;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		checkfd("pipe", fds[0], total);
+		_exit(0);
+	}
+	close(fds[0]);
+
+	infd = open(SRCFILE, O_RDONLY);
+	if (infd < 0) {
+		err(1, "%s", SRCFILE);
+	}
+	bench_start(&start);
+	while ((r = sendfile(fds[1], infd, total)) > 0) {
+		/* nothing */
+	}
+	if (r < 0) {
+		err(1, "sendfile to pipe");
+	}
+	close(fds[1]);
+	close(infd);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "pipe reader failed");
+	}
+	bench_report("sendfile to pipe", &start, total / 1024);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long kbytes, total;
+
+	kbytes = DEFKBYTES;
+	if (argc > 1) {
+		kbytes = atoi(argv[1]);
+	}
+	if (argc > 2 || kbytes == 0) {
+		errx(1, "Usage: copybench [kbytes]");
+	}
+	total = kbytes * 1024;
+
+	printf("copybench: %lu KB; times are per KB\n", kbytes);
+	makesrc(total);
+	copy_rw(total, 1024);
+	copy_rw(total, BIGBUF);
+	copy_sendfile(total);
+	pipe_sendfile(total);
+
+	remove(SRCFILE);
+	remove(DSTFILE);
+	printf("copybench: passed\n");
+	return 0;
+}
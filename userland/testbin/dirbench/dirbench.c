@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dirbench.c
+ *
+ * 	Compare reading a directory one name per call (getdirentry)
+ *	with reading it a bufferful at a time (getdirentries).
+ *
+ * Creates NFILES empty files in the current directory, then lists
+ * the directory ROUNDS times each way, checks both ways see the same
+ * entries, and removes the files again.
+ *
+ * Usage: dirbench [nfiles [rounds]]
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define PREFIX     "dirbench."
+#define DEFFILES   100
+#define DEFROUNDS  20
+
+static char buf[4096];
+
+static
+void
+mkname(char *name, size_t len, unsigned num)
+{
+	snprintf(name, len, "%s%u", PREFIX, num);
+}
+
+static
+void
+makefiles(unsigned nfiles)
+{
+	char name[32];
+	unsigned i;
+	int fd;
+
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+		if (fd < 0) {
+			err(1, "%s", name);
+		}
+		close(fd);
+	}
+}
+
+static
+void
+removefiles(unsigned nfiles)
+{
+	char name[32];
+	unsigned i;
+
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		if (remove(name) < 0) {
+			warn("%s: remove", name);
+		}
+	}
+}
+
+/*
+ * Count the entries, and separately the ones we made.
+ */
+static
+void
+countname(const char *name, unsigned *total, unsigned *ours)
+{
+	(*total)++;
+	if (strlen(name) >= strlen(PREFIX) &&
+	    memcmp(name, PREFIX, strlen(PREFIX)) == 0) {
+		(*ours)++;
+	}
+}
+
+static
+void
+list_one(unsigned *total, unsigned *ours)
+{
+	ssize_t len;
+	int fd;
+
+	*total = *ours = 0;
+	fd = open(".", O_RDONLY);
+	if (fd < 0) {
+		err(1, ".");
+	}
+	while ((len = getdirentry(fd, buf, sizeof(buf)-1)) > 0) {
+		buf[len] = 0;
+		countname(buf, total, ours);
+	}
+	if (len < 0) {
+		err(1, "getdirentry");
+	}
+	close(fd);
+}
+
+static
+void
+list_many(unsigned *total, unsigned *ours)
+{
+	struct dirent *d;
+	ssize_t len, pos;
+	int fd;
+
+	*total = *ours = 0;
+	fd = open(".", O_RDONLY);
+	if (fd < 0) {
+		err(1, ".");
+	}
+	while ((len = getdirentries(fd, buf, sizeof(buf))) > 0) {
+		for (pos = 0; pos < len; pos += d->d_reclen) {
+			d = (struct dirent *)(buf + pos);
+			if (d->d_reclen < _DIRENT_RECLEN(0) ||
+			    d->d_reclen > len - pos ||
+			    strlen(d->d_name) != d->d_namlen) {
+				errx(1, "getdirentries: bad record at %zd",
+				     pos);
+			}
+			countname(d->d_name, total, ours);
+		}
+	}
+	if (len < 0) {
+		err(1, "getdirentries");
+	}
+	close(fd);
+}
+
+static
+void
+bench(const char *what, void (*func)(unsigned *, unsigned *),
+      unsigned rounds, unsigned nfiles, unsigned *total)
+{
+	struct benchtime start;
+	unsigned i, ours;
+
+	bench_start(&start);
+	for (i=0; i<rounds; i++) {
+		func(total, &ours);
+		if (ours != nfiles) {
+			errx(1, "%s: found %u of our %u files", what,
+			     ours, nfiles);
+		}
+	}
+	bench_report(what, &start, rounds);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned nfiles, rounds, total1, total2;
+
+	nfiles = DEFFILES;
+	rounds = DEFROUNDS;
+	if (argc > 1) {
+		nfiles = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		rounds = atoi(argv[2]);
+	}
+
+	printf("dirbench: %u files, %u rounds\n", nfiles, rounds);
+	makefiles(nfiles);
+
+	bench("getdirentry", list_one, rounds, nfiles, &total1);
+	bench("getdirentries", list_many, rounds, nfiles, &total2);
+	if (total1 != total2) {
+		removefiles(nfiles);
+		errx(1, "getdirentry saw %u entries, getdirentries %u",
+		     total1, total2);
+	}
+	printf("dirbench: %u entries each way\n", total1);
+
+	removefiles(nfiles);
+	printf("dirbench: done\n");
+	return 0;
+}
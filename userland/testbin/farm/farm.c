@@ -48,7 +48,7 @@ static int pids[MAXPROCS], npids;
 
 static
 void
-spawnv(const char *prog, char **argv)
+farm_spawn(const char *prog, char **argv)
 {
 	int pid = fork();
 	switch (pid) {
@@ -87,14 +87,14 @@ static
 void
 hog(void)
 {
-	spawnv("/testbin/hog", hargv);
+	farm_spawn("/testbin/hog", hargv);
 }
 
 static
 void
 cat(void)
 {
-	spawnv("/bin/cat", cargv);
+	farm_spawn("/bin/cat", cargv);
 }
 
 int
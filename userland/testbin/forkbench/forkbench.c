@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * forkbench.c
+ *
+ * 	Benchmark for fork/exit/waitpid throughput.
+ *
+ * Starts NPROCS worker processes, each of which forks and waits for
+ * ROUNDS children that exit straight away. Optionally first fills
+ * the process table with HELD exited-but-unwaited children, which is
+ * where a pid allocator that searches for free slots does worst.
+ *
+ * Usage: forkbench [rounds [nprocs [held]]]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define DEFROUNDS 200
+#define DEFPROCS  4
+#define MAXHELD   100
+
+static pid_t held[MAXHELD];
+static pid_t workers[16];
+
+static
+void
+waitfor(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d failed", pid);
+	}
+}
+
+static
+void
+worker(unsigned rounds)
+{
+	unsigned i;
+	pid_t pid;
+
+	for (i=0; i<rounds; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			_exit(0);
+		}
+		waitfor(pid);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct benchtime start;
+	unsigned rounds, nprocs, nheld, i;
+	pid_t pid;
+
+	rounds = DEFROUNDS;
+	nprocs = DEFPROCS;
+	nheld = 0;
+	if (argc > 1) {
+		rounds = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		nprocs = atoi(argv[2]);
+	}
+	if (argc > 3) {
+		nheld = atoi(argv[3]);
+	}
+	if (nprocs < 1 || nprocs > sizeof(workers)/sizeof(workers[0])) {
+		errx(1, "Number of processes must be between 1 and %u",
+		     sizeof(workers)/sizeof(workers[0]));
+	}
+	if (nheld > MAXHELD) {
+		errx(1, "At most %d held children", MAXHELD);
+	}
+
+	printf("forkbench: %u rounds, %u processes, %u held\n",
+	       rounds, nprocs, nheld);
+
+	/* Exited but not waited for, so their pids stay in use. */
+	for (i=0; i<nheld; i++) {
+		held[i] = fork();
+		if (held[i] < 0) {
+			err(1, "fork");
+		}
+		if (held[i] == 0) {
+			_exit(0);
+		}
+	}
+
+	bench_start(&start);
+	for (i=0; i<nprocs; i++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "fork");
+		}
+		if (pid == 0) {
+			worker(rounds);
+			_exit(0);
+		}
+		workers[i] = pid;
+	}
+	for (i=0; i<nprocs; i++) {
+		waitfor(workers[i]);
+	}
+	bench_report("fork+wait", &start, (unsigned long)rounds * nprocs);
+
+	for (i=0; i<nheld; i++) {
+		waitfor(held[i]);
+	}
+
+	printf("forkbench: done\n");
+	return 0;
+}
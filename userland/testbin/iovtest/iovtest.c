@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * iovtest.c
+ *
+ * 	Tests readv/writev and pread/pwrite, then times concurrent
+ * 	positional reads of one shared file.
+ *
+ * The functional part writes a header and payload with one writev,
+ * reads them back with one readv, and checks that pread and pwrite
+ * neither use nor move the seek position. It also does a readv with
+ * IOV_MAX one-byte iovecs, more than the kernel copies in at once.
+ *
+ * The timing part forks NPROCS children that share one open file
+ * and read BLOCKS blocks each from it, first with lseek+read (which
+ * serialize on the file's seek position) and then with pread (which
+ * don't touch it).
+ *
+ * Usage: iovtest [blocks [nprocs]]
+ */
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define FILENAME  "iovtest.dat"
+#define BLOCKSIZE 512
+#define NBLOCKS   64		/* Size of the file, in blocks */
+#define DEFBLOCKS 1000
+#define DEFPROCS  4
+#define MAXPROCS  16
+
+static char buf[BLOCKSIZE];
+static char bigbuf[IOV_MAX];
+static struct iovec maxiov[IOV_MAX + 1];
+
+static
+void
+fillblock(char *p, unsigned blockno)
+{
+	unsigned i;
+
+	for (i=0; i<BLOCKSIZE; i++) {
+		p[i] = (blockno * 31 + i) % 251;
+	}
+}
+
+static
+void
+checkblock(const char *p, unsigned blockno)
+{
+	char want[BLOCKSIZE];
+
+	fillblock(want, blockno);
+	if (memcmp(p, want, BLOCKSIZE)) {
+		errx(1, "block %u: wrong data", blockno);
+	}
+}
+
+static
+void
+checkpos(int fd, off_t want)
+{
+	off_t pos;
+
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos != want) {
+		errx(1, "seek position %lld, expected %lld",
+		     (long long)pos, (long long)want);
+	}
+}
+
+static
+void
+functional(int fd)
+{
+	char header[16], payload[100], got1[16], got2[100];
+	struct iovec iov[3];
+	unsigned i;
+	ssize_t r;
+
+	strcpy(header, "iovtest header");
+	for (i=0; i<sizeof(payload); i++) {
+		payload[i] = i;
+	}
+
+	/* writev: header and payload in one call, plus an empty iovec */
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = NULL;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = payload;
+	iov[2].iov_len = sizeof(payload);
+	r = writev(fd, iov, 3);
+	if (r != sizeof(header) + sizeof(payload)) {
+		err(1, "writev");
+	}
+	checkpos(fd, r);
+
+	lseek(fd, 0, SEEK_SET);
+	iov[0].iov_base = got1;
+	iov[0].iov_len = sizeof(got1);
+	iov[1].iov_base = got2;
+	iov[1].iov_len = sizeof(got2);
+	r = readv(fd, iov, 2);
+	if (r != sizeof(got1) + sizeof(got2)) {
+		err(1, "readv");
+	}
+	if (memcmp(header, got1, sizeof(header)) ||
+	    memcmp(payload, got2, sizeof(payload))) {
+		errx(1, "readv: wrong data");
+	}
+	checkpos(fd, r);
+
+	if (readv(fd, iov, 0) != -1 || errno != EINVAL) {
+		errx(1, "readv with no iovecs didn't fail with EINVAL");
+	}
+
+	/* lay out the file for the timing part, without seeking */
+	lseek(fd, 7, SEEK_SET);
+	for (i=0; i<NBLOCKS; i++) {
+		fillblock(buf, i);
+		if (pwrite(fd, buf, BLOCKSIZE, (off_t)i * BLOCKSIZE)
+		    != BLOCKSIZE) {
+			err(1, "pwrite");
+		}
+	}
+	checkpos(fd, 7);
+	for (i=NBLOCKS; i-- > 0; ) {
+		if (pread(fd, buf, BLOCKSIZE, (off_t)i * BLOCKSIZE)
+		    != BLOCKSIZE) {
+			err(1, "pread");
+		}
+		checkblock(buf, i);
+	}
+	checkpos(fd, 7);
+
+	if (pread(fd, buf, 1, -1) != -1 || errno != EINVAL) {
+		errx(1, "pread at negative offset didn't fail with EINVAL");
+	}
+	if (pread(STDIN_FILENO, buf, 1, 0) != -1 || errno != ESPIPE) {
+		errx(1, "pread on console didn't fail with ESPIPE");
+	}
+
+	/* readv with as many iovecs as allowed, a byte each */
+	for (i=0; i<=IOV_MAX; i++) {
+		maxiov[i].iov_base = &bigbuf[i % IOV_MAX];
+		maxiov[i].iov_len = 1;
+	}
+	lseek(fd, 0, SEEK_SET);
+	if (readv(fd, maxiov, IOV_MAX) != IOV_MAX) {
+		err(1, "readv of IOV_MAX iovecs");
+	}
+	for (i=0; i<IOV_MAX; i += BLOCKSIZE) {
+		checkblock(bigbuf + i, i / BLOCKSIZE);
+	}
+	checkpos(fd, IOV_MAX);
+	if (readv(fd, maxiov, IOV_MAX + 1) != -1 || errno != EINVAL) {
+		errx(1, "readv of IOV_MAX+1 iovecs didn't fail with EINVAL");
+	}
+}
+
+static
+void
+reader(int fd, unsigned blocks, unsigned seed, int positional)
+{
+	unsigned i, blockno;
+
+	for (i=0; i<blocks; i++) {
+		blockno = (seed * 7 + i * 13) % NBLOCKS;
+		if (positional) {
+			if (pread(fd, buf, BLOCKSIZE,
+				  (off_t)blockno * BLOCKSIZE) != BLOCKSIZE) {
+				err(1, "pread");
+			}
+			checkblock(buf, blockno);
+		}
+		else {
+			/*
+			 * The seek position is shared with the other
+			 * processes, so the block we get may not be the
+			 * one we asked for; just check it's some block.
+			 */
+			lseek(fd, (off_t)blockno * BLOCKSIZE, SEEK_SET);
+			if (read(fd, buf, BLOCKSIZE) < 0) {
+				err(1, "read");
+			}
+		}
+	}
+}
+
+static
+void
+timing(int fd, unsigned blocks, unsigned nprocs, int positional)
+{
+	struct benchtime start;
+	pid_t pids[MAXPROCS];
+	unsigned i;
+	int status;
+
+	bench_start(&start);
+	for (i=0; i<nprocs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			reader(fd, blocks, i, positional);
+			_exit(0);
+		}
+	}
+	for (i=0; i<nprocs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			errx(1, "reader %u failed", i);
+		}
+	}
+	bench_report(positional ? "pread" : "lseek+read", &start,
+		     (unsigned long)blocks * nprocs);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned blocks, nprocs;
+	int fd;
+
+	blocks = DEFBLOCKS;
+	nprocs = DEFPROCS;
+	if (argc > 1) {
+		blocks = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		nprocs = atoi(argv[2]);
+	}
+	if (nprocs < 1 || nprocs > MAXPROCS) {
+		errx(1, "Number of processes must be between 1 and %d",
+		     MAXPROCS);
+	}
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+
+	functional(fd);
+	printf("iovtest: functional tests passed\n");
+
+	printf("iovtest: %u blocks each in %u processes\n", blocks, nprocs);
+	timing(fd, blocks, nprocs, 0);
+	timing(fd, blocks, nprocs, 1);
+
+	close(fd);
+	remove(FILENAME);
+	printf("iovtest: done\n");
+	return 0;
+}
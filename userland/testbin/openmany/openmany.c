@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * openmany.c
+ *
+ * 	Benchmark for opening many distinct files at once.
+ *
+ * Creates N files and holds them all open, so the file system has N
+ * vnodes loaded, then repeatedly reopens each of them. Every reopen
+ * has to find an already-loaded vnode, so with a slow vnode table
+ * the cost per open grows with N.
+ *
+ * Usage: openmany [nfiles [rounds]]
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <err.h>
+#include <test/bench.h>
+
+/* leave room for stdin/stdout/stderr and the reopened file */
+#define MAXFILES  (OPEN_MAX - 4)
+#define DEFFILES  100
+#define DEFROUNDS 20
+
+static int fds[MAXFILES];
+
+static
+void
+mkname(char *buf, size_t len, unsigned num)
+{
+	snprintf(buf, len, "openmany.%u", num);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct benchtime start;
+	char name[32];
+	unsigned nfiles, rounds, i, j;
+	int fd;
+
+	nfiles = DEFFILES;
+	rounds = DEFROUNDS;
+	if (argc > 1) {
+		nfiles = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		rounds = atoi(argv[2]);
+	}
+	if (nfiles < 1 || nfiles > MAXFILES) {
+		errx(1, "Number of files must be between 1 and %d",
+		     MAXFILES);
+	}
+
+	printf("openmany: %u files, %u rounds\n", nfiles, rounds);
+
+	bench_start(&start);
+	for (i=0; i<nfiles; i++) {
+		mkname(name, sizeof(name), i);
+		fds[i] = open(name, O_RDWR|O_CREAT|O_TRUNC, 0664);
+		if (fds[i] < 0) {
+			err(1, "%s: create", name);
+		}
+	}
+	bench_report("creates", &start, nfiles);
+
+	bench_start(&start);
+	for (j=0; j<rounds; j++) {
+		for (i=0; i<nfiles; i++) {
+			mkname(name, sizeof(name), i);
+			fd = open(name, O_RDONLY);
+			if (fd < 0) {
+				err(1, "%s: open", name);
+			}
+			close(fd);
+		}
+	}
+	bench_report("opens", &start, (unsigned long)nfiles * rounds);
+
+	bench_start(&start);
+	for (i=0; i<nfiles; i++) {
+		close(fds[i]);
+		mkname(name, sizeof(name), i);
+		if (remove(name)) {
+			err(1, "%s: remove", name);
+		}
+	}
+	bench_report("removes", &start, nfiles);
+
+	printf("openmany: done\n");
+	return 0;
+}
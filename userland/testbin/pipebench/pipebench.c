@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * pipebench.c
+ *
+ * 	Producer/consumer throughput through a pipe.
+ *
+ * A child writes KBYTES kilobytes into a pipe in CHUNK-byte writes
+ * from a page-aligned buffer, so chunks of a page or more can be
+ * lent to the pipe instead of copied; the parent reads it all back
+ * and checks it. Then checks that reading a pipe with no writer
+ * gets EOF and writing one with no reader gets EPIPE.
+ *
+ * Usage: pipebench [kbytes [chunk]]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define DEFKBYTES 4096
+#define DEFCHUNK  16384
+#define MAXCHUNK  65536
+#define PAGESIZE  4096
+
+static char rawbuf[MAXCHUNK + PAGESIZE];
+
+static
+char *
+pagealign(char *p)
+{
+	return (char *)(((uintptr_t)p + PAGESIZE - 1) & ~(uintptr_t)(PAGESIZE-1));
+}
+
+static
+void
+producer(int fd, unsigned long total, size_t chunk)
+{
+	char *buf;
+	unsigned long done;
+	size_t len, i;
+	ssize_t r;
+
+	buf = pagealign(rawbuf);
+	for (i=0; i<chunk; i++) {
+		buf[i] = i % 251;
+	}
+
+	for (done = 0; done < total; done += r) {
+		len = chunk;
+		if (len > total - done) {
+			len = total - done;
+		}
+		r = write(fd, buf, len);
+		if (r < 0) {
+			err(1, "write");
+		}
+		if ((size_t)r != len) {
+			errx(1, "short write: %zd of %zu", r, len);
+		}
+	}
+}
+
+static
+unsigned long
+consumer(int fd, size_t chunk)
+{
+	char *buf;
+	unsigned long got;
+	ssize_t r, i;
+
+	buf = pagealign(rawbuf);
+	got = 0;
+	while (1) {
+		r = read(fd, buf, chunk);
+		if (r < 0) {
+			err(1, "read");
+		}
+		if (r == 0) {
+			break;
+		}
+		for (i=0; i<r; i++) {
+			if (buf[i] != (char)(((got + i) % chunk) % 251)) {
+				errx(1, "wrong data at offset %lu", got + i);
+			}
+		}
+		got += r;
+	}
+	return got;
+}
+
+static
+void
+throughput(unsigned long kbytes, size_t chunk)
+{
+	struct benchtime start;
+	unsigned long total, got;
+	int fds[2], status;
+	pid_t pid;
+
+	total = kbytes * 1024;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	bench_start(&start);
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		producer(fds[1], total, chunk);
+		_exit(0);
+	}
+	close(fds[1]);
+	got = consumer(fds[0], chunk);
+	close(fds[0]);
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "producer failed");
+	}
+	bench_report("kbyte", &start, kbytes);
+
+	if (got != total) {
+		errx(1, "read %lu bytes, expected %lu", got, total);
+	}
+}
+
+static
+void
+endings(void)
+{
+	int fds[2];
+	char c = 'x';
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	if (write(fds[1], &c, 1) != 1) {
+		err(1, "write");
+	}
+	close(fds[1]);
+	c = 0;
+	if (read(fds[0], &c, 1) != 1 || c != 'x') {
+		errx(1, "lost data written before close");
+	}
+	if (read(fds[0], &c, 1) != 0) {
+		errx(1, "no EOF after write end closed");
+	}
+	close(fds[0]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	if (write(fds[1], &c, 1) != -1 || errno != EPIPE) {
+		errx(1, "no EPIPE after read end closed");
+	}
+	close(fds[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned long kbytes;
+	size_t chunk;
+
+	kbytes = DEFKBYTES;
+	chunk = DEFCHUNK;
+	if (argc > 1) {
+		kbytes = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		chunk = atoi(argv[2]);
+	}
+	if (chunk < 1 || chunk > MAXCHUNK) {
+		errx(1, "Chunk size must be between 1 and %d", MAXCHUNK);
+	}
+
+	printf("pipebench: %lu kbytes in %zu-byte writes\n", kbytes, chunk);
+	throughput(kbytes, chunk);
+	endings();
+	printf("pipebench: done\n");
+	return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * polltest.c
+ *
+ * 	Check that poll() reports pipe readiness correctly, honors its
+ * 	timeout, and wakes up when another process makes a pipe ready.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <err.h>
+
+#define WAITMS    500	/* timeout for the timeout test */
+#define CHILDMS   300	/* how long the child waits before writing */
+
+static
+unsigned long
+now_ms(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return secs * 1000UL + nsecs / 1000000;
+}
+
+static
+void
+msleep(unsigned ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	if (nanosleep(&ts, NULL) < 0) {
+		err(1, "nanosleep");
+	}
+}
+
+/*
+ * Poll one fd for EVENTS with TIMEOUT and check what comes back.
+ */
+static
+void
+check(const char *what, int fd, int events, int timeout,
+      int wantret, int wantrevents)
+{
+	struct pollfd pfd;
+	int r;
+
+	pfd.fd = fd;
+	pfd.events = events;
+	pfd.revents = -1;
+	r = poll(&pfd, 1, timeout);
+	if (r < 0) {
+		err(1, "%s: poll", what);
+	}
+	if (r != wantret || pfd.revents != wantrevents) {
+		errx(1, "%s: got %d (revents 0x%x), expected %d (0x%x)",
+		     what, r, pfd.revents, wantret, wantrevents);
+	}
+	printf("polltest: %s: ok\n", what);
+}
+
+static
+void
+test_ready(void)
+{
+	int fds[2];
+	char ch;
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+
+	check("empty pipe", fds[0], POLLIN, 0, 0, 0);
+	check("writable pipe", fds[1], POLLOUT, 0, 1, POLLOUT);
+
+	if (write(fds[1], "x", 1) != 1) {
+		err(1, "write");
+	}
+	check("nonempty pipe", fds[0], POLLIN, 0, 1, POLLIN);
+	if (read(fds[0], &ch, 1) != 1) {
+		err(1, "read");
+	}
+	check("drained pipe", fds[0], POLLIN, 0, 0, 0);
+
+	close(fds[1]);
+	check("pipe hangup", fds[0], POLLIN, 0, 1, POLLHUP);
+	close(fds[0]);
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	close(fds[0]);
+	check("no reader", fds[1], POLLOUT, 0, 1, POLLERR);
+	close(fds[1]);
+
+	check("closed fd", fds[0], POLLIN, 0, 1, POLLNVAL);
+	check("negative fd", -1, POLLIN, 0, 0, 0);
+}
+
+static
+void
+test_timeout(void)
+{
+	unsigned long start, took;
+	int fds[2];
+
+	if (pipe(fds) < 0) {
+		err(1, "pipe");
+	}
+	start = now_ms();
+	check("timeout", fds[0], POLLIN, WAITMS, 0, 0);
+	took = now_ms() - start;
+	if (took < WAITMS) {
+		errx(1, "timeout: returned after %lu ms, wanted %u",
+		     took, WAITMS);
+	}
+	printf("polltest: timeout took %lu ms\n", took);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+/*
+ * Poll two pipes forever; a child writes to the second one after a
+ * while, and that has to wake us.
+ */
+static
+void
+test_wakeup(void)
+{
+	struct pollfd pfds[2];
+	int a[2], b[2];
+	int r, status;
+	pid_t pid;
+
+	if (pipe(a) < 0 || pipe(b) < 0) {
+		err(1, "pipe");
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		msleep(CHILDMS);
+		if (write(b[1], "y", 1) != 1) {
+			err(1, "child: write");
+		}
+		_exit(0);
+	}
+
+	pfds[0].fd = a[0];
+	pfds[0].events = POLLIN;
+	pfds[1].fd = b[0];
+	pfds[1].events = POLLIN;
+	r = poll(pfds, 2, INFTIM);
+	if (r < 0) {
+		err(1, "wakeup: poll");
+	}
+	if (r != 1 || pfds[0].revents != 0 || pfds[1].revents != POLLIN) {
+		errx(1, "wakeup: got %d (revents 0x%x 0x%x)", r,
+		     pfds[0].revents, pfds[1].revents);
+	}
+	printf("polltest: wakeup: ok\n");
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	close(a[0]);
+	close(a[1]);
+	close(b[0]);
+	close(b[1]);
+}
+
+int
+main(void)
+{
+	test_ready();
+	test_timeout();
+	test_wakeup();
+	printf("polltest: passed\n");
+	return 0;
+}
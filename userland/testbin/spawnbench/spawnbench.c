@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * spawnbench.c
+ *
+ * 	Compare the ways of running a program in a new process.
+ *
+ * Runs /bin/true ROUNDS times each with fork+execv, vfork+execv, and
+ * spawnv, waiting for each one. First touches HEAPKB of heap so there
+ * is something for fork to copy, as there would be in a real shell.
+ *
+ * Usage: spawnbench [rounds [heapkb]]
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define PROG       "/bin/true"
+#define DEFROUNDS  50
+#define DEFHEAPKB  256
+
+static char *const progargs[] = { (char *)PROG, NULL };
+
+static
+void
+waitfor(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "pid %d failed", pid);
+	}
+}
+
+static
+void
+bench_fork(unsigned rounds, int usevfork)
+{
+	struct benchtime start;
+	unsigned i;
+	pid_t pid;
+
+	bench_start(&start);
+	for (i=0; i<rounds; i++) {
+		pid = usevfork ? vfork() : fork();
+		if (pid < 0) {
+			err(1, usevfork ? "vfork" : "fork");
+		}
+		if (pid == 0) {
+			execv(PROG, progargs);
+			_exit(1);
+		}
+		waitfor(pid);
+	}
+	bench_report(usevfork ? "vfork+execv" : "fork+execv", &start, rounds);
+}
+
+static
+void
+bench_spawn(unsigned rounds)
+{
+	struct benchtime start;
+	unsigned i;
+	pid_t pid;
+
+	bench_start(&start);
+	for (i=0; i<rounds; i++) {
+		pid = spawnv(PROG, progargs);
+		if (pid < 0) {
+			err(1, "spawnv");
+		}
+		waitfor(pid);
+	}
+	bench_report("spawnv", &start, rounds);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned rounds, heapkb;
+	char *heap;
+
+	rounds = DEFROUNDS;
+	heapkb = DEFHEAPKB;
+	if (argc > 1) {
+		rounds = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		heapkb = atoi(argv[2]);
+	}
+
+	heap = NULL;
+	if (heapkb > 0) {
+		heap = malloc(heapkb * 1024);
+		if (heap == NULL) {
+			errx(1, "malloc of %u KB failed", heapkb);
+		}
+		memset(heap, 1, heapkb * 1024);
+	}
+
+	/* a bad program must fail in the parent, not the child */
+	if (spawnv("/nonexistent", progargs) >= 0) {
+		errx(1, "spawnv of a missing program succeeded");
+	}
+
+	printf("spawnbench: %u rounds, %u KB heap\n", rounds, heapkb);
+	bench_fork(rounds, 0);
+	bench_fork(rounds, 1);
+	bench_spawn(rounds);
+
+	free(heap);
+	printf("spawnbench: done\n");
+	return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * syscallbench.c
+ *
+ * 	Microbenchmarks for system call overhead and user/kernel copies.
+ *
+ * Times ROUNDS repetitions each of getpid (just the trap), open and
+ * close of a file (a path copyinstr), and pwrite and pread of 1 byte,
+ * 4 KiB, and 64 KiB at the start of a file (copyin and copyout of
+ * increasing size; the file stays in the buffer cache).
+ *
+ * Usage: syscallbench [rounds]
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+#include <test/bench.h>
+
+#define FILENAME  "syscallbench.dat"
+#define DEFROUNDS 1000
+#define BIGSIZE   65536
+
+static char buf[BIGSIZE];
+
+static
+void
+bench_getpid(unsigned rounds)
+{
+	struct benchtime start;
+	unsigned i;
+
+	bench_start(&start);
+	for (i=0; i<rounds; i++) {
+		getpid();
+	}
+	bench_report("getpid", &start, rounds);
+}
+
+static
+void
+bench_openclose(unsigned rounds)
+{
+	struct benchtime start;
+	unsigned i;
+	int fd;
+
+	bench_start(&start);
+	for (i=0; i<rounds; i++) {
+		fd = open(FILENAME, O_RDONLY);
+		if (fd < 0) {
+			err(1, "%s", FILENAME);
+		}
+		close(fd);
+	}
+	bench_report("open+close", &start, rounds);
+}
+
+static
+void
+bench_io(int fd, unsigned rounds, size_t size)
+{
+	struct benchtime start;
+	char what[32];
+	unsigned i;
+
+	snprintf(what, sizeof(what), "pwrite %zu", size);
+	bench_start(&start);
+	for (i=0; i<rounds; i++) {
+		if (pwrite(fd, buf, size, 0) != (ssize_t)size) {
+			err(1, "pwrite");
+		}
+	}
+	bench_report(what, &start, rounds);
+
+	snprintf(what, sizeof(what), "pread %zu", size);
+	bench_start(&start);
+	for (i=0; i<rounds; i++) {
+		if (pread(fd, buf, size, 0) != (ssize_t)size) {
+			err(1, "pread");
+		}
+	}
+	bench_report(what, &start, rounds);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned rounds;
+	int fd;
+
+	rounds = DEFROUNDS;
+	if (argc > 1) {
+		rounds = atoi(argv[1]);
+	}
+
+	fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", FILENAME);
+	}
+	/* fill it once so the reads don't hit a hole */
+	if (write(fd, buf, BIGSIZE) != BIGSIZE) {
+		err(1, "write");
+	}
+
+	printf("syscallbench: %u rounds\n", rounds);
+	bench_getpid(rounds);
+	bench_openclose(rounds);
+	bench_io(fd, rounds, 1);
+	bench_io(fd, rounds, 4096);
+	bench_io(fd, rounds / 16 + 1, BIGSIZE);
+
+	close(fd);
+	remove(FILENAME);
+	printf("syscallbench: done\n");
+	return 0;
+}
@@ -28,32 +28,34 @@
  */
 
 /*
- * Test multiple user level threads inside a process. The program
- * forks 3 threads off 2 to functions, each of which displays a string
- * every once in a while.
+ * Test multiple user level threads inside a process.
  *
- * This won't do much of anything unless you implement user-level
- * threads.
+ * First the program creates 3 threads running 2 functions, each of
+ * which displays a string every once in a while as they race on a
+ * shared counter, and joins them. Each thread also counts on its own
+ * stack and returns the count, which checks that the stacks are
+ * separate and that exit values come back through thread_join.
  *
- * It also makes various assumptions about the thread API. In
- * particular, it believes (1) that you create a thread by calling
- * "threadfork()" and passing the address for execution of the new
- * thread to begin at, (2) that if the parent thread exits any child
- * threads will keep running, and (3) child threads will exit if they
- * return from the function they started in. If any or all of these
- * assumptions are not met by your user-level threads, you will need
- * to patch this test accordingly.
+ * Then it does the same thing in a child process whose main thread
+ * calls exit() while the others are still spinning, which must take
+ * the whole process down.
  *
- * This is also a rather basic test and you'll probably want to write
- * some more of your own.
+ * Last, another child's main thread exits while its other threads are
+ * blocked in the kernel, reading and polling a pipe that will never
+ * have anything in it. If exit() doesn't get them out, the test
+ * hangs in waitpid.
  */
 
-
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <poll.h>
+#include <err.h>
+#include <sys/wait.h>
 
 #define NTHREADS  3
-#define MAX       1<<25
+#define MAX       1<<20
 
 /* counter for the loop in the threads:
    This variable is shared and incremented by each
@@ -61,25 +63,112 @@
 volatile int count = 0;
 
 /* the 2 threads : */
-void ThreadRunner(void);
-void BladeRunner(void);
+static int ThreadRunner(void *);
+static int BladeRunner(void *);
+
+/* the threads that block in the last test, and their pipe */
+static int PipeReader(void *);
+static int PipePoller(void *);
+static int pipefds[2];
+
+static
+void
+startthreads(int *tids)
+{
+    int i;
+
+    for (i=0; i<NTHREADS; i++) {
+	tids[i] = thread_create(i ? ThreadRunner : BladeRunner, NULL);
+	if (tids[i] < 0) {
+	    err(1, "thread_create");
+	}
+    }
+}
+
+static
+void
+waitchild(pid_t pid)
+{
+    int status;
+
+    if (waitpid(pid, &status, 0) < 0) {
+	err(1, "waitpid");
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	errx(1, "FAILED: child exited with status %d", status);
+    }
+}
+
+static
+void
+blockedexit(void)
+{
+    struct timespec ts;
+
+    if (pipe(pipefds) < 0) {
+	err(1, "pipe");
+    }
+    if (thread_create(PipeReader, NULL) < 0 ||
+	thread_create(PipePoller, NULL) < 0) {
+	err(1, "thread_create");
+    }
+
+    /* give them time to block */
+    ts.tv_sec = 0;
+    ts.tv_nsec = 200000000;
+    nanosleep(&ts, NULL);
+
+    printf("Parent thread leaving; blocked threads must stop too\n");
+    exit(0);
+}
 
 int
 main(int argc, char *argv[])
 {
-    int i;
+    int tids[NTHREADS];
+    int i, status, total;
+    pid_t pid;
 
     (void)argc;
     (void)argv;
 
+    startthreads(tids);
+
+    total = 0;
     for (i=0; i<NTHREADS; i++) {
-	if (i)
-	    threadfork(ThreadRunner);
-        else
-	    threadfork(BladeRunner);
+	if (thread_join(tids[i], &status) < 0) {
+	    err(1, "thread_join");
+	}
+	total += status;
+    }
+    printf("\nThreads counted %d between them (shared count %d)\n",
+	   total, count);
+    if (total < MAX) {
+	errx(1, "FAILED: threads counted fewer than %d", MAX);
     }
 
-    printf("Parent has left.\n");
+    pid = fork();
+    if (pid < 0) {
+	err(1, "fork");
+    }
+    if (pid == 0) {
+	count = 0;
+	startthreads(tids);
+	printf("\nParent thread leaving; the others must stop too\n");
+	exit(0);
+    }
+    waitchild(pid);
+
+    pid = fork();
+    if (pid < 0) {
+	err(1, "fork");
+    }
+    if (pid == 0) {
+	blockedexit();
+    }
+    waitchild(pid);
+
+    printf("Passed.\n");
     return 0;
 }
 
@@ -88,22 +177,60 @@ main(int argc, char *argv[])
    random results.
 */
 
-void
-BladeRunner()
+static
+int
+BladeRunner(void *junk)
 {
+    int mine = 0;
+
+    (void)junk;
     while (count < MAX) {
 	if (count % 500 == 0)
 	    printf("Blade ");
 	count++;
+	mine++;
     }
+    return mine;
 }
 
-void
-ThreadRunner()
+static
+int
+ThreadRunner(void *junk)
 {
+    int mine = 0;
+
+    (void)junk;
     while (count < MAX) {
 	if (count % 513 == 0)
 	    printf(" Runner\n");
 	count++;
+	mine++;
     }
+    return mine;
+}
+
+static
+int
+PipeReader(void *junk)
+{
+    char ch;
+
+    (void)junk;
+    read(pipefds[0], &ch, 1);
+    printf("FAILED: read returned while exiting\n");
+    return 0;
+}
+
+static
+int
+PipePoller(void *junk)
+{
+    struct pollfd pfd;
+
+    (void)junk;
+    pfd.fd = pipefds[0];
+    pfd.events = POLLIN;
+    poll(&pfd, 1, -1);
+    printf("FAILED: poll returned while exiting\n");
+    return 0;
 }